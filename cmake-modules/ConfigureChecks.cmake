@@ -1,6 +1,16 @@
 include(CheckIncludeFile)
 include(CheckSymbolExists)
+include(CheckLibraryExists)
 
 check_symbol_exists(scandir dirent.h HAVE_SCANDIR)
 check_include_file (error.h HAVE_ERROR_H)
 check_include_file (search.h HAVE_TSEARCH)
+check_include_file (sys/mman.h HAVE_SYS_MMAN_H)
+# clock_gettime() is in librt with older glibc
+check_symbol_exists(clock_gettime time.h HAVE_CLOCK_GETTIME)
+if (NOT HAVE_CLOCK_GETTIME)
+  check_library_exists(rt clock_gettime "" HAVE_CLOCK_GETTIME_RT)
+  if (HAVE_CLOCK_GETTIME_RT)
+    set(HAVE_CLOCK_GETTIME 1)
+  endif (HAVE_CLOCK_GETTIME_RT)
+endif (NOT HAVE_CLOCK_GETTIME)
@@ -41,8 +41,164 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 
 #include "SDL_rotozoom.h"
+#include "SDL_thread.h"
+#include "tasks.h"
 
 #define MAX(a,b)    (((a) > (b)) ? (a) : (b))
+#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
+
+/* tuxmath: the 32bit smoothing and shrinking inner loops have SSE2   */
+/* and AVX2 versions, picked at run time as in blend.c.  They give    */
+/* exactly the same results as the C ones:                            */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define ROTOZOOM_X86 1
+#include <immintrin.h>
+#endif
+
+/* Pixels interpolated per call of lerp_row(): */
+#define LERP_BATCH 64
+
+/* Row tables up to this size are kept on the stack: */
+#define ZOOM_TABLE_STACK 4096
+
+/* tuxmath: big 32bit surfaces (full screen backgrounds, say) are done */
+/* in bands of rows, one for each CPU.  The threads are made for each  */
+/* call, so several threads can still rotozoom at once:                */
+#define BAND_MIN_PIXELS (256 * 1024)
+#define BAND_MIN_ROWS 32
+#define MAX_BANDS 16
+
+/* Rows y0 to y1-1 of a transformSurfaceRGBA() or zoomSurfaceRGBA(): */
+typedef struct rotozoom_band {
+    void (*rows)(const struct rotozoom_band* band);
+    SDL_Surface *src, *dst;
+    int cx, cy, isin, icos;     /* (rotating) */
+    int *sax, *say;             /* (zooming) */
+    int flipx, flipy, smooth;
+    int y0, y1;
+} rotozoom_band;
+
+static void transform_rows_rgba(const rotozoom_band* band);
+static void zoom_rows_rgba(const rotozoom_band* band);
+static void run_bands(rotozoom_band* band);
+static int band_worker(void* data);
+
+/* Bilinear interpolation of a batch of pixels, each between its four */
+/* source pixels c00 (top left), c01, c10 and c11 (bottom right), ex  */
+/* and ey being its 16-bit fixed point position between them.         */
+/* lerp_row() does pixels i to n-1, into d[i] onwards:                 */
+typedef struct lerp_batch {
+    tColorRGBA c00[LERP_BATCH];
+    tColorRGBA c01[LERP_BATCH];
+    tColorRGBA c10[LERP_BATCH];
+    tColorRGBA c11[LERP_BATCH];
+    Uint16 ex[LERP_BATCH];
+    Uint16 ey[LERP_BATCH];
+} lerp_batch;
+
+typedef void (*lerp_row_func)(tColorRGBA* d, const lerp_batch* b, int i, int n);
+/* Adds each byte of n pixels to the acc[] for it (4 per pixel): */
+typedef void (*accum_row_func)(Uint32* acc, const tColorRGBA* s, int n);
+
+static void lerp_row_c(tColorRGBA* d, const lerp_batch* b, int i, int n);
+static void accum_row_c(Uint32* acc, const tColorRGBA* s, int n);
+#ifdef ROTOZOOM_X86
+static void lerp_row_sse2(tColorRGBA* d, const lerp_batch* b, int i, int n);
+static void accum_row_sse2(Uint32* acc, const tColorRGBA* s, int n);
+static void lerp_row_avx2(tColorRGBA* d, const lerp_batch* b, int i, int n);
+static void accum_row_avx2(Uint32* acc, const tColorRGBA* s, int n);
+#endif
+
+static lerp_row_func lerp_row = NULL;
+static accum_row_func accum_row = NULL;
+static const char* kernel_name = NULL;
+
+/* Pick the fastest kernels this CPU can run.  (This can happen on two */
+/* threads at once, harmlessly - lerp_row is set last, and checked):   */
+static void rotozoom_init(void)
+{
+    lerp_row_func lerp = lerp_row_c;
+    accum_row_func accum = accum_row_c;
+    const char* name = "C";
+
+    if (lerp_row)
+        return;
+#ifdef ROTOZOOM_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        lerp = lerp_row_avx2;
+        accum = accum_row_avx2;
+        name = "AVX2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        lerp = lerp_row_sse2;
+        accum = accum_row_sse2;
+        name = "SSE2";
+    }
+#endif
+    kernel_name = name;
+    accum_row = accum;
+    lerp_row = lerp;
+}
+
+/* Which kernels are in use, for debugging output: */
+const char *rotozoomKernels(void)
+{
+    rotozoom_init();
+    return kernel_name;
+}
+
+/* tuxmath: do band's rows of its surface - all of them, split between */
+/* threads if there are enough to be worth it:                          */
+static void run_bands(rotozoom_band* band)
+{
+    static int cpus = 0;
+    rotozoom_band bands[MAX_BANDS];
+    SDL_Thread* threads[MAX_BANDS];
+    int h = band->dst->h;
+    int i, n = 1;
+
+    if (band->dst->w * h >= BAND_MIN_PIXELS) {
+        if (cpus == 0)
+            cpus = tasks_count_cpus();
+        n = MIN(cpus, h / BAND_MIN_ROWS);
+        n = MAX(1, MIN(n, MAX_BANDS));
+    }
+
+    if (n == 1) {
+        band->y0 = 0;
+        band->y1 = h;
+        band->rows(band);
+        return;
+    }
+
+    /*
+     * Each band to a thread but the first, which is done here 
+     */
+    for (i = 0; i < n; i++) {
+        bands[i] = *band;
+        bands[i].y0 = h * i / n;
+        bands[i].y1 = h * (i + 1) / n;
+        threads[i] = NULL;
+    }
+    for (i = 1; i < n; i++)
+        threads[i] = SDL_CreateThread(band_worker, &bands[i]);
+    band->rows(&bands[0]);
+    for (i = 1; i < n; i++) {
+        if (threads[i])
+            SDL_WaitThread(threads[i], NULL);
+        else
+            band->rows(&bands[i]);
+    }
+}
+
+static int band_worker(void* data)
+{
+    rotozoom_band* band = (rotozoom_band*) data;
+
+    band->rows(band);
+    return 0;
+}
 
 
 /* 
@@ -55,9 +211,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 int shrinkSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int factorx, int factory)
 {
-    int x, y, dx, dy, sgap, dgap, ra, ga, ba, aa;
-    int n_average;
-    tColorRGBA *sp, *osp, *oosp;
+    int x, y, dx, dy, dgap, ra, ga, ba, aa;
+    int n_average, n_acc;
+    Uint32 acc_stack[ZOOM_TABLE_STACK];
+    Uint32 *acc, *cacc;
+    Uint8 *sp;
     tColorRGBA *dp;
 
     /*
@@ -67,37 +225,46 @@ int shrinkSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int factorx, int fac
     /* Precalculate division factor */
     n_average = factorx*factory;
 
+    /*
+     * Column sums for one row of boxes - each source row is added in
+     * by accum_row(), then the sums across each box are taken from them
+     */
+    rotozoom_init();
+    n_acc = dst->w * factorx * 4;
+    if (n_acc <= ZOOM_TABLE_STACK) {
+        acc = acc_stack;
+    } else if ((acc = (Uint32 *) malloc(n_acc * sizeof(Uint32))) == NULL) {
+        return (-1);
+    }
+
     /*
      * Scan destination
      */
-    sp = (tColorRGBA *) src->pixels;
-    sgap = src->pitch - src->w * 4;
+    sp = (Uint8 *) src->pixels;
 
     dp = (tColorRGBA *) dst->pixels;
     dgap = dst->pitch - dst->w * 4;
 
     for (y = 0; y < dst->h; y++) {
 
-        osp=sp;
+        memset(acc, 0, n_acc * sizeof(Uint32));
+        for (dy=0; dy < factory; dy++) {
+            accum_row(acc, (tColorRGBA *) sp, dst->w * factorx);
+            sp += src->pitch;
+        } // src dy loop
+
+        cacc = acc;
         for (x = 0; x < dst->w; x++) {
 
-            /* Trace out source box and accumulate */
-            oosp=sp;
+            /* Add up the column sums across the box */
             ra=ga=ba=aa=0;
-            for (dy=0; dy < factory; dy++) {
-                for (dx=0; dx < factorx; dx++) {
-                    ra += sp->r;
-                    ga += sp->g;
-                    ba += sp->b;
-                    aa += sp->a;
-
-                    sp++;
-                } // src dx loop
-                sp = (tColorRGBA *)((Uint8*)sp + (src->pitch - 4*factorx)); // next y
-            } // src dy loop
-
-            // next box-x
-            sp = (tColorRGBA *)((Uint8*)oosp + 4*factorx);
+            for (dx=0; dx < factorx; dx++) {
+                ra += cacc[0];
+                ga += cacc[1];
+                ba += cacc[2];
+                aa += cacc[3];
+                cacc += 4;
+            } // src dx loop
 
             /* Store result in destination */
             dp->r = ra/n_average;
@@ -111,15 +278,15 @@ int shrinkSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int factorx, int fac
             dp++;
         } // dst x loop
 
-        // next box-y
-        sp = (tColorRGBA *)((Uint8*)osp + src->pitch*factory);
-
         /*
          * Advance destination pointers 
          */
         dp = (tColorRGBA *) ((Uint8 *) dp + dgap);
     } // dst y loop
 
+    if (acc != acc_stack)
+        free(acc);
+
     return (0);
 }
 
@@ -204,10 +371,9 @@ int shrinkSurfaceY(SDL_Surface * src, SDL_Surface * dst, int factorx, int factor
 
 int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy, int smooth)
 {
-    int x, y, sx, sy, *sax, *say, *csax, *csay, csx, csy, ex, ey, t1, t2, sstep;
-    tColorRGBA *c00, *c01, *c10, *c11;
-    tColorRGBA *sp, *csp, *dp;
-    int dgap;
+    int x, y, sx, sy, *sax, *say, *csax, *csay, csx, csy;
+    int table[ZOOM_TABLE_STACK];
+    rotozoom_band band;
 
     /*
      * Variable setup 
@@ -227,25 +393,19 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
     }
 
     /*
-     * Allocate memory for row increments 
+     * Allocate memory for row increments - on the stack unless they
+     * are too big for it
      */
-    if ((sax = (int *) malloc((dst->w + 1) * sizeof(Uint32))) == NULL) {
-        return (-1);
-    }
-    if ((say = (int *) malloc((dst->h + 1) * sizeof(Uint32))) == NULL) {
-        free(sax);
+    if (dst->w + dst->h + 2 <= ZOOM_TABLE_STACK) {
+        sax = table;
+    } else if ((sax = (int *) malloc((dst->w + dst->h + 2) * sizeof(int))) == NULL) {
         return (-1);
     }
+    say = sax + dst->w + 1;
 
     /*
      * Precalculate row increments 
      */
-    sp = csp = (tColorRGBA *) src->pixels;
-    dp = (tColorRGBA *) dst->pixels;
-
-    if (flipx) csp += (src->w-1);
-    if (flipy) csp  = (tColorRGBA*)( (Uint8*)csp + src->pitch*(src->h-1) );
-
     csx = 0;
     csax = sax;
     for (x = 0; x <= dst->w; x++) {
@@ -263,12 +423,67 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
         csy += sy;
     }
 
+    if (smooth)
+        rotozoom_init();
+
+    /*
+     * Zoom, in bands if it's big 
+     */
+    band.rows = zoom_rows_rgba;
+    band.src = src;
+    band.dst = dst;
+    band.sax = sax;
+    band.say = say;
+    band.flipx = flipx;
+    band.flipy = flipy;
+    band.smooth = smooth;
+    run_bands(&band);
+
+    /*
+     * Remove temp arrays 
+     */
+    if (sax != table)
+        free(sax);
+
+    return (0);
+}
+
+/* tuxmath: the rows of zoomSurfaceRGBA(), from band->y0 to band->y1: */
+static void zoom_rows_rgba(const rotozoom_band* band)
+{
+    SDL_Surface *src = band->src;
+    SDL_Surface *dst = band->dst;
+    int x, y, *sax, *csax, *csay, ey, sstep, n;
+    int flipx = band->flipx, flipy = band->flipy;
+    tColorRGBA *c00, *c01, *c10, *c11;
+    tColorRGBA *sp, *csp, *dp, *run;
+    lerp_batch b;
+    int dgap;
+
+    sax = band->sax;
+    csp = (tColorRGBA *) src->pixels;
+    dp = (tColorRGBA *) ((Uint8 *) dst->pixels + band->y0 * dst->pitch);
+
+    if (flipx) csp += (src->w-1);
+    if (flipy) csp  = (tColorRGBA*)( (Uint8*)csp + src->pitch*(src->h-1) );
+
+    /*
+     * Skip the source rows before this band 
+     */
+    csay = band->say;
+    for (y = 0; y < band->y0; y++) {
+        csay++;
+        sstep = (*csay >> 16) * src->pitch;
+        if (flipy && !band->smooth) sstep = -sstep;
+        csp = (tColorRGBA *) ((Uint8 *) csp + sstep);
+    }
+
     dgap = dst->pitch - dst->w * 4;
 
     /*
      * Switch between interpolating and non-interpolating code 
      */
-    if (smooth) {
+    if (band->smooth) {
 
         /*
          * Interpolating Zoom 
@@ -277,8 +492,7 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
         /*
          * Scan destination 
          */
-        csay = say;
-        for (y = 0; y < dst->h; y++) {
+        for (y = band->y0; y < band->y1; y++) {
             /*
              * Setup color source pointers 
              */
@@ -289,25 +503,25 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
             c11 = c10;
             c11++;
             csax = sax;
+            ey = (*csay & 0xffff);
+            run = dp;
+            n = 0;
             for (x = 0; x < dst->w; x++) {
 
                 /*
-                 * Interpolate colors 
+                 * Collect the colors, to be interpolated a batch at a time 
                  */
-                ex = (*csax & 0xffff);
-                ey = (*csay & 0xffff);
-                t1 = ((((c01->r - c00->r) * ex) >> 16) + c00->r) & 0xff;
-                t2 = ((((c11->r - c10->r) * ex) >> 16) + c10->r) & 0xff;
-                dp->r = (((t2 - t1) * ey) >> 16) + t1;
-                t1 = ((((c01->g - c00->g) * ex) >> 16) + c00->g) & 0xff;
-                t2 = ((((c11->g - c10->g) * ex) >> 16) + c10->g) & 0xff;
-                dp->g = (((t2 - t1) * ey) >> 16) + t1;
-                t1 = ((((c01->b - c00->b) * ex) >> 16) + c00->b) & 0xff;
-                t2 = ((((c11->b - c10->b) * ex) >> 16) + c10->b) & 0xff;
-                dp->b = (((t2 - t1) * ey) >> 16) + t1;
-                t1 = ((((c01->a - c00->a) * ex) >> 16) + c00->a) & 0xff;
-                t2 = ((((c11->a - c10->a) * ex) >> 16) + c10->a) & 0xff;
-                dp->a = (((t2 - t1) * ey) >> 16) + t1;
+                b.c00[n] = *c00;
+                b.c01[n] = *c01;
+                b.c10[n] = *c10;
+                b.c11[n] = *c11;
+                b.ex[n] = (*csax & 0xffff);
+                b.ey[n] = ey;
+                if (++n == LERP_BATCH) {
+                    lerp_row(run, &b, 0, n);
+                    run += n;
+                    n = 0;
+                }
 
                 /*
                  * Advance source pointers 
@@ -323,6 +537,8 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
                  */
                 dp++;
             }
+            if (n)
+                lerp_row(run, &b, 0, n);
             /*
              * Advance source pointer 
              */
@@ -340,8 +556,7 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
          * Non-Interpolating Zoom 
          */
 
-        csay = say;
-        for (y = 0; y < dst->h; y++) {
+        for (y = band->y0; y < band->y1; y++) {
             sp = csp;
             csax = sax;
             for (x = 0; x < dst->w; x++) {
@@ -376,14 +591,6 @@ int zoomSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy,
         }
 
     }
-
-    /*
-     * Remove temp arrays 
-     */
-    free(sax);
-    free(say);
-
-    return (0);
 }
 
 /* 
@@ -511,9 +718,34 @@ int zoomSurfaceY(SDL_Surface * src, SDL_Surface * dst, int flipx, int flipy)
 
 void transformSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int cx, int cy, int isin, int icos, int flipx, int flipy, int smooth)
 {
-    int x, y, t1, t2, dx, dy, xd, yd, sdx, sdy, ax, ay, ex, ey, sw, sh;
+    rotozoom_band band;
+
+    if (smooth)
+        rotozoom_init();
+
+    band.rows = transform_rows_rgba;
+    band.src = src;
+    band.dst = dst;
+    band.cx = cx;
+    band.cy = cy;
+    band.isin = isin;
+    band.icos = icos;
+    band.flipx = flipx;
+    band.flipy = flipy;
+    band.smooth = smooth;
+    run_bands(&band);
+}
+
+/* tuxmath: the rows of transformSurfaceRGBA(), from band->y0 to band->y1: */
+static void transform_rows_rgba(const rotozoom_band* band)
+{
+    SDL_Surface *src = band->src;
+    SDL_Surface *dst = band->dst;
+    int cx = band->cx, cy = band->cy, isin = band->isin, icos = band->icos;
+    int x, y, dx, dy, xd, yd, sdx, sdy, ax, ay, sw, sh, n;
     tColorRGBA c00, c01, c10, c11;
-    tColorRGBA *pc, *sp;
+    tColorRGBA *pc, *sp, *run;
+    lerp_batch b;
     int gap;
 
     c00.r = c00.g = c00.b = c00.a = 0;
@@ -529,17 +761,24 @@ void transformSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int cx, int cy,
     ay = (cy << 16) - (isin * cx);
     sw = src->w - 1;
     sh = src->h - 1;
-    pc = dst->pixels;
+    pc = (tColorRGBA *) ((Uint8 *) dst->pixels + band->y0 * dst->pitch);
     gap = dst->pitch - dst->w * 4;
 
     /*
      * Switch between interpolating and non-interpolating code 
      */
-    if (smooth) {
-        for (y = 0; y < dst->h; y++) {
+    if (band->smooth) {
+        run = pc;
+        for (y = band->y0; y < band->y1; y++) {
             dy = cy - y;
             sdx = (ax + (isin * dy)) + xd;
             sdy = (ay - (icos * dy)) + yd;
+            /*
+             * The pixels that come from the source are collected, and
+             * interpolated a batch at a time - being a straight line
+             * through a rectangle, they are all in one run along the row
+             */
+            n = 0;
             for (x = 0; x < dst->w; x++) {
                 dx = (sdx >> 16);
                 dy = (sdy >> 16);
@@ -615,39 +854,42 @@ void transformSurfaceRGBA(SDL_Surface * src, SDL_Surface * dst, int cx, int cy,
                         c11 = *sp;
                     }
                     /*
-                     * Interpolate colors 
+                     * Collect colors to interpolate 
                      */
-                    ex = (sdx & 0xffff);
-                    ey = (sdy & 0xffff);
-                    t1 = ((((c01.r - c00.r) * ex) >> 16) + c00.r) & 0xff;
-                    t2 = ((((c11.r - c10.r) * ex) >> 16) + c10.r) & 0xff;
-                    pc->r = (((t2 - t1) * ey) >> 16) + t1;
-                    t1 = ((((c01.g - c00.g) * ex) >> 16) + c00.g) & 0xff;
-                    t2 = ((((c11.g - c10.g) * ex) >> 16) + c10.g) & 0xff;
-                    pc->g = (((t2 - t1) * ey) >> 16) + t1;
-                    t1 = ((((c01.b - c00.b) * ex) >> 16) + c00.b) & 0xff;
-                    t2 = ((((c11.b - c10.b) * ex) >> 16) + c10.b) & 0xff;
-                    pc->b = (((t2 - t1) * ey) >> 16) + t1;
-                    t1 = ((((c01.a - c00.a) * ex) >> 16) + c00.a) & 0xff;
-                    t2 = ((((c11.a - c10.a) * ex) >> 16) + c10.a) & 0xff;
-                    pc->a = (((t2 - t1) * ey) >> 16) + t1;
+                    if (n == 0)
+                        run = pc;
+                    b.c00[n] = c00;
+                    b.c01[n] = c01;
+                    b.c10[n] = c10;
+                    b.c11[n] = c11;
+                    b.ex[n] = (sdx & 0xffff);
+                    b.ey[n] = (sdy & 0xffff);
+                    if (++n == LERP_BATCH) {
+                        lerp_row(run, &b, 0, n);
+                        n = 0;
+                    }
+                } else if (n) {
+                    lerp_row(run, &b, 0, n);
+                    n = 0;
                 }
                 sdx += icos;
                 sdy += isin;
                 pc++;
             }
+            if (n)
+                lerp_row(run, &b, 0, n);
             pc = (tColorRGBA *) ((Uint8 *) pc + gap);
         }
     } else {
-        for (y = 0; y < dst->h; y++) {
+        for (y = band->y0; y < band->y1; y++) {
             dy = cy - y;
             sdx = (ax + (isin * dy)) + xd;
             sdy = (ay - (icos * dy)) + yd;
             for (x = 0; x < dst->w; x++) {
                 dx = (short) (sdx >> 16);
                 dy = (short) (sdy >> 16);
-                if (flipx) dx = (src->w-1)-dx;
-                if (flipy) dy = (src->h-1)-dy;
+                if (band->flipx) dx = (src->w-1)-dx;
+                if (band->flipy) dy = (src->h-1)-dy;
                 if ((dx >= 0) && (dy >= 0) && (dx < src->w) && (dy < src->h)) {
                     sp = (tColorRGBA *) ((Uint8 *) src->pixels + src->pitch * dy);
                     sp += dx;
@@ -1380,3 +1622,211 @@ SDL_Surface *shrinkSurface(SDL_Surface * src, int factorx, int factory)
      */
     return (rz_dst);
 }
+
+/* 
+
+   tuxmath: inner loops for the 32bit smoothing and shrinking above.
+
+   lerp_row() interpolates each byte of each pixel as
+
+       t1 = c00 + (((c01 - c00) * ex) >> 16)
+       t2 = c10 + (((c11 - c10) * ex) >> 16)
+       d  = t1 + (((t2 - t1) * ey) >> 16)
+
+   with arithmetic (rounding down) shifts, as SDL_gfx always did.
+
+*/
+
+static void lerp_row_c(tColorRGBA* d, const lerp_batch* b, int i, int n)
+{
+    const Uint8 *c00, *c01, *c10, *c11;
+    Uint8 *dp;
+    int k, ex, ey, t1, t2;
+
+    for (; i < n; i++) {
+        c00 = (const Uint8 *) &b->c00[i];
+        c01 = (const Uint8 *) &b->c01[i];
+        c10 = (const Uint8 *) &b->c10[i];
+        c11 = (const Uint8 *) &b->c11[i];
+        dp = (Uint8 *) &d[i];
+        ex = b->ex[i];
+        ey = b->ey[i];
+        for (k = 0; k < 4; k++) {
+            t1 = ((((c01[k] - c00[k]) * ex) >> 16) + c00[k]) & 0xff;
+            t2 = ((((c11[k] - c10[k]) * ex) >> 16) + c10[k]) & 0xff;
+            dp[k] = (((t2 - t1) * ey) >> 16) + t1;
+        }
+    }
+}
+
+
+static void accum_row_c(Uint32* acc, const tColorRGBA* s, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        acc[0] += s->r;
+        acc[1] += s->g;
+        acc[2] += s->b;
+        acc[3] += s->a;
+        acc += 4;
+        s++;
+    }
+}
+
+
+#ifdef ROTOZOOM_X86
+
+/* The vector kernels work on each color byte widened to 16 bits.  The */
+/* 16-bit multiplies are signed, so for weights of 0x8000 and up, whose */
+/* top bit makes them negative, ((c * w) >> 16) comes out low by c -    */
+/* which is added back:                                                 */
+
+__attribute__((target("sse2")))
+static __m128i mul_frac_sse2(__m128i c, __m128i w)
+{
+    return _mm_add_epi16(_mm_mulhi_epi16(c, w),
+                         _mm_and_si128(_mm_srai_epi16(w, 15), c));
+}
+
+
+__attribute__((target("sse2")))
+static __m128i lerp_sse2(__m128i c00, __m128i c01, __m128i c10, __m128i c11,
+                         __m128i ex, __m128i ey)
+{
+    __m128i t1, t2;
+
+    t1 = _mm_add_epi16(c00, mul_frac_sse2(_mm_sub_epi16(c01, c00), ex));
+    t2 = _mm_add_epi16(c10, mul_frac_sse2(_mm_sub_epi16(c11, c10), ex));
+    return _mm_add_epi16(t1, mul_frac_sse2(_mm_sub_epi16(t2, t1), ey));
+}
+
+
+/* Four pixels at a time, two in each half: */
+__attribute__((target("sse2")))
+static void lerp_row_sse2(tColorRGBA* d, const lerp_batch* b, int i, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c00, c01, c10, c11, ex, ey, lo, hi;
+
+    for (; i + 4 <= n; i += 4) {
+        c00 = _mm_loadu_si128((const __m128i *) &b->c00[i]);
+        c01 = _mm_loadu_si128((const __m128i *) &b->c01[i]);
+        c10 = _mm_loadu_si128((const __m128i *) &b->c10[i]);
+        c11 = _mm_loadu_si128((const __m128i *) &b->c11[i]);
+
+        /* Each pixel's weights, repeated for its four bytes: */
+        ex = _mm_loadl_epi64((const __m128i *) &b->ex[i]);
+        ex = _mm_unpacklo_epi16(ex, ex);
+        ey = _mm_loadl_epi64((const __m128i *) &b->ey[i]);
+        ey = _mm_unpacklo_epi16(ey, ey);
+
+        lo = lerp_sse2(_mm_unpacklo_epi8(c00, zero), _mm_unpacklo_epi8(c01, zero),
+                       _mm_unpacklo_epi8(c10, zero), _mm_unpacklo_epi8(c11, zero),
+                       _mm_unpacklo_epi32(ex, ex), _mm_unpacklo_epi32(ey, ey));
+        hi = lerp_sse2(_mm_unpackhi_epi8(c00, zero), _mm_unpackhi_epi8(c01, zero),
+                       _mm_unpackhi_epi8(c10, zero), _mm_unpackhi_epi8(c11, zero),
+                       _mm_unpackhi_epi32(ex, ex), _mm_unpackhi_epi32(ey, ey));
+        _mm_storeu_si128((__m128i *) &d[i], _mm_packus_epi16(lo, hi));
+    }
+
+    if (i < n)
+        lerp_row_c(d, b, i, n);
+}
+
+
+__attribute__((target("sse2")))
+static void accum_row_sse2(Uint32* acc, const tColorRGBA* s, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i p, lo, hi;
+    __m128i* a = (__m128i *) acc;
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        p = _mm_loadu_si128((const __m128i *) &s[i]);
+        lo = _mm_unpacklo_epi8(p, zero);
+        hi = _mm_unpackhi_epi8(p, zero);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+        a += 4;
+    }
+
+    if (i < n)
+        accum_row_c(acc + i * 4, s + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static __m256i mul_frac_avx2(__m256i c, __m256i w)
+{
+    return _mm256_add_epi16(_mm256_mulhi_epi16(c, w),
+                            _mm256_and_si256(_mm256_srai_epi16(w, 15), c));
+}
+
+
+__attribute__((target("avx2")))
+static __m256i lerp_avx2(__m256i c00, __m256i c01, __m256i c10, __m256i c11,
+                         __m256i ex, __m256i ey)
+{
+    __m256i t1, t2;
+
+    t1 = _mm256_add_epi16(c00, mul_frac_avx2(_mm256_sub_epi16(c01, c00), ex));
+    t2 = _mm256_add_epi16(c10, mul_frac_avx2(_mm256_sub_epi16(c11, c10), ex));
+    return _mm256_add_epi16(t1, mul_frac_avx2(_mm256_sub_epi16(t2, t1), ey));
+}
+
+
+/* Same as lerp_row_sse2(), eight pixels at a time.  The unpacks work */
+/* within each 128-bit half, so the weights are spread to match:      */
+__attribute__((target("avx2")))
+static void lerp_row_avx2(tColorRGBA* d, const lerp_batch* b, int i, int n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i c00, c01, c10, c11, ex, ey, lo, hi;
+
+    for (; i + 8 <= n; i += 8) {
+        c00 = _mm256_loadu_si256((const __m256i *) &b->c00[i]);
+        c01 = _mm256_loadu_si256((const __m256i *) &b->c01[i]);
+        c10 = _mm256_loadu_si256((const __m256i *) &b->c10[i]);
+        c11 = _mm256_loadu_si256((const __m256i *) &b->c11[i]);
+
+        ex = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &b->ex[i]));
+        ex = _mm256_or_si256(ex, _mm256_slli_epi32(ex, 16));
+        ey = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &b->ey[i]));
+        ey = _mm256_or_si256(ey, _mm256_slli_epi32(ey, 16));
+
+        lo = lerp_avx2(_mm256_unpacklo_epi8(c00, zero), _mm256_unpacklo_epi8(c01, zero),
+                       _mm256_unpacklo_epi8(c10, zero), _mm256_unpacklo_epi8(c11, zero),
+                       _mm256_unpacklo_epi32(ex, ex), _mm256_unpacklo_epi32(ey, ey));
+        hi = lerp_avx2(_mm256_unpackhi_epi8(c00, zero), _mm256_unpackhi_epi8(c01, zero),
+                       _mm256_unpackhi_epi8(c10, zero), _mm256_unpackhi_epi8(c11, zero),
+                       _mm256_unpackhi_epi32(ex, ex), _mm256_unpackhi_epi32(ey, ey));
+        _mm256_storeu_si256((__m256i *) &d[i], _mm256_packus_epi16(lo, hi));
+    }
+
+    /* Finish off with the SSE2 loop, then plain C: */
+    if (i < n)
+        lerp_row_sse2(d, b, i, n);
+}
+
+
+__attribute__((target("avx2")))
+static void accum_row_avx2(Uint32* acc, const tColorRGBA* s, int n)
+{
+    __m256i* a = (__m256i *) acc;
+    int i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a),
+                    _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &s[i]))));
+        a++;
+    }
+
+    if (i < n)
+        accum_row_c(acc + i * 4, s + i, n - i);
+}
+
+#endif /* ROTOZOOM_X86 */
@@ -146,6 +146,10 @@ extern "C" {
 
     DLLINTERFACE SDL_Surface* rotateSurface90Degrees(SDL_Surface* pSurf, int numClockwiseTurns);
 
+    /* Which inner loops ("C", "SSE2" or "AVX2") smoothing and shrinking use */
+
+    DLLINTERFACE const char *rotozoomKernels(void);
+
     /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
@@ -0,0 +1,461 @@
+/*
+   archive.c:
+
+   Loads images and sounds from the archive made by pack_assets, which
+   is mapped into memory, so that startup opens one file instead of
+   hundreds and only reads the parts of it that are used.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+archive.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "SDL_image.h"
+#ifndef NOSOUND
+#include "SDL_mixer.h"
+#endif
+
+#include "archive.h"
+
+/* (after archive.h, which brings in config.h) */
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* The whole archive, and its index: */
+static Uint8* archive = NULL;
+static Uint32 archive_size = 0;
+static Uint32 archive_mtime = 0;
+static int archive_mapped = 0;
+static Uint32 num_files = 0;
+
+static Uint32 read_u32(const Uint8* p);
+static int check_archive(void);
+static const char* file_name(Uint32 i);
+static SDL_Surface* decode_image(const char* name);
+static int image_exists(const char* name);
+static int svg_preferred(const char* name);
+
+
+/* Returns 1 if the archive was opened - if not, everything is just */
+/* loaded from the data directory as before:                        */
+int archive_open(const char* path)
+{
+    struct stat st;
+    FILE* fp;
+
+    archive_close();
+
+    if (stat(path, &st) != 0)
+    {
+        DEBUGMSG(debug_fileops, "archive_open(): no archive at %s\n", path);
+        return 0;
+    }
+    archive_size = st.st_size;
+    archive_mtime = st.st_mtime;
+
+#ifdef HAVE_SYS_MMAN_H
+    {
+        int fd = open(path, O_RDONLY);
+        void* map;
+
+        if (fd < 0)
+            return 0;
+        map = mmap(NULL, archive_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map != MAP_FAILED)
+        {
+            archive = map;
+            archive_mapped = 1;
+        }
+    }
+#endif
+
+    /* Without mmap(), read the whole thing: */
+    if (!archive)
+    {
+        archive = malloc(archive_size);
+        fp = fopen(path, "rb");
+        if (!archive || !fp || fread(archive, 1, archive_size, fp) != archive_size)
+        {
+            fprintf(stderr, "archive_open(): couldn't read %s\n", path);
+            if (fp)
+                fclose(fp);
+            free(archive);
+            archive = NULL;
+            return 0;
+        }
+        fclose(fp);
+    }
+
+    if (!check_archive())
+    {
+        fprintf(stderr, "Warning - %s is damaged or out of date, not using it\n", path);
+        archive_close();
+        return 0;
+    }
+
+    DEBUGMSG(debug_fileops, "archive_open(): %d files in %s (%s)\n", num_files,
+             path, archive_mapped ? "mapped" : "read");
+    return 1;
+}
+
+
+void archive_close(void)
+{
+    if (archive)
+    {
+#ifdef HAVE_SYS_MMAN_H
+        if (archive_mapped)
+            munmap(archive, archive_size);
+        else
+#endif
+            free(archive);
+    }
+    archive = NULL;
+    archive_mapped = 0;
+    archive_size = 0;
+    num_files = 0;
+}
+
+
+/* The contents of the named file, or NULL if it isn't in the archive: */
+const void* archive_find(const char* name, Uint32* size)
+{
+    Uint32 lo = 0, hi = num_files, mid;
+    const Uint8* entry;
+    int cmp;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        cmp = strcmp(name, file_name(mid));
+        if (cmp == 0)
+        {
+            entry = archive + ARCHIVE_HEADER_SIZE + mid * ARCHIVE_ENTRY_SIZE;
+            if (size)
+                *size = read_u32(entry + 12);
+            return archive + read_u32(entry + 8);
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
+}
+
+
+/* Like stat(), for keying the images cache: the archive's time stands */
+/* in for the file's, as the file isn't read from the disk:            */
+int archive_stat(const char* name, Uint32* size, Uint32* mtime)
+{
+    if (!archive_find(name, size))
+        return 0;
+    *mtime = archive_mtime;
+    return 1;
+}
+
+
+/* SDL_image sets up its decoders the first time they're used, which   */
+/* mustn't happen on two threads at once - so call this on the main     */
+/* thread before decoding on any other:                                 */
+void archive_start_decoding(void)
+{
+#if SDL_VERSIONNUM(SDL_IMAGE_MAJOR_VERSION, SDL_IMAGE_MINOR_VERSION, SDL_IMAGE_PATCHLEVEL) >= SDL_VERSIONNUM(1, 2, 8)
+    IMG_Init(IMG_INIT_PNG | IMG_INIT_JPG);
+#endif
+}
+
+
+/* Decode an image (named as for T4K_LoadImage()) from the archive, or */
+/* from the data directory if it isn't in it, into a plain surface not */
+/* yet converted for the screen.  Only SDL_image is used, so this may  */
+/* be called on any thread.  Returns NULL for anything t4k_common has  */
+/* to load instead (e.g. SVGs, which it prefers to PNGs of the same    */
+/* name) or that can't be decoded:                                     */
+SDL_Surface* archive_decode_image(const char* file)
+{
+    char name[PATH_MAX];
+
+    snprintf(name, sizeof(name), "images/%s", file);
+    if (svg_preferred(name))
+        return NULL;
+    return decode_image(name);
+}
+
+
+/* As archive_decode_image(), for a sprite: an optional default image */
+/* "<name>d", then frames "<name>0", "<name>1"... until one is missing. */
+/* Like T4K_LoadSprite(), "<name>.svg" (all the frames in one SVG) is   */
+/* used in preference to any of them, so is left to t4k_common:         */
+sprite* archive_decode_sprite(const char* name)
+{
+    char fn[PATH_MAX];
+    sprite* s;
+    int i;
+
+    snprintf(fn, sizeof(fn), "images/%s.svg", name);
+    if (image_exists(fn))
+        return NULL;
+    snprintf(fn, sizeof(fn), "images/%sd.png", name);
+    if (svg_preferred(fn))
+        return NULL;
+    for (i = 0; i < MAX_SPRITE_FRAMES; i++)
+    {
+        snprintf(fn, sizeof(fn), "images/%s%d.png", name, i);
+        if (svg_preferred(fn))
+            return NULL;
+        if (!image_exists(fn))
+            break;
+    }
+    if (i == 0)
+        return NULL;
+
+    s = (sprite*)calloc(1, sizeof(sprite));
+    if (!s)
+        return NULL;
+    snprintf(fn, sizeof(fn), "images/%sd.png", name);
+    if (image_exists(fn))
+        s->default_img = decode_image(fn);
+    for (i = 0; i < MAX_SPRITE_FRAMES; i++)
+    {
+        snprintf(fn, sizeof(fn), "images/%s%d.png", name, i);
+        if (!image_exists(fn))
+            break;
+        s->frame[i] = decode_image(fn);
+        if (!s->frame[i])
+        {
+            s->num_frames = i;
+            archive_free_sprite(s);
+            return NULL;
+        }
+    }
+    s->num_frames = i;
+    s->cur = 0;
+    return s;
+}
+
+
+/* Convert a decoded image for the screen, as T4K_LoadImage() does for */
+/* IMG_ALPHA, freeing the decoded one.  Main thread only:              */
+SDL_Surface* archive_finish_image(SDL_Surface* img)
+{
+    SDL_Surface* converted;
+
+    if (!img || !SDL_GetVideoSurface())
+        return img;
+    converted = SDL_DisplayFormatAlpha(img);
+    SDL_FreeSurface(img);
+    return converted;
+}
+
+
+/* As archive_finish_image(), for each image of a decoded sprite. */
+/* Returns NULL, with the sprite freed, if any can't be converted: */
+sprite* archive_finish_sprite(sprite* s)
+{
+    int i, ok = 1;
+
+    if (!s)
+        return NULL;
+    if (s->default_img)
+    {
+        s->default_img = archive_finish_image(s->default_img);
+        ok = (s->default_img != NULL);
+    }
+    for (i = 0; i < s->num_frames; i++)
+    {
+        s->frame[i] = archive_finish_image(s->frame[i]);
+        ok = ok && s->frame[i];
+    }
+    if (!ok)
+    {
+        archive_free_sprite(s);
+        return NULL;
+    }
+    return s;
+}
+
+
+/* Free a sprite from archive_decode_sprite() - which, unlike one from  */
+/* T4K_LoadSprite(), may be missing frames if it was only part decoded: */
+void archive_free_sprite(sprite* s)
+{
+    int i;
+
+    if (!s)
+        return;
+    if (s->default_img)
+        SDL_FreeSurface(s->default_img);
+    for (i = 0; i < s->num_frames; i++)
+        if (s->frame[i])
+            SDL_FreeSurface(s->frame[i]);
+    free(s);
+}
+
+
+/* As T4K_LoadImage(), but decoded by SDL_image where possible: */
+SDL_Surface* archive_load_image(const char* file, int mode)
+{
+    SDL_Surface* img = NULL;
+
+    if (mode == IMG_ALPHA)
+        img = archive_finish_image(archive_decode_image(file));
+    if (!img)
+        return T4K_LoadImage(file, mode);
+    return img;
+}
+
+
+sprite* archive_load_sprite(const char* name, int mode)
+{
+    sprite* s = NULL;
+
+    if (mode == IMG_ALPHA)
+        s = archive_finish_sprite(archive_decode_sprite(name));
+    if (!s)
+        return T4K_LoadSprite(name, mode);
+    return s;
+}
+
+
+/* The contents of a file given by its full path under DATA_PREFIX, */
+/* or NULL if it isn't in the archive:                              */
+const void* archive_find_path(const char* path, Uint32* size)
+{
+    int len = strlen(DATA_PREFIX);
+
+    if (!archive || strncmp(path, DATA_PREFIX "/", len + 1) != 0)
+        return NULL;
+    return archive_find(path + len + 1, size);
+}
+
+
+#ifndef NOSOUND
+/* As Mix_LoadWAV(), for a path under DATA_PREFIX: */
+Mix_Chunk* archive_load_wav(const char* path)
+{
+    const void* data;
+    Uint32 size;
+
+    data = archive_find_path(path, &size);
+    if (!data)
+        return Mix_LoadWAV(path);
+
+    /* (the samples are copied, so the mapping needn't outlive this) */
+    return Mix_LoadWAV_RW(SDL_RWFromConstMem(data, size), 1);
+}
+#endif
+
+
+static Uint32 read_u32(const Uint8* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((Uint32)p[3] << 24);
+}
+
+
+/* Make sure the index can't send us outside the archive: */
+static int check_archive(void)
+{
+    const Uint8* entry;
+    Uint32 i, name, len, data, size;
+
+    if (archive_size < ARCHIVE_HEADER_SIZE
+            || read_u32(archive) != ARCHIVE_MAGIC
+            || read_u32(archive + 4) != ARCHIVE_VERSION)
+        return 0;
+    num_files = read_u32(archive + 8);
+    if (num_files > (archive_size - ARCHIVE_HEADER_SIZE) / ARCHIVE_ENTRY_SIZE)
+        return 0;
+
+    for (i = 0; i < num_files; i++)
+    {
+        entry = archive + ARCHIVE_HEADER_SIZE + i * ARCHIVE_ENTRY_SIZE;
+        name = read_u32(entry);
+        len = read_u32(entry + 4);
+        data = read_u32(entry + 8);
+        size = read_u32(entry + 12);
+        if (name >= archive_size || len >= archive_size - name
+                || archive[name + len] != '\0'
+                || data > archive_size || size > archive_size - data)
+            return 0;
+        if (i > 0 && strcmp(file_name(i - 1), file_name(i)) >= 0)
+            return 0;
+    }
+    return 1;
+}
+
+
+static const char* file_name(Uint32 i)
+{
+    return (const char*)archive + read_u32(archive + ARCHIVE_HEADER_SIZE + i * ARCHIVE_ENTRY_SIZE);
+}
+
+
+/* Decode a PNG or JPEG ("images/...") straight from the mapping, or  */
+/* from the data directory if it isn't in the archive.  NOTE no        */
+/* SDL_GetError() here, as it may be called on any thread:             */
+static SDL_Surface* decode_image(const char* name)
+{
+    char path[PATH_MAX];
+    const void* data;
+    Uint32 size;
+
+    data = archive_find(name, &size);
+    if (data)
+        return IMG_Load_RW(SDL_RWFromConstMem(data, size), 1);
+    snprintf(path, sizeof(path), "%s/%s", DATA_PREFIX, name);
+    return IMG_Load(path);
+}
+
+
+/* Whether "name" is in the archive or the data directory: */
+static int image_exists(const char* name)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (archive_find(name, NULL))
+        return 1;
+    snprintf(path, sizeof(path), "%s/%s", DATA_PREFIX, name);
+    return stat(path, &st) == 0;
+}
+
+
+/* Whether t4k_common would load an SVG instead of "name" (a .png): */
+static int svg_preferred(const char* name)
+{
+    char svg[PATH_MAX];
+    char* ext;
+
+    strncpy(svg, name, PATH_MAX - 5);
+    svg[PATH_MAX - 5] = '\0';
+    ext = strrchr(svg, '.');
+    if (!ext || strcmp(ext, ".svg") == 0)
+        return ext != NULL;
+    strcpy(ext, ".svg");
+    return image_exists(svg);
+}
@@ -0,0 +1,46 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+/* The packed archive of images and sounds made by pack_assets at build */
+/* time.  All numbers are 32-bit little-endian.  It starts with:        */
+/*   magic, version, number of files, offset of the first file's data   */
+/* then for each file, sorted by name:                                  */
+/*   offset of its name, length of its name, offset of its data, size   */
+/* then the names (each followed by a 0), then each file's data, each   */
+/* starting on an ARCHIVE_ALIGN boundary.  Names are relative to the    */
+/* data directory, e.g. "images/status/title.png":                      */
+#define ARCHIVE_MAGIC 0x4B504D54  /* "TMPK" */
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 16
+#define ARCHIVE_ENTRY_SIZE 16
+#define ARCHIVE_ALIGN 16
+#define ARCHIVE_NAME "assets.pak"
+
+#ifndef PACK_ASSETS
+
+#include "globals.h"
+
+/* Loading from the archive (mapped into memory while it's open) - */
+/* anything not in it, or that it can't be used for, is loaded the  */
+/* usual way instead.  The decode functions may be used on any      */
+/* thread, the rest only on the main one.  See archive.c:           */
+int archive_open(const char* path);
+void archive_close(void);
+const void* archive_find(const char* name, Uint32* size);
+const void* archive_find_path(const char* path, Uint32* size);
+int archive_stat(const char* name, Uint32* size, Uint32* mtime);
+void archive_start_decoding(void);
+SDL_Surface* archive_decode_image(const char* file);
+sprite* archive_decode_sprite(const char* name);
+SDL_Surface* archive_finish_image(SDL_Surface* img);
+sprite* archive_finish_sprite(sprite* s);
+void archive_free_sprite(sprite* s);
+SDL_Surface* archive_load_image(const char* file, int mode);
+sprite* archive_load_sprite(const char* name, int mode);
+#ifndef NOSOUND
+Mix_Chunk* archive_load_wav(const char* path);
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,556 @@
+/*
+   blend.c:
+
+   Alpha blits, fades and fills for 32-bit surfaces, with SSE2 and
+   AVX2 inner loops chosen according to what the CPU supports.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+blend.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <t4k_common.h>
+
+#include "blend.h"
+#include "tuxmath.h"
+
+/* The vector kernels need GCC's per-function target attributes, so  */
+/* the rest of the program can still be built for a plain x86 CPU:   */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BLEND_X86 1
+#include <immintrin.h>
+#endif
+
+
+/* Our sprites are loaded with straight (not premultiplied) alpha,  */
+/* as SDL and t4k_common expect, so each kernel premultiplies the   */
+/* source as it loads it and then does a premultiplied "over":      */
+/*                                                                  */
+/*     a = src alpha * fade / 255                                   */
+/*     dst = src * a / 255  +  dst * (255 - a) / 255                */
+/*                                                                  */
+/* The destination has no alpha channel (it is the screen), so the  */
+/* byte it would be in is left as garbage.                          */
+typedef void (*blend_row_func)(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade);
+typedef void (*fill_row_func)(Uint32* d, int n, Uint32 color);
+
+static void blend_row_c(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade);
+static void fill_row_c(Uint32* d, int n, Uint32 color);
+#ifdef BLEND_X86
+static void blend_row_sse2(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade);
+static void fill_row_sse2(Uint32* d, int n, Uint32 color);
+static void blend_row_avx2(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade);
+static void fill_row_avx2(Uint32* d, int n, Uint32 color);
+#endif
+
+static blend_row_func blend_row = NULL;
+static fill_row_func fill_row = NULL;
+static const char* kernel_name = NULL;
+
+static void blend_init(void);
+static int blend_ok(SDL_Surface* src, SDL_Surface* dst);
+static int clip_blit(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst,
+        SDL_Rect* dstrect, SDL_Rect* sr);
+static int blend_surfaces(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst,
+        SDL_Rect* dstrect, Uint8 fade);
+
+
+/* Drop-in for SDL_BlitSurface(): */
+int blend_blit(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect)
+{
+    if(!blend_ok(src, dst))
+        return SDL_BlitSurface(src, srcrect, dst, dstrect);
+    return blend_surfaces(src, srcrect, dst, dstrect, SDL_ALPHA_OPAQUE);
+}
+
+
+/* As blend_blit(), but with the whole source made more transparent */
+/* by "alpha" - which SDL 1.2 can't do for surfaces that have an    */
+/* alpha channel, as it ignores the per-surface alpha for them:     */
+int blend_fade(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect, Uint8 alpha)
+{
+    Uint32 flags;
+    Uint8 old_alpha;
+    int ret;
+
+    if(blend_ok(src, dst))
+        return blend_surfaces(src, srcrect, dst, dstrect, alpha);
+
+    /* Best we can do is the per-surface alpha: */
+    if(!src)
+        return -1;
+    flags = src->flags & SDL_SRCALPHA;
+    old_alpha = src->format->alpha;
+    SDL_SetAlpha(src, SDL_SRCALPHA, alpha);
+    ret = SDL_BlitSurface(src, srcrect, dst, dstrect);
+    SDL_SetAlpha(src, flags, old_alpha);
+    return ret;
+}
+
+
+/* Drop-in for SDL_FillRect(): */
+int blend_fill(SDL_Surface* dst, SDL_Rect* rect, Uint32 color)
+{
+    SDL_Rect r;
+    Uint8* row;
+    int y, x2, y2;
+
+    if(!dst || dst->format->BytesPerPixel != 4 || (dst->flags & SDL_HWSURFACE))
+        return SDL_FillRect(dst, rect, color);
+
+    blend_init();
+
+    /* Clip the same way SDL_FillRect() does: */
+    if(rect)
+    {
+        r.x = (rect->x < dst->clip_rect.x) ? dst->clip_rect.x : rect->x;
+        r.y = (rect->y < dst->clip_rect.y) ? dst->clip_rect.y : rect->y;
+        x2 = rect->x + rect->w;
+        y2 = rect->y + rect->h;
+        if(x2 > dst->clip_rect.x + dst->clip_rect.w)
+            x2 = dst->clip_rect.x + dst->clip_rect.w;
+        if(y2 > dst->clip_rect.y + dst->clip_rect.h)
+            y2 = dst->clip_rect.y + dst->clip_rect.h;
+        if(x2 <= r.x || y2 <= r.y)
+        {
+            rect->w = rect->h = 0;
+            return 0;
+        }
+        r.w = x2 - r.x;
+        r.h = y2 - r.y;
+        *rect = r;
+    }
+    else
+        r = dst->clip_rect;
+
+    if(SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0)
+        return -1;
+    row = (Uint8*)dst->pixels + r.y * dst->pitch + r.x * 4;
+    for(y = 0; y < r.h; y++, row += dst->pitch)
+        fill_row((Uint32*)row, r.w, color);
+    if(SDL_MUSTLOCK(dst))
+        SDL_UnlockSurface(dst);
+    return 0;
+}
+
+
+/* Which kernels are in use, for debugging output: */
+const char* blend_kernels(void)
+{
+    blend_init();
+    return kernel_name;
+}
+
+
+/* Pick the fastest kernels this CPU can run (once): */
+static void blend_init(void)
+{
+    if(blend_row)
+        return;
+
+    blend_row = blend_row_c;
+    fill_row = fill_row_c;
+    kernel_name = "C";
+#ifdef BLEND_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        blend_row = blend_row_avx2;
+        fill_row = fill_row_avx2;
+        kernel_name = "AVX2";
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        blend_row = blend_row_sse2;
+        fill_row = fill_row_sse2;
+        kernel_name = "SSE2";
+    }
+#endif
+    DEBUGMSG(debug_sdl, "blend_init(): using %s kernels\n", kernel_name);
+}
+
+
+/* Only a 32-bit source with an alpha channel going onto a 32-bit    */
+/* destination without one, with the colors in the same places, is  */
+/* ours - in practice, sprites going onto the screen:               */
+static int blend_ok(SDL_Surface* src, SDL_Surface* dst)
+{
+    SDL_PixelFormat* sf;
+    SDL_PixelFormat* df;
+
+    if(!src || !dst)
+        return 0;
+    sf = src->format;
+    df = dst->format;
+
+    if(sf->BytesPerPixel != 4 || df->BytesPerPixel != 4)
+        return 0;
+    if(!(src->flags & SDL_SRCALPHA) || (sf->Ashift % 8)
+            || sf->Amask != (0xFFu << sf->Ashift) || df->Amask)
+        return 0;
+    if(sf->Rmask != df->Rmask || sf->Gmask != df->Gmask || sf->Bmask != df->Bmask)
+        return 0;
+    /* Reading back from video memory is far slower than letting SDL do it: */
+    if((src->flags & SDL_HWSURFACE) || (dst->flags & SDL_HWSURFACE))
+        return 0;
+
+    blend_init();
+    return 1;
+}
+
+
+/* Clip a blit to the source and to the destination's clip rect,    */
+/* updating *dstrect to the area actually drawn as SDL_BlitSurface() */
+/* does.  Returns 0 if nothing is left to draw:                     */
+static int clip_blit(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst,
+        SDL_Rect* dstrect, SDL_Rect* sr)
+{
+    SDL_Rect* c = &dst->clip_rect;
+    int sx, sy, dx, dy, w, h, d;
+
+    if(srcrect)
+    {
+        sx = srcrect->x;
+        sy = srcrect->y;
+        w = srcrect->w;
+        h = srcrect->h;
+    }
+    else
+    {
+        sx = sy = 0;
+        w = src->w;
+        h = src->h;
+    }
+    dx = dstrect ? dstrect->x : 0;
+    dy = dstrect ? dstrect->y : 0;
+
+    /* Clip to the source: */
+    if(sx < 0)
+    {
+        w += sx;
+        dx -= sx;
+        sx = 0;
+    }
+    if(sy < 0)
+    {
+        h += sy;
+        dy -= sy;
+        sy = 0;
+    }
+    if(sx + w > src->w)
+        w = src->w - sx;
+    if(sy + h > src->h)
+        h = src->h - sy;
+
+    /* Clip to the destination: */
+    d = c->x - dx;
+    if(d > 0)
+    {
+        w -= d;
+        sx += d;
+        dx = c->x;
+    }
+    d = c->y - dy;
+    if(d > 0)
+    {
+        h -= d;
+        sy += d;
+        dy = c->y;
+    }
+    if(dx + w > c->x + c->w)
+        w = c->x + c->w - dx;
+    if(dy + h > c->y + c->h)
+        h = c->y + c->h - dy;
+
+    if(w <= 0 || h <= 0)
+    {
+        if(dstrect)
+            dstrect->w = dstrect->h = 0;
+        return 0;
+    }
+
+    sr->x = sx;
+    sr->y = sy;
+    sr->w = w;
+    sr->h = h;
+    if(dstrect)
+    {
+        dstrect->x = dx;
+        dstrect->y = dy;
+        dstrect->w = w;
+        dstrect->h = h;
+    }
+    return 1;
+}
+
+
+static int blend_surfaces(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst,
+        SDL_Rect* dstrect, Uint8 fade)
+{
+    SDL_Rect sr;
+    SDL_Rect dr = {0, 0, 0, 0};
+    Uint8* srow;
+    Uint8* drow;
+    int y;
+
+    if(!dstrect)
+        dstrect = &dr;
+    if(!clip_blit(src, srcrect, dst, dstrect, &sr))
+        return 0;
+    if(fade == SDL_ALPHA_TRANSPARENT)
+        return 0;
+
+    if(SDL_MUSTLOCK(dst) && SDL_LockSurface(dst) < 0)
+        return -1;
+    if(SDL_MUSTLOCK(src) && SDL_LockSurface(src) < 0)
+    {
+        if(SDL_MUSTLOCK(dst))
+            SDL_UnlockSurface(dst);
+        return -1;
+    }
+
+    srow = (Uint8*)src->pixels + sr.y * src->pitch + sr.x * 4;
+    drow = (Uint8*)dst->pixels + dstrect->y * dst->pitch + dstrect->x * 4;
+    for(y = 0; y < sr.h; y++)
+    {
+        blend_row((Uint32*)drow, (const Uint32*)srow, sr.w, src->format->Ashift, fade);
+        srow += src->pitch;
+        drow += dst->pitch;
+    }
+
+    if(SDL_MUSTLOCK(src))
+        SDL_UnlockSurface(src);
+    if(SDL_MUSTLOCK(dst))
+        SDL_UnlockSurface(dst);
+    return 0;
+}
+
+
+/* x / 255, rounded, for x up to 255 * 255: */
+static Uint32 div255(Uint32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+
+static void blend_row_c(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade)
+{
+    Uint32 sp, dp, a, c, out;
+    int i, shift;
+
+    for(i = 0; i < n; i++)
+    {
+        sp = s[i];
+        a = (sp >> ashift) & 0xFF;
+        if(fade != SDL_ALPHA_OPAQUE)
+            a = div255(a * fade);
+        if(a == SDL_ALPHA_TRANSPARENT)
+            continue;
+        if(a == SDL_ALPHA_OPAQUE)
+        {
+            d[i] = sp;
+            continue;
+        }
+
+        dp = d[i];
+        out = 0;
+        for(shift = 0; shift < 32; shift += 8)
+        {
+            if(shift == ashift)
+                continue;
+            c = div255(((sp >> shift) & 0xFF) * a)
+                + div255(((dp >> shift) & 0xFF) * (255 - a));
+            if(c > 255)
+                c = 255;
+            out |= c << shift;
+        }
+        d[i] = out;
+    }
+}
+
+
+static void fill_row_c(Uint32* d, int n, Uint32 color)
+{
+    int i;
+
+    for(i = 0; i < n; i++)
+        d[i] = color;
+}
+
+
+#ifdef BLEND_X86
+
+/* The vector kernels widen each color byte to 16 bits so the       */
+/* products fit, four pixels per SSE2 register or eight per AVX2:   */
+
+__attribute__((target("sse2")))
+static __m128i div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+
+__attribute__((target("sse2")))
+static void blend_row_sse2(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ff = _mm_set1_epi32(0xFF);
+    const __m128i inv = _mm_set1_epi16(0xFF);
+    const __m128i f = _mm_set1_epi16(fade);
+    const __m128i shift = _mm_cvtsi32_si128(ashift);
+    __m128i sp, dp, a, a_lo, a_hi, s_lo, s_hi, d_lo, d_hi;
+    int i;
+
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        sp = _mm_loadu_si128((const __m128i*)(s + i));
+        a = _mm_and_si128(_mm_srl_epi32(sp, shift), ff);
+
+        /* Skip runs of clear pixels, and copy solid ones, outright: */
+        if(_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF)
+            continue;
+        if(fade == SDL_ALPHA_OPAQUE
+                && _mm_movemask_epi8(_mm_cmpeq_epi32(a, ff)) == 0xFFFF)
+        {
+            _mm_storeu_si128((__m128i*)(d + i), sp);
+            continue;
+        }
+
+        /* Spread each pixel's alpha across its four bytes: */
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+        a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+        a_lo = _mm_unpacklo_epi8(a, zero);
+        a_hi = _mm_unpackhi_epi8(a, zero);
+        if(fade != SDL_ALPHA_OPAQUE)
+        {
+            a_lo = div255_sse2(_mm_mullo_epi16(a_lo, f));
+            a_hi = div255_sse2(_mm_mullo_epi16(a_hi, f));
+        }
+
+        dp = _mm_loadu_si128((const __m128i*)(d + i));
+        s_lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(sp, zero), a_lo));
+        s_hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(sp, zero), a_hi));
+        d_lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(dp, zero),
+                    _mm_xor_si128(a_lo, inv)));
+        d_hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(dp, zero),
+                    _mm_xor_si128(a_hi, inv)));
+
+        _mm_storeu_si128((__m128i*)(d + i),
+                _mm_adds_epu8(_mm_packus_epi16(s_lo, s_hi),
+                    _mm_packus_epi16(d_lo, d_hi)));
+    }
+
+    if(i < n)
+        blend_row_c(d + i, s + i, n - i, ashift, fade);
+}
+
+
+__attribute__((target("sse2")))
+static void fill_row_sse2(Uint32* d, int n, Uint32 color)
+{
+    const __m128i c = _mm_set1_epi32(color);
+    int i;
+
+    for(i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i*)(d + i), c);
+    for(; i < n; i++)
+        d[i] = color;
+}
+
+
+__attribute__((target("avx2")))
+static __m256i div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+
+/* Same as blend_row_sse2() - the unpacks and packs work within each */
+/* 128-bit half, so the pixels come back out in the right order:     */
+__attribute__((target("avx2")))
+static void blend_row_avx2(Uint32* d, const Uint32* s, int n, int ashift, Uint8 fade)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ff = _mm256_set1_epi32(0xFF);
+    const __m256i inv = _mm256_set1_epi16(0xFF);
+    const __m256i f = _mm256_set1_epi16(fade);
+    const __m128i shift = _mm_cvtsi32_si128(ashift);
+    __m256i sp, dp, a, a_lo, a_hi, s_lo, s_hi, d_lo, d_hi;
+    int i;
+
+    for(i = 0; i + 8 <= n; i += 8)
+    {
+        sp = _mm256_loadu_si256((const __m256i*)(s + i));
+        a = _mm256_and_si256(_mm256_srl_epi32(sp, shift), ff);
+
+        if(_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, zero)) == -1)
+            continue;
+        if(fade == SDL_ALPHA_OPAQUE
+                && _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, ff)) == -1)
+        {
+            _mm256_storeu_si256((__m256i*)(d + i), sp);
+            continue;
+        }
+
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        a_lo = _mm256_unpacklo_epi8(a, zero);
+        a_hi = _mm256_unpackhi_epi8(a, zero);
+        if(fade != SDL_ALPHA_OPAQUE)
+        {
+            a_lo = div255_avx2(_mm256_mullo_epi16(a_lo, f));
+            a_hi = div255_avx2(_mm256_mullo_epi16(a_hi, f));
+        }
+
+        dp = _mm256_loadu_si256((const __m256i*)(d + i));
+        s_lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(sp, zero), a_lo));
+        s_hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(sp, zero), a_hi));
+        d_lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(dp, zero),
+                    _mm256_xor_si256(a_lo, inv)));
+        d_hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(dp, zero),
+                    _mm256_xor_si256(a_hi, inv)));
+
+        _mm256_storeu_si256((__m256i*)(d + i),
+                _mm256_adds_epu8(_mm256_packus_epi16(s_lo, s_hi),
+                    _mm256_packus_epi16(d_lo, d_hi)));
+    }
+
+    /* Finish off with the SSE2 loop, then plain C: */
+    if(i < n)
+        blend_row_sse2(d + i, s + i, n - i, ashift, fade);
+}
+
+
+__attribute__((target("avx2")))
+static void fill_row_avx2(Uint32* d, int n, Uint32 color)
+{
+    const __m256i c = _mm256_set1_epi32(color);
+    int i;
+
+    for(i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i*)(d + i), c);
+    for(; i < n; i++)
+        d[i] = color;
+}
+
+#endif /* BLEND_X86 */
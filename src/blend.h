@@ -0,0 +1,15 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <SDL_video.h>
+
+/* Compositing onto the screen, with SSE2/AVX2 versions of the inner */
+/* loops picked at run time.  Each call falls back to SDL's own      */
+/* blitter or fill when the surfaces aren't in a format we handle -  */
+/* see blend.c:                                                       */
+int blend_blit(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect);
+int blend_fade(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, SDL_Rect* dstrect, Uint8 alpha);
+int blend_fill(SDL_Surface* dst, SDL_Rect* rect, Uint32 color);
+const char* blend_kernels(void);
+
+#endif
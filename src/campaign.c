@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "fileops.h"
 #include "mathcards.h"
 #include "options.h"
+#include "setup.h"
 
 
 void briefPlayer(int stage); //show text introducing the given stage
@@ -52,6 +53,9 @@ int start_campaign()
     char endtext[2][MAX_LINEWIDTH] = {N_("Congratulations! You win!"), " "};
     fprintf(stderr, "Entering start_campaign()\n");
 
+    /* Keep the comets images loaded from one round to the next: */
+    if (!load_bundle(BUNDLE_COMETS))
+        return 0;
 
     for (i = 0; i < NUM_STAGES; ++i)
     {
@@ -106,7 +110,10 @@ int start_campaign()
             }
 
             if (endcampaign)
+            {
+                release_bundle(BUNDLE_COMETS);
                 return 0;
+            }
         }
 
         //if we've beaten the last stage, there is no bonus, skip to win sequence
@@ -122,6 +129,7 @@ int start_campaign()
               game();
               */
     }
+    release_bundle(BUNDLE_COMETS);
     scroll_text(endtext, screen->clip_rect, 3);
     return 0;
 }
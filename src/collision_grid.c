@@ -0,0 +1,302 @@
+/*
+   collision_grid.c:
+
+   A broad-phase for collisions between many objects: the screen is
+   divided into cells, each object is listed in every cell its bounding
+   circle touches (on both sides of an edge it is wrapping across), and
+   a query only looks in the cells it covers.  The objects found may
+   still miss, so the caller tests each exactly as it would have
+   without the grid.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+collision_grid.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "collision_grid.h"
+
+typedef struct grid_node {
+    int id;
+    int next;       /* the next node in the same cell, or -1 */
+} grid_node;
+
+static int grid_w = 0, grid_h = 0;
+static int cols = 0, rows = 0;
+static int* cell_head = NULL;   /* each cell's first node, or -1 */
+static grid_node* nodes = NULL;
+static int num_nodes = 0;
+static int max_nodes = 0;
+
+/* For not finding an object twice in one query: */
+static int* seen = NULL;
+static int num_ids = 0;
+static int stamp = 0;
+
+/* Scratch space for the cells covered along each axis: */
+static int* col_span = NULL;
+static int* row_span = NULL;
+
+static int cell_of(int v, int size, int n);
+static int span(int lo, int hi, int size, int n, int* out);
+static int collect(int x0, int y0, int x1, int y1, int* ids, int count, int max);
+static void next_stamp(void);
+static int compare_ids(const void* a, const void* b);
+
+
+/* A grid over a w x h screen with cells of about cell_size pixels, */
+/* for objects numbered 0 to max_ids-1.  Returns 1 if successful:   */
+int grid_init(int w, int h, int cell_size, int max_ids)
+{
+    grid_cleanup();
+
+    if (w < 1 || h < 1 || max_ids < 1)
+        return 0;
+    if (cell_size < 1)
+        cell_size = 1;
+
+    grid_w = w;
+    grid_h = h;
+    cols = (w + cell_size - 1) / cell_size;
+    rows = (h + cell_size - 1) / cell_size;
+    num_ids = max_ids;
+    max_nodes = max_ids * 4;
+
+    cell_head = (int*)malloc(cols * rows * sizeof(int));
+    nodes = (grid_node*)malloc(max_nodes * sizeof(grid_node));
+    seen = (int*)calloc(num_ids, sizeof(int));
+    col_span = (int*)malloc(cols * sizeof(int));
+    row_span = (int*)malloc(rows * sizeof(int));
+    if (!cell_head || !nodes || !seen || !col_span || !row_span)
+    {
+        fprintf(stderr, "grid_init(): out of memory\n");
+        grid_cleanup();
+        return 0;
+    }
+
+    grid_clear();
+    return 1;
+}
+
+
+/* Empty every cell, before adding the objects again where they now are: */
+void grid_clear(void)
+{
+    int i;
+
+    for (i = 0; i < cols * rows; i++)
+        cell_head[i] = -1;
+    num_nodes = 0;
+}
+
+
+void grid_add(int id, int x, int y, int radius)
+{
+    grid_node* grown;
+    int nx, ny, i, j, cell;
+
+    if (!cell_head || id < 0 || id >= num_ids)
+        return;
+    if (radius < 0)
+        radius = 0;
+
+    nx = span(x - radius, x + radius, grid_w, cols, col_span);
+    ny = span(y - radius, y + radius, grid_h, rows, row_span);
+
+    if (num_nodes + nx * ny > max_nodes)
+    {
+        grown = (grid_node*)realloc(nodes, 2 * (num_nodes + nx * ny) * sizeof(grid_node));
+        if (!grown)
+        {
+            fprintf(stderr, "grid_add(): out of memory\n");
+            return;
+        }
+        nodes = grown;
+        max_nodes = 2 * (num_nodes + nx * ny);
+    }
+
+    for (j = 0; j < ny; j++)
+    {
+        for (i = 0; i < nx; i++)
+        {
+            cell = row_span[j] * cols + col_span[i];
+            nodes[num_nodes].id = id;
+            nodes[num_nodes].next = cell_head[cell];
+            cell_head[cell] = num_nodes++;
+        }
+    }
+}
+
+
+/* The objects that may be within "radius" of (x, y) - at most "max" */
+/* of them, into ids[].  Returns how many:                            */
+int grid_query_circle(int x, int y, int radius, int* ids, int max)
+{
+    int count;
+
+    if (!cell_head)
+        return 0;
+    if (radius < 0)
+        radius = 0;
+
+    next_stamp();
+    count = collect(x - radius, y - radius, x + radius, y + radius, ids, 0, max);
+    qsort(ids, count, sizeof(int), compare_ids);
+    return count;
+}
+
+
+/* The objects that may touch the line from (x0, y0) to (x1, y1).  It */
+/* is looked along in steps no longer than the narrowest cell, each   */
+/* step checking the cells within half a step of it, so none of the   */
+/* cells the line crosses are missed:                                 */
+int grid_query_segment(int x0, int y0, int x1, int y1, int* ids, int max)
+{
+    int dx = x1 - x0, dy = y1 - y0;
+    int len, step, pad, n, i, px, py;
+    int count = 0;
+
+    if (!cell_head)
+        return 0;
+
+    step = grid_w / cols;
+    if (grid_h / rows < step)
+        step = grid_h / rows;
+    pad = step / 2 + 1;
+
+    len = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+    n = len / step + 1;
+
+    next_stamp();
+    for (i = 0; i <= n && count < max; i++)
+    {
+        px = x0 + dx * i / n;
+        py = y0 + dy * i / n;
+        count = collect(px - pad, py - pad, px + pad, py + pad, ids, count, max);
+    }
+    qsort(ids, count, sizeof(int), compare_ids);
+    return count;
+}
+
+
+void grid_cleanup(void)
+{
+    free(cell_head);
+    free(nodes);
+    free(seen);
+    free(col_span);
+    free(row_span);
+    cell_head = NULL;
+    nodes = NULL;
+    seen = NULL;
+    col_span = row_span = NULL;
+    cols = rows = 0;
+    num_nodes = max_nodes = 0;
+    num_ids = 0;
+    stamp = 0;
+}
+
+
+/* Which of n cells across "size" pixels v is in, wrapping around: */
+static int cell_of(int v, int size, int n)
+{
+    v %= size;
+    if (v < 0)
+        v += size;
+    return v * n / size;
+}
+
+
+/* The cells that lo to hi covers along one axis, into out[].  The cells */
+/* are size/n pixels wide give or take one, so stepping by the smaller   */
+/* can't skip any:                                                       */
+static int span(int lo, int hi, int size, int n, int* out)
+{
+    int step = size / n;
+    int count = 0;
+    int i, c, v;
+
+    if (hi - lo + 1 >= size)
+    {
+        for (i = 0; i < n; i++)
+            out[i] = i;
+        return n;
+    }
+
+    for (v = lo; ; v += step)
+    {
+        if (v > hi)
+            v = hi;
+        c = cell_of(v, size, n);
+        for (i = 0; i < count && out[i] != c; i++)
+            ;
+        if (i == count)
+            out[count++] = c;
+        if (v == hi)
+            break;
+    }
+    return count;
+}
+
+
+/* Add the objects in the cells under the box that aren't already */
+/* in ids[], up to "max" in all:                                   */
+static int collect(int x0, int y0, int x1, int y1, int* ids, int count, int max)
+{
+    int nx, ny, i, j, node;
+
+    nx = span(x0, x1, grid_w, cols, col_span);
+    ny = span(y0, y1, grid_h, rows, row_span);
+
+    for (j = 0; j < ny; j++)
+    {
+        for (i = 0; i < nx; i++)
+        {
+            for (node = cell_head[row_span[j] * cols + col_span[i]];
+                    node >= 0; node = nodes[node].next)
+            {
+                if (seen[nodes[node].id] == stamp)
+                    continue;
+                if (count == max)
+                    return count;
+                seen[nodes[node].id] = stamp;
+                ids[count++] = nodes[node].id;
+            }
+        }
+    }
+    return count;
+}
+
+
+static void next_stamp(void)
+{
+    if (++stamp <= 0)
+    {
+        memset(seen, 0, num_ids * sizeof(int));
+        stamp = 1;
+    }
+}
+
+
+static int compare_ids(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
@@ -0,0 +1,17 @@
+#ifndef COLLISION_GRID_H
+#define COLLISION_GRID_H
+
+/* A uniform grid over the screen, for finding which of many objects   */
+/* might be at a point, within a circle or along a line without trying */
+/* every one.  Objects are added with their bounding circles after     */
+/* each move, and are found across the screen edges as they wrap       */
+/* around.  Queries give the candidates' ids in increasing order, for  */
+/* the caller's own exact test - see collision_grid.c:                 */
+int grid_init(int w, int h, int cell_size, int max_ids);
+void grid_clear(void);
+void grid_add(int id, int x, int y, int radius);
+int grid_query_circle(int x, int y, int radius, int* ids, int max);
+int grid_query_segment(int x0, int y0, int x1, int y1, int* ids, int max);
+void grid_cleanup(void);
+
+#endif
@@ -57,6 +57,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "titlescreen.h"
 #include "options.h"
 #include "draw_utils.h"
+#include "profiler.h"
+#include "quality.h"
+#include "render_target.h"
+#include "SDL_rotozoom.h"
+#include "blend.h"
 #include "t4k_common.h"
 
 #define CITY_EXPL_START (3 * 5)  /* Must be mult. of 5 (number of expl frames) */
@@ -87,6 +92,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #define BASE_COMET_FONTSIZE 24
 
+/* How long to keep trying to get back into a LAN game after our */
+/* connection drops, and how often to try:                        */
+#define LAN_RESUME_TIMEOUT 10000
+#define LAN_RECONNECT_INTERVAL 500
+
 static MC_MathGame* curr_game;
 
 static int powerup_comet_running = 0;
@@ -150,6 +160,7 @@ static int digits[MC_MAX_DIGITS];
 
 static comet_type* comets = NULL;
 static powerup_comet_type* powerup_comet = NULL;
+static comet_positions comet_pos;
 
 static city_type* cities = NULL;
 static penguin_type* penguins = NULL;
@@ -160,6 +171,21 @@ static laser_type laser[MAX_LASER];
 
 static SDL_Surface* bkgd = NULL; //640x480 background (windowed)
 static SDL_Surface* scaled_bkgd = NULL; //fullscreen resolution (from OS)
+/* scaled_bkgd scaled down to fit when drawing off-screen (see */
+/* render_target.c), and the size it was made for:             */
+static SDL_Surface* render_bkgd = NULL;
+static int render_bkgd_w = 0;
+static int render_bkgd_h = 0;
+/* How many display pixels each one we draw covers (see comets_render_target()): */
+static int render_scale = 1;
+
+/* Copy of the fully drawn background, used to erase sprites drawn last */
+/* frame (see dirty_rects_restore()), and what it was drawn from:       */
+static SDL_Surface* backdrop = NULL;
+static SDL_Surface* backdrop_bkgd = NULL;
+static int backdrop_wave = -1;
+/* Whether we're holding the comets bundle of images: */
+static int comets_bundle_loaded = 0;
 
 
 static game_message s1, s2, s3, s4, s5;
@@ -170,6 +196,20 @@ static int start_message_chosen = 0;
 SDL_Surface* player_left_surf = NULL;
 int player_left_time = 0;
 SDL_Rect player_left_pos = {0};
+
+/* Questions the server has sent ahead of time, waiting to be launched: */
+typedef struct pending_quest_type {
+    int pending;
+    Uint32 spawn_time;
+    MC_FlashCard fc;
+} pending_quest_type;
+
+static pending_quest_type pending_quests[QUEST_QUEUE_SIZE];
+
+/* Nonzero while we are trying to rejoin after a dropped connection: */
+static Uint32 lan_lost_time = 0;
+static Uint32 lan_last_attempt = 0;
+static int lan_resume_sent = 0;
 #endif
 /****************************************************************/
 
@@ -191,11 +231,12 @@ static void comets_handle_cities(void);
 static void comets_handle_penguins(void);
 static void comets_handle_steam(void);
 static void comets_handle_extra_life(void);
+static void comets_save_positions(void);
 static void comets_draw(void);
 static void comets_handle_game_over(int comets_status);
 
-static SDL_Surface* current_bkgd()
-{ return screen->flags & SDL_FULLSCREEN ? scaled_bkgd : bkgd; } //too clever for my brain to process
+static SDL_Surface* current_bkgd(void);
+static void free_render_bkgd(void);
 
 static int check_extra_life(void);
 static int check_exit_conditions(void);
@@ -211,6 +252,7 @@ static int add_comet(void);
 static void add_score(int inc);
 static void reset_comets(void);
 static int num_comets_alive(void);
+static void comet_set_alive(int i, int alive);
 
 static void comets_mouse_event(SDL_Event event);
 static void comets_key_event(SDLKey key, SDLMod mod);
@@ -219,6 +261,9 @@ static void free_on_exit(void);
 static void help_add_comet(const char* formula_str, const char* ans_str);
 static int help_renderframe_exit(void);
 static void comets_recalc_positions(int xres, int yres);
+static int comets_render_scale(void);
+static void comets_render_target(int on);
+static void comets_resolution_switch(int xres, int yres);
 
 //Accessibility functions
 wchar_t* convert_formula_to_sentence(char *formula_string);
@@ -242,8 +287,13 @@ void comets_handle_net_messages(void);
 void comets_handle_net_msg(char* buf);
 int lan_add_comet(MC_FlashCard* fc);
 int add_quest_recvd(char* buf);
+int prefetch_quest_recvd(char* buf);
+void launch_pending_quests(void);
+void reset_pending_quests(void);
 int remove_quest_recvd(char* buf);
 int wave_recvd(char* buf);
+int game_snapshot_recvd(char* buf);
+void lan_check_resume(void);
 int player_left_recvd(char* buf);
 int comets_halted_recvd(char* buf);
 int erase_comet_on_screen(comet_type* zapped_comet, int answered_by);
@@ -306,47 +356,73 @@ int comets_game(MC_MathGame* mgame)
 
     DEBUGMSG(debug_game, "About to enter main game loop.\n");
 
+    /* Time each part of every frame, if asked to: */
+    PROF_start("Comets");
+    QG_init();
+    /* Draw at a lower resolution and scale it up, if asked to: */
+    comets_render_target(1);
+
     /* --- MAIN GAME LOOP: --- */
     do
     {
+        int i, steps;
+
         FC_frame_begin();
+        /* Turn the drawing down (or up) if need be: */
+        QG_frame();
+        comets_render_target(1);
 
         /* reset or increment various things with each loop: */
         old_tux_img = tux_img;
         tux_pressing = 0;
-        int i;    
-        for(i=0;i<MAX_LASER;i++)
-        {
-            if (laser[i].alive > 0)
-                laser[i].alive -= 15*FC_time_elapsed;
-        }
 #ifdef HAVE_LIBSDL_NET
         /* Check for server messages if we are playing a LAN game: */
         if(Opts_LanMode())
         {    
+            PROF_begin(PROF_NET);
             comets_handle_net_messages();
+            /* Launch any prefetched questions that are now due: */
+            launch_pending_quests();
             /* Ask server to send our index if somehow we don't yet have it: */
             if(LAN_MyIndex() < 0)
                 LAN_RequestIndex();
+            PROF_end(PROF_NET);
         }
 #endif
 
         /* Most code now in smaller functions: */
 
         // 1. Check for user input
+        PROF_begin(PROF_INPUT);
         comets_handle_user_events();
-        // 2. Update state of various game elements
-        comets_handle_demo();
-        comets_handle_answer();
-        comets_countdown();
-        comets_handle_tux();
-        comets_handle_comets();
-        comets_handle_powerup();
-        comets_handle_cities();
-        comets_handle_penguins();
-        comets_handle_steam();
-        comets_handle_extra_life();
-        // 3. Redraw:
+        PROF_end(PROF_INPUT);
+        // 2. Update state of various game elements, in fixed steps so
+        //    that nothing moves further at once than in one step
+        //    (e.g. past city_expl_height) however slow the frame was:
+        steps = FC_fixed_steps();
+        PROF_begin(PROF_LOGIC);
+        while (steps-- > 0)
+        {
+            comets_save_positions();
+            for(i=0;i<MAX_LASER;i++)
+            {
+                if (laser[i].alive > 0)
+                    laser[i].alive -= 15*FC_time_elapsed;
+            }
+            comets_handle_demo();
+            comets_handle_answer();
+            comets_countdown();
+            comets_handle_tux();
+            comets_handle_comets();
+            comets_handle_powerup();
+            comets_handle_cities();
+            comets_handle_penguins();
+            comets_handle_steam();
+            comets_handle_extra_life();
+        }
+        PROF_end(PROF_LOGIC);
+        // 3. Redraw, with the comets part way between the last two
+        //    steps (see FC_step_alpha):
         comets_draw();
         // 4. Figure out if we should leave loop:
         comets_status = check_exit_conditions();
@@ -360,6 +436,8 @@ int comets_game(MC_MathGame* mgame)
 			T4K_Tts_say(DEFAULT_VALUE,DEFAULT_VALUE,INTERRUPT,_("Game paused. Press escape or p to continue"));
             pause_game();
             paused = 0;
+            /* The pause screen drew over everything: */
+            dirty_rects_invalidate();
             start_tts_announcer_thread();
         }
 
@@ -380,6 +458,9 @@ int comets_game(MC_MathGame* mgame)
     while(GAME_IN_PROGRESS == comets_status);
     /* END OF MAIN GAME LOOP! */
 
+    PROF_stop();
+    comets_render_target(0);
+
 
     comets_handle_game_over(comets_status);
 
@@ -419,10 +500,24 @@ int comets_initialize(void)
     DEBUGMSG(debug_game,"Entering comets_initialize()\n");
     DEBUGCODE(debug_game) print_game_options(stderr, 0);
 
+    /* The game's images are only loaded while it is running: */
+    if (!comets_bundle_loaded)
+    {
+        if (!load_bundle(BUNDLE_COMETS))
+        {
+            fprintf(stderr, "comets_initialize(): could not load images\n");
+            return 0;
+        }
+        comets_bundle_loaded = 1;
+    }
+
     /* Clear window: */
     SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
     SDL_Flip(screen);
 
+    /* From here on only the parts of the screen that change are redrawn: */
+    dirty_rects_start();
+
     comets_status = GAME_IN_PROGRESS;
     gameover_counter = -1;
     user_quit_received = 0;
@@ -472,6 +567,10 @@ int comets_initialize(void)
         //   }
         /* Ask server to send a message telling which socket is ours: */
         LAN_RequestIndex();
+        /* Forget any questions prefetched during a previous game: */
+        reset_pending_quests();
+        lan_lost_time = 0;
+        lan_resume_sent = 0;
         /* Disable pausing and feedback mode: */
         Opts_SetAllowPause(0);
         Opts_SetUseFeedback(0);
@@ -612,6 +711,8 @@ int comets_initialize(void)
 
     /* Reset remaining stuff: */
     comet_fontsize = (int)(BASE_COMET_FONTSIZE * get_scale());
+    /* Comet formulas are put together from these glyphs: */
+    prepare_glyph_atlas(comet_fontsize, &white);
     bkgd = scaled_bkgd = NULL;
     last_bkgd = -1;
     reset_comets();
@@ -641,7 +742,7 @@ int comets_initialize(void)
 
     //This tells t4k_common what function we want called
     //when the screen size changes.
-    T4K_OnResolutionSwitch(comets_recalc_positions);
+    T4K_OnResolutionSwitch(comets_resolution_switch);
 
     DEBUGMSG(debug_game,"Exiting comets_initialize()\n");
 
@@ -676,9 +777,27 @@ void comets_cleanup(void)
     /* clear start message */
     start_message_chosen = 0;
 
+    comets_free_text_cache();
+
+    /* Back to full screen updates for everyone else: */
+    dirty_rects_stop();
+    if (backdrop)
+    {
+        SDL_FreeSurface(backdrop);
+        backdrop = NULL;
+    }
+    backdrop_bkgd = NULL;
+    backdrop_wave = -1;
+
     /* Free dynamically-allocated items */
     free_on_exit();
 
+    if (comets_bundle_loaded)
+    {
+        release_bundle(BUNDLE_COMETS);
+        comets_bundle_loaded = 0;
+    }
+
     DEBUGMSG(debug_game, "Leaving comets_cleanup():\n");
 }
 
@@ -816,11 +935,11 @@ void comets_handle_help(void)
     
 	T4K_Tts_say(DEFAULT_VALUE,DEFAULT_VALUE,APPEND,"3 x 3 = ?");
     
-    comets[0].y = 2*(screen->h)/3;   // start it low down
+    comet_pos.y[0] = 2*(screen->h)/3;   // start it low down
     while ((comets[0].expl == -1) && !(quit_help = help_renderframe_exit()));  // wait 3 secs
     if (quit_help)
         return;
-    game_set_message(&s4,_("Notice the answer"),left_edge,comets[0].y-100);    
+    game_set_message(&s4,_("Notice the answer"),left_edge,comet_pos.y[0]-100);    
 	T4K_Tts_say(DEFAULT_VALUE,DEFAULT_VALUE,APPEND,"%s 9",_("Notice the answer"));
     
     help_renderframe_exit();
@@ -849,7 +968,7 @@ void comets_handle_help(void)
 	
 	T4K_Tts_say(DEFAULT_VALUE,DEFAULT_VALUE,APPEND,"56 ÷ 8 = ?");
     
-    comets[0].y = 2*(screen->h)/3;   // start it low down
+    comet_pos.y[0] = 2*(screen->h)/3;   // start it low down
 
     while (comets[0].alive && !(quit_help = help_renderframe_exit()));
 
@@ -871,7 +990,7 @@ void comets_handle_help(void)
 		_("You can fix the igloos"),_("by stopping bonus comets."));
 		
 		
-    comets[0].bonus = 1;
+    comet_pos.bonus[0] = 1;
     timer = 0;
 
     while (comets[0].alive && ((timer+=FC_time_elapsed) < 3) && !(quit_help = help_renderframe_exit()));
@@ -997,22 +1116,22 @@ void help_add_comet(const char* formula_str, const char* ans_str)
     //  char probstr[MC_FORMULA_LEN];
     //  char ansstr[MC_ANSWER_LEN];
 
-    comets[0].alive = 1;
+    comet_set_alive(0, 1);
     comets[0].expl = -1;
     comets[0].answer = atoi(ans_str);
     //  num_comets_alive = 1;
     comets[0].city = 0;
-    comets[0].x = cities[0].x;
-    comets[0].y = 0;
+    comet_pos.x[0] = cities[0].x;
+    comet_pos.y[0] = 0;
     comets[0].zapped = 0;
-    comets[0].bonus = 0;
+    comet_pos.bonus[0] = 0;
 
     strncpy(comets[0].flashcard.formula_string,formula_str, MC_MaxFormulaSize() );
     strncpy(comets[0].flashcard.answer_string,ans_str,MC_MaxAnswerSize() );
     if(comets[0].formula_surf) SDL_FreeSurface(comets[0].formula_surf);
     if(comets[0].answer_surf) SDL_FreeSurface(comets[0].answer_surf);
-    comets[0].formula_surf = T4K_BlackOutline(comets[0].flashcard.formula_string, comet_fontsize, &white);
-    comets[0].answer_surf = T4K_BlackOutline(comets[0].flashcard.answer_string, comet_fontsize, &white);
+    comets[0].formula_surf = glyph_text(comets[0].flashcard.formula_string, comet_fontsize, &white);
+    comets[0].answer_surf = glyph_text(comets[0].flashcard.answer_string, comet_fontsize, &white);
 }
 
 void game_set_message(game_message *msg,const char *txt,int x,int y)
@@ -1057,9 +1176,10 @@ void comets_write_message(const game_message *msg)
             else
                 rect.x = msg->x;              // left justified
             rect.y = msg->y;
-            //FIXME alpha blending doesn't seem to work properly
-            SDL_SetAlpha(surf, SDL_SRCALPHA, msg->alpha);
-            SDL_BlitSurface(surf, NULL, screen, &rect);
+            /* NOTE SDL ignores SDL_SetAlpha() for text, as it has an */
+            /* alpha channel of its own, so fade it ourselves:         */
+            blend_fade(surf, NULL, screen, &rect, msg->alpha);
+            dirty_rects_add(&rect);
             SDL_FreeSurface(surf);
         }
     }
@@ -1123,7 +1243,7 @@ void comets_handle_demo(void)
 
             if (!(comets[picked_comet].alive &&
                         comets[picked_comet].expl == -1)
-                    || comets[picked_comet].y < 80)
+                    || comet_pos.y[picked_comet] < 80)
             {
                 picked_comet = -1;
             }
@@ -1273,8 +1393,8 @@ void comets_handle_answer(void)
             laser[i].alive = LASER_START;
             laser[i].x1 = screen->w / 2;
             laser[i].y1 = screen->h;
-            laser[i].x2 = comets[index_comets].x;
-            laser[i].y2 = comets[index_comets].y;
+            laser[i].x2 = comet_pos.x[index_comets];
+            laser[i].y2 = comet_pos.y[index_comets];
             if(num_zapped == 1)
             {
                 playsound(SND_LASER);
@@ -1294,10 +1414,10 @@ void comets_handle_answer(void)
             if (Opts_UseFeedback())
             {
                 comet_feedback_number++;
-                comet_feedback_height += comets[index_comets].y/city_expl_height;
+                comet_feedback_height += comet_pos.y[index_comets]/city_expl_height;
 
 #ifdef FEEDBACK_DEBUG
-                fprintf(stderr, "Added comet feedback with height %g\n",comets[index_comets].y/city_expl_height);
+                fprintf(stderr, "Added comet feedback with height %g\n",comet_pos.y[index_comets]/city_expl_height);
 #endif
             }
 
@@ -1322,7 +1442,7 @@ void comets_handle_answer(void)
             /* [ the higher the better ] */
             /* FIXME looks like it might score a bit differently based on screen mode? */
             add_score(25 * comets[index_comets].flashcard.difficulty *
-                    (screen->h - comets[index_comets].y + 1) /
+                    (screen->h - comet_pos.y[index_comets] + 1) /
                     screen->h);
         } 
 
@@ -1334,8 +1454,8 @@ void comets_handle_answer(void)
             laser[i].alive = LASER_START;
             laser[i].x1 = screen->w / 2;
             laser[i].y1 = screen->h;
-            laser[i].x2 = powerup_comet->comet.x;
-            laser[i].y2 = powerup_comet->comet.y;
+            laser[i].x2 = powerup_comet->x;
+            laser[i].y2 = powerup_comet->y;
 
             /* Tell Mathcards or the server that we answered correctly: */
             /* NOTE - need to do this or the counter for the number of
@@ -1449,43 +1569,44 @@ void comets_handle_comets(void)
 {
     /* Handle comets. Since the comets also are the things that trigger
        changes in the cities, we set some flags in them, too. */
-    int i, this_city;
+    int i, k, this_city;
+    int live[MAX_MAX_COMETS], num_live;
+    float fall, bonus_fall;
     Uint32 ctime;
 
-    //  num_comets_alive = 0;
-
     /* Clear the threatened flag on each city */
     for (i = 0; i < NUM_CITIES; i++)
         cities[i].threatened = 0;
 
-    for (i = 0; i < MAX_MAX_COMETS; i++)
+    /* Update comet positions (no lateral motion for now!) */
+    /* Make bonus comet move faster at chosen ratio: */
+    /* NOTE y increment scaled to make game play similar at any resolution */
+    fall = FC_time_elapsed * speed *
+        city_expl_height / (480 - images[IMG_CITY_BLUE]->h);
+    bonus_fall = FC_time_elapsed * speed * Opts_BonusSpeedRatio() *
+        city_expl_height / (480 - images[IMG_CITY_BLUE]->h);
+    for (k = 0; k < comet_pos.num_live; k++)
     {
+        i = comet_pos.live[k];
+        comet_pos.y[i] += comet_pos.bonus[i] ? bonus_fall : fall;
+    }
+
+    /* (a copy of the list, as comets may finish exploding below) */
+    num_live = comet_pos.num_live;
+    memcpy(live, comet_pos.live, num_live * sizeof(int));
+    for (k = 0; k < num_live; k++)
+    {
+        i = live[k];
         if (comets[i].alive)
         {
-            //     num_comets_alive++;
             this_city = comets[i].city;
 
-            /* Update comet position */
-            comets[i].x = comets[i].x + 0; /* no lateral motion for now! */
-            /* Make bonus comet move faster at chosen ratio: */
-            /* NOTE y increment scaled to make game play similar at any resolution */
-            if (comets[i].bonus)
-            {
-                comets[i].y += FC_time_elapsed * speed * Opts_BonusSpeedRatio() *
-                    city_expl_height / (480 - images[IMG_CITY_BLUE]->h);
-            }
-            else /* Regular comet: */
-            {
-                comets[i].y += FC_time_elapsed * speed *
-                    city_expl_height / (480 - images[IMG_CITY_BLUE]->h);
-            }
-
             /* Does it threaten a city? */
-            if (comets[i].y > 3 * screen->h / 4)
+            if (comet_pos.y[i] > 3 * screen->h / 4)
                 cities[this_city].threatened = 1;
 
             /* Did it hit a city? */
-            if (comets[i].y >= city_expl_height &&
+            if (comet_pos.y[i] >= city_expl_height &&
                     comets[i].expl == -1)
                 /* Oh no - an igloo or city has been hit!        */     
             {
@@ -1547,7 +1668,7 @@ void comets_handle_comets(void)
                 }
 
                 /* If this was a bonus comet, restart the counter */
-                if (comets[i].bonus)
+                if (comet_pos.bonus[i])
                     bonus_comet_counter = Opts_BonusCometInterval()+1;
 
                 /* If slow_after_wrong selected, set flag to go back to starting speed and */
@@ -1568,7 +1689,7 @@ void comets_handle_comets(void)
             {
                 comets[i].expl++;
                 if (comets[i].expl >= sprites[IMG_COMET_EXPL]->num_frames * 2) {
-                    comets[i].alive = 0;
+                    comet_set_alive(i, 0);
                     comets[i].expl = -1;
                     if(comets[i].answer_surf)
                     {SDL_FreeSurface(comets[i].answer_surf); comets[i].answer_surf = NULL; }
@@ -1578,7 +1699,7 @@ void comets_handle_comets(void)
                         bonus_comet_counter--;
                         DEBUGMSG(debug_game, "bonus_comet_counter is now %d\n",bonus_comet_counter);
                     }
-                    if (comets[i].bonus && comets[i].zapped) {
+                    if (comet_pos.bonus[i] && comets[i].zapped) {
                         playsound(SND_EXTRA_LIFE);
                         extra_life_earned = 1;
                         DEBUGMSG(debug_game, "Extra life earned!");
@@ -1899,6 +2020,20 @@ int check_extra_life(void)
 }
 
 
+/* Remember where everything was before a step, so comets_draw() can */
+/* put it part way between there and where it is now:                */
+static void comets_save_positions(void)
+{
+    memcpy(comet_pos.prev_x, comet_pos.x, sizeof(comet_pos.x));
+    memcpy(comet_pos.prev_y, comet_pos.y, sizeof(comet_pos.y));
+    if (powerup_comet)
+    {
+        powerup_comet->prev_x = powerup_comet->x;
+        powerup_comet->prev_y = powerup_comet->y;
+    }
+}
+
+
 void comets_handle_extra_life(void)
 {
     // This handles the animation sequence during the rebuilding of an igloo
@@ -1911,6 +2046,7 @@ void comets_handle_extra_life(void)
             if (penguins[cloud.city].status == PENGUIN_WALKING_OFF) {
                 print_status();
                 pause_game();
+                dirty_rects_invalidate();
             }
         }
 
@@ -1950,31 +2086,109 @@ void comets_handle_extra_life(void)
     }
 }
 
+/* The background to draw on the screen - when drawing off-screen, */
+/* the fullscreen one scaled down to the size we are drawing at:   */
+static SDL_Surface* current_bkgd(void)
+{
+    SDL_Surface* zoomed;
+
+    if (!RT_active())
+        return screen->flags & SDL_FULLSCREEN ? scaled_bkgd : bkgd; //too clever for my brain to process
+
+    if (!scaled_bkgd || (bkgd && bkgd->w == screen->w && bkgd->h == screen->h))
+        return bkgd;
+
+    if (render_bkgd_w != screen->w || render_bkgd_h != screen->h)
+    {
+        free_render_bkgd();
+        /* Only try once for each size, even if it fails: */
+        render_bkgd_w = screen->w;
+        render_bkgd_h = screen->h;
+        zoomed = rotozoomSurfaceXY(scaled_bkgd, 0,
+                                   (double)screen->w / scaled_bkgd->w,
+                                   (double)screen->h / scaled_bkgd->h, 1);
+        if (zoomed)
+        {
+            render_bkgd = SDL_DisplayFormat(zoomed);
+            SDL_FreeSurface(zoomed);
+        }
+    }
+    return render_bkgd ? render_bkgd : bkgd;
+}
+
+
+static void free_render_bkgd(void)
+{
+    if (render_bkgd)
+    {
+        SDL_FreeSurface(render_bkgd);
+        render_bkgd = NULL;
+    }
+    render_bkgd_w = render_bkgd_h = 0;
+}
+
+
 void comets_draw(void)
 {
     SDL_Rect dest;
 
-    /* Clear screen: */
-    comets_draw_background(current_bkgd(), wave);
+    /* Clear screen - normally only where we drew last frame, but the */
+    /* whole screen if the background has changed in any way:        */
+    PROF_begin(PROF_DRAW_BKGR);
+    if (dirty_rects_full()
+            || !backdrop
+            || backdrop->w != screen->w
+            || backdrop->h != screen->h
+            || backdrop_bkgd != current_bkgd()
+            || backdrop_wave != wave)
+    {
+        comets_draw_background(current_bkgd(), wave);
+        if (backdrop)
+            SDL_FreeSurface(backdrop);
+        backdrop = SDL_DisplayFormat(screen);
+        backdrop_bkgd = current_bkgd();
+        backdrop_wave = wave;
+        dirty_rects_invalidate();
+    }
+    else
+        dirty_rects_restore(backdrop);
+    PROF_end(PROF_DRAW_BKGR);
 
     /* Draw miscellaneous informational items */
+    PROF_begin(PROF_DRAW_MISC);
     comets_draw_misc(curr_game, wave, extra_life_earned, bonus_comet_counter,
             score, total_questions_left, &help_controls);
+    PROF_end(PROF_DRAW_MISC);
 
     /* Draw cities/igloos and (if applicable) penguins: */
+    PROF_begin(PROF_DRAW_CITIES);
     comets_draw_cities(igloo_vertical_offset, &cloud, cities, penguins, steam);
+    PROF_end(PROF_DRAW_CITIES);
 
     /* Draw smart bomb icon */
+    PROF_begin(PROF_DRAW_SMARTBOMB);
     comets_draw_smartbomb(smartbomb_alive);
+    PROF_end(PROF_DRAW_SMARTBOMB);
 
     /* Draw normal comets first, then bonus comets */
-    comets_draw_comets(comets);
+    PROF_begin(PROF_DRAW_COMETS);
+    comets_draw_comets(comets, &comet_pos);
+    PROF_end(PROF_DRAW_COMETS);
 
     /* Draw powerup comet */
+    PROF_begin(PROF_DRAW_POWERUP);
     comets_draw_powerup(powerup_comet);
+    PROF_end(PROF_DRAW_POWERUP);
+
+    /* Cities, comets and so forth have only been queued up to here: */
+    PROF_begin(PROF_DRAW_SPRITES);
+    draw_list_flush();
+    PROF_end(PROF_DRAW_SPRITES);
 
     /* Draw laser: */
     int i;
+    PROF_begin(PROF_DRAW_LASERS);
+    draw_lines_begin(screen);
     for(i = 0; i < MAX_LASER; i++)
     {
         if (laser[i].alive > 0)
@@ -1985,8 +2199,11 @@ void comets_draw(void)
                     64);
         }
     }
+    draw_lines_end();
+    PROF_end(PROF_DRAW_LASERS);
 
     /* Draw numeric keypad: */
+    PROF_begin(PROF_DRAW_CONSOLE);
     if (Opts_GetGlobalOpt(USE_KEYPAD))
     {
         /* pick image to draw: */
@@ -2008,6 +2225,7 @@ void comets_draw(void)
         dest.w = images[keypad_image]->w;
         dest.h = images[keypad_image]->h;
         SDL_BlitSurface(images[keypad_image], NULL, screen, &dest);
+        dirty_rects_add(&dest);
     }
 
     /* Draw console, LED numbers, & tux: */
@@ -2020,11 +2238,20 @@ void comets_draw(void)
 #ifdef HAVE_LIBSDL_NET
     /* Display message indicating that a player left */
     if(player_left_surf != NULL && (SDL_GetTicks() - player_left_time) < 2000)
-        SDL_BlitSurface(player_left_surf, NULL, T4K_GetScreen(), &player_left_pos);
+    {
+        dest = player_left_pos;
+        SDL_BlitSurface(player_left_surf, NULL, RT_surface(), &dest);
+        dirty_rects_add(&dest);
+    }
 #endif
+    PROF_end(PROF_DRAW_CONSOLE);
 
-    /* Swap buffers: */
-    SDL_Flip(screen);
+    PROF_draw_overlay();
+
+    /* Show what changed: */
+    PROF_begin(PROF_FLIP);
+    dirty_rects_update();
+    PROF_end(PROF_FLIP);
 }
 
 
@@ -2545,10 +2772,11 @@ void reset_level(void)
         SDL_FreeSurface(scaled_bkgd);
         scaled_bkgd = NULL;
     }
+    free_render_bkgd();
 
     if (Opts_UseBkgd())
     {
-        T4K_LoadBothBkgds(fname, &scaled_bkgd, &bkgd);
+        load_both_bkgds(fname, &scaled_bkgd, &bkgd);
         if (bkgd == NULL || scaled_bkgd == NULL)
         {
             fprintf(stderr,
@@ -2696,11 +2924,11 @@ int add_comet(void)
     for (i = 0; i < MAX_MAX_COMETS; i++)
     {
         if (comets[i].alive)
-            if (comets[i].y < y_spacing)
+            if (comet_pos.y[i] < y_spacing)
             {
                 DEBUGMSG(debug_game,
                         "add_comet() - returning because comet[%d] not"
-                        " far enough down: %f\n", i, comets[i].y);
+                        " far enough down: %f\n", i, comet_pos.y[i]);
                 return 0;
             }
     }  
@@ -2747,11 +2975,11 @@ int add_comet(void)
 
     /* If we make it to here, create a new comet!*/
     comets[com_found].answer = comets[com_found].flashcard.answer;
-    comets[com_found].alive = 1;
+    comet_set_alive(com_found, 1);
     if(comets[com_found].formula_surf) SDL_FreeSurface(comets[com_found].formula_surf);
     if(comets[com_found].answer_surf) SDL_FreeSurface(comets[com_found].answer_surf);
-    comets[com_found].formula_surf = T4K_BlackOutline(comets[com_found].flashcard.formula_string, comet_fontsize, &white);
-    comets[com_found].answer_surf = T4K_BlackOutline(comets[com_found].flashcard.answer_string, comet_fontsize, &white);
+    comets[com_found].formula_surf = glyph_text(comets[com_found].flashcard.formula_string, comet_fontsize, &white);
+    comets[com_found].answer_surf = glyph_text(comets[com_found].flashcard.answer_string, comet_fontsize, &white);
     //  num_comets_alive++;
 
     /* Pick a city to attack that was not attacked last time */
@@ -2767,18 +2995,18 @@ int add_comet(void)
     /* Set in to attack that city: */
     comets[com_found].city = i;
     /* Start at the top, above the city in question: */
-    comets[com_found].x = cities[i].x;
-    comets[com_found].y = 0;
+    comet_pos.x[com_found] = comet_pos.prev_x[com_found] = cities[i].x;
+    comet_pos.y[com_found] = comet_pos.prev_y[com_found] = 0;
     comets[com_found].zapped = 0;
     /* Should it be a bonus comet? */
-    comets[com_found].bonus = 0;
+    comet_pos.bonus[com_found] = 0;
 
     DEBUGMSG(debug_game, "bonus_comet_counter is %d\n",bonus_comet_counter);
 
     if (bonus_comet_counter == 1)
     {
         bonus_comet_counter = 0;
-        comets[com_found].bonus = 1;
+        comet_pos.bonus[com_found] = 1;
         playsound(SND_BONUS_COMET);
         DEBUGMSG(debug_game, "Created bonus comet");
     }
@@ -2815,6 +3043,10 @@ void comets_mouse_event(SDL_Event event)
     keypad_w = 0;
     keypad_h = 0;
 
+    /* The click is in display pixels, but we may be drawing smaller: */
+    event.button.x /= RT_scale();
+    event.button.y /= RT_scale();
+
     /* Check to see if user clicked exit button: */
     /* The exit button is in the upper right corner of the screen: */
     if(event.button.button == SDL_BUTTON_LEFT &&
@@ -3187,16 +3419,14 @@ void reset_comets(void)
 {
     int i = 0;
 
+    memset(&comet_pos, 0, sizeof(comet_pos));
     for (i = 0; i < MAX_MAX_COMETS; i++)
     {
-        comets[i].alive = 0;
+        comet_set_alive(i, 0);
         comets[i].expl = -1;
         comets[i].city = 0;
-        comets[i].x = 0;
-        comets[i].y = 0;
         comets[i].answer = 0;
         MC_ResetFlashCard(&(comets[i].flashcard));
-        comets[i].bonus = 0;
         if(comets[i].formula_surf) SDL_FreeSurface(comets[i].formula_surf);
         comets[i].formula_surf = NULL;
         if(comets[i].answer_surf) SDL_FreeSurface(comets[i].answer_surf);
@@ -3291,6 +3521,7 @@ void free_on_exit(void)
         SDL_FreeSurface(scaled_bkgd);
         scaled_bkgd = NULL;
     }
+    free_render_bkgd();
 
 #ifdef HAVE_LIBSDL_NET  
     if(player_left_surf)
@@ -3303,6 +3534,55 @@ void free_on_exit(void)
     DEBUGMSG(debug_game,"Leave free_on_exit\n");
 }
 
+/* The scale to draw at - what the "render_scale" option asks for, */
+/* or what the quality governor does if that is smaller still:      */
+static int comets_render_scale(void)
+{
+    int scale = Opts_RenderScale() > 0 ? Opts_RenderScale() : RT_auto_scale();
+
+    return scale > QG_render_scale() ? scale : QG_render_scale();
+}
+
+
+/* Draw on a surface of our own at a fraction of the screen's size  */
+/* (on), or go back to drawing on the screen, and move everything to */
+/* fit.  Nothing is done if the scale is the same as before:        */
+static void comets_render_target(int on)
+{
+    int scale = on ? comets_render_scale() : 1;
+
+    if (scale == render_scale)
+        return;
+    render_scale = scale;
+    if (scale > 1)
+        screen = RT_begin(scale, Opts_RenderSmooth());
+    else
+    {
+        RT_end();
+        screen = T4K_GetScreen();
+    }
+
+    dirty_rects_invalidate();
+    comets_recalc_positions(screen->w, screen->h);
+}
+
+
+/* Called by t4k_common when the screen changes size - if we are */
+/* drawing off-screen, that has to change size along with it:    */
+static void comets_resolution_switch(int xres, int yres)
+{
+    if (render_scale > 1)
+    {
+        render_scale = comets_render_scale();
+        screen = RT_begin(render_scale, Opts_RenderSmooth());
+        xres = screen->w;
+        yres = screen->h;
+        dirty_rects_invalidate();
+    }
+    comets_recalc_positions(xres, yres);
+}
+
+
 /* Recalculate on-screen city & comet locations when screen dimensions change */
 void comets_recalc_positions(int xres, int yres)
 {
@@ -3342,6 +3622,8 @@ void comets_recalc_positions(int xres, int yres)
 
     city_expl_height = yres - images[IMG_CITY_BLUE]->h;
     comet_fontsize = (int)(BASE_COMET_FONTSIZE * get_scale());
+    /* Cached labels were rendered for the old size: */
+    comets_free_text_cache();
 
     for (i = 0; i < MAX_MAX_COMETS; ++i)
     {
@@ -3350,30 +3632,55 @@ void comets_recalc_positions(int xres, int yres)
 
         //move comets to a location 'equivalent' to where they were
         //i.e. with the same amount of time left before impact
-        comets[i].x = cities[comets[i].city].x;
-        comets[i].y = comets[i].y * city_expl_height / old_city_expl_height;
+        comet_pos.x[i] = cities[comets[i].city].x;
+        comet_pos.y[i] = comet_pos.y[i] * city_expl_height / old_city_expl_height;
+        comet_pos.prev_x[i] = comet_pos.x[i];
+        comet_pos.prev_y[i] = comet_pos.y[i];
         //  Re-render the numbers of any living comets at the new resolution:
         if(comets[i].formula_surf != NULL)  //for safety, but shouldn't occur if comet is alive
         {
             SDL_FreeSurface(comets[i].formula_surf);
-            comets[i].formula_surf = T4K_BlackOutline(comets[i].flashcard.formula_string, comet_fontsize, &white);
+            comets[i].formula_surf = glyph_text(comets[i].flashcard.formula_string, comet_fontsize, &white);
         }
         if(comets[i].answer_surf != NULL)
         {
             SDL_FreeSurface(comets[i].answer_surf);
-            comets[i].answer_surf = T4K_BlackOutline(comets[i].flashcard.answer_string, comet_fontsize, &white);
+            comets[i].answer_surf = glyph_text(comets[i].flashcard.answer_string, comet_fontsize, &white);
         }
     }
 }
 
 static int num_comets_alive()
 {
-    int i = 0;
-    int living = 0;
-    for(i = 0; i < MAX_MAX_COMETS; i++)
-        if(comets[i].alive)
-            living++;
-    return living;
+    return comet_pos.num_live;
+}
+
+
+/* Set comets[i].alive, keeping comet_pos.live[] in slot order, so going */
+/* through it is like going through the slots and skipping dead ones:   */
+static void comet_set_alive(int i, int alive)
+{
+    int* live = comet_pos.live;
+    int k;
+
+    comets[i].alive = alive;
+    for (k = 0; k < comet_pos.num_live && live[k] < i; k++)
+        ;
+    if (alive)
+    {
+        if (k < comet_pos.num_live && live[k] == i)
+            return;
+        memmove(&live[k + 1], &live[k], (comet_pos.num_live - k) * sizeof(int));
+        live[k] = i;
+        comet_pos.num_live++;
+    }
+    else
+    {
+        if (k == comet_pos.num_live || live[k] != i)
+            return;
+        memmove(&live[k], &live[k + 1], (comet_pos.num_live - k - 1) * sizeof(int));
+        comet_pos.num_live--;
+    }
 }
 
 
@@ -3397,8 +3704,8 @@ int powerup_initialize(void)
 
     powerup_comet->comet.alive = 0;
     powerup_comet->comet.expl = -1;
-    powerup_comet->comet.x = 0;
-    powerup_comet->comet.y = 0;
+    powerup_comet->x = 0;
+    powerup_comet->y = 0;
     powerup_comet->comet.zapped = 0;
     powerup_comet->comet.answer = 0;
     powerup_comet->comet.formula_surf = NULL;
@@ -3463,26 +3770,29 @@ int powerup_add_comet(void)
         SDL_FreeSurface(powerup_comet->comet.formula_surf);
     if(powerup_comet->comet.answer_surf)
         SDL_FreeSurface(powerup_comet->comet.answer_surf);
-    powerup_comet->comet.formula_surf = T4K_BlackOutline(powerup_comet->comet.flashcard.formula_string, comet_fontsize, &white);
-    powerup_comet->comet.answer_surf = T4K_BlackOutline(powerup_comet->comet.flashcard.answer_string, comet_fontsize, &white);
+    powerup_comet->comet.formula_surf = glyph_text(powerup_comet->comet.flashcard.formula_string, comet_fontsize, &white);
+    powerup_comet->comet.answer_surf = glyph_text(powerup_comet->comet.flashcard.answer_string, comet_fontsize, &white);
 
     /* Set the direction */
     /* Only two direction, left or right */
     powerup_comet->direction = rand()%2;
 
     /* Set the initial coordinates */
-    powerup_comet->comet.y = POWERUP_Y_POS;
+    powerup_comet->y = POWERUP_Y_POS;
     if(powerup_comet->direction == POWERUP_DIR_LEFT)
     {
-        powerup_comet->comet.x = screen->w; 
+        powerup_comet->x = screen->w; 
         powerup_comet->inc_speed = -MS_POWERUP_SPEED;
     }
     else
     {
-        powerup_comet->comet.x = 0; 
+        powerup_comet->x = 0; 
         powerup_comet->inc_speed = MS_POWERUP_SPEED;
     }
 
+    powerup_comet->prev_x = powerup_comet->x;
+    powerup_comet->prev_y = powerup_comet->y;
+
     powerup_comet->comet.time_started = SDL_GetTicks();
 
     DEBUGMSG( debug_game, "Leave powerup_add_comet()\n");
@@ -3498,7 +3808,7 @@ void comets_handle_powerup(void)
     if(!powerup_comet->comet.alive)
         return;
 
-    powerup_comet->comet.x += powerup_comet->inc_speed*FC_time_elapsed*screen->w/640;
+    powerup_comet->x += powerup_comet->inc_speed*FC_time_elapsed*screen->w/640;
 
     if(powerup_comet->comet.expl >= 0)
     {
@@ -3531,7 +3841,7 @@ void comets_handle_powerup(void)
         switch(powerup_comet->direction)
         {
             case POWERUP_DIR_LEFT:
-                if(powerup_comet->comet.x <= 0)
+                if(powerup_comet->x <= 0)
                 {
                     powerup_comet->comet.alive = 0;
                     powerup_comet_running = 0;
@@ -3539,7 +3849,7 @@ void comets_handle_powerup(void)
                 break;
 
             case POWERUP_DIR_RIGHT:
-                if(powerup_comet->comet.x >= screen->w)
+                if(powerup_comet->x >= screen->w)
                 {
                     powerup_comet->comet.alive = 0; 
                     powerup_comet_running = 0;
@@ -3587,13 +3897,53 @@ void comets_handle_net_messages(void)
                 break;
             case -1:  //Error in networking or server:
                 done = 1;
-                network_error = 1;
+                /* If the server gave us a session token we can try */
+                /* to get back in, otherwise the game is over:       */
+                if(LAN_CanResume())
+                {
+                    if(!lan_lost_time)
+                        lan_lost_time = SDL_GetTicks();
+                    lan_resume_sent = 0;
+                }
+                else
+                    network_error = 1;
+                break;
             default:
                 {}
         }
         //"empty" buffer before next time through:
         buf[0] = '\0';
     }
+
+    lan_check_resume();
+}
+
+
+/* Keep trying to reconnect after a dropped connection until the    */
+/* server sends us a GAME_SNAPSHOT or we run out of time.  The game  */
+/* carries on meanwhile, but answers can't reach the server:         */
+void lan_check_resume(void)
+{
+    Uint32 now;
+
+    if(!lan_lost_time)
+        return;
+
+    now = SDL_GetTicks();
+    if(now - lan_lost_time > LAN_RESUME_TIMEOUT)
+    {
+        DEBUGMSG(debug_game|debug_lan, "lan_check_resume() - giving up on server\n");
+        lan_lost_time = 0;
+        network_error = 1;
+        return;
+    }
+
+    if(!lan_resume_sent && (now - lan_last_attempt > LAN_RECONNECT_INTERVAL))
+    {
+        lan_last_attempt = now;
+        lan_resume_sent = LAN_Reconnect();
+        DEBUGMSG(debug_game|debug_lan, "lan_check_resume() - LAN_Reconnect() returned %d\n", lan_resume_sent);
+    }
 }
 
 
@@ -3614,6 +3964,12 @@ void comets_handle_net_msg(char* buf)
             DEBUGCODE(debug_game|debug_lan) print_current_quests();
     }
 
+    else if(strncmp(buf, "PREFETCH_QUESTION", strlen("PREFETCH_QUESTION")) == 0)
+    {
+        if(!prefetch_quest_recvd(buf))
+            fprintf(stderr, "PREFETCH_QUESTION received but could not queue question\n");
+    }
+
     else if(strncmp(buf, "REMOVE_QUESTION", strlen("REMOVE_QUESTION")) == 0)
     {
         if(!remove_quest_recvd(buf)) //remove the question with id in buf
@@ -3637,6 +3993,18 @@ void comets_handle_net_msg(char* buf)
         wave_recvd(buf);
     }
 
+    else if(strncmp(buf, "GAME_SNAPSHOT", strlen("GAME_SNAPSHOT")) == 0)
+    {
+        game_snapshot_recvd(buf);
+    }
+
+    else if(strncmp(buf, "GAME_IN_PROGRESS", strlen("GAME_IN_PROGRESS")) == 0)
+    {
+        /* Server would not let us resume: */
+        lan_lost_time = 0;
+        network_error = 1;
+    }
+
     else if(strncmp(buf, "MISSION_ACCOMPLISHED", strlen("MISSION_ACCOMPLISHED")) == 0)
     {
         game_over_won = 1;
@@ -3698,8 +4066,97 @@ int add_quest_recvd(char* buf)
 }
 
 
+/* Receive a question the server has sent ahead of its spawn time.    */
+/* The message is "PREFETCH_QUESTION\t<delay>\t" followed by the same */
+/* fields as ADD_QUESTION.  We hold the card until <delay> msec have  */
+/* passed and launch_pending_quests() turns it into a comet:          */
+int prefetch_quest_recvd(char* buf)
+{
+    MC_FlashCard fc;
+    char* p = NULL;
+    int delay = 0;
+    int i;
+
+    DEBUGMSG(debug_game|debug_lan, "Enter prefetch_quest_recvd(), buf is: %s\n", buf);
+
+    if(!buf)
+    {
+        fprintf(stderr, "NULL buf\n");
+        return 0;
+    }
+
+    p = strchr(buf, '\t');
+    if(!p)
+        return 0;
+    p++;
+    delay = atoi(p);
+
+    /* MC_MakeFlashcard() skips the first field, so starting at the  */
+    /* delay field gives it exactly the layout of ADD_QUESTION:       */
+    if(!MC_MakeFlashcard(p, &fc))
+    {
+        fprintf(stderr, "Unable to parse buffer into FlashCard\n");
+        return 0;
+    }
+
+    for(i = 0; i < QUEST_QUEUE_SIZE; i++)
+    {
+        if(!pending_quests[i].pending)
+        {
+            MC_CopyCard(&fc, &(pending_quests[i].fc));
+            pending_quests[i].spawn_time = SDL_GetTicks() + (delay > 0 ? delay : 0);
+            pending_quests[i].pending = 1;
+            return 1;
+        }
+    }
+
+    /* Queue full (should not happen) - launch it right away instead: */
+    DEBUGMSG(debug_game|debug_lan, "prefetch_quest_recvd() - pending queue full, adding now\n");
+    if(lan_add_comet(&fc))
+    {
+        if(num_attackers > 0)
+            num_attackers--;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Turn prefetched questions into comets once their spawn time arrives: */
+void launch_pending_quests(void)
+{
+    Uint32 now = SDL_GetTicks();
+    int i;
+
+    for(i = 0; i < QUEST_QUEUE_SIZE; i++)
+    {
+        if(!pending_quests[i].pending)
+            continue;
+        if((Sint32)(now - pending_quests[i].spawn_time) < 0)
+            continue;
+
+        /* If no comet slot is free, try again next frame: */
+        if(!lan_add_comet(&(pending_quests[i].fc)))
+            continue;
+        if(num_attackers > 0)
+            num_attackers--;
+        pending_quests[i].pending = 0;
+        DEBUGCODE(debug_game|debug_lan) print_current_quests();
+    }
+}
+
+
+void reset_pending_quests(void)
+{
+    int i;
+    for(i = 0; i < QUEST_QUEUE_SIZE; i++)
+        pending_quests[i].pending = 0;
+}
+
+
 /* Add a comet to a lan game: Note that in the lan game, the comets are added
- * immediately when a new question comes in.  It is up to the server to time
+ * immediately when a new question comes in (or, for prefetched questions,
+ * when their scheduled time arrives).  It is up to the server to time
  * them appropriately - DSB.  */
 int lan_add_comet(MC_FlashCard* fc)
 { 
@@ -3751,11 +4208,11 @@ int lan_add_comet(MC_FlashCard* fc)
     /* If we make it to here, create a new comet!*/
     MC_CopyCard(fc, &(comets[com_found].flashcard));
     comets[com_found].answer = fc->answer;
-    comets[com_found].alive = 1;
+    comet_set_alive(com_found, 1);
     if(comets[com_found].formula_surf) SDL_FreeSurface(comets[com_found].formula_surf);
     if(comets[com_found].answer_surf) SDL_FreeSurface(comets[com_found].answer_surf);
-    comets[com_found].formula_surf = T4K_BlackOutline(comets[com_found].flashcard.formula_string, comet_fontsize, &white);
-    comets[com_found].answer_surf = T4K_BlackOutline(comets[com_found].flashcard.answer_string, comet_fontsize, &white);
+    comets[com_found].formula_surf = glyph_text(comets[com_found].flashcard.formula_string, comet_fontsize, &white);
+    comets[com_found].answer_surf = glyph_text(comets[com_found].flashcard.answer_string, comet_fontsize, &white);
     //  num_comets_alive++;
 
     /* Pick a city to attack that was not attacked last time */
@@ -3771,11 +4228,11 @@ int lan_add_comet(MC_FlashCard* fc)
     /* Set in to attack that city: */
     comets[com_found].city = i;
     /* Start at the top, above the city in question: */
-    comets[com_found].x = cities[i].x;
-    comets[com_found].y = 0;
+    comet_pos.x[com_found] = comet_pos.prev_x[com_found] = cities[i].x;
+    comet_pos.y[com_found] = comet_pos.prev_y[com_found] = 0;
     comets[com_found].zapped = 0;
     /* Should it be a bonus comet? */
-    comets[com_found].bonus = 0;
+    comet_pos.bonus[com_found] = 0;
 
     /* Record the time at which this comet was created */
     comets[com_found].time_started = SDL_GetTicks();
@@ -3788,7 +4245,7 @@ int lan_add_comet(MC_FlashCard* fc)
     if (bonus_comet_counter == 1)
     {
         bonus_comet_counter = 0;
-        //    comets[com_found].bonus = 1;
+        //    comet_pos.bonus[com_found] = 1;
         //    playsound(SND_BONUS_COMET);
         //    DEBUGMSG(debug_game|debug_lan, "Created bonus comet");
     }
@@ -3861,6 +4318,21 @@ int remove_quest_recvd(char* buf)
         return 0;
     }
 
+    /* It may not have been launched yet - if so, just drop it: */
+    {
+        int i;
+        for(i = 0; i < QUEST_QUEUE_SIZE; i++)
+        {
+            if(pending_quests[i].pending
+                    && pending_quests[i].fc.question_id == id)
+            {
+                DEBUGMSG(debug_game|debug_lan, "remove_quest_recvd() - dropping pending question id = %d\n", id);
+                pending_quests[i].pending = 0;
+                return 1;
+            }
+        }
+    }
+
     zapped_comet = search_comets_by_id(id);
     if(!zapped_comet)
     {
@@ -3905,6 +4377,42 @@ int wave_recvd(char* buf)
 }
 
 
+/* We have rejoined a game after a dropped connection.  The message  */
+/* gives the wave, questions left, and how many questions are in play */
+/* - those follow as PREFETCH_QUESTION messages, so we clear out what  */
+/* we had and let them replace it:                                    */
+int game_snapshot_recvd(char* buf)
+{
+    int snap_wave = 0;
+    int snap_left = 0;
+    int snap_active = 0;
+
+    if(!buf)
+        return 0;
+
+    if(sscanf(buf, "%*s %d %d %d", &snap_wave, &snap_left, &snap_active) != 3)
+    {
+        DEBUGMSG(debug_game|debug_lan, "game_snapshot_recvd() - could not parse: %s\n", buf);
+        return 0;
+    }
+
+    DEBUGMSG(debug_game|debug_lan, "game_snapshot_recvd() - wave %d, %d left, %d active\n",
+            snap_wave, snap_left, snap_active);
+
+    lan_lost_time = 0;
+    lan_resume_sent = 0;
+
+    if(snap_wave != wave)
+        reset_level();
+    wave = snap_wave;
+    total_questions_left = snap_left;
+
+    reset_comets();
+    reset_pending_quests();
+    return 1;
+}
+
+
 int player_left_recvd(char* buf)
 {
     char _tmpbuf[512];
@@ -3921,7 +4429,7 @@ int player_left_recvd(char* buf)
         SDL_FreeSurface(player_left_surf);
     player_left_surf = T4K_BlackOutline( _tmpbuf, fontsize, &white);
     player_left_time = SDL_GetTicks();
-    player_left_pos.y = T4K_GetScreen()->h - player_left_surf->h;
+    player_left_pos.y = RT_surface()->h - player_left_surf->h;
     return 1;
 }
 
@@ -4117,7 +4625,7 @@ int tts_announcer(void *unused)
 			{
 				for (i = 0; i < 3; i++){
 					for(j = 0; j < 3; j++){
-						if (comets[order[j]].y < comets[order[j+1]].y){
+						if (comet_pos.y[order[j]] < comet_pos.y[order[j+1]]){
 							y_axis = order[j+1];
 							order[j+1] = order[j];
 							order[j] = y_axis;
@@ -4135,7 +4643,7 @@ int tts_announcer(void *unused)
 					//Announce if comet is alive
 					if (comets[order[i]].alive)
 					{
-						rate = (int)(comets[order[i]].y*100)/(screen->h - igloo_vertical_offset - images[IMG_IGLOO_INTACT]->h);
+						rate = (int)(comet_pos.y[order[i]]*100)/(screen->h - igloo_vertical_offset - images[IMG_IGLOO_INTACT]->h);
 						if (rate < 30)
 							rate = 30;
 						else if (rate > 70)
@@ -3,6 +3,7 @@
 
 #include <SDL_video.h>
 
+#include "globals.h"
 #include "mathcards.h"
 
 #define MAX_COMETS 10
@@ -128,9 +129,7 @@ typedef struct comet_type {
     int alive;
     int expl;
     int city;
-    float x, y;
     int answer;
-    int bonus;
     int zapped;
     MC_FlashCard flashcard;
     SDL_Surface* formula_surf;
@@ -138,8 +137,19 @@ typedef struct comet_type {
     Uint32 time_started;
 } comet_type;
 
+/* Positions of comets[i], split out so each step skips the flashcards: */
+typedef struct comet_positions {
+    float x[MAX_MAX_COMETS], y[MAX_MAX_COMETS];
+    float prev_x[MAX_MAX_COMETS], prev_y[MAX_MAX_COMETS];  /* before the last step, for drawing */
+    int bonus[MAX_MAX_COMETS];
+    int live[MAX_MAX_COMETS];
+    int num_live;
+} comet_positions;
+
 typedef struct powerup_comet_type {
     comet_type comet;
+    float x, y;
+    float prev_x, prev_y;
     PowerUp_Direction direction;
     PowerUp_Type type;
     int inc_speed;
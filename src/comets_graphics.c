@@ -1,11 +1,29 @@
 #include "comets_graphics.h"
 
+#include "blend.h"
+#include "draw_utils.h"
 #include "fileops.h"
 #include "frame_counter.h"
 #include "globals.h"
 #include "options.h"
 #include "multiplayer.h"
 #include "tuxmath.h"
+#include "quality.h"
+#include "render_target.h"
+
+
+/* Player score lines only change when someone scores, so we keep */
+/* them rendered rather than going to FreeType every frame:       */
+#define NUM_SCORE_LINES MAX_CLIENTS
+
+static char score_line_str[NUM_SCORE_LINES][64];
+static SDL_Color* score_line_col[NUM_SCORE_LINES];
+static int score_line_size[NUM_SCORE_LINES];
+static SDL_Surface* score_line_surf[NUM_SCORE_LINES];
+static SDL_Surface* smartbomb_label = NULL;
+
+static SDL_Surface* score_line(int line, const char* str, int fontsize, SDL_Color* col);
+static float step_pos(float prev, float cur);
 
 
 void comets_draw_background(SDL_Surface *bkgd, int wave)
@@ -34,38 +52,41 @@ void comets_draw_background(SDL_Surface *bkgd, int wave)
         dest.w = screen->w;
         dest.h = ((screen->h) / 4) * 3;
 
-        SDL_FillRect(screen, &dest, bgcolor);
+        blend_fill(screen, &dest, bgcolor);
 
 
         dest.y = ((screen->h) / 4) * 3;
         dest.h = (screen->h) / 4;
 
-        SDL_FillRect(screen, &dest, fgcolor);
+        blend_fill(screen, &dest, fgcolor);
     }
 
     if (bkgd)
     {
         dest.x = (screen->w - bkgd->w) / 2;
         dest.y = (screen->h - bkgd->h) / 2;
-        SDL_BlitSurface(bkgd, NULL, screen, &dest);
+        blend_blit(bkgd, NULL, screen, &dest);
     }
 }
 
 /* Draw comets: */
 /* NOTE bonus comets split into separate pass to make them */
 /* draw last (i.e. in front), as they can overlap          */
-void comets_draw_comets(const comet_type *comets)
+/* NOTE comets, like cities and the powerup comet, go on   */
+/* the draw list - see draw_list_flush() in comets_draw()  */
+void comets_draw_comets(const comet_type *comets, const comet_positions *pos)
 {
 
-    int i;
+    int i, k, x, y;
     bool answered, num_draw;
     SDL_Surface* img = NULL;
     SDL_Rect dest;
 
     /* First draw regular comets: */
-    for (i = 0; i < MAX_MAX_COMETS; i++)
+    for (k = 0; k < pos->num_live; k++)
     {
-        if (comets[i].alive && !comets[i].bonus)
+        i = pos->live[k];
+        if (comets[i].alive && !pos->bonus[i])
         {
             if (comets[i].expl == -1)
             {
@@ -74,7 +95,7 @@ void comets_draw_comets(const comet_type *comets)
                 img = sprites[IMG_COMET]->frame[(FC_sprite_counter + i) % sprites[IMG_COMET]->num_frames];
                 /* Display the formula (flashing, in the bottom half
                    of the screen) */
-                if (comets[i].y < screen->h / 2 || FC_sprite_counter % 8 < 6)
+                if (pos->y[i] < screen->h / 2 || FC_sprite_counter % 8 < 6)
                     num_draw = 1;
                 else
                     num_draw = 0;
@@ -88,23 +109,26 @@ void comets_draw_comets(const comet_type *comets)
             }
 
             /* Draw it! */
-            dest.x = comets[i].x - (img->w / 2);
-            dest.y = comets[i].y - img->h;
+            x = step_pos(pos->prev_x[i], pos->x[i]);
+            y = step_pos(pos->prev_y[i], pos->y[i]);
+            dest.x = x - (img->w / 2);
+            dest.y = y - img->h;
             dest.w = img->w;
             dest.h = img->h;
-            SDL_BlitSurface(img, NULL, screen, &dest);
+            draw_list_add(img, NULL, &dest, COMETS_LAYER_COMETS);
 
             if (num_draw)
             {
-                comets_draw_comet_nums(&comets[i], answered, &white);
+                comets_draw_comet_nums(&comets[i], x, y, answered, &white);
             }
         }
     }
 
     /* Now draw any bonus comets: */
-    for (i = 0; i < MAX_MAX_COMETS; i++)
+    for (k = 0; k < pos->num_live; k++)
     {
-        if (comets[i].alive && comets[i].bonus)
+        i = pos->live[k];
+        if (comets[i].alive && pos->bonus[i])
         {
             if (comets[i].expl == -1)
             {
@@ -113,7 +137,7 @@ void comets_draw_comets(const comet_type *comets)
                 img = sprites[IMG_BONUS_COMET]->frame[(FC_sprite_counter + i) % sprites[IMG_BONUS_COMET]->num_frames];
                 /* Display the formula (flashing, in the bottom half
                    of the screen) */
-                if (comets[i].y < screen->h / 2 || FC_sprite_counter % 8 < 6)
+                if (pos->y[i] < screen->h / 2 || FC_sprite_counter % 8 < 6)
                     num_draw = 1;
                 else
                     num_draw = 0;
@@ -126,13 +150,15 @@ void comets_draw_comets(const comet_type *comets)
             }
 
             /* Draw it! */
-            dest.x = comets[i].x - (img->w / 2);
-            dest.y = comets[i].y - img->h;
+            x = step_pos(pos->prev_x[i], pos->x[i]);
+            y = step_pos(pos->prev_y[i], pos->y[i]);
+            dest.x = x - (img->w / 2);
+            dest.y = y - img->h;
             dest.w = img->w;
             dest.h = img->h;
-            SDL_BlitSurface(img, NULL, screen, &dest);
+            draw_list_add(img, NULL, &dest, COMETS_LAYER_BONUS_COMETS);
             if (num_draw)
-                comets_draw_comet_nums(&comets[i], answered, &white);
+                comets_draw_comet_nums(&comets[i], x, y, answered, &white);
         }
     }
 }
@@ -175,7 +201,8 @@ void comets_draw_cities(int igloo_vertical_offset,
                         dest.y -= (images[IMG_IGLOO_MELTED1]->h - this_image->h)/2;
                     dest.w = (this_image->w);
                     dest.h = (this_image->h);
-                    SDL_BlitSurface(this_image, NULL, screen, &dest);
+                    draw_list_add(this_image, NULL, &dest,
+                            COMETS_LAYER_CITIES + 4 * current_layer);
                 }
                 if (penguins[i].layer == current_layer &&
                         penguins[i].status != PENGUIN_OFFSCREEN) {
@@ -205,7 +232,8 @@ void comets_draw_cities(int igloo_vertical_offset,
                     }
                     dest.w = (this_image->w);
                     dest.h = (this_image->h);
-                    SDL_BlitSurface(this_image, NULL, screen, &dest);
+                    draw_list_add(this_image, NULL, &dest,
+                            COMETS_LAYER_CITIES + 4 * current_layer + 1);
                 }
                 if (steam[i].layer == current_layer &&
                         steam[i].status == STEAM_ON) {
@@ -214,14 +242,15 @@ void comets_draw_cities(int igloo_vertical_offset,
                     dest.y = (screen->h) - this_image->h - ((4 * images[IMG_IGLOO_INTACT]->h) / 7);
                     dest.w = (this_image->w);
                     dest.h = (this_image->h);
-                    SDL_BlitSurface(this_image, NULL, screen, &dest);
+                    draw_list_add(this_image, NULL, &dest,
+                            COMETS_LAYER_CITIES + 4 * current_layer + 2);
                 }
             }
             current_layer++;
         } while (current_layer <= max_layer);
         if (cloud->status == EXTRA_LIFE_ON) {
-            /* Render cloud & snowflakes */
-            for (i = 0; i < NUM_SNOWFLAKES; i++) {
+            /* Render cloud & snowflakes (fewer if the game is slow) */
+            for (i = 0; i < NUM_SNOWFLAKES; i += QG_snowflake_step()) {
                 if (cloud->snowflake_y[i] > cloud->y &&
                         cloud->snowflake_y[i] < screen->h - igloo_vertical_offset) {
                     this_image = images[IMG_SNOW1+cloud->snowflake_size[i]];
@@ -229,7 +258,7 @@ void comets_draw_cities(int igloo_vertical_offset,
                     dest.y = cloud->snowflake_y[i] - this_image->h/2;
                     dest.w = this_image->w;
                     dest.h = this_image->h;
-                    SDL_BlitSurface(this_image, NULL, screen, &dest);
+                    draw_list_add(this_image, NULL, &dest, COMETS_LAYER_SNOW);
                 }
             }
             this_image = images[IMG_CLOUD];
@@ -237,7 +266,7 @@ void comets_draw_cities(int igloo_vertical_offset,
             dest.y = cloud->y - this_image->h/2;
             dest.w = this_image->w;
             dest.h = this_image->h;
-            SDL_BlitSurface(this_image, NULL, screen, &dest);
+            draw_list_add(this_image, NULL, &dest, COMETS_LAYER_CLOUD);
         }
     }
     else {
@@ -249,7 +278,7 @@ void comets_draw_cities(int igloo_vertical_offset,
             dest.y = (screen->h) - (this_image->h);
             dest.w = (this_image->w);
             dest.h = (this_image->h);
-            SDL_BlitSurface(this_image, NULL, screen, &dest);
+            draw_list_add(this_image, NULL, &dest, COMETS_LAYER_CITIES);
 
             /* Draw sheilds: */
             if (cities[i].hits_left > 1) {
@@ -264,7 +293,7 @@ void comets_draw_cities(int igloo_vertical_offset,
                     dest.w = src.w;
                     dest.h = src.h;
 
-                    SDL_BlitSurface(images[IMG_SHIELDS], &src, screen, &dest);
+                    draw_list_add(images[IMG_SHIELDS], &src, &dest, COMETS_LAYER_CITIES + 1);
                 }
             }
         }
@@ -292,7 +321,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         dest.w = images[IMG_DEMO]->w;
         dest.h = images[IMG_DEMO]->h;
 
-        SDL_BlitSurface(images[IMG_DEMO], NULL, screen, &dest);
+        blend_blit(images[IMG_DEMO], NULL, screen, &dest);
+        dirty_rects_add(&dest);
     }
 
     /* If we are playing through a defined list of questions */
@@ -308,7 +338,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         dest.y = 0;
         dest.w = images[IMG_EXTRA_LIFE]->w;
         dest.h = images[IMG_EXTRA_LIFE]->h;
-        SDL_BlitSurface(images[IMG_EXTRA_LIFE], NULL, screen, &dest);
+        blend_blit(images[IMG_EXTRA_LIFE], NULL, screen, &dest);
+        dirty_rects_add(&dest);
     } else if (bonus_comet_counter) {
         /* Draw extra life progress bar */
         dest.x = 0;
@@ -316,7 +347,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         dest.h = images[IMG_EXTRA_LIFE]->h/2;
         dest.w = ((Opts_BonusCometInterval() + 1 - bonus_comet_counter)
                 * images[IMG_EXTRA_LIFE]->w) / Opts_BonusCometInterval();
-        SDL_FillRect(screen, &dest, SDL_MapRGB(screen->format, 0, 255, 0));
+        blend_fill(screen, &dest, SDL_MapRGB(screen->format, 0, 255, 0));
+        dirty_rects_add(&dest);
     }
 
     /* Draw wave: */
@@ -330,7 +362,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
     dest.w = images[IMG_WAVE]->w;
     dest.h = images[IMG_WAVE]->h;
 
-    SDL_BlitSurface(images[IMG_WAVE], NULL, screen, &dest);
+    blend_blit(images[IMG_WAVE], NULL, screen, &dest);
+    dirty_rects_add(&dest);
 
     sprintf(str, "%d", wave);
     draw_numbers(screen, str, offset+images[IMG_WAVE]->w + (images[IMG_NUMBERS]->w / 10), 0);
@@ -344,7 +377,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         dest.y = glyph_offset;
         dest.w = images[IMG_SCORE]->w;
         dest.h = images[IMG_SCORE]->h;
-        SDL_BlitSurface(images[IMG_SCORE], NULL, screen, &dest);
+        blend_blit(images[IMG_SCORE], NULL, screen, &dest);
+        dirty_rects_add(&dest);
 
         /* In LAN mode, we show the server-generated score: */
         if(Opts_LanMode())
@@ -371,7 +405,7 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         for (i = 0; i < mp_get_parameter(PLAYERS); ++i)
         {
             snprintf(str, 64, "%s: %d", mp_get_player_name(i), mp_get_player_score(i));
-            score_surf = T4K_BlackOutline(str, fontsize, &white);
+            score_surf = score_line(i, str, fontsize, &white);
             if(score_surf)
             {
                 loc.x = 0;
@@ -379,9 +413,8 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
                 loc.w = score_surf->w;
                 loc.h = score_surf->h;
 
-                SDL_BlitSurface(score_surf, NULL, screen, &loc);
-                SDL_FreeSurface(score_surf);
-                score_surf = NULL;
+                blend_blit(score_surf, NULL, screen, &loc);
+                dirty_rects_add(&loc);
             }
         }
     }
@@ -402,19 +435,18 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
             {
                 snprintf(str, 64, "%s: %d",  LAN_PlayerName(i),  LAN_PlayerScore(i));
                 if(LAN_PlayerMine(i))
-                    score_surf = T4K_BlackOutline(str, fontsize, &yellow);
+                    score_surf = score_line(entries, str, fontsize, &yellow);
                 else
-                    score_surf = T4K_BlackOutline(str, fontsize, &white);
+                    score_surf = score_line(entries, str, fontsize, &white);
                 if(score_surf)
                 {
                     loc.w = score_surf->w;
                     loc.h = score_surf->h;
                     loc.x = 0;
                     loc.y = score_surf->h * (entries + 2);
-                    SDL_BlitSurface(score_surf, NULL, screen, &loc);
+                    blend_blit(score_surf, NULL, screen, &loc);
+                    dirty_rects_add(&loc);
                     entries++;
-                    SDL_FreeSurface(score_surf);
-                    score_surf = NULL;
                 }
             }
         }
@@ -427,14 +459,16 @@ void comets_draw_misc(MC_MathGame *curr_game, int wave,
         dest.w = images[IMG_STOP]->w;
         dest.h = images[IMG_STOP]->h;
 
-        SDL_BlitSurface(images[IMG_STOP], NULL, screen, &dest);
+        blend_blit(images[IMG_STOP], NULL, screen, &dest);
+        dirty_rects_add(&dest);
     }
 }
 
 
 /* Draw numbers/symbols over the attacker: */
-/* This draws the numbers related to the comets */
-void comets_draw_comet_nums(const comet_type *comet, bool answered, SDL_Color *col)
+/* This draws the numbers related to the comets, over the */
+/* attacker drawn at (x, y)                               */
+void comets_draw_comet_nums(const comet_type *comet, int x, int y, bool answered, SDL_Color *col)
 {
     if(!comet || !col)
         return;
@@ -442,9 +476,7 @@ void comets_draw_comet_nums(const comet_type *comet, bool answered, SDL_Color *c
     SDL_Surface* surf = answered ? comet->answer_surf : comet->formula_surf;
     if(surf)
     {
-        int w = T4K_GetScreen()->w;
-        int x = comet->x;
-        int y = comet->y;
+        int w = RT_surface()->w;
         x -= surf->w/2;
         // Keep formula at least 8 pixels inside screen:
         if(surf->w + x > (w - 8))
@@ -455,7 +487,7 @@ void comets_draw_comet_nums(const comet_type *comet, bool answered, SDL_Color *c
         y -= surf->h;
 
         SDL_Rect pos = {x, y};
-        SDL_BlitSurface(surf, NULL, T4K_GetScreen(), &pos);
+        draw_list_add(surf, NULL, &pos, COMETS_LAYER_COMET_NUMS);
     }
 }
 
@@ -487,7 +519,8 @@ void comets_draw_question_counter(MC_MathGame* curr_game, int total_questions_le
     dest.w = comet_width;
     dest.h = images[comet_img]->h;
 
-    SDL_BlitSurface(images[comet_img], NULL, screen, &dest);
+    blend_blit(images[comet_img], NULL, screen, &dest);
+    dirty_rects_add(&dest);
 
     /* draw number of remaining questions: */
     if(Opts_LanMode())
@@ -541,7 +574,8 @@ void comets_draw_led_console(MC_MathGame *curr_game, int neg_answer_picked, int
                 dest.w = src.w;
                 dest.h = src.h;
 
-                SDL_BlitSurface(images[IMG_LED_NEG_SIGN], &src, screen, &dest);
+                blend_blit(images[IMG_LED_NEG_SIGN], &src, screen, &dest);
+                dirty_rects_add(&dest);
                 /* move "cursor" */
                 dest.x += src.w;
             }
@@ -558,7 +592,8 @@ void comets_draw_led_console(MC_MathGame *curr_game, int neg_answer_picked, int
             dest.w = src.w;
             dest.h = src.h;
 
-            SDL_BlitSurface(images[IMG_LEDNUMS], &src, screen, &dest);
+            blend_blit(images[IMG_LEDNUMS], &src, screen, &dest);
+            dirty_rects_add(&dest);
             /* move "cursor" */
             dest.x += src.w;
         }
@@ -572,6 +607,7 @@ void comets_draw_powerup(powerup_comet_type* powerup_comet)
     SDL_Surface* img = NULL;
     SDL_Rect dest;
     int imgid, answered, num_draw ;
+    int x, y;
     if(powerup_comet == NULL)
         return;
 
@@ -590,8 +626,8 @@ void comets_draw_powerup(powerup_comet_type* powerup_comet)
         if(!img)
             return;
 
-        if(powerup_comet->comet.x >= img->w/2 &&
-                powerup_comet->comet.x <= screen->w - img->w/2)
+        if(powerup_comet->x >= img->w/2 &&
+                powerup_comet->x <= screen->w - img->w/2)
         {
             num_draw = 1;
         }
@@ -609,15 +645,17 @@ void comets_draw_powerup(powerup_comet_type* powerup_comet)
     }
 
     /* Draw it! */
-    dest.x = powerup_comet->comet.x - (img->w/2);
-    dest.y = powerup_comet->comet.y - img->h;
+    x = step_pos(powerup_comet->prev_x, powerup_comet->x);
+    y = step_pos(powerup_comet->prev_y, powerup_comet->y);
+    dest.x = x - (img->w/2);
+    dest.y = y - img->h;
     dest.w = img->w;
     dest.h = img->h;
 
-    SDL_BlitSurface(img, NULL, screen, &dest);
+    draw_list_add(img, NULL, &dest, COMETS_LAYER_POWERUP);
     if (num_draw)
     {
-        comets_draw_comet_nums(&(powerup_comet->comet), answered, &white);
+        comets_draw_comet_nums(&(powerup_comet->comet), x, y, answered, &white);
     }
 }
 
@@ -637,15 +675,62 @@ void comets_draw_smartbomb(int smartbomb_alive)
         rect.y = (screen->h * 0.7) - img->h;
         rect.w = img->w;
         rect.h = img->h;
-        SDL_BlitSurface(img, NULL, screen, &rect);
+        draw_list_add(img, NULL, &rect, COMETS_LAYER_SMARTBOMB);
     }
 
-    img = T4K_BlackOutline(txt, fontsize, &white);
+    if(!smartbomb_label)
+        smartbomb_label = T4K_BlackOutline(txt, fontsize, &white);
+    img = smartbomb_label;
     if(img)
     {
         rect.y += rect.h;
-        SDL_BlitSurface(img, NULL, screen, &rect);
-        SDL_FreeSurface(img);
+        draw_list_add(img, NULL, &rect, COMETS_LAYER_SMARTBOMB);
+    }
+}
+
+
+/* Returns the rendered score line, only rendering it again if the text */
+/* or its look has changed.  NOTE don't free the returned surface:      */
+static SDL_Surface* score_line(int line, const char* str, int fontsize, SDL_Color* col)
+{
+    if(line < 0 || line >= NUM_SCORE_LINES)
+        return NULL;
+
+    if(!score_line_surf[line]
+            || score_line_col[line] != col
+            || score_line_size[line] != fontsize
+            || strcmp(score_line_str[line], str) != 0)
+    {
+        if(score_line_surf[line])
+            SDL_FreeSurface(score_line_surf[line]);
+        score_line_surf[line] = T4K_BlackOutline(str, fontsize, col);
+        strncpy(score_line_str[line], str, 64);
+        score_line_str[line][63] = '\0';
+        score_line_col[line] = col;
+        score_line_size[line] = fontsize;
     }
+    return score_line_surf[line];
 }
 
+
+void comets_free_text_cache(void)
+{
+    int i;
+    for(i = 0; i < NUM_SCORE_LINES; i++)
+    {
+        if(score_line_surf[i])
+            SDL_FreeSurface(score_line_surf[i]);
+        score_line_surf[i] = NULL;
+    }
+    if(smartbomb_label)
+        SDL_FreeSurface(smartbomb_label);
+    smartbomb_label = NULL;
+}
+
+
+/* Where to draw something that moved from "prev" to "cur" in the last */
+/* game step, given how far the frame is into the next one:            */
+static float step_pos(float prev, float cur)
+{
+    return prev + (cur - prev) * FC_step_alpha;
+}
@@ -3,6 +3,20 @@
 
 #define IMG_CITY_NONE 0
 
+/* Draw list layers, back to front.  Igloos, penguins and steam each  */
+/* get a layer within every 4 starting at COMETS_LAYER_CITIES, since */
+/* the cities have layers of their own:                               */
+enum {
+    COMETS_LAYER_CITIES = 0,
+    COMETS_LAYER_SNOW = 1000,
+    COMETS_LAYER_CLOUD,
+    COMETS_LAYER_SMARTBOMB,
+    COMETS_LAYER_COMETS,
+    COMETS_LAYER_BONUS_COMETS,
+    COMETS_LAYER_POWERUP,
+    COMETS_LAYER_COMET_NUMS
+};
+
 #include <stdbool.h>
 
 #include "comets.h"
@@ -10,9 +24,9 @@
 
 void comets_draw_background(SDL_Surface *bkgd, int wave);
 
-void comets_draw_comets(const comet_type *comets);
+void comets_draw_comets(const comet_type *comets, const comet_positions *pos);
 
-void comets_draw_comet_nums(const comet_type *comet, bool answered, SDL_Color *col);
+void comets_draw_comet_nums(const comet_type *comet, int x, int y, bool answered, SDL_Color *col);
 
 void comets_draw_cities(int igloo_vertical_offset, const cloud_type *cloud, const city_type *cities,
         const penguin_type *penguins, const steam_type *steam);
@@ -28,5 +42,7 @@ void comets_draw_powerup(powerup_comet_type* powerup_comet);
 
 void comets_draw_smartbomb(int smartbomb_alive);
 
+void comets_free_text_cache(void);
+
 
 #endif
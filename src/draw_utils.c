@@ -1,8 +1,88 @@
 #include <t4k_common.h>
 
+#include "blend.h"
 #include "draw_utils.h"
 #include "tuxmath.h"
 #include "fileops.h"
+#include "profiler.h"
+#include "render_target.h"
+
+
+/* Dirty rectangles: while tracking is on, everything drawn on the  */
+/* screen is recorded, so that next frame only those areas need to  */
+/* be restored from the background and sent to the display:         */
+static int dirty_tracking = 0;
+static int dirty_full = 1;
+static int dirty_overflow = 0;
+static SDL_Rect dirty_prev[MAX_DIRTY_RECTS];
+static SDL_Rect dirty_curr[MAX_DIRTY_RECTS];
+static int num_dirty_prev = 0;
+static int num_dirty_curr = 0;
+
+static int merge_rect(SDL_Rect* list, int n, SDL_Rect* r);
+
+
+/* Surface locked by draw_lines_begin(), if any: */
+static SDL_Surface* lines_surface = NULL;
+
+static void plot_pixel(SDL_Surface* surface, int x, int y, Uint32 pixel,
+        int red, int grn, int blu, int cover);
+
+
+/* Draw list: blits to the screen collected over a frame and then done */
+/* in one pass, back to front by layer and within each layer in the   */
+/* order they were added, so overlapping sprites keep their z-order    */
+/* whichever animation frame they are showing.  Blits that don't      */
+/* overlap are then grouped by source surface within their layer (see */
+/* group_draw_cmds()), so the blitter keeps working on the same pixels: */
+typedef struct draw_cmd_type {
+    SDL_Surface* surf;
+    SDL_Rect src;
+    SDL_Rect dst;
+    int use_src;
+    int layer;
+    int seq;          //order added, to keep the sort stable
+    int zone;         //profiler zone it was queued in, which its blit is timed in
+} draw_cmd_type;
+
+static draw_cmd_type draw_cmds[MAX_DRAW_CMDS];
+static int num_draw_cmds = 0;
+#define GROUP_SCAN 64
+
+static int compare_draw_cmds(const void* a, const void* b);
+static void group_draw_cmds(int first, int end);
+static int rects_overlap(const SDL_Rect* a, const SDL_Rect* b);
+
+
+/* Glyph atlases: the characters used in comet formulas and other  */
+/* numbers, rendered once per font size and colour side by side in */
+/* a single surface.  Text made only of these is put together by   */
+/* blitting from the atlas instead of rendering it with FreeType.  */
+/* NOTE strings are UTF-8, hence "÷" taking more than one byte:     */
+static const char* atlas_glyphs[] = {
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9",
+    "+", "-", "x", "÷", "=", "?", ".", "(", ")"
+};
+#define NUM_ATLAS_GLYPHS (sizeof(atlas_glyphs) / sizeof(atlas_glyphs[0]))
+
+typedef struct glyph_atlas_type {
+    int size;
+    SDL_Color col;
+    SDL_Surface* surf;                 //NULL if slot unused
+    SDL_Rect rect[NUM_ATLAS_GLYPHS];   //where each glyph is in surf
+    int pad;                           //outline margin in each glyph's width
+    int space_w;                       //how far a space moves along
+    Uint32 last_used;
+} glyph_atlas_type;
+
+static glyph_atlas_type glyph_atlases[MAX_GLYPH_ATLASES];
+
+static glyph_atlas_type* get_glyph_atlas(int size, SDL_Color* col);
+static int build_glyph_atlas(glyph_atlas_type* a, int size, SDL_Color* col);
+static int next_glyph(glyph_atlas_type* a, const char** p);
+static void draw_glyphs(SDL_Surface* surface, glyph_atlas_type* a, const char* str, int x, int y, int copy);
+static void copy_glyph(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, int x, int y);
+static int outline_width(const char* str, int size, SDL_Color* col);
 
 
 float get_scale(void)
@@ -15,64 +95,184 @@ float get_scale(void)
     int win_w, win_h, full_w, full_h;
 
     T4K_GetResolutions(&win_w, &win_h, &full_w, &full_h);
-    if(T4K_GetScreen()->h == full_h)
+    if(RT_surface()->h == full_h)
         return  pow(((float)full_h/(float)win_h), SCALE_EXPONENT);
     else
         return  1;
 }
 
 
-/* Draw a line: */
+/* Draw a line, DEFAULT_LINE_WIDTH pixels across: */
 void draw_line(SDL_Surface* surface, int x1, int y1, int x2, int y2, int red, int grn, int blu)
+{
+    draw_wide_line(surface, x1, y1, x2, y2, DEFAULT_LINE_WIDTH, red, grn, blu);
+}
+
+
+/* Lock the surface once for a whole batch of lines (e.g. every laser */
+/* in a frame) rather than once per line.  Nothing else may be       */
+/* blitted to the surface until draw_lines_end():                    */
+void draw_lines_begin(SDL_Surface* surface)
 {
     if(!surface)
-        surface = T4K_GetScreen();
+        surface = RT_surface();
+    if(lines_surface)
+        draw_lines_end();
+    if(SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) < 0)
+        return;
+    lines_surface = surface;
+}
 
-    int dx, dy, tmp;
-    float m, b;
+
+void draw_lines_end(void)
+{
+    if(lines_surface && SDL_MUSTLOCK(lines_surface))
+        SDL_UnlockSurface(lines_surface);
+    lines_surface = NULL;
+}
+
+
+/* Draw an anti-aliased line "width" pixels across, straight into the */
+/* surface's pixels.  This is Wu's algorithm with the single pixel     */
+/* widened to a span: stepping along the major axis, the minor axis    */
+/* position is kept in 16.16 fixed point, the pixels wholly inside the */
+/* span are set and the two at its edges are blended by how much of    */
+/* them it covers:                                                     */
+void draw_wide_line(SDL_Surface* surface, int x1, int y1, int x2, int y2,
+        int width, int red, int grn, int blu)
+{
+    int dx, dy, steep, tmp, x, y, k, frac;
+    Sint32 pos, step;
     Uint32 pixel;
     SDL_Rect dest;
+    int own_lock;
+
+    if(!surface)
+        surface = RT_surface();
+    if(width < 1)
+        width = 1;
+    /* Out of range colors wrap, as they always did with SDL_MapRGB(): */
+    red &= 0xFF;
+    grn &= 0xFF;
+    blu &= 0xFF;
+
+    if(surface == RT_surface())
+    {
+        dest.x = ((x1 < x2) ? x1 : x2) - width;
+        dest.y = ((y1 < y2) ? y1 : y2) - width;
+        dest.w = abs(x2 - x1) + 2 * width + 1;
+        dest.h = abs(y2 - y1) + 2 * width + 1;
+        dirty_rects_add(&dest);
+    }
+
+    own_lock = (surface != lines_surface);
+    if(own_lock && SDL_MUSTLOCK(surface) && SDL_LockSurface(surface) < 0)
+        return;
 
     pixel = SDL_MapRGB(surface->format, red, grn, blu);
 
-    dx = x2 - x1;
-    dy = y2 - y1;
+    /* Always step along x, swapping the axes for steep lines: */
+    dx = abs(x2 - x1);
+    dy = abs(y2 - y1);
+    steep = (dy > dx);
+    if(steep)
+    {
+        tmp = x1; x1 = y1; y1 = tmp;
+        tmp = x2; x2 = y2; y2 = tmp;
+        tmp = dx; dx = dy; dy = tmp;
+    }
+    if(x1 > x2)
+    {
+        tmp = x1; x1 = x2; x2 = tmp;
+        tmp = y1; y1 = y2; y2 = tmp;
+    }
 
-    putpixel(surface, x1, y1, pixel);
+    step = dx ? (y2 - y1) * 65536 / dx : 0;
+    /* Top edge of the span, which is centered on the line: */
+    pos = y1 * 65536 - (width - 1) * 32768;
 
-    if (dx != 0)
+    for(x = x1; x <= x2; x++, pos += step)
     {
-        m = ((float) dy) / ((float) dx);
-        b = y1 - m * x1;
+        y = pos >> 16;
+        frac = (pos >> 8) & 0xFF;
 
-        if (x2 > x1)
-            dx = 1;
+        if(steep)
+        {
+            plot_pixel(surface, y, x, pixel, red, grn, blu, 255 - frac);
+            for(k = 1; k < width; k++)
+                plot_pixel(surface, y + k, x, pixel, red, grn, blu, 255);
+            plot_pixel(surface, y + width, x, pixel, red, grn, blu, frac);
+        }
         else
-            dx = -1;
-
-        while (x1 != x2)
         {
-            x1 = x1 + dx;
-            y1 = m * x1 + b;
-
-            putpixel(surface, x1, y1, pixel);
+            plot_pixel(surface, x, y, pixel, red, grn, blu, 255 - frac);
+            for(k = 1; k < width; k++)
+                plot_pixel(surface, x, y + k, pixel, red, grn, blu, 255);
+            plot_pixel(surface, x, y + width, pixel, red, grn, blu, frac);
         }
     }
-    else
+
+    if(own_lock && SDL_MUSTLOCK(surface))
+        SDL_UnlockSurface(surface);
+}
+
+
+/* Set one pixel of a locked surface, mixed with what is already there */
+/* if "cover" (0 - 255) is less than all of it:                        */
+static void plot_pixel(SDL_Surface* surface, int x, int y, Uint32 pixel,
+        int red, int grn, int blu, int cover)
+{
+    SDL_Rect* c = &surface->clip_rect;
+    int bpp = surface->format->BytesPerPixel;
+    Uint8* p;
+    Uint32 old;
+    Uint8 r, g, b;
+
+    if(cover <= 0 || x < c->x || y < c->y || x >= c->x + c->w || y >= c->y + c->h)
+        return;
+
+    p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
+
+    if(cover < 255)
     {
-        if (y1 > y2)
+        switch(bpp)
         {
-            tmp = y1;
-            y1 = y2;
-            y2 = tmp;
+            case 1: old = *p; break;
+            case 2: old = *(Uint16*)p; break;
+            case 3:
+                if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+                    old = p[0] << 16 | p[1] << 8 | p[2];
+                else
+                    old = p[0] | p[1] << 8 | p[2] << 16;
+                break;
+            default: old = *(Uint32*)p;
         }
+        SDL_GetRGB(old, surface->format, &r, &g, &b);
+        pixel = SDL_MapRGB(surface->format,
+                r + (red - r) * cover / 255,
+                g + (grn - g) * cover / 255,
+                b + (blu - b) * cover / 255);
+    }
 
-        dest.x = x1;
-        dest.y = y1;
-        dest.w = 3;
-        dest.h = y2 - y1;
-
-        SDL_FillRect(surface, &dest, pixel);
+    switch(bpp)
+    {
+        case 1: *p = pixel; break;
+        case 2: *(Uint16*)p = pixel; break;
+        case 3:
+            if(SDL_BYTEORDER == SDL_BIG_ENDIAN)
+            {
+                p[0] = (pixel >> 16) & 0xff;
+                p[1] = (pixel >> 8) & 0xff;
+                p[2] = pixel & 0xff;
+            }
+            else
+            {
+                p[0] = pixel & 0xff;
+                p[1] = (pixel >> 8) & 0xff;
+                p[2] = (pixel >> 16) & 0xff;
+            }
+            break;
+        default: *(Uint32*)p = pixel;
     }
 }
 
@@ -137,7 +337,7 @@ void putpixel(SDL_Surface* surface, int x, int y, Uint32 pixel)
     dest.w = 3;
     dest.h = 4;
 
-    SDL_FillRect(surface, &dest, pixel);
+    blend_fill(surface, &dest, pixel);
 #endif
 }
 
@@ -172,8 +372,10 @@ void draw_numbers(SDL_Surface* surface, const char* str, int x, int y)
             dest.w = src.w;
             dest.h = src.h;
 
-            SDL_BlitSurface(images[IMG_NUMBERS], &src,
+            blend_blit(images[IMG_NUMBERS], &src,
                     surface, &dest);
+            if(surface == RT_surface())
+                dirty_rects_add(&dest);
 
             /* Move the 'cursor' one character width: */
             cur_x = cur_x + (images[IMG_NUMBERS]->w / 10);
@@ -188,22 +390,39 @@ void draw_nums(float zoom, const char* str, int x, int y, SDL_Color* col)
     if(!str || !col)
         return;
 
-    SDL_Surface* surf = NULL;
-    surf = T4K_BlackOutline(str, 48 * zoom, col);
-    if(surf)
+    int w = RT_surface()->w;
+    int size = 48 * zoom;
+    int text_w = glyph_text_width(str, size, col);
+
+    /* Anything the glyph atlas can't do goes through FreeType: */
+    if(text_w < 0)
     {
-        int w = T4K_GetScreen()->w;
-        x -= surf->w/2;
-        // Keep formula at least 8 pixels inside screen:
-        if(surf->w + x > (w - 8))
-            x -= (surf->w + x - (w - 8));
-        if(x < 8)
-            x = 8;
+        SDL_Surface* surf = NULL;
+        surf = T4K_BlackOutline(str, size, col);
+        if(surf)
+        {
+            x -= surf->w/2;
+            // Keep formula at least 8 pixels inside screen:
+            if(surf->w + x > (w - 8))
+                x -= (surf->w + x - (w - 8));
+            if(x < 8)
+                x = 8;
 
-        SDL_Rect pos = {x, y};
-        SDL_BlitSurface(surf, NULL, T4K_GetScreen(), &pos);
-        SDL_FreeSurface(surf);
+            SDL_Rect pos = {x, y};
+            blend_blit(surf, NULL, RT_surface(), &pos);
+            dirty_rects_add(&pos);
+            SDL_FreeSurface(surf);
+        }
+        return;
     }
+
+    x -= text_w/2;
+    // Keep formula at least 8 pixels inside screen:
+    if(text_w + x > (w - 8))
+        x -= (text_w + x - (w - 8));
+    if(x < 8)
+        x = 8;
+    draw_glyph_text(RT_surface(), str, size, col, x, y);
 }
 
 
@@ -217,5 +436,590 @@ void draw_console_image(int i)
     dest.w = images[i]->w;
     dest.h = images[i]->h;
 
-    SDL_BlitSurface(images[i], NULL, screen, &dest);
+    blend_blit(images[i], NULL, screen, &dest);
+    dirty_rects_add(&dest);
+}
+
+
+/* Render the glyphs for this size and colour now, so it doesn't */
+/* happen in the middle of a game:                               */
+void prepare_glyph_atlas(int size, SDL_Color* col)
+{
+    get_glyph_atlas(size, col);
+}
+
+
+/* Drop-in replacement for T4K_BlackOutline() - the returned surface */
+/* must be freed by the caller.  Text the atlas can't handle is      */
+/* passed on to T4K_BlackOutline():                                  */
+SDL_Surface* glyph_text(const char* str, int size, SDL_Color* col)
+{
+    glyph_atlas_type* a;
+    SDL_Surface* surf;
+    int w;
+
+    w = glyph_text_width(str, size, col);
+    if(w <= 0)
+        return T4K_BlackOutline(str, size, col);
+
+    a = get_glyph_atlas(size, col);
+    surf = SDL_CreateRGBSurface(SDL_SWSURFACE, w, a->surf->h,
+            a->surf->format->BitsPerPixel,
+            a->surf->format->Rmask, a->surf->format->Gmask,
+            a->surf->format->Bmask, a->surf->format->Amask);
+    if(!surf)
+        return T4K_BlackOutline(str, size, col);
+    SDL_FillRect(surf, NULL, 0);
+
+    /* Copy the glyphs across, alpha channel and all, rather than */
+    /* blending them onto the empty surface:                      */
+    draw_glyphs(surf, a, str, 0, 0, 1);
+    SDL_SetAlpha(surf, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+    return surf;
+}
+
+
+/* Blit str onto surface from the glyph atlas, with its top left corner */
+/* at (x, y).  Returns 0, without drawing anything, if str has any      */
+/* characters not in the atlas:                                         */
+int draw_glyph_text(SDL_Surface* surface, const char* str, int size, SDL_Color* col, int x, int y)
+{
+    if(glyph_text_width(str, size, col) < 0)
+        return 0;
+    draw_glyphs(surface, get_glyph_atlas(size, col), str, x, y, 0);
+    return 1;
+}
+
+
+/* Width in pixels of str drawn from the atlas, or -1 if it can't be: */
+int glyph_text_width(const char* str, int size, SDL_Color* col)
+{
+    glyph_atlas_type* a;
+    const char* p;
+    int g, w = 0;
+
+    if(!str || !col)
+        return -1;
+    a = get_glyph_atlas(size, col);
+    if(!a)
+        return -1;
+
+    /* Each glyph's outline reaches into the next one, as it does */
+    /* when FreeType renders the whole string:                    */
+    p = str;
+    while(*p)
+    {
+        g = next_glyph(a, &p);
+        if(g == -1)
+            return -1;
+        w += (g == -2) ? a->space_w : a->rect[g].w - a->pad;
+    }
+    return w + a->pad;
+}
+
+
+void free_glyph_atlases(void)
+{
+    int i;
+    for(i = 0; i < MAX_GLYPH_ATLASES; i++)
+    {
+        if(glyph_atlases[i].surf)
+            SDL_FreeSurface(glyph_atlases[i].surf);
+        glyph_atlases[i].surf = NULL;
+    }
+}
+
+
+/* Find the atlas for this size and colour, building it if need be in */
+/* place of the least recently used one.  Returns NULL on failure:    */
+static glyph_atlas_type* get_glyph_atlas(int size, SDL_Color* col)
+{
+    static Uint32 use_count = 0;
+    int i, oldest = 0;
+
+    for(i = 0; i < MAX_GLYPH_ATLASES; i++)
+    {
+        glyph_atlas_type* a = &glyph_atlases[i];
+        if(a->surf && a->size == size
+                && a->col.r == col->r && a->col.g == col->g && a->col.b == col->b)
+        {
+            a->last_used = ++use_count;
+            return a;
+        }
+        if(!a->surf)
+            oldest = i;
+        else if(glyph_atlases[oldest].surf && a->last_used < glyph_atlases[oldest].last_used)
+            oldest = i;
+    }
+
+    if(!build_glyph_atlas(&glyph_atlases[oldest], size, col))
+        return NULL;
+    glyph_atlases[oldest].last_used = ++use_count;
+    return &glyph_atlases[oldest];
+}
+
+
+static int build_glyph_atlas(glyph_atlas_type* a, int size, SDL_Color* col)
+{
+    SDL_Surface* glyph[NUM_ATLAS_GLYPHS];
+    SDL_Surface* fmt = NULL;
+    SDL_Rect dest;
+    int i, w = 0, h = 0;
+
+    DEBUGMSG(debug_sdl, "Building glyph atlas for size %d\n", size);
+
+    if(a->surf)
+        SDL_FreeSurface(a->surf);
+    a->surf = NULL;
+
+    for(i = 0; i < NUM_ATLAS_GLYPHS; i++)
+    {
+        glyph[i] = T4K_BlackOutline(atlas_glyphs[i], size, col);
+        if(glyph[i])
+        {
+            fmt = glyph[i];
+            w += glyph[i]->w;
+            if(glyph[i]->h > h)
+                h = glyph[i]->h;
+        }
+    }
+
+    if(fmt)
+        a->surf = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h,
+                fmt->format->BitsPerPixel,
+                fmt->format->Rmask, fmt->format->Gmask,
+                fmt->format->Bmask, fmt->format->Amask);
+    if(a->surf)
+        SDL_FillRect(a->surf, NULL, 0);
+
+    /* Lay the glyphs out left to right.  Any that failed to render */
+    /* get zero width, so strings using them fall back to FreeType: */
+    dest.x = 0;
+    dest.y = 0;
+    for(i = 0; i < NUM_ATLAS_GLYPHS; i++)
+    {
+        a->rect[i].x = dest.x;
+        a->rect[i].y = 0;
+        a->rect[i].w = 0;
+        a->rect[i].h = 0;
+        if(!glyph[i])
+            continue;
+        if(a->surf)
+        {
+            a->rect[i].w = glyph[i]->w;
+            a->rect[i].h = glyph[i]->h;
+            SDL_SetAlpha(glyph[i], 0, SDL_ALPHA_OPAQUE);
+            SDL_BlitSurface(glyph[i], NULL, a->surf, &dest);
+            dest.x += glyph[i]->w;
+        }
+        SDL_FreeSurface(glyph[i]);
+    }
+
+    if(!a->surf)
+    {
+        fprintf(stderr, "build_glyph_atlas() - could not create atlas for size %d\n", size);
+        return 0;
+    }
+
+    SDL_SetAlpha(a->surf, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+    a->size = size;
+    a->col = *col;
+
+    /* Measure the outline margin and the font's own space by rendering */
+    /* a few strings whole - if that fails, guess:                      */
+    a->pad = 0;
+    a->space_w = a->rect[0].w / 2;
+    w = outline_width("00", size, col);
+    if(w > 0 && a->rect[0].w > 0)
+    {
+        a->pad = 2 * a->rect[0].w - w;
+        if(a->pad < 0 || a->pad >= a->rect[0].w)
+            a->pad = 0;
+        h = outline_width("0 0", size, col);
+        if(h > w)
+            a->space_w = h - w;
+    }
+    return 1;
+}
+
+
+/* Width of str as T4K_BlackOutline() renders it, or 0 on failure: */
+static int outline_width(const char* str, int size, SDL_Color* col)
+{
+    SDL_Surface* s = T4K_BlackOutline(str, size, col);
+    int w = 0;
+
+    if(s)
+    {
+        w = s->w;
+        SDL_FreeSurface(s);
+    }
+    return w;
+}
+
+
+/* Put str together from the atlas at (x, y), either blending it onto */
+/* surface or, if copy is set, copying the pixels alpha and all:      */
+static void draw_glyphs(SDL_Surface* surface, glyph_atlas_type* a, const char* str, int x, int y, int copy)
+{
+    const char* p;
+    SDL_Rect dest;
+    int g;
+
+    p = str;
+    while(*p)
+    {
+        g = next_glyph(a, &p);
+        if(g == -2)  // space
+        {
+            x += a->space_w;
+            continue;
+        }
+        if(copy)
+            copy_glyph(a->surf, &a->rect[g], surface, x, y);
+        else
+        {
+            dest.x = x;
+            dest.y = y;
+            blend_blit(a->surf, &a->rect[g], surface, &dest);
+            if(surface == RT_surface())
+                dirty_rects_add(&dest);
+        }
+        x += a->rect[g].w - a->pad;
+    }
+}
+
+
+/* Copy a glyph onto a transparent surface.  Glyphs overlap by their */
+/* outline margin, so where they do the more opaque pixel is kept     */
+/* instead of the later glyph's blank edge wiping out the earlier one: */
+static void copy_glyph(SDL_Surface* src, SDL_Rect* srcrect, SDL_Surface* dst, int x, int y)
+{
+    SDL_Rect dest;
+    Uint32 amask = src->format->Amask;
+    Uint32* s;
+    Uint32* d;
+    int i, j, w, h;
+
+    if(src->format->BytesPerPixel != 4 || dst->format->BytesPerPixel != 4
+            || amask == 0 || dst->format->Amask != amask)
+    {
+        dest.x = x;
+        dest.y = y;
+        SDL_SetAlpha(src, 0, SDL_ALPHA_OPAQUE);
+        SDL_BlitSurface(src, srcrect, dst, &dest);
+        SDL_SetAlpha(src, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+        return;
+    }
+
+    w = srcrect->w;
+    h = srcrect->h;
+    if(x + w > dst->w)
+        w = dst->w - x;
+    if(y + h > dst->h)
+        h = dst->h - y;
+    if(x < 0 || y < 0 || w <= 0 || h <= 0)
+        return;
+
+    SDL_LockSurface(src);
+    SDL_LockSurface(dst);
+    for(j = 0; j < h; j++)
+    {
+        s = (Uint32*)((Uint8*)src->pixels + (srcrect->y + j) * src->pitch) + srcrect->x;
+        d = (Uint32*)((Uint8*)dst->pixels + (y + j) * dst->pitch) + x;
+        for(i = 0; i < w; i++)
+            if((s[i] & amask) > (d[i] & amask))
+                d[i] = s[i];
+    }
+    SDL_UnlockSurface(dst);
+    SDL_UnlockSurface(src);
+}
+
+
+/* Returns the atlas index of the glyph at *p and moves *p past it, */
+/* or -2 for a space, or -1 if the atlas doesn't have it:           */
+static int next_glyph(glyph_atlas_type* a, const char** p)
+{
+    int i;
+    size_t len;
+
+    if(**p == ' ')
+    {
+        (*p)++;
+        return -2;
+    }
+    for(i = 0; i < NUM_ATLAS_GLYPHS; i++)
+    {
+        len = strlen(atlas_glyphs[i]);
+        if(a->rect[i].w > 0 && strncmp(*p, atlas_glyphs[i], len) == 0)
+        {
+            *p += len;
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* Queue a blit to the screen.  The surface must stay valid until */
+/* draw_list_flush() is called:                                   */
+void draw_list_add(SDL_Surface* surf, SDL_Rect* src, SDL_Rect* dst, int layer)
+{
+    draw_cmd_type* cmd;
+
+    if(!surf || !dst)
+        return;
+    /* Out of room - draw what we have so far: */
+    if(num_draw_cmds >= MAX_DRAW_CMDS)
+        draw_list_flush();
+
+    cmd = &draw_cmds[num_draw_cmds];
+    cmd->surf = surf;
+    cmd->use_src = (src != NULL);
+    if(src)
+        cmd->src = *src;
+    cmd->dst = *dst;
+    cmd->layer = layer;
+    cmd->seq = num_draw_cmds;
+    cmd->zone = PROF_zone();
+    num_draw_cmds++;
+}
+
+
+/* Do all the queued blits and empty the list: */
+void draw_list_flush(void)
+{
+    SDL_Surface* scr = RT_surface();
+    int outer = PROF_zone();
+    int i, first;
+
+    if(num_draw_cmds > 1)
+    {
+        qsort(draw_cmds, num_draw_cmds, sizeof(draw_cmd_type), compare_draw_cmds);
+        for(first = 0, i = 1; i <= num_draw_cmds; i++)
+            if(i == num_draw_cmds || draw_cmds[i].layer != draw_cmds[first].layer)
+            {
+                group_draw_cmds(first, i);
+                first = i;
+            }
+    }
+
+    for(i = 0; i < num_draw_cmds; i++)
+    {
+        /* When profiling, each blit is timed in the zone that queued */
+        /* it, so e.g. "comets" is the time the comets take to draw:  */
+        if(outer >= 0 && (i == 0 || draw_cmds[i].zone != draw_cmds[i - 1].zone))
+            PROF_begin(draw_cmds[i].zone >= 0 ? draw_cmds[i].zone : outer);
+        blend_blit(draw_cmds[i].surf,
+                draw_cmds[i].use_src ? &draw_cmds[i].src : NULL,
+                scr, &draw_cmds[i].dst);
+        dirty_rects_add(&draw_cmds[i].dst);
+    }
+    if(outer >= 0)
+        PROF_begin(outer);
+    num_draw_cmds = 0;
+}
+
+
+static int compare_draw_cmds(const void* a, const void* b)
+{
+    const draw_cmd_type* c1 = (const draw_cmd_type*)a;
+    const draw_cmd_type* c2 = (const draw_cmd_type*)b;
+
+    if(c1->layer != c2->layer)
+        return (c1->layer < c2->layer) ? -1 : 1;
+    return c1->seq - c2->seq;
+}
+
+
+/* Within the layer draw_cmds[first] to draw_cmds[end - 1], move each */
+/* blit back to just after the last one from the same surface, if it  */
+/* doesn't overlap any it would jump over - so what ends up on top    */
+/* doesn't change.  Only the last GROUP_SCAN blits are looked back at: */
+static void group_draw_cmds(int first, int end)
+{
+    draw_cmd_type cmd;
+    int i, j, stop;
+
+    for(i = first + 1; i < end; i++)
+    {
+        if(draw_cmds[i].surf == draw_cmds[i - 1].surf)
+            continue;
+        stop = (i - GROUP_SCAN > first) ? i - GROUP_SCAN : first;
+        for(j = i - 1; j >= stop && draw_cmds[j].surf != draw_cmds[i].surf; j--)
+            if(rects_overlap(&draw_cmds[j].dst, &draw_cmds[i].dst))
+                break;
+        if(j < stop || draw_cmds[j].surf != draw_cmds[i].surf)
+            continue;
+
+        cmd = draw_cmds[i];
+        memmove(&draw_cmds[j + 2], &draw_cmds[j + 1], (i - j - 1) * sizeof(draw_cmd_type));
+        draw_cmds[j + 1] = cmd;
+    }
+}
+
+
+static int rects_overlap(const SDL_Rect* a, const SDL_Rect* b)
+{
+    return a->x < b->x + b->w && b->x < a->x + a->w
+        && a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+
+/* Start tracking.  The first frame is always drawn in full: */
+void dirty_rects_start(void)
+{
+    dirty_tracking = 1;
+    dirty_full = 1;
+    dirty_overflow = 0;
+    num_dirty_prev = num_dirty_curr = 0;
+}
+
+
+void dirty_rects_stop(void)
+{
+    dirty_tracking = 0;
+    num_dirty_prev = num_dirty_curr = 0;
+}
+
+
+/* Use when something other than the tracked drawing has changed */
+/* the screen, e.g. a pause screen or a mode switch:             */
+void dirty_rects_invalidate(void)
+{
+    dirty_full = 1;
+}
+
+
+/* Returns 1 if the whole screen must be redrawn this frame.  This  */
+/* is always so for double-buffered (page flipping) displays, where */
+/* the back buffer does not hold what we drew last frame - though   */
+/* not when drawing off-screen, see render_target.c:                */
+int dirty_rects_full(void)
+{
+    SDL_Surface* scr = RT_surface();
+    if(!dirty_tracking || !scr || (scr->flags & SDL_DOUBLEBUF))
+        return 1;
+    return dirty_full;
+}
+
+
+/* Record an area drawn on the screen.  SDL_BlitSurface() leaves the */
+/* clipped destination in its dstrect, so that can be passed as is: */
+void dirty_rects_add(SDL_Rect* r)
+{
+    SDL_Surface* scr = RT_surface();
+    SDL_Rect c;
+    int x2, y2;
+
+    if(!dirty_tracking || !r || !scr || dirty_overflow)
+        return;
+
+    /* Clip to screen: */
+    c.x = (r->x < 0) ? 0 : r->x;
+    c.y = (r->y < 0) ? 0 : r->y;
+    x2 = r->x + r->w;
+    y2 = r->y + r->h;
+    if(x2 > scr->w)
+        x2 = scr->w;
+    if(y2 > scr->h)
+        y2 = scr->h;
+    if(x2 <= c.x || y2 <= c.y)
+        return;
+    c.w = x2 - c.x;
+    c.h = y2 - c.y;
+
+    num_dirty_curr = merge_rect(dirty_curr, num_dirty_curr, &c);
+    /* Too many to keep track of - update everything instead: */
+    if(num_dirty_curr >= MAX_DIRTY_RECTS)
+        dirty_overflow = 1;
+}
+
+
+/* Erase last frame's drawing by copying those areas back from the */
+/* backdrop, which must be the same size as the screen:            */
+void dirty_rects_restore(SDL_Surface* backdrop)
+{
+    int i;
+    SDL_Rect dest;
+
+    if(!backdrop)
+        return;
+    for(i = 0; i < num_dirty_prev; i++)
+    {
+        dest = dirty_prev[i];
+        SDL_BlitSurface(backdrop, &dirty_prev[i], RT_surface(), &dest);
+    }
+}
+
+
+/* Show this frame: update the areas drawn last frame (now erased) */
+/* together with the areas drawn this frame, or flip the whole     */
+/* screen if we did a full redraw.  If we are drawing off-screen   */
+/* (see render_target.c) those areas are scaled up to the display: */
+void dirty_rects_update(void)
+{
+    SDL_Surface* scr = RT_surface();
+    int i, n;
+
+    if(dirty_rects_full() || dirty_overflow)
+        RT_flip();
+    else
+    {
+        /* Merge last frame's areas into a copy of this frame's: */
+        SDL_Rect update[MAX_DIRTY_RECTS];
+        memcpy(update, dirty_curr, num_dirty_curr * sizeof(SDL_Rect));
+        n = num_dirty_curr;
+        for(i = 0; i < num_dirty_prev && n < MAX_DIRTY_RECTS; i++)
+            n = merge_rect(update, n, &dirty_prev[i]);
+        if(n >= MAX_DIRTY_RECTS)
+            RT_flip();
+        else
+            RT_update_rects(n, update);
+    }
+
+    if(dirty_overflow)
+    {
+        /* We lost track of what was drawn, so next frame */
+        /* has to restore the whole screen:               */
+        dirty_prev[0].x = dirty_prev[0].y = 0;
+        dirty_prev[0].w = scr->w;
+        dirty_prev[0].h = scr->h;
+        num_dirty_prev = 1;
+    }
+    else
+    {
+        memcpy(dirty_prev, dirty_curr, num_dirty_curr * sizeof(SDL_Rect));
+        num_dirty_prev = num_dirty_curr;
+    }
+    num_dirty_curr = 0;
+    dirty_full = 0;
+    dirty_overflow = 0;
+}
+
+
+/* Add r to list of n rects, merging it into the first rect it overlaps  */
+/* so the same pixels are not copied twice.  Returns new length of list: */
+static int merge_rect(SDL_Rect* list, int n, SDL_Rect* r)
+{
+    int i, x1, y1, x2, y2;
+
+    for(i = 0; i < n; i++)
+    {
+        if(rects_overlap(r, &list[i]))
+        {
+            x1 = (r->x < list[i].x) ? r->x : list[i].x;
+            y1 = (r->y < list[i].y) ? r->y : list[i].y;
+            x2 = (r->x + r->w > list[i].x + list[i].w) ? r->x + r->w : list[i].x + list[i].w;
+            y2 = (r->y + r->h > list[i].y + list[i].h) ? r->y + r->h : list[i].y + list[i].h;
+            list[i].x = x1;
+            list[i].y = y1;
+            list[i].w = x2 - x1;
+            list[i].h = y2 - y1;
+            return n;
+        }
+    }
+    if(n < MAX_DIRTY_RECTS)
+        list[n] = *r;
+    return n + 1;
 }
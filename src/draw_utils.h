@@ -2,6 +2,10 @@
 #define DRAW_UTILS_H
 
 #define SCALE_EXPONENT 0.7
+#define MAX_DIRTY_RECTS 256
+#define MAX_GLYPH_ATLASES 8
+#define MAX_DRAW_CMDS 512
+#define DEFAULT_LINE_WIDTH 3
 
 #include <SDL_video.h>
 
@@ -11,6 +15,9 @@ float get_scale();
 void putpixel(SDL_Surface* surface, int x, int y, Uint32 pixel);
 
 void draw_line(SDL_Surface* surface, int x1, int y1, int x2, int y2, int r, int g, int b);
+void draw_wide_line(SDL_Surface* surface, int x1, int y1, int x2, int y2, int width, int r, int g, int b);
+void draw_lines_begin(SDL_Surface* surface);
+void draw_lines_end(void);
 
 void draw_numbers(SDL_Surface* surface, const char* str, int x, int y);
 
@@ -18,5 +25,26 @@ void draw_nums(float zoom, const char* str, int x, int y, SDL_Color* col);
 
 void draw_console_image(int i);
 
+/* Outlined text for formulas and numbers, built from pre-rendered */
+/* glyphs rather than FreeType where possible - see draw_utils.c:  */
+void prepare_glyph_atlas(int size, SDL_Color* col);
+SDL_Surface* glyph_text(const char* str, int size, SDL_Color* col);
+int draw_glyph_text(SDL_Surface* surface, const char* str, int size, SDL_Color* col, int x, int y);
+int glyph_text_width(const char* str, int size, SDL_Color* col);
+void free_glyph_atlases(void);
+
+/* Batched drawing of sprites to the screen - see draw_utils.c: */
+void draw_list_add(SDL_Surface* surf, SDL_Rect* src, SDL_Rect* dst, int layer);
+void draw_list_flush(void);
+
+/* Dirty rectangle tracking - see draw_utils.c: */
+void dirty_rects_start(void);
+void dirty_rects_stop(void);
+void dirty_rects_invalidate(void);
+int dirty_rects_full(void);
+void dirty_rects_add(SDL_Rect* r);
+void dirty_rects_restore(SDL_Surface* backdrop);
+void dirty_rects_update(void);
+
 
 #endif
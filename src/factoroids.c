@@ -53,11 +53,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "options.h"
 #include "frame_counter.h"
 #include "draw_utils.h"
+#include "profiler.h"
+#include "collision_grid.h"
+#include "fixed.h"
 
 #define BASE_RES_X 1280
 
 #define MAX_LASER 5
-#define MAX_ASTEROIDS 50
+/* Each large asteroid can break into two, so a wave starts with at */
+/* most half as many as there is room for:                          */
+#define MAX_WAVE_ASTEROIDS (MAX_ASTEROIDS / 2)
 #define NUM_TUXSHIPS 2
 #define NUM_SPRITES 11
 #define TUXSHIP_LIVES 3
@@ -65,9 +70,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #define NUM_OF_ROTO_IMGS 360/DEG_PER_ROTATION
 /* TUXSHIP_DECEL controls "friction" - 1 means ship glides infinitely, 0 stops it instantly */
 #define TUXSHIP_DECEL 0.95
-#define DEG_TO_RAD 0.0174532925
 #define MAX(a,b)           (((a) > (b)) ? (a) : (b))
-#define ROUND(X)           ((X) > 0 ? (int)((X)+0.5f) : (int)((X)-0.5f))
 //the prime set keeps increasing till its size reaches this value
 #define PRIME_MAX_LIMIT 6
 
@@ -116,23 +119,6 @@ typedef struct colorRGBA_type {
 
 /********* Global vars ************/
 
-/* Trig junk:  (thanks to Atari BASIC for this) */
-
-static int trig[12] = {
-    1024,
-    1014,
-    984,
-    935,
-    868,
-    784,
-    685,
-    572,
-    448,
-    316,
-    117,
-    0
-};
-
 static int bonus = -1;
 static int bonus_time = BONUS_NOTUSED;
 
@@ -191,6 +177,11 @@ static tuxship_type tuxship;
 static FF_laser_type laser[MAX_LASER];
 
 static int NUM_ASTEROIDS;
+/* Set whenever an asteroid moves, appears or goes, so the collision */
+/* grid is rebuilt before it is next used:                           */
+static int asteroid_grid_dirty;
+static int grid_ids[MAX_ASTEROIDS];
+static asteroid_motion motion;
 static int roto_speed;
 
 /*************** The Factor and Fraction Activity Game Functions ***************/
@@ -212,12 +203,12 @@ static void FF_exit_free(void);
 static int FF_add_laser(void);
 static int FF_add_asteroid(int x, int y, int xspeed, int yspeed, int size, int angle, int angle_speed, int fact_num, int a, int b, int new_wave);
 static int FF_destroy_asteroid(int i, float xspeed, float yspeed);
+static void update_asteroid_grid(void);
+static void asteroid_set_alive(int i, int alive);
 
 static int AsteroidColl(int astW,int astH,int astX,int astY,
         int x, int y);
 static int is_prime(int num);
-static int fast_cos(int angle);
-static int fast_sin(int angle);
 static int generatenumber(int wave);
 static int validate_number(int num, int wave);
 static void game_handle_user_events(void);
@@ -249,28 +240,35 @@ void factors(void)
         return;
     }
 
-    factoroids_draw(asteroid, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+    factoroids_draw(asteroid, &motion, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
     factoroids_level_message(wave);
     /* Reset frame counter */
     FC_init();
     /* Escape key disable in overview screen */
     escape_received = 0;
+    PROF_start("Factoroids");
 
     while (game_status == FF_IN_PROGRESS)
     {
         FC_frame_begin();
 
+        PROF_begin(PROF_INPUT);
         game_handle_user_events();
+        PROF_end(PROF_INPUT);
         if(SDL_GetTicks() > bonus_time && bonus_time != -1) {bonus_time = 0;}
 
+        PROF_begin(PROF_LOGIC);
         FF_handle_ship();
         FF_handle_asteroids();
         FF_handle_answer();
+        PROF_end(PROF_LOGIC);
 
         tux_img = cockpit_tux_image(num);
 
-        factoroids_draw(asteroid, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+        factoroids_draw(asteroid, &motion, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+        PROF_begin(PROF_FLIP);
         SDL_Flip(screen);
+        PROF_end(PROF_FLIP);
 
         game_status = check_exit_conditions();
 
@@ -295,6 +293,7 @@ void factors(void)
 
         FC_frame_end();
     }
+    PROF_stop();
     FF_over(game_status);
 
     if(previous_fps != -1)
@@ -322,6 +321,7 @@ void fractions(void)
     }
 
     /************ Main Loop **************/
+    PROF_start("Fractions");
     while (game_status == FF_IN_PROGRESS)
     {
         static float timer = 0;
@@ -336,13 +336,19 @@ void fractions(void)
                 tux_img = IMG_TUX_CONSOLE1;
         }
 
+        PROF_begin(PROF_INPUT);
         game_handle_user_events();
+        PROF_end(PROF_INPUT);
 
+        PROF_begin(PROF_LOGIC);
         FF_handle_ship();
         FF_handle_asteroids();
         FF_handle_answer();
-        factoroids_draw(asteroid, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+        PROF_end(PROF_LOGIC);
+        factoroids_draw(asteroid, &motion, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+        PROF_begin(PROF_FLIP);
         SDL_Flip(screen);
+        PROF_end(PROF_FLIP);
 
         game_status = check_exit_conditions();
 
@@ -365,6 +371,7 @@ void fractions(void)
 
         FC_frame_end();
     }
+    PROF_stop();
     FF_over(game_status);
 }
 
@@ -404,6 +411,15 @@ static int FF_init(void)
     }
 
     memset(asteroid, 0, MAX_ASTEROIDS * sizeof(asteroid_type));
+    memset(&motion, 0, sizeof(motion));
+    fixed_init();
+
+    /* Cells about the size of a large asteroid: */
+    if (!grid_init(screen->w, screen->h,
+                MAX(get_asteroid_image(1, 0)->w, get_asteroid_image(1, 0)->h),
+                MAX_ASTEROIDS))
+        return 0;
+    asteroid_grid_dirty = 1;
 
     NUM_ASTEROIDS = 4;
 
@@ -416,16 +432,10 @@ static int FF_init(void)
     tuxship.angle = 90;
     tuxship.xspeed = 0;
     tuxship.yspeed = 0;
+    tuxship.x_frac = tuxship.y_frac = tuxship.angle_frac = 0;
     tuxship.radius = (images[IMG_SHIP01]->h)/2;
     tuxship.thrust = 0;
 
-    tuxship.x1 = images[IMG_SHIP01]->w-(images[IMG_SHIP01]->w/8);
-    tuxship.y1 = images[IMG_SHIP01]->h/2;
-    tuxship.x2 = images[IMG_SHIP01]->w/8;
-    tuxship.y2 = images[IMG_SHIP01]->h/8;
-    tuxship.x3 = images[IMG_SHIP01]->w/8;
-    tuxship.y3 = images[IMG_SHIP01]->h-(images[IMG_SHIP01]->h/8);
-
     /*  --- reset all controls:  ---  */
     left_pressed = 0;
     right_pressed = 0;
@@ -452,6 +462,9 @@ static int FF_init(void)
 
 static void FF_handle_ship(void)
 {
+    fixed dt = FLOAT_TO_FIXED(FC_time_elapsed);
+    int dx, dy, i;
+
     /****************** Ship center... ******************/
 
     tuxship.centerx = tuxship.x;
@@ -486,45 +499,30 @@ static void FF_handle_ship(void)
 
     if (right_pressed)
     {
-        tuxship.angle -= DEG_PER_ROTATION * roto_speed * 15 * FC_time_elapsed;
+        tuxship.angle += fixed_step(&tuxship.angle_frac,
+                -DEG_PER_ROTATION * roto_speed * 15, dt);
         if (tuxship.angle < 0)
             tuxship.angle = tuxship.angle + 360;
-
-        tuxship.x1= fast_cos(DEG_PER_ROTATION*-roto_speed) * tuxship.centerx
-            -fast_sin(DEG_PER_ROTATION*-roto_speed) * tuxship.centery;
-        tuxship.y1= fast_sin(DEG_PER_ROTATION*-roto_speed) * tuxship.centerx
-            +fast_cos(DEG_PER_ROTATION*-roto_speed) * tuxship.centery;
-
     }
     else if (left_pressed)
     {
-        tuxship.angle += DEG_PER_ROTATION * roto_speed * 15 * FC_time_elapsed;
+        tuxship.angle += fixed_step(&tuxship.angle_frac,
+                DEG_PER_ROTATION * roto_speed * 15, dt);
         if (tuxship.angle >= 360)
             tuxship.angle = tuxship.angle - 360;
-
-        tuxship.x1= fast_cos(DEG_PER_ROTATION*roto_speed) * tuxship.centerx
-            -fast_sin(DEG_PER_ROTATION*roto_speed) * tuxship.centery;
-        tuxship.y1= fast_sin(DEG_PER_ROTATION*roto_speed * tuxship.centerx
-                +fast_cos(DEG_PER_ROTATION*roto_speed)) * tuxship.centery;
-
     }
 
     /**************** Mouse Rotation ************************/
     tuxship.angle = (tuxship.angle + DEG_PER_ROTATION * -mouseroto) % 360;
     tuxship.angle += tuxship.angle < 0 ? 360 : 0;
 
-    tuxship.x1= fast_cos(DEG_PER_ROTATION*roto_speed) * tuxship.centerx
-        -fast_sin(DEG_PER_ROTATION*roto_speed) * tuxship.centery;
-    tuxship.y1= fast_sin(DEG_PER_ROTATION*roto_speed * tuxship.centerx
-            +fast_cos(DEG_PER_ROTATION*roto_speed)) * tuxship.centery;
-
     /**************** Move, and increse speed ***************/
 
 
     if (up_pressed && (tuxship.lives > 0))
     {
-        tuxship.xspeed += ((fast_cos(tuxship.angle >> 3) * 3) >> 10)*5;
-        tuxship.yspeed -= ((fast_sin(tuxship.angle >> 3) * 3) >> 10)*5;
+        tuxship.xspeed += FIXED_ROUND(15 * fixed_cos(tuxship.angle));
+        tuxship.yspeed -= FIXED_ROUND(15 * fixed_sin(tuxship.angle));
 
         //Google Code-In 2010 Task: Add sound for ship's thrust
         //Sound taken from http://www.freesound.org 20/12/2010
@@ -544,8 +542,23 @@ static void FF_handle_ship(void)
         }
     }
 
-    tuxship.x += tuxship.xspeed * FC_time_elapsed;
-    tuxship.y += tuxship.yspeed * FC_time_elapsed;
+    // Whole pixels this frame, the fractions being kept for the next:
+    dx = fixed_step(&tuxship.x_frac, tuxship.xspeed, dt);
+    dy = fixed_step(&tuxship.y_frac, tuxship.yspeed, dt);
+    tuxship.x += dx;
+    tuxship.y += dy;
+
+    // Lasers still being drawn drift along with the ship:
+    for (i = 0; i < MAX_LASER; i++)
+    {
+        if (laser[i].alive && laser[i].count > 0)
+        {
+            laser[i].x += dx;
+            laser[i].y += dy;
+            laser[i].destx += dx;
+            laser[i].desty += dy;
+        }
+    }
 
     /*************** Wrap ship around edges of screen ****************/
 
@@ -571,73 +584,92 @@ static void FF_handle_ship(void)
 static void FF_handle_asteroids(void){
 
     SDL_Surface* surf;
-    int i, found=0;
-    for (i = 0; i < MAX_ASTEROIDS; i++){
-        if (asteroid[i].alive)
-        {
+    fixed dt = FLOAT_TO_FIXED(FC_time_elapsed);
+    int i, k, n;
 
-            found=1;
+    if(motion.num_live == 0)
+    {
+        FF_add_level();
+        return;
+    }
 
-            /*************** Rotate asteroid ****************/
+    /*************** Rotate and move asteroids ****************/
 
-            asteroid[i].angle += ROUND(asteroid[i].angle_speed*FC_time_elapsed);
+    for (k = 0; k < motion.num_live; k++){
+        i = motion.live[k];
 
-            // Wrap rotation angle...
+        motion.angle[i] += fixed_step(&motion.angle_frac[i], motion.angle_speed[i], dt);
 
-            if (asteroid[i].angle < 0)
-                asteroid[i].angle = asteroid[i].angle + 360;
-            else if (asteroid[i].angle >= 360)
-                asteroid[i].angle = asteroid[i].angle - 360;
+        // Wrap rotation angle...
 
-            /**************Move the astroids ****************/
-            surf=get_asteroid_image(asteroid[i].size,asteroid[i].angle);
+        if (motion.angle[i] < 0)
+            motion.angle[i] = motion.angle[i] + 360;
+        else if (motion.angle[i] >= 360)
+            motion.angle[i] = motion.angle[i] - 360;
 
-            asteroid[i].rx += ROUND(asteroid[i].xspeed*FC_time_elapsed);
-            asteroid[i].ry += ROUND(asteroid[i].yspeed*FC_time_elapsed);
+        motion.rx[i] += fixed_step(&motion.x_frac[i], motion.xspeed[i], dt);
+        motion.ry[i] += fixed_step(&motion.y_frac[i], motion.yspeed[i], dt);
+    }
 
-            asteroid[i].x  = (asteroid[i].rx - (surf->w/2));
-            asteroid[i].y  = (asteroid[i].ry - (surf->h/2));
+    /*************** Place their images ****************/
 
-            // Wrap asteroid around edges of screen:
+    for (k = 0; k < motion.num_live; k++){
+        i = motion.live[k];
+        surf=get_asteroid_image(asteroid[i].size,motion.angle[i]);
 
-            if (asteroid[i].x >= (screen->w))
-                asteroid[i].rx = asteroid[i].rx - (screen->w);
-            else if (asteroid[i].x < 0)
-                asteroid[i].rx = asteroid[i].rx + (screen->w);
+        asteroid[i].x  = (motion.rx[i] - (surf->w/2));
+        asteroid[i].y  = (motion.ry[i] - (surf->h/2));
 
-            if (asteroid[i].y >= (screen->h))
-                asteroid[i].ry = asteroid[i].ry - (screen->h);
-            else if (asteroid[i].ry < 0)
-                asteroid[i].ry = asteroid[i].ry + (screen->h);
-            /**************Center Asteroids**************/
+        // Wrap asteroid around edges of screen:
 
-            asteroid[i].centerx=((surf->w)/2)+(asteroid[i].x-5);
-            asteroid[i].centery=((surf->h)/2)+(asteroid[i].y-5);
+        if (asteroid[i].x >= (screen->w))
+            motion.rx[i] = motion.rx[i] - (screen->w);
+        else if (asteroid[i].x < 0)
+            motion.rx[i] = motion.rx[i] + (screen->w);
 
-            /*************** Collisions! ****************/
+        if (asteroid[i].y >= (screen->h))
+            motion.ry[i] = motion.ry[i] - (screen->h);
+        else if (motion.ry[i] < 0)
+            motion.ry[i] = motion.ry[i] + (screen->h);
+        /**************Center Asteroids**************/
 
-            if(AsteroidColl(surf->w, surf->h, asteroid[i].x, asteroid[i].y, tuxship.centerx, tuxship.centery) &&
-                    !(bonus == TB_CLOAKING && bonus_time > 0))
-            {
-                if(!tuxship.hurt)
-                {
-                    asteroid[i].xdead=asteroid[i].centerx;
-                    asteroid[i].ydead=asteroid[i].centery;
+        asteroid[i].centerx=((surf->w)/2)+(asteroid[i].x-5);
+        asteroid[i].centery=((surf->h)/2)+(asteroid[i].y-5);
+    }
+    asteroid_grid_dirty = 1;
 
-                    if(!(bonus == TB_FORCEFIELD && bonus_time > 0)) {
-                        tuxship.lives--;
-                        tuxship.hurt=1;
-                        tuxship.hurt_count=50;
-                    }
-                    FF_destroy_asteroid(i, tuxship.xspeed, tuxship.yspeed);
-                    playsound(SND_EXPLOSION);
+    /*************** Collisions! ****************/
+
+    if(bonus == TB_CLOAKING && bonus_time > 0)
+        return;
+
+    // Only the asteroids in the grid cell under the ship can hit it:
+    update_asteroid_grid();
+    n = grid_query_circle(tuxship.centerx, tuxship.centery, 0, grid_ids, MAX_ASTEROIDS);
+    for (k = 0; k < n; k++)
+    {
+        i = grid_ids[k];
+        if (!asteroid[i].alive)
+            continue;
+        surf=get_asteroid_image(asteroid[i].size,motion.angle[i]);
+        if(AsteroidColl(surf->w, surf->h, asteroid[i].x, asteroid[i].y, tuxship.centerx, tuxship.centery))
+        {
+            if(!tuxship.hurt)
+            {
+                asteroid[i].xdead=asteroid[i].centerx;
+                asteroid[i].ydead=asteroid[i].centery;
 
+                if(!(bonus == TB_FORCEFIELD && bonus_time > 0)) {
+                    tuxship.lives--;
+                    tuxship.hurt=1;
+                    tuxship.hurt_count=50;
                 }
+                FF_destroy_asteroid(i, tuxship.xspeed, tuxship.yspeed);
+                playsound(SND_EXPLOSION);
+
             }
         }
     }
-    if(!found)
-        FF_add_level();
 }
 
 static void FF_handle_answer(void)
@@ -687,7 +719,7 @@ int AsteroidColl(int astW,int astH,int astX,int astY,
     x1=astX;
     y1=astY+astHq*3;
 
-    x2=astW;
+    x2=astX+astW;
     y2=astY+astHq*6;
 
     if(x>x1 && x<x2 && y>y1 && y<y2)
@@ -749,10 +781,9 @@ static void FF_add_level(void)
     digits[1] = c_prime / 10;
 
     //Limit the new asteroids
-    if(NUM_ASTEROIDS<MAX_ASTEROIDS)
-        NUM_ASTEROIDS=NUM_ASTEROIDS+wave;
-    else
-        NUM_ASTEROIDS=MAX_ASTEROIDS;
+    NUM_ASTEROIDS=NUM_ASTEROIDS+wave;
+    if(NUM_ASTEROIDS>MAX_WAVE_ASTEROIDS)
+        NUM_ASTEROIDS=MAX_WAVE_ASTEROIDS;
 
     width = screen->w;
     if (screen->h < width)
@@ -768,8 +799,9 @@ static void FF_add_level(void)
         max_speed = 1;
 
     for (i=0; i<MAX_ASTEROIDS; i++)
-        asteroid[i].alive=0;
-    for (i=0; i<NUM_ASTEROIDS && NUM_ASTEROIDS<MAX_ASTEROIDS; i++){
+        asteroid_set_alive(i, 0);
+    asteroid_grid_dirty = 1;
+    for (i=0; i<NUM_ASTEROIDS; i++){
         // Generate the new position, avoiding the location of the ship
         ok = 0;
         while (!ok) {
@@ -821,7 +853,7 @@ static void FF_add_level(void)
 
             rect.x=(screen->w/2)-(images[IMG_GOOD]->w/2);
             rect.y=(screen->h/2)-(images[IMG_GOOD]->h/2);
-            factoroids_draw(asteroid, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+            factoroids_draw(asteroid, &motion, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
             SDL_BlitSurface(images[IMG_GOOD],NULL,screen,&rect);
             SDL_Flip(screen);
 
@@ -831,7 +863,7 @@ static void FF_add_level(void)
         //Empty the message queue
         while(SDL_PollEvent(&event));
 
-        factoroids_draw(asteroid, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
+        factoroids_draw(asteroid, &motion, &tuxship, laser, bonus, bonus_time, digits, wave, score, num, tux_img, button_pressed);
         factoroids_level_message(wave);
         /* Reset frame counter */
         FC_init();
@@ -942,6 +974,7 @@ static int FF_over(int game_status)
 static void FF_exit_free()
 {
     free(asteroid);
+    grid_cleanup();
     factoroids_cleanup_graphics();
 
     /* Resume "normal" settings when we leave:
@@ -983,30 +1016,6 @@ int is_simplified(int a, int b)
             return 0;
     return 1;
 }
-/*** Fast cos by Bill***/
-
-int fast_cos(int angle)
-{
-    angle = (angle % 45);
-
-    if (angle < 12)
-        return(trig[angle]);
-    else if (angle < 23)
-        return(-trig[10 - (angle - 12)]);
-    else if (angle < 34)
-        return(-trig[angle - 22]);
-    else
-        return(trig[45 - angle]);
-}
-
-
-/*** Sine based on fast cosine..., by Bill ***/
-
-int fast_sin(int angle)
-{
-    return(- fast_cos((angle + 11) % 45));
-}
-
 /*** fact_number generator by aviraldg ***/
 
 static int generatenumber(int wave) {
@@ -1070,13 +1079,12 @@ void _tb_PowerBomb (int num) {
 /*Return -1 if no laser is available*/
 int FF_add_laser(void)
 {
-    int i, k, zapIndex, zapScore;
-    float ux, uy, s, smin,dx,dy,dx2, dy2, d2, thresh;
+    int i, j, k, n, zapIndex, zapScore, dx, dy, half;
+    fixed ux, uy, s, smin, dx2, dy2;
+    Sint64 d2, thresh;
     int screensize;
     SDL_Surface *asteroid_image;
 
-    const float inside_factor = 0.9*0.9;
-
     screensize = screen->w;
     if (screensize < screen->h)
         screensize = screen->h;
@@ -1093,10 +1101,10 @@ int FF_add_laser(void)
             laser[i].count=15;
             laser[i].n = num;
 
-            ux = cos((float)laser[i].angle * DEG_TO_RAD);
-            uy = -sin((float)laser[i].angle * DEG_TO_RAD);
-            laser[i].destx = laser[i].x + (int)(ux * screensize);
-            laser[i].desty = laser[i].y + (int)(uy * screensize);
+            ux = fixed_cos(laser[i].angle);
+            uy = -fixed_sin(laser[i].angle);
+            laser[i].destx = laser[i].x + FIXED_FLOOR(ux * screensize);
+            laser[i].desty = laser[i].y + FIXED_FLOOR(uy * screensize);
 
             // Check to see if it hits asteroids---we only check when it
             // just starts firing, "drift" later doesn't count!
@@ -1105,17 +1113,27 @@ int FF_add_laser(void)
             //   u = (ux,uy) is the unit vector of the laser's direction
             //   s (a scalar) is the distance along the laser (s >= 0)
             // With this parametrization, it's easy to calculate the
-            // closest approach to the asteroid center, etc.
+            // closest approach to the asteroid center, etc.  u and s are
+            // in fixed point, the rest in whole pixels.
             zapIndex = -1;  // keep track of the closest "hit" asteroid
             zapScore = 0;
-            smin = 10*screensize;
-
-
-            for (k=0; k<MAX_ASTEROIDS; k++)
+            smin = 0;
+
+
+            // Only the asteroids in grid cells along the laser can be hit
+            // (it is followed twice the screen size, to be sure of
+            // reaching the far corner):
+            update_asteroid_grid();
+            n = grid_query_segment(laser[i].x, laser[i].y,
+                    laser[i].x + FIXED_FLOOR(2 * ux * screensize),
+                    laser[i].y + FIXED_FLOOR(2 * uy * screensize),
+                    grid_ids, MAX_ASTEROIDS);
+            for (j = 0; j < n; j++)
             {
+                k = grid_ids[j];
                 if (!asteroid[k].alive)
                     continue;
-                asteroid_image = get_asteroid_image(asteroid[k].size,asteroid[k].angle);
+                asteroid_image = get_asteroid_image(asteroid[k].size,motion.angle[k]);
                 dx = asteroid[k].x + asteroid_image->w/2 - laser[i].x;
                 dy = asteroid[k].y + asteroid_image->h/2 - laser[i].y;
                 // Find distance along laser of closest approach to asteroid center
@@ -1123,11 +1141,12 @@ int FF_add_laser(void)
                 if (s >= 0)  // don't worry about it if it's in the opposite direction! (i.e., behind the ship)
                 {
                     // Find the distance to the asteroid center at closest approach
-                    dx2 = dx - s*ux;
-                    dy2 = dy - s*uy;
-                    d2 = dx2*dx2 + dy2*dy2;
-                    thresh = (asteroid_image->h)/2;
-                    thresh = thresh*thresh*inside_factor;
+                    // (inside 0.9 of its radius counts)
+                    dx2 = INT_TO_FIXED(dx) - FIXED_MUL(s, ux);
+                    dy2 = INT_TO_FIXED(dy) - FIXED_MUL(s, uy);
+                    d2 = ((Sint64)dx2*dx2 + (Sint64)dy2*dy2) >> FIXED_SHIFT;
+                    half = (asteroid_image->h)/2;
+                    thresh = (Sint64)half*half*FIXED_ONE*81/100;
                     if (d2 < thresh)
                     {
                         // The laser intersects the asteroid. Check to see if
@@ -1138,7 +1157,7 @@ int FF_add_laser(void)
                           )
                         {
                             // It's valid, check to see if it's closest
-                            if (s < smin)
+                            if (zapIndex < 0 || s < smin)
                             {
                                 // It's the closest yet examined but has not score
                                 smin = s;
@@ -1150,7 +1169,7 @@ int FF_add_laser(void)
                                 (FF_game==FRACTIONS_GAME && num > 1 && ((asteroid[k].a%num)==0) && ((asteroid[k].b%num)==0) && (num!=asteroid[k].fact_number)))
                         {
                             // It's valid, check to see if it's closest
-                            if (s < smin)
+                            if (zapIndex < 0 || s < smin)
                             {
                                 // It's the closest yet examined and has socre
                                 smin = s;
@@ -1166,9 +1185,9 @@ int FF_add_laser(void)
             if (zapIndex >= 0)  // did we zap one?
             {
                 asteroid[zapIndex].isdead = 1;
-                laser[i].destx = laser[i].x + (int)(ux * smin);
-                laser[i].desty = laser[i].y + (int)(uy * smin);
-                FF_destroy_asteroid(zapIndex,30*ux,30*uy);
+                laser[i].destx = laser[i].x + FIXED_FLOOR(FIXED_MUL(ux, smin));
+                laser[i].desty = laser[i].y + FIXED_FLOOR(FIXED_MUL(uy, smin));
+                FF_destroy_asteroid(zapIndex, FIXED_TO_FLOAT(30*ux), FIXED_TO_FLOAT(30*uy));
                 playsound(SND_SIZZLE);
 
                 if (floor((float)score/100) < floor((float)(score+num)/100))
@@ -1195,38 +1214,39 @@ static int FF_add_asteroid(int x, int y, int xspeed, int yspeed, int size, int a
     for(i=0; i<MAX_ASTEROIDS; i++){
         if(asteroid[i].alive==0)
         {
-            asteroid[i].alive=1;
-            asteroid[i].rx=x;
-            asteroid[i].ry=y;
-            asteroid[i].angle=angle;
-            asteroid[i].y=(asteroid[i].ry - tuxship_img_h(asteroid[i].angle/DEG_PER_ROTATION)/2);
-            asteroid[i].x=(asteroid[i].rx - tuxship_img_w(asteroid[i].angle/DEG_PER_ROTATION)/2);
+            asteroid_set_alive(i, 1);
+            motion.rx[i]=x;
+            motion.ry[i]=y;
+            motion.angle[i]=angle;
+            motion.angle_frac[i] = motion.x_frac[i] = motion.y_frac[i] = 0;
+            asteroid[i].y=(motion.ry[i] - tuxship_img_h(motion.angle[i])/2);
+            asteroid[i].x=(motion.rx[i] - tuxship_img_w(motion.angle[i])/2);
             asteroid[i].xdead = 0;
             asteroid[i].ydead = 0;
             asteroid[i].isdead = 0;
             asteroid[i].countdead = 0;
 
-            //Without this on higher frame rates moevement in pixels per frame could be less than 1
+            //Keep every asteroid moving fast enough to see
             if(xspeed < 16 && xspeed >= 0)
-                asteroid[i].xspeed = (rand()%4+1)*16;
+                motion.xspeed[i] = (rand()%4+1)*16;
             else if(xspeed > -16 && xspeed <= 0)
-                asteroid[i].xspeed = -(rand()%4+1)*16;
+                motion.xspeed[i] = -(rand()%4+1)*16;
             else
-                asteroid[i].xspeed = xspeed;
+                motion.xspeed[i] = xspeed;
 
             if(yspeed < 16 && yspeed >= 0)
-                asteroid[i].yspeed = (rand()%4+1)*16;
+                motion.yspeed[i] = (rand()%4+1)*16;
             else if(yspeed > -16 && yspeed <= 0)
-                asteroid[i].yspeed = -(rand()%4+1)*16;
+                motion.yspeed[i] = -(rand()%4+1)*16;
             else
-                asteroid[i].yspeed = yspeed;
+                motion.yspeed[i] = yspeed;
 
             if(angle_speed < 16 && angle_speed >= 0)
-                asteroid[i].angle_speed = (rand()%4+1)*16;
+                motion.angle_speed[i] = (rand()%4+1)*16;
             else if(angle_speed > -16 && angle_speed <= 0)
-                asteroid[i].angle_speed = -(rand()%4+1)*16;
+                motion.angle_speed[i] = -(rand()%4+1)*16;
             else
-                asteroid[i].angle_speed = angle_speed;
+                motion.angle_speed[i] = angle_speed;
 
             if(FF_game==FACTOROIDS_GAME){
 
@@ -1261,8 +1281,8 @@ static int FF_add_asteroid(int x, int y, int xspeed, int yspeed, int size, int a
                         tuxship.y+50>asteroid[i].y &&
                         tuxship.lives>0 &&
                         asteroid[i].alive){
-                    asteroid[i].rx=asteroid[i].rx+300;
-                    asteroid[i].ry=asteroid[i].ry+300;
+                    motion.rx[i]=motion.rx[i]+300;
+                    motion.ry[i]=motion.ry[i]+300;
                 }
             }
 
@@ -1282,9 +1302,9 @@ static int FF_add_asteroid(int x, int y, int xspeed, int yspeed, int size, int a
                 asteroid[i].radius=(images[IMG_ASTEROID1]->h/2);
             }
 
-            while (asteroid[i].xspeed==0)
+            while (motion.xspeed[i]==0)
             {
-                asteroid[i].xspeed = ((rand() % 3) - 1)*2;
+                motion.xspeed[i] = ((rand() % 3) - 1)*2;
             }
             return 1;
         }
@@ -1293,6 +1313,54 @@ static int FF_add_asteroid(int x, int y, int xspeed, int yspeed, int size, int a
     return -1;
 }
 
+/* List every asteroid in the collision grid where it is now, unless */
+/* none has changed since it was last done:                          */
+static void update_asteroid_grid(void)
+{
+    SDL_Surface* surf;
+    int i, k;
+
+    if (!asteroid_grid_dirty)
+        return;
+
+    grid_clear();
+    for (k = 0; k < motion.num_live; k++)
+    {
+        i = motion.live[k];
+        surf = get_asteroid_image(asteroid[i].size, motion.angle[i]);
+        grid_add(i, asteroid[i].x + surf->w/2, asteroid[i].y + surf->h/2,
+                MAX(surf->w, surf->h)/2 + 1);
+    }
+    asteroid_grid_dirty = 0;
+}
+
+/* Set asteroid[i].alive, keeping motion.live[] in slot order: */
+static void asteroid_set_alive(int i, int alive)
+{
+    int* live = motion.live;
+    int k;
+
+    asteroid[i].alive = alive;
+    asteroid_grid_dirty = 1;
+    for (k = 0; k < motion.num_live && live[k] < i; k++)
+        ;
+    if (alive)
+    {
+        if (k < motion.num_live && live[k] == i)
+            return;
+        memmove(&live[k + 1], &live[k], (motion.num_live - k) * sizeof(int));
+        live[k] = i;
+        motion.num_live++;
+    }
+    else
+    {
+        if (k == motion.num_live || live[k] != i)
+            return;
+        memmove(&live[k], &live[k + 1], (motion.num_live - k - 1) * sizeof(int));
+        motion.num_live--;
+    }
+}
+
 int FF_destroy_asteroid(int i, float xspeed, float yspeed)
 {
     if(asteroid[i].alive==1){
@@ -1306,38 +1374,38 @@ int FF_destroy_asteroid(int i, float xspeed, float yspeed)
 
 
                 if(FF_game==FACTOROIDS_GAME){
-                    FF_add_asteroid(asteroid[i].rx,
-                            asteroid[i].ry,
-                            asteroid[i].xspeed + (xspeed - yspeed)/2,
-                            asteroid[i].yspeed + (yspeed + xspeed)/2,
+                    FF_add_asteroid(motion.rx[i],
+                            motion.ry[i],
+                            motion.xspeed[i] + (xspeed - yspeed)/2,
+                            motion.yspeed[i] + (yspeed + xspeed)/2,
                             0,
                             rand()%360, rand()%150-75, (int)(asteroid[i].fact_number/num),
                             0, 0,
                             0);
 
-                    FF_add_asteroid(asteroid[i].rx,
-                            asteroid[i].ry,
-                            asteroid[i].xspeed + (xspeed + yspeed)/2,
-                            asteroid[i].yspeed + (yspeed - xspeed)/2,
+                    FF_add_asteroid(motion.rx[i],
+                            motion.ry[i],
+                            motion.xspeed[i] + (xspeed + yspeed)/2,
+                            motion.yspeed[i] + (yspeed - xspeed)/2,
                             0,
                             rand()%360, rand()%150-75, num,
                             0, 0,
                             0);
                 }
                 else if(FF_game==FRACTIONS_GAME){
-                    FF_add_asteroid(asteroid[i].rx,
-                            asteroid[i].ry,
-                            ((asteroid[i].xspeed + xspeed) / 2),
-                            (asteroid[i].yspeed + yspeed),
+                    FF_add_asteroid(motion.rx[i],
+                            motion.ry[i],
+                            ((motion.xspeed[i] + xspeed) / 2),
+                            (motion.yspeed[i] + yspeed),
                             0,
                             rand()%360, rand()%150-75, 0,
                             (int)(asteroid[i].a/num), (int)(asteroid[i].b/num),
                             0);
 
-                    FF_add_asteroid(asteroid[i].rx,
-                            asteroid[i].ry,
-                            (asteroid[i].xspeed + xspeed),
-                            ((asteroid[i].yspeed + yspeed) / 2),
+                    FF_add_asteroid(motion.rx[i],
+                            motion.ry[i],
+                            (motion.xspeed[i] + xspeed),
+                            ((motion.yspeed[i] + yspeed) / 2),
                             0,
                             rand()%360, rand()%150-75, 0,
                             (int)(asteroid[i].b/num), (int)(asteroid[i].a/num),
@@ -1348,7 +1416,7 @@ int FF_destroy_asteroid(int i, float xspeed, float yspeed)
 
         /* Destroy the old asteroid */
 
-        asteroid[i].alive=0;
+        asteroid_set_alive(i, 0);
         return 1;
     }
     return 0;
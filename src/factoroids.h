@@ -32,14 +32,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <stdbool.h>
 
 #include "fileops.h"
+#include "fixed.h"
+
+/* Room for the biggest waves and the fragments of their asteroids: */
+#define MAX_ASTEROIDS 256
 
 
 typedef struct asteroid_type {
     int alive, size;
-    int angle, angle_speed;
-    int xspeed, yspeed;
     int x, y;
-    int rx, ry;
     int centerx, centery;
     int radius;
     int fact_number;
@@ -49,13 +50,25 @@ typedef struct asteroid_type {
     int xdead, ydead, isdead, countdead;
 } asteroid_type;
 
+/* Spin and speed of asteroid[i]; live[] indexes the ones still flying: */
+typedef struct asteroid_motion {
+    int angle[MAX_ASTEROIDS], angle_speed[MAX_ASTEROIDS];
+    int xspeed[MAX_ASTEROIDS], yspeed[MAX_ASTEROIDS];
+    int rx[MAX_ASTEROIDS], ry[MAX_ASTEROIDS];
+    /* the fractions of a degree or pixel not yet moved (see fixed.h): */
+    fixed angle_frac[MAX_ASTEROIDS];
+    fixed x_frac[MAX_ASTEROIDS], y_frac[MAX_ASTEROIDS];
+    int live[MAX_ASTEROIDS];
+    int num_live;
+} asteroid_motion;
+
 
 typedef struct tuxship_type {
     int lives, size;
     int xspeed, yspeed;
     int x, y;
     int rx, ry;
-    int x1,y1,x2,y2,x3,y3;
+    fixed x_frac, y_frac, angle_frac;
     int radius;
     int centerx, centery;
     int angle;
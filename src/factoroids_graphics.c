@@ -2,9 +2,13 @@
 
 #include "tuxmath.h"
 #include "fileops.h"
+#include "setup.h"
 #include "factoroids.h"
 #include "frame_counter.h"
 #include "draw_utils.h"
+#include "profiler.h"
+#include "blend.h"
+#include "roto_cache.h"
 #include "SDL_rotozoom.h"
 
 /* definitions for cockpit buttons */
@@ -27,12 +31,10 @@
 #define BASE_RES_X 1280
 
 #define MAX_LASER 5
-#define MAX_ASTEROIDS 50
 #define NUM_TUXSHIPS 2
 #define NUM_SPRITES 11
 #define TUXSHIP_LIVES 3
 #define DEG_PER_ROTATION 2
-#define NUM_OF_ROTO_IMGS 360/DEG_PER_ROTATION
 
 
 /* definitions of level message */
@@ -83,15 +85,35 @@ int bonus_img_ids[] = {
 };
 
 static float zoom;
+/* Whether we're holding the factoroids bundle of images: */
+static int bundle_loaded = 0;
 
 //SDL_Surfaces:
 static SDL_Surface* IMG_lives_ship = NULL;
-static SDL_Surface* IMG_tuxship[NUM_OF_ROTO_IMGS];
-static SDL_Surface* IMG_tuxship_cloaked[NUM_OF_ROTO_IMGS];
-static SDL_Surface* IMG_tuxship_thrust[NUM_OF_ROTO_IMGS];
-static SDL_Surface* IMG_tuxship_thrust_cloaked[NUM_OF_ROTO_IMGS];
-static SDL_Surface* IMG_asteroids1[NUM_OF_ROTO_IMGS];
-static SDL_Surface* IMG_asteroids2[NUM_OF_ROTO_IMGS];
+
+/* The images drawn rotated (from the rotation cache), and what */
+/* they are rotated from:                                       */
+enum {
+    ROTO_SHIP,
+    ROTO_SHIP_CLOAKED,
+    ROTO_SHIP_THRUST,
+    ROTO_SHIP_THRUST_CLOAKED,
+    ROTO_ASTEROID1,
+    ROTO_ASTEROID2,
+    NUM_ROTO_SOURCES
+};
+static int roto_sources[NUM_ROTO_SOURCES] = {
+    IMG_SHIP01, IMG_SHIP_CLOAKED, IMG_SHIP_THRUST,
+    IMG_SHIP_THRUST_CLOAKED, IMG_ASTEROID1, IMG_ASTEROID2
+};
+/* The asteroids are always turning, so they're prewarmed first: */
+static int prewarm_order[NUM_ROTO_SOURCES] = {
+    ROTO_ASTEROID1, ROTO_ASTEROID2, ROTO_SHIP, ROTO_SHIP_THRUST,
+    ROTO_SHIP_CLOAKED, ROTO_SHIP_THRUST_CLOAKED
+};
+
+static SDL_Surface* rotate_image(SDL_Surface* src, double angle, double zoom);
+static SDL_Surface* rotated(int src, int angle);
 
 SDL_Surface* bkgd = NULL; //640x480 background (windowed)
 SDL_Surface* scaled_bkgd = NULL; //native resolution (fullscreen)
@@ -108,6 +130,18 @@ SDL_Surface* current_bkgd(void)
 int factoroids_init_graphics(void)
 {
     int i;
+    SDL_Surface* srcs[NUM_ROTO_SOURCES];
+
+    /* The game's images are only loaded while it is running: */
+    if (!bundle_loaded)
+    {
+        if (!load_bundle(BUNDLE_FACTOROIDS))
+        {
+            fprintf(stderr, "factoroids_init_graphics(): could not load images\n");
+            return 0;
+        }
+        bundle_loaded = 1;
+    }
 
     if(screen->h < 600 && screen->w < 800)
         zoom = 0.65;
@@ -121,7 +155,7 @@ int factoroids_init_graphics(void)
     /* NOTE - optimization code moved into LoadBothBkgds() so rest of program     */
     /* can take advantage of it - DSB                                             */
 
-    T4K_LoadBothBkgds("factoroids/gbstars.png", &scaled_bkgd, &bkgd);
+    load_both_bkgds("factoroids/gbstars.png", &scaled_bkgd, &bkgd);
 
     if (bkgd == NULL || scaled_bkgd == NULL)
     {
@@ -130,84 +164,54 @@ int factoroids_init_graphics(void)
         return 0;
     }
 
-    /*************** Precalculating software rotation ***************/
+    /*************** Software rotation ***************/
+    /* The rotated ship and asteroids are made as they are first drawn, */
+    /* keeping only as many as Opts_RotationCacheSize() allows:         */
 
-    for(i = 0; i < NUM_OF_ROTO_IMGS; i++)
-    {
-        //rotozoomSurface (SDL_Surface *src, double angle, double zoom, int smooth);
-        IMG_tuxship[i] = rotozoomSurface(images[IMG_SHIP01], i * DEG_PER_ROTATION, zoom, 1);
-        IMG_tuxship_cloaked[i] = rotozoomSurface(images[IMG_SHIP_CLOAKED], i * DEG_PER_ROTATION, zoom, 1);
-        IMG_tuxship_thrust[i] = rotozoomSurface(images[IMG_SHIP_THRUST], i * DEG_PER_ROTATION, zoom, 1);
-        IMG_tuxship_thrust_cloaked[i] = rotozoomSurface(images[IMG_SHIP_THRUST_CLOAKED], i * DEG_PER_ROTATION, zoom, 1);
-
-        if (IMG_tuxship[i] == NULL)
-        {
-            fprintf(stderr,
-                    "\nError: rotozoomSurface() of images[IMG_SHIP01] for i = %d returned NULL\n", i);
-            return 0;
-        }
-
-        IMG_asteroids1[i] = rotozoomSurface(images[IMG_ASTEROID1], i * DEG_PER_ROTATION, zoom, 1);
+    for(i = 0; i < NUM_ROTO_SOURCES; i++)
+        srcs[i] = images[roto_sources[i]];
+    if(!roto_cache_init(srcs, NUM_ROTO_SOURCES, zoom, Opts_RotationStep(),
+                Opts_RotationCacheSize() * 1024 * 1024))
+        return 0;
+    if(Opts_RotationPrewarm())
+        roto_cache_prewarm(prewarm_order, NUM_ROTO_SOURCES);
 
-        if (IMG_asteroids1[i] == NULL)
-        {
-            fprintf(stderr,
-                    "\nError: rotozoomSurface() of images[IMG_ASTEROID1] for i = %d returned NULL\n", i);
-            return 0;
-        }
+    /* Create zoomed and scaled ship image for "lives" counter */
+    IMG_lives_ship = rotate_image(images[IMG_SHIP_CLOAKED], 90, zoom * 0.7);
+    if (IMG_lives_ship == NULL)
+    {
+        fprintf(stderr,
+                "\nError: rotozoomSurface() of images[%d] returned NULL\n",
+                IMG_SHIP_CLOAKED);
+        return 0;
+    }
 
-        IMG_asteroids2[i] = rotozoomSurface(images[IMG_ASTEROID2], i*DEG_PER_ROTATION, zoom, 1);
+    return 1;
+}
 
-        if (IMG_asteroids2[i] == NULL)
-        {
-            fprintf(stderr,
-                    "\nError: rotozoomSurface() of images[IMG_ASTEROID2] for i = %d returned NULL\n", i);
-            return 0;
-        }
-    }
 
-    /* Create zoomed and scaled ship image for "lives" counter */
-    IMG_lives_ship = rotozoomSurface(images[IMG_SHIP_CLOAKED], 90, zoom * 0.7, 1);
+/* Rotate and zoom an image, converting the result to the display */
+/* format so it needn't be converted every time it is drawn:      */
+static SDL_Surface* rotate_image(SDL_Surface* src, double angle, double zoom)
+{
+    SDL_Surface* rotated;
+    SDL_Surface* converted;
+
+    //rotozoomSurface (SDL_Surface *src, double angle, double zoom, int smooth);
+    rotated = rotozoomSurface(src, angle, zoom, 1);
+    if (!rotated)
+        return NULL;
+    converted = SDL_DisplayFormatAlpha(rotated);
+    if (!converted)
+        return rotated;
+    SDL_FreeSurface(rotated);
+    return converted;
 }
 
 
 void factoroids_cleanup_graphics(void)
 {
-    int i;
-
-    for(i = 0; i < NUM_OF_ROTO_IMGS; i++)
-    {
-        if (IMG_tuxship[i])
-        {
-            SDL_FreeSurface(IMG_tuxship[i]);
-            IMG_tuxship[i] = NULL;
-        }
-        if (IMG_tuxship_thrust[i])
-        {
-            SDL_FreeSurface(IMG_tuxship_thrust[i]);
-            IMG_tuxship_thrust[i] = NULL;
-        }
-        if (IMG_tuxship_cloaked[i])
-        {
-            SDL_FreeSurface(IMG_tuxship_cloaked[i]);
-            IMG_tuxship_cloaked[i] = NULL;
-        }
-        if (IMG_tuxship_thrust_cloaked[i])
-        {
-            SDL_FreeSurface(IMG_tuxship_thrust_cloaked[i]);
-            IMG_tuxship_thrust_cloaked[i] = NULL;
-        }
-        if (IMG_asteroids1[i])
-        {
-            SDL_FreeSurface(IMG_asteroids1[i]);
-            IMG_asteroids1[i] = NULL;
-        }
-        if (IMG_asteroids2[i])
-        {
-            SDL_FreeSurface(IMG_asteroids2[i]);
-            IMG_asteroids2[i] = NULL;
-        }
-    }
+    roto_cache_cleanup();
 
     if (IMG_lives_ship)
     {
@@ -225,6 +229,12 @@ void factoroids_cleanup_graphics(void)
         SDL_FreeSurface(scaled_bkgd);
         scaled_bkgd = NULL;
     }
+
+    if (bundle_loaded)
+    {
+        release_bundle(BUNDLE_FACTOROIDS);
+        bundle_loaded = 0;
+    }
 }
 
 
@@ -252,7 +262,7 @@ void factoroids_intro(void)
                     "Switch Prime Number Gun: [D], [F], or mouse scroll wheel.\n"
                     "Activate Powerup: [Shift].\n"
                     "Shoot the rocks with their prime factors until they are all destroyed."));
-        SDL_BlitSurface(IMG_asteroids1[3],NULL,screen,&rect);
+        SDL_BlitSurface(rotated(ROTO_ASTEROID1, 3 * DEG_PER_ROTATION),NULL,screen,&rect);
     }
     else if (FF_game == FRACTIONS_GAME)
     {
@@ -270,34 +280,36 @@ void factoroids_intro(void)
 }
 
 
-void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_type *laser,
+void factoroids_draw(asteroid_type *asteroid, const asteroid_motion *motion, tuxship_type *tuxship, FF_laser_type *laser,
         int bonus, int bonus_time, int *digits, int wave, int score, int num,
         int tux_img, int button_pressed)
 {
 
-    int i, offset;
+    int i, k, offset;
     int xnum, ynum;
     char str[64];
     SDL_Surface* surf;
     SDL_Rect dest;
 
-    SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+    /* (rotated images from the last frame may be freed now) */
+    PROF_begin(PROF_DRAW_BKGR);
+    roto_cache_next_frame();
+
+    blend_fill(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
 
     /************ Draw Background ***************/
 
     factoroids_draw_bkgr();
+    PROF_end(PROF_DRAW_BKGR);
 
     /******************* Draw laser *************************/
+    PROF_begin(PROF_DRAW_LASERS);
+    draw_lines_begin(screen);
     for (i=0;i<MAX_LASER;i++){
         if(laser[i].alive)
         {
             if(laser[i].count>0)
             {
-                laser[i].x += tuxship->xspeed*FC_time_elapsed;
-                laser[i].y += tuxship->yspeed*FC_time_elapsed;
-                laser[i].destx += tuxship->xspeed*FC_time_elapsed;
-                laser[i].desty += tuxship->yspeed*FC_time_elapsed;
-
                 draw_line(screen, laser[i].x, laser[i].y, laser[i].destx, laser[i].desty,
                         laser[i].count*laser_coeffs[laser[i].n][0], laser[i].count*laser_coeffs[laser[i].n][1], laser[i].count*laser_coeffs[laser[i].n][2]);
 
@@ -308,49 +320,70 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
             }
         }
     }
+    draw_lines_end();
+    PROF_end(PROF_DRAW_LASERS);
     /*************** Draw Ship ******************/
+    PROF_begin(PROF_DRAW_SHIP);
 
     if(!tuxship->hurt || (tuxship->hurt && tuxship->hurt_count%2==0)){
-        dest.x = (tuxship->x - (IMG_tuxship[tuxship->angle/DEG_PER_ROTATION]->w/2));
-        dest.y = (tuxship->y - (IMG_tuxship[tuxship->angle/DEG_PER_ROTATION]->h/2));
-        dest.w = IMG_tuxship[tuxship->angle/DEG_PER_ROTATION]->w;
-        dest.h = IMG_tuxship[tuxship->angle/DEG_PER_ROTATION]->h;
+        int ship;
 
         //Change the image based on if the rocket is thrusting
         //Google code in task
 
         if(!tuxship->thrust) {
-            SDL_Surface **_IMG_ship = bonus == TB_CLOAKING && bonus_time>0 ? IMG_tuxship_cloaked : IMG_tuxship;
-            SDL_BlitSurface(_IMG_ship[tuxship->angle/DEG_PER_ROTATION], NULL, screen, &dest);
+            ship = bonus == TB_CLOAKING && bonus_time>0 ? ROTO_SHIP_CLOAKED : ROTO_SHIP;
         } else {
-            SDL_Surface **_IMG_ship = bonus == TB_CLOAKING && bonus_time>0 ? IMG_tuxship_thrust_cloaked : IMG_tuxship_thrust;
-            SDL_BlitSurface(_IMG_ship[tuxship->angle/DEG_PER_ROTATION], NULL, screen, &dest);
+            ship = bonus == TB_CLOAKING && bonus_time>0 ? ROTO_SHIP_THRUST_CLOAKED : ROTO_SHIP_THRUST;
         }
+        surf = rotated(ship, tuxship->angle);
+
+        dest.x = (tuxship->x - (surf->w/2));
+        dest.y = (tuxship->y - (surf->h/2));
+        dest.w = surf->w;
+        dest.h = surf->h;
+        draw_list_add(surf, NULL, &dest, FF_LAYER_SHIP);
 
 
 
         if(bonus == TB_FORCEFIELD && bonus_time > 0) {
             SDL_Rect tmp = {tuxship->x - images[IMG_FORCEFIELD]->w/2, tuxship->y - images[IMG_FORCEFIELD]->h/2};
-            SDL_BlitSurface(images[IMG_FORCEFIELD], NULL, screen, &tmp);
+            draw_list_add(images[IMG_FORCEFIELD], NULL, &tmp, FF_LAYER_FORCEFIELD);
         }
     }
 
     /************* Draw Asteroids ***************/
-    for(i=0; i<MAX_ASTEROIDS; i++){
+    /* Asteroids sharing a rotation frame are blitted together, so   */
+    /* the numbers go on in a second pass once they are all drawn:   */
+    PROF_end(PROF_DRAW_SHIP);
+    PROF_begin(PROF_DRAW_ASTEROIDS);
+    for(k=0; k<motion->num_live; k++){
+        i = motion->live[k];
         if(asteroid[i].alive>0){
 
-            xnum=0;
-            ynum=0;
-
             dest.x = asteroid[i].x;
             dest.y = asteroid[i].y;
 
-            surf=get_asteroid_image(asteroid[i].size,asteroid[i].angle);
+            surf=get_asteroid_image(asteroid[i].size,motion->angle[i]);
 
             dest.w = surf->w;
             dest.h = surf->h;
 
-            SDL_BlitSurface(surf, NULL, screen, &dest);
+            draw_list_add(surf, NULL, &dest, FF_LAYER_ASTEROIDS);
+        }
+    }
+    PROF_end(PROF_DRAW_ASTEROIDS);
+    PROF_begin(PROF_DRAW_SPRITES);
+    draw_list_flush();
+    PROF_end(PROF_DRAW_SPRITES);
+
+    PROF_begin(PROF_DRAW_CONSOLE);
+    for(k=0; k<motion->num_live; k++){
+        i = motion->live[k];
+        if(asteroid[i].alive>0){
+
+            xnum=0;
+            ynum=0;
 
             // Wrap the numbers of the asteroids
             if((asteroid[i].centery)>23 && (asteroid[i].centery)<screen->h)
@@ -403,7 +436,7 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
         if(asteroid[i].isdead) {
             dest.x = asteroid[i].xdead;
             dest.y = asteroid[i].ydead;
-            SDL_BlitSurface(images[IMG_STEAM1+asteroid[i].countdead], NULL, screen, &dest);
+            blend_blit(images[IMG_STEAM1+asteroid[i].countdead], NULL, screen, &dest);
             if(bonus == TB_POWERBOMB && bonus_time > 0)
                 draw_line(screen, asteroid[i].x, asteroid[i].y, tuxship->x, tuxship->y,
                         (5 - asteroid[i].countdead)*4*laser_coeffs[digits[1]*10+digits[2]][0],
@@ -415,7 +448,7 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
         if(asteroid[i].isdead) {
             dest.x = asteroid[i].xdead;
             dest.y = asteroid[i].ydead;
-            SDL_BlitSurface(images[IMG_STEAM1+asteroid[i].countdead], NULL, screen, &dest);
+            blend_blit(images[IMG_STEAM1+asteroid[i].countdead], NULL, screen, &dest);
             asteroid[i].countdead++;
             if(asteroid[i].countdead > 5)
             {
@@ -437,7 +470,7 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
     dest.w = images[IMG_WAVE]->w;
     dest.h = images[IMG_WAVE]->h;
 
-    SDL_BlitSurface(images[IMG_WAVE], NULL, screen, &dest);
+    blend_blit(images[IMG_WAVE], NULL, screen, &dest);
 
     sprintf(str, "%d", wave);
     draw_numbers(screen, str, offset+images[IMG_WAVE]->w + (images[IMG_NUMBERS]->w / 10), 0);
@@ -450,7 +483,7 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
     dest.w = images[IMG_SCORE]->w;
     dest.h = images[IMG_SCORE]->h;
 
-    SDL_BlitSurface(images[IMG_SCORE], NULL, screen, &dest);
+    blend_blit(images[IMG_SCORE], NULL, screen, &dest);
 
     sprintf(str, "%.6d", score);
     draw_numbers(screen, str,
@@ -464,7 +497,7 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
     dest.w = images[IMG_STOP]->w;
     dest.h = images[IMG_STOP]->h;
 
-    SDL_BlitSurface(images[IMG_STOP], NULL, screen, &dest);
+    blend_blit(images[IMG_STOP], NULL, screen, &dest);
     // }
 
     /************* Draw pre answer ************/
@@ -490,12 +523,12 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
         if(tuxship->lives <= 5)
         {
             dest.y = dest.y - (IMG_lives_ship->h);
-            SDL_BlitSurface(IMG_lives_ship, NULL, screen, &dest);
+            blend_blit(IMG_lives_ship, NULL, screen, &dest);
         }
         else if(tuxship->lives > 4)
         {
             dest.y = screen->h - (IMG_lives_ship->h);
-            SDL_BlitSurface(IMG_lives_ship, NULL, screen, &dest);
+            blend_blit(IMG_lives_ship, NULL, screen, &dest);
             sprintf(str, "%d", tuxship->lives);
             draw_numbers(screen, str, 10, (screen->h) - 30);
         }
@@ -512,8 +545,11 @@ void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_ty
     if(bonus != -1 && blink>4) {
         SDL_Surface *indicator = images[bonus_img_ids[bonus]];
         SDL_Rect pos = {screen->w - indicator->w, screen->h - indicator->h};
-        SDL_BlitSurface(indicator, NULL, screen, &pos);
+        blend_blit(indicator, NULL, screen, &pos);
     }
+    PROF_end(PROF_DRAW_CONSOLE);
+
+    PROF_draw_overlay();
 }
 
 
@@ -590,7 +626,7 @@ void factoroids_init_buttons(void)
 void factoroids_draw_bkgr(void)
 {
 
-    SDL_BlitSurface(current_bkgd(), NULL, screen, NULL);
+    blend_blit(current_bkgd(), NULL, screen, NULL);
 }
 
 
@@ -607,22 +643,22 @@ void factoroids_draw_button(int img_id, enum BUTTON_TYPE type, int x, int y)
     if(type == ACTIVE)
     {
         rect.x = 0;
-        SDL_BlitSurface(images[img_id], &rect, screen, &scr);
+        blend_blit(images[img_id], &rect, screen, &scr);
     }
     else if(type == SELECTED)
     {
         rect.x = BUTTONW;
-        SDL_BlitSurface(images[img_id], &rect, screen, &scr);
+        blend_blit(images[img_id], &rect, screen, &scr);
     }
     else if(type == PRESSED)
     {
         rect.x = BUTTONW * 2;
-        SDL_BlitSurface(images[img_id], &rect, screen, &scr);
+        blend_blit(images[img_id], &rect, screen, &scr);
     }
     else if(type == DISABLED)
     {
         rect.x = BUTTONW * 3;
-        SDL_BlitSurface(images[img_id], &rect, screen, &scr);
+        blend_blit(images[img_id], &rect, screen, &scr);
     }
 }
 
@@ -737,22 +773,32 @@ void factoroids_level_message(int wave)
 }
 
 
-int tuxship_img_h(int deg)
+int tuxship_img_h(int angle)
 {
-    return IMG_tuxship[deg]->h;
+    return rotated(ROTO_SHIP, angle)->h;
 }
 
 
-int tuxship_img_w(int deg)
+int tuxship_img_w(int angle)
 {
-    return IMG_tuxship[deg]->w;
+    return rotated(ROTO_SHIP, angle)->w;
 }
 
 
 SDL_Surface* get_asteroid_image(int size,int angle)
 {
     if (size == 0)
-        return IMG_asteroids1[angle/DEG_PER_ROTATION];
+        return rotated(ROTO_ASTEROID1, angle);
     else
-        return IMG_asteroids2[angle/DEG_PER_ROTATION];
+        return rotated(ROTO_ASTEROID2, angle);
+}
+
+
+/* An image from the rotation cache - or, should rotating it fail, */
+/* the image unrotated rather than nothing at all:                 */
+static SDL_Surface* rotated(int src, int angle)
+{
+    SDL_Surface* s = roto_cache_get(src, angle);
+
+    return s ? s : images[roto_sources[src]];
 }
@@ -15,6 +15,14 @@ enum BUTTON_TYPE
     DISABLED
 };
 
+/* Draw list layers, back to front: */
+enum
+{
+    FF_LAYER_SHIP,
+    FF_LAYER_FORCEFIELD,
+    FF_LAYER_ASTEROIDS
+};
+
 
 SDL_Surface* current_bkgd(void);
 
@@ -24,7 +32,7 @@ void factoroids_cleanup_graphics(void);
 
 void factoroids_intro(void);
 
-void factoroids_draw(asteroid_type *asteroid, tuxship_type *tuxship, FF_laser_type *laser,
+void factoroids_draw(asteroid_type *asteroid, const asteroid_motion *motion, tuxship_type *tuxship, FF_laser_type *laser,
         int bonus, int bonus_time, int *digits, int wave, int score, int num,
         int tux_img, int button_pressed);
 
@@ -42,8 +50,8 @@ void factoroids_level_message(int wave);
 
 void factoroids_level_objs_hints(char *label, char *contents, int x, int y );
 
-int tuxship_img_h(int deg);
-int tuxship_img_w(int deg);
+int tuxship_img_h(int angle);
+int tuxship_img_w(int angle);
 
 SDL_Surface* get_asteroid_image(int size,int angle);
 
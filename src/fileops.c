@@ -183,6 +183,7 @@ char *GetDefaultSaveDir(const char *suffix)
 #define GOLDSTAR_FILENAME "goldstars.txt"
 #define USER_MENU_ENTRIES_FILENAME "user_menu_entries.txt"
 #define USER_LOGIN_QUESTIONS_FILENAME "user_login_questions.txt"
+#define CACHE_SUBDIR "cache/"
 #else
 
 # define get_home getenv("HOME")
@@ -192,6 +193,7 @@ char *GetDefaultSaveDir(const char *suffix)
 #define GOLDSTAR_FILENAME "goldstars"
 #define USER_MENU_ENTRIES_FILENAME "user_menu_entries"
 #define USER_LOGIN_QUESTIONS_FILENAME "user_login_questions"
+#define CACHE_SUBDIR "cache/"
 
 #endif
 
@@ -765,6 +767,39 @@ int write_goldstars(void)
 }
 
 
+/* Find (creating it if need be) the directory in the user's */
+/* tuxmath dir where ready-converted images are cached, and   */
+/* put its path into cache_path.  Returns 1 if successful:    */
+int find_cache_dir(char* cache_path)
+{
+    DIR* dir_ptr;
+    int status;
+
+    if (!find_tuxmath_dir())
+        return 0;
+
+    get_user_data_dir_with_subdir(cache_path);
+    strcat(cache_path, CACHE_SUBDIR);
+
+    dir_ptr = opendir(cache_path);
+    if (dir_ptr)
+    {
+        closedir(dir_ptr);
+        return 1;
+    }
+
+#ifndef BUILD_MINGW32
+    status = mkdir(cache_path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+#else
+    status = mkdir(cache_path);
+#endif
+    DEBUGMSG(debug_fileops, "In find_cache_dir() - mkdir of %s returned: %d\n",
+            cache_path, status);
+
+    return (0 == status);
+}
+
+
 /* Look for a highscore table file in the current user    */
 /* data directory.  Return 1 if found, 0 if not.  This    */
 /* is used for the multi-user login code, in deciding     */
@@ -1351,6 +1386,54 @@ int read_config_file(MC_MathGame* game, FILE *fp, int file_type)
             Opts_SetFPSLimit(atoi(value));
         }
 
+        else if (0 == strcasecmp(parameter, "frame_pacing"))
+        {
+            int v = str_to_bool(value);
+            if (v != -1)
+                Opts_SetFramePacing(v);
+        }
+
+        else if (0 == strcasecmp(parameter, "auto_quality"))
+        {
+            int v = str_to_bool(value);
+            if (v != -1)
+                Opts_SetAutoQuality(v);
+        }
+
+        else if (0 == strcasecmp(parameter, "render_scale"))
+        {
+            Opts_SetRenderScale(atoi(value));
+        }
+
+        else if (0 == strcasecmp(parameter, "render_smooth"))
+        {
+            int v = str_to_bool(value);
+            if (v != -1)
+                Opts_SetRenderSmooth(v);
+        }
+
+        else if (0 == strcasecmp(parameter, "rotation_step"))
+        {
+            Opts_SetRotationStep(atoi(value));
+        }
+
+        else if (0 == strcasecmp(parameter, "rotation_cache_size"))
+        {
+            Opts_SetRotationCacheSize(atoi(value));
+        }
+
+        else if (0 == strcasecmp(parameter, "rotation_prewarm"))
+        {
+            int v = str_to_bool(value);
+            if (v != -1)
+                Opts_SetRotationPrewarm(v);
+        }
+
+        else if (0 == strcasecmp(parameter, "profiler"))
+        {
+            Opts_SetProfiler(atoi(value));
+        }
+
         else if (0 == strcasecmp(parameter, "window_width"))
         {
             int w = atoi(value);
@@ -1968,13 +2051,107 @@ int write_config_file(MC_MathGame* game, FILE* fp, int verbose)
                 "#                                                          #\n"
                 "# Parameter: fps_limit (integer)                           #\n"
                 "# Default: 60                                              #\n"
+                "# Parameter: frame_pacing (boolean)                        #\n"
+                "# Default: 1                                               #\n"
                 "#                                                          #\n"
                 "# 'fps_limit' is the max allowed frame count per second,   #\n"
                 "# 0 means no limit.                                        #\n"
+                "# With 'frame_pacing', frames are shown at evenly spaced   #\n"
+                "# times, waiting out the last moment before each one       #\n"
+                "# rather than relying on the system to wake the game up    #\n"
+                "# on time. This is smoother, for a little more CPU time.   #\n"
                 "#                                                          #\n"
                 "############################################################\n\n");
     }
     fprintf(fp, "fps_limit = %d\n", Opts_FPSLimit());
+    fprintf(fp, "frame_pacing = %d\n", Opts_FramePacing());
+
+    if(verbose)
+    {
+        fprintf (fp, "\n\n############################################################\n"
+                "#                                                          #\n"
+                "#                Automatic drawing quality                 #\n"
+                "#                                                          #\n"
+                "# Parameter: auto_quality (boolean)                        #\n"
+                "# Default: 1                                               #\n"
+                "#                                                          #\n"
+                "# If the computer can't keep up with 'fps_limit', the      #\n"
+                "# comets game draws fewer snowflakes and then draws at     #\n"
+                "# half size (as 'render_scale' = 2 does, if the screen is  #\n"
+                "# at least 1280x960), going back to full quality once it   #\n"
+                "# can.                                                     #\n"
+                "#                                                          #\n"
+                "############################################################\n\n");
+    }
+    fprintf(fp, "auto_quality = %d\n", Opts_AutoQuality());
+
+    if(verbose)
+    {
+        fprintf (fp, "\n\n############################################################\n"
+                "#                                                          #\n"
+                "#                 Drawing at lower resolution              #\n"
+                "#                                                          #\n"
+                "# Parameter: render_scale (integer)                        #\n"
+                "# Default: 1                                               #\n"
+                "# Parameter: render_smooth (boolean)                       #\n"
+                "# Default: 0                                               #\n"
+                "#                                                          #\n"
+                "# At 2 to 4, the comets game is drawn at a half, a third   #\n"
+                "# or a quarter of the screen's width and height, and       #\n"
+                "# scaled up to fill it - much faster on large screens, and #\n"
+                "# closer to the 640x480 the pictures are made for. At 0    #\n"
+                "# the largest of these that leaves at least 640x480 is     #\n"
+                "# used. With 'render_smooth' the scaled up picture is      #\n"
+                "# smoothed rather than blocky.                             #\n"
+                "#                                                          #\n"
+                "############################################################\n\n");
+    }
+    fprintf(fp, "render_scale = %d\n", Opts_RenderScale());
+    fprintf(fp, "render_smooth = %d\n", Opts_RenderSmooth());
+
+    if(verbose)
+    {
+        fprintf (fp, "\n\n############################################################\n"
+                "#                                                          #\n"
+                "#              Rotated images in Factoroids                #\n"
+                "#                                                          #\n"
+                "# Parameter: rotation_step (integer)                       #\n"
+                "# Default: 2                                               #\n"
+                "# Parameter: rotation_cache_size (integer)                 #\n"
+                "# Default: 24                                              #\n"
+                "# Parameter: rotation_prewarm (boolean)                    #\n"
+                "# Default: 1                                               #\n"
+                "#                                                          #\n"
+                "# The ship and asteroids are drawn turned to the nearest   #\n"
+                "# 'rotation_step' degrees, each angle being made when it   #\n"
+                "# is first needed and kept until they take more than       #\n"
+                "# 'rotation_cache_size' MB. With 'rotation_prewarm', they  #\n"
+                "# are also made in the background as the game starts.      #\n"
+                "#                                                          #\n"
+                "############################################################\n\n");
+    }
+    fprintf(fp, "rotation_step = %d\n", Opts_RotationStep());
+    fprintf(fp, "rotation_cache_size = %d\n", Opts_RotationCacheSize());
+    fprintf(fp, "rotation_prewarm = %d\n", Opts_RotationPrewarm());
+
+    if(verbose)
+    {
+        fprintf (fp, "\n\n############################################################\n"
+                "#                                                          #\n"
+                "#                   Frame profiler                         #\n"
+                "#                                                          #\n"
+                "# Parameter: profiler (integer)                            #\n"
+                "# Default: 0                                               #\n"
+                "#                                                          #\n"
+                "# For finding out what slows the games down. At 1, how     #\n"
+                "# long each part of every frame takes is timed, and at the #\n"
+                "# end of each game a summary is added to the file          #\n"
+                "# 'frame_profile.txt' in the user's tuxmath directory. At  #\n"
+                "# 2, a graph of the recent frames is also shown on screen. #\n"
+                "#                                                          #\n"
+                "############################################################\n\n");
+    }
+    fprintf(fp, "profiler = %d\n", Opts_Profiler());
 
     if(verbose)
     {
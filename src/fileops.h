@@ -177,6 +177,15 @@ enum {
     NUM_IMAGES
 };
 
+/* Bundles of images loaded together - the common one stays loaded, */
+/* the others are loaded while their game is running:               */
+enum {
+    BUNDLE_COMMON,
+    BUNDLE_COMETS,
+    BUNDLE_FACTOROIDS,
+    NUM_BUNDLES
+};
+
 /* Names for animated images (sprites) */
 enum {
     IMG_COMET,
@@ -257,11 +266,30 @@ void user_data_dirname_down(char *subdir);
 int write_pregame_summary(MC_MathGame* game);
 int write_postgame_summary(MC_MathGame* game);
 
-int load_image_data();
+/* Images are loaded in bundles, as the activities that need them    */
+/* start (see load_bundle() in setup.c).  Decoding is queued as tasks */
+/* (see tasks.c), then finished on the main thread once they've run:  */
+void queue_image_data(int bundle);
+int finish_image_data(int bundle);
+int begin_prefetch_image_data(int bundle);
+int prefetch_image_data(int bundle);
+void free_image_data(int bundle, int keep);
+
+/* Cache of display-ready images in the user's tuxmath dir - see */
+/* fileops_media.c:                                               */
+int find_cache_dir(char* cache_path);
+Uint32 asset_key_start(void);
+Uint32 asset_key_data(Uint32 key, const void* data, int len);
+Uint32 asset_key_file(Uint32 key, const char* name);
+Uint32 asset_key_surface(Uint32 key, SDL_Surface* s);
+int asset_cache_load(const char* name, Uint32 key, SDL_Surface** surfs, int n);
+int asset_cache_save(const char* name, Uint32 key, SDL_Surface** surfs, int n);
+void load_both_bkgds(const char* name, SDL_Surface** fs_bkgd, SDL_Surface** win_bkgd);
 
 
 #ifndef NOSOUND
-int load_sound_data();
+void queue_sound_data(void);
+int finish_sound_data(void);
 #endif
 
 #endif
@@ -25,6 +25,37 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "tuxmath.h"
 #include "fileops.h"
 #include "options.h"
+#include "tasks.h"
+#include "archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* Cached images are stored as raw pixels in the display format, so   */
+/* reading them back is just a read - no PNG or SVG decoding and no    */
+/* scaling.  Each cache file starts with a magic number, its version,  */
+/* a key and the number of surfaces.  The key covers everything the    */
+/* pixels depend on (image files, display format, resolution...), so   */
+/* if it doesn't match the file is simply rebuilt:                     */
+#define ASSET_CACHE_MAGIC 0x43414D54  /* "TMAC" */
+#define ASSET_CACHE_VERSION 1
+
+/* Room kept per sprite in the images cache file: */
+#define CACHED_SPRITE_FRAMES 16
+#define NUM_CACHED_IMAGES (NUM_IMAGES + NUM_SPRITES * (CACHED_SPRITE_FRAMES + 1))
+
+typedef struct cache_surface_header {
+    Uint32 w, h, bpp;
+    Uint32 Rmask, Gmask, Bmask, Amask;
+    Uint32 flags;
+    Uint32 colorkey;
+    Uint32 alpha;
+} cache_surface_header;
+
+static int cache_file_path(char* path, const char* name);
+static int cache_load_path(const char* path, Uint32 key, SDL_Surface** surfs, int n);
+static void free_surfaces(SDL_Surface** surfs, int n);
 
 int glyph_offset;
 
@@ -34,199 +65,289 @@ int glyph_offset;
 /*   display the progress of the loading.                        */
 /*****************************************************************/
 
-/* returns 1 if all data files successfully loaded, 0 otherwise. */
-
 /* TODO load only "igloo" or "city" files, not both.             */
 /* TODO get rid of files no longer used.                         */
 
-int load_image_data()
+static char* image_filenames[NUM_IMAGES] = {
+    "status/title.png",
+    "status/left.png",
+    "status/left_gray.png",
+    "status/right.png",
+    "status/right_gray.png",
+    "status/tux4kids.png",
+    "status/nbs.png",
+    "cities/city-blue.png",
+    "cities/csplode-blue-1.png",
+    "cities/csplode-blue-2.png",
+    "cities/csplode-blue-3.png",
+    "cities/csplode-blue-4.png",
+    "cities/csplode-blue-5.png",
+    "cities/cdead-blue.png",
+    "cities/city-green.png",
+    "cities/csplode-green-1.png",
+    "cities/csplode-green-2.png",
+    "cities/csplode-green-3.png",
+    "cities/csplode-green-4.png",
+    "cities/csplode-green-5.png",
+    "cities/cdead-green.png",
+    "cities/city-orange.png",
+    "cities/csplode-orange-1.png",
+    "cities/csplode-orange-2.png",
+    "cities/csplode-orange-3.png",
+    "cities/csplode-orange-4.png",
+    "cities/csplode-orange-5.png",
+    "cities/cdead-orange.png",
+    "cities/city-red.png",
+    "cities/csplode-red-1.png",
+    "cities/csplode-red-2.png",
+    "cities/csplode-red-3.png",
+    "cities/csplode-red-4.png",
+    "cities/csplode-red-5.png",
+    "cities/cdead-red.png",
+    "cities/shields.png",
+    "comets/mini_comet1.png",
+    "comets/mini_comet2.png",
+    "comets/mini_comet3.png",
+    "status/nums.png",
+    "status/lednums.png",
+    "status/led_neg_sign.png",
+    "status/paused.png",
+    "status/demo.png",
+    "status/demo-small.png",
+    "status/keypad.png",
+    "status/keypad_no_neg.png",
+    "tux/console_led.png",
+    "tux/console_bash.png",
+    "tux/tux-console1.png",
+    "tux/tux-console2.png",
+    "tux/tux-console3.png",
+    "tux/tux-console4.png",
+    "tux/tux-relax1.png",
+    "tux/tux-relax2.png",
+    "tux/tux-egypt1.png",
+    "tux/tux-egypt2.png",
+    "tux/tux-egypt3.png",
+    "tux/tux-egypt4.png",
+    "tux/tux-drat.png",
+    "tux/tux-yipe.png",
+    "tux/tux-yay1.png",
+    "tux/tux-yay2.png",
+    "tux/tux-yes1.png",
+    "tux/tux-yes2.png",
+    "tux/tux-sit.png",
+    "tux/tux-fist1.png",
+    "tux/tux-fist2.png",
+    "penguins/flapdown.png",
+    "penguins/flapup.png",
+    "penguins/incoming.png",
+    "penguins/grumpy.png",
+    "penguins/worried.png",
+    "penguins/standing-up.png",
+    "penguins/sitting-down.png",
+    "penguins/walk-on1.png",
+    "penguins/walk-on2.png",
+    "penguins/walk-on3.png",
+    "penguins/walk-off1.png",
+    "penguins/walk-off2.png",
+    "penguins/walk-off3.png",
+    "igloos/melted3.png",
+    "igloos/melted2.png",
+    "igloos/melted1.png",
+    "igloos/half.png",
+    "igloos/intact.png",
+    "igloos/rebuilding1.png",
+    "igloos/rebuilding2.png",
+    "igloos/steam1.png",
+    "igloos/steam2.png",
+    "igloos/steam3.png",
+    "igloos/steam4.png",
+    "igloos/steam5.png",
+    "igloos/cloud.png",
+    "igloos/snow1.png",
+    "igloos/snow2.png",
+    "igloos/snow3.png",
+    "igloos/extra_life.png",
+    "status/wave.png",
+    "status/score.png",
+    "status/stop.png",
+    "status/numbers.png",
+    "status/gameover.png",
+    "status/gameover_won.png",
+    "factoroids/gbstars.png",
+    "factoroids/asteroid1.png",
+    "factoroids/asteroid2.png",
+    "factoroids/asteroid3.png",
+    "factoroids/ship.png",
+    "factoroids/ship-cloaked.png",
+    "factoroids/powerbomb.png",
+    "factoroids/shield.png",
+    "factoroids/stealth.png",
+    "factoroids/factoroids.png",
+    "factoroids/factors.png",
+    "factoroids/tux.png",
+    "factoroids/good.png",
+    "tux/cockpit_tux1.png",
+    "tux/cockpit_tux2.png",
+    "tux/cockpit_tux3.png",
+    "tux/cockpit_tux4.png",
+    "tux/cockpit_tux5.png",
+    "tux/cockpit_tux6.png",
+    "factoroids/button_2.png",
+    "factoroids/button_3.png",
+    "factoroids/button_5.png",
+    "factoroids/button_7.png",
+    "factoroids/button_11.png",
+    "factoroids/button_13.png",
+    "factoroids/cockpit.png",
+    "factoroids/forcefield.png",
+    "factoroids/ship-thrust.png",
+    "factoroids/ship-thrust-cloaked.png",
+    "status/arrows.png"
+};
+
+static char* sprite_filenames[NUM_SPRITES] = {
+    "comets/comet",
+    "comets/bonus_comet",
+    "comets/cometex",
+    "comets/bonus_cometex",
+    "comets/left_powerup_comet",
+    "comets/right_powerup_comet",
+    "comets/powerup_cometex",
+    "tux/bigtux"
+};
+
+
+/* Images are loaded a bundle at a time (see load_bundle() in setup.c). */
+/* Each bundle has its own images cache file, and keeps the key it was */
+/* saved with.  Images and sprites decoded by the tasks or the prefetch */
+/* thread, or read from the cache, wait here until finish_image_data()  */
+/* converts them for the screen (unless they're from the cache, and so  */
+/* ready already) and puts them in images[] and sprites[], on the main  */
+/* thread.  Which ones are wanted is worked out on the main thread too: */
+#define BUNDLE_BIT(b) (1 << (b))
+#define SPRITE_BUNDLES BUNDLE_BIT(BUNDLE_COMETS)
+
+static const char* bundle_names[NUM_BUNDLES] = {
+    "common",
+    "comets",
+    "factoroids"
+};
+
+static Uint32 bundle_keys[NUM_BUNDLES];
+static SDL_Surface* decoded_images[NUM_IMAGES];
+static sprite* decoded_sprites[NUM_SPRITES];
+static int decoded_image_ready[NUM_IMAGES];
+static int decoded_sprite_ready[NUM_SPRITES];
+static Uint32 decoded_format;  /* asset_key_start() for the ready ones */
+static int want_image[NUM_IMAGES];
+static int want_sprite[NUM_SPRITES];
+static char prefetch_cache_path[PATH_MAX];
+
+static int image_bundles(int img);
+static Uint32 bundle_key(int bundle);
+static int mark_wanted(int bundle);
+static int decode_wanted(void);
+static int bundle_cache_path(int bundle, char* path);
+static int bundle_cache_load(int bundle, const char* path);
+static void bundle_cache_save(int bundle);
+static int decode_image_task(int i);
+static int decode_sprite_task(int i);
+static int load_image(int i);
+static int load_sprite(int i);
+
+
+/* Queue the decoding of the bundle's images and sprites that aren't */
+/* loaded or decoded yet for tasks_run(), unless they are in the      */
+/* cache, in which case they are read from it straight away:          */
+void queue_image_data(int bundle)
 {
+    char path[PATH_MAX];
     int i;
 
-    static char* image_filenames[NUM_IMAGES] = {
-        "status/title.png",
-        "status/left.png",
-        "status/left_gray.png",
-        "status/right.png",
-        "status/right_gray.png",
-        "status/tux4kids.png",
-        "status/nbs.png",
-        "cities/city-blue.png",
-        "cities/csplode-blue-1.png",
-        "cities/csplode-blue-2.png",
-        "cities/csplode-blue-3.png",
-        "cities/csplode-blue-4.png",
-        "cities/csplode-blue-5.png",
-        "cities/cdead-blue.png",
-        "cities/city-green.png",
-        "cities/csplode-green-1.png",
-        "cities/csplode-green-2.png",
-        "cities/csplode-green-3.png",
-        "cities/csplode-green-4.png",
-        "cities/csplode-green-5.png",
-        "cities/cdead-green.png",
-        "cities/city-orange.png",
-        "cities/csplode-orange-1.png",
-        "cities/csplode-orange-2.png",
-        "cities/csplode-orange-3.png",
-        "cities/csplode-orange-4.png",
-        "cities/csplode-orange-5.png",
-        "cities/cdead-orange.png",
-        "cities/city-red.png",
-        "cities/csplode-red-1.png",
-        "cities/csplode-red-2.png",
-        "cities/csplode-red-3.png",
-        "cities/csplode-red-4.png",
-        "cities/csplode-red-5.png",
-        "cities/cdead-red.png",
-        "cities/shields.png",
-        "comets/mini_comet1.png",
-        "comets/mini_comet2.png",
-        "comets/mini_comet3.png",
-        "status/nums.png",
-        "status/lednums.png",
-        "status/led_neg_sign.png",
-        "status/paused.png",
-        "status/demo.png",
-        "status/demo-small.png",
-        "status/keypad.png",
-        "status/keypad_no_neg.png",
-        "tux/console_led.png",
-        "tux/console_bash.png",
-        "tux/tux-console1.png",
-        "tux/tux-console2.png",
-        "tux/tux-console3.png",
-        "tux/tux-console4.png",
-        "tux/tux-relax1.png",
-        "tux/tux-relax2.png",
-        "tux/tux-egypt1.png",
-        "tux/tux-egypt2.png",
-        "tux/tux-egypt3.png",
-        "tux/tux-egypt4.png",
-        "tux/tux-drat.png",
-        "tux/tux-yipe.png",
-        "tux/tux-yay1.png",
-        "tux/tux-yay2.png",
-        "tux/tux-yes1.png",
-        "tux/tux-yes2.png",
-        "tux/tux-sit.png",
-        "tux/tux-fist1.png",
-        "tux/tux-fist2.png",
-        "penguins/flapdown.png",
-        "penguins/flapup.png",
-        "penguins/incoming.png",
-        "penguins/grumpy.png",
-        "penguins/worried.png",
-        "penguins/standing-up.png",
-        "penguins/sitting-down.png",
-        "penguins/walk-on1.png",
-        "penguins/walk-on2.png",
-        "penguins/walk-on3.png",
-        "penguins/walk-off1.png",
-        "penguins/walk-off2.png",
-        "penguins/walk-off3.png",
-        "igloos/melted3.png",
-        "igloos/melted2.png",
-        "igloos/melted1.png",
-        "igloos/half.png",
-        "igloos/intact.png",
-        "igloos/rebuilding1.png",
-        "igloos/rebuilding2.png",
-        "igloos/steam1.png",
-        "igloos/steam2.png",
-        "igloos/steam3.png",
-        "igloos/steam4.png",
-        "igloos/steam5.png",
-        "igloos/cloud.png",
-        "igloos/snow1.png",
-        "igloos/snow2.png",
-        "igloos/snow3.png",
-        "igloos/extra_life.png",
-        "status/wave.png",
-        "status/score.png",
-        "status/stop.png",
-        "status/numbers.png",
-        "status/gameover.png",
-        "status/gameover_won.png",
-        "factoroids/gbstars.png",
-        "factoroids/asteroid1.png",
-        "factoroids/asteroid2.png",
-        "factoroids/asteroid3.png",
-        "factoroids/ship.png",
-        "factoroids/ship-cloaked.png",
-        "factoroids/powerbomb.png",
-        "factoroids/shield.png",
-        "factoroids/stealth.png",
-        "factoroids/factoroids.png",
-        "factoroids/factors.png",
-        "factoroids/tux.png",
-        "factoroids/good.png",
-        "tux/cockpit_tux1.png",
-        "tux/cockpit_tux2.png",
-        "tux/cockpit_tux3.png",
-        "tux/cockpit_tux4.png",
-        "tux/cockpit_tux5.png",
-        "tux/cockpit_tux6.png",
-        "factoroids/button_2.png",
-        "factoroids/button_3.png",
-        "factoroids/button_5.png",
-        "factoroids/button_7.png",
-        "factoroids/button_11.png",
-        "factoroids/button_13.png",
-        "factoroids/cockpit.png",
-        "factoroids/forcefield.png",
-        "factoroids/ship-thrust.png",
-        "factoroids/ship-thrust-cloaked.png",
-        "status/arrows.png"
-    };
-
-    static char* sprite_filenames[NUM_SPRITES] = {
-        "comets/comet",
-        "comets/bonus_comet",
-        "comets/cometex",
-        "comets/bonus_cometex",
-        "comets/left_powerup_comet",
-        "comets/right_powerup_comet",
-        "comets/powerup_cometex",
-        "tux/bigtux"
-    };
-
-    /* Load static images: */
-    for (i = 0; i < NUM_IMAGES; i++)
-    {
-        images[i] = T4K_LoadImage(image_filenames[i], IMG_ALPHA);
+    bundle_keys[bundle] = bundle_key(bundle);
+    if (mark_wanted(bundle) == 0)
+        return;
 
-        if (images[i] == NULL)
-        {
-            fprintf(stderr,
-                    "\nError: I couldn't load a graphics file:\n"
-                    "%s\n"
-                    "The Simple DirectMedia error that occured was:\n"
-                    "%s\n\n", image_filenames[i], SDL_GetError());
-            return 0;
-        }
+    if (bundle_cache_path(bundle, path) && bundle_cache_load(bundle, path))
+    {
+        DEBUGMSG(debug_setup, "queue_image_data(): using cached %s images\n",
+                 bundle_names[bundle]);
+        return;
     }
 
-    /* Load animated graphics: */
+    /* Otherwise each one is decoded as a task of its own.  Any that */
+    /* don't fit in the task list, or that only t4k_common can load   */
+    /* (e.g. SVGs), are left for finish_image_data():                  */
+    archive_start_decoding();
+    for (i = 0; i < NUM_IMAGES; i++)
+        if (want_image[i])
+            task_add("images", decode_image_task, i);
     for (i = 0; i < NUM_SPRITES; i++)
-    {
-        sprites[i] = T4K_LoadSprite(sprite_filenames[i], IMG_ALPHA);
+        if (want_sprite[i])
+            task_add("sprites", decode_sprite_task, i);
+}
+
 
-        if (sprites[i] == NULL)
+/* After tasks_run(), on the main thread: convert what was decoded  */
+/* for the screen, load anything that wasn't, save the cache if any   */
+/* of it wasn't from there and make the images that need text.        */
+/* Returns 1 if all of the bundle's images were loaded, 0 otherwise:  */
+int finish_image_data(int bundle)
+{
+    int i, fresh = 0;
+    int ready_ok = (decoded_format == asset_key_start());
+
+    for (i = 0; i < NUM_IMAGES; i++)
+    {
+        if (!(image_bundles(i) & BUNDLE_BIT(bundle)))
+            continue;
+        if (images[i])
         {
-            fprintf(stderr,
-                    "\nError: I couldn't load a graphics file:\n"
-                    "%s\n"
-                    "The Simple DirectMedia error that occured was:\n"
-                    "%s\n\n", sprite_filenames[i], SDL_GetError());
+            if (decoded_images[i])
+                SDL_FreeSurface(decoded_images[i]);
+        }
+        else if (decoded_images[i] && decoded_image_ready[i] && ready_ok)
+            images[i] = decoded_images[i];
+        else
+        {
+            images[i] = archive_finish_image(decoded_images[i]);
+            fresh = 1;
+        }
+        decoded_images[i] = NULL;
+        if (!images[i] && !load_image(i))
             return 0;
+    }
+    if (SPRITE_BUNDLES & BUNDLE_BIT(bundle))
+    {
+        for (i = 0; i < NUM_SPRITES; i++)
+        {
+            if (sprites[i])
+                archive_free_sprite(decoded_sprites[i]);
+            else if (decoded_sprites[i] && decoded_sprite_ready[i] && ready_ok)
+                sprites[i] = decoded_sprites[i];
+            else
+            {
+                sprites[i] = archive_finish_sprite(decoded_sprites[i]);
+                fresh = 1;
+            }
+            decoded_sprites[i] = NULL;
+            if (!sprites[i] && !load_sprite(i))
+                return 0;
         }
     }
 
+    /* Save them for next time, if they weren't from the cache: */
+    if (fresh)
+        bundle_cache_save(bundle);
+
+    if (bundle != BUNDLE_COMMON)
+        return 1;
+
     glyph_offset = 0;
 
 #ifdef REPLACE_WAVESCORE
-    /* Replace the "WAVE" and "SCORE" with translate-able versions */
+    /* Replace the "WAVE" and "SCORE" with translate-able versions.   */
+    /* (This stays on the main thread - the text code isn't threadsafe) */
     SDL_FreeSurface(images[IMG_WAVE]);
     images[IMG_WAVE] = T4K_SimpleTextWithOffset(_("WAVE"), 28, &white, &glyph_offset);
     SDL_FreeSurface(images[IMG_SCORE]);
@@ -239,50 +360,785 @@ int load_image_data()
 }
 
 
+/* On the main thread, before prefetch_image_data() is started on     */
+/* another: work out what it has to do.  Returns 0 if there's nothing: */
+int begin_prefetch_image_data(int bundle)
+{
+    bundle_keys[bundle] = bundle_key(bundle);
+    if (mark_wanted(bundle) == 0)
+        return 0;
+    if (!bundle_cache_path(bundle, prefetch_cache_path))
+        prefetch_cache_path[0] = '\0';
+    archive_start_decoding();
+    return 1;
+}
+
+
+/* Read the bundle's wanted images from the cache, or decode them one */
+/* at a time, on the calling thread - used to prefetch a bundle in    */
+/* the background.  Only the decoded images are written, which the    */
+/* main thread leaves alone until it has waited for this to finish.   */
+/* load_bundle() then puts them in place.  Returns 1 if they were all */
+/* decoded:                                                           */
+int prefetch_image_data(int bundle)
+{
+    if (prefetch_cache_path[0] && bundle_cache_load(bundle, prefetch_cache_path))
+        return 1;
+    return decode_wanted();
+}
 
 
+/* Free the bundle's images, except those that one of the bundles in */
+/* "keep" (a mask of BUNDLE_BIT()s) uses too:                         */
+void free_image_data(int bundle, int keep)
+{
+    int i;
 
-#ifndef NOSOUND
-int load_sound_data(void)
+    for (i = 0; i < NUM_IMAGES; i++)
+    {
+        if (!(image_bundles(i) & BUNDLE_BIT(bundle)) || (image_bundles(i) & keep))
+            continue;
+        if (images[i])
+            SDL_FreeSurface(images[i]);
+        images[i] = NULL;
+        /* (left over if loading the bundle failed part way) */
+        if (decoded_images[i])
+            SDL_FreeSurface(decoded_images[i]);
+        decoded_images[i] = NULL;
+    }
+    if ((SPRITE_BUNDLES & BUNDLE_BIT(bundle)) && !(SPRITE_BUNDLES & keep))
+    {
+        for (i = 0; i < NUM_SPRITES; i++)
+        {
+            if (sprites[i])
+                T4K_FreeSprite(sprites[i]);
+            sprites[i] = NULL;
+            archive_free_sprite(decoded_sprites[i]);
+            decoded_sprites[i] = NULL;
+        }
+    }
+}
+
+
+/* Which bundles need each image, as a mask of BUNDLE_BIT()s: */
+static int image_bundles(int img)
 {
-    int i = 0;
-
-    static char* sound_filenames[NUM_SOUNDS] = {
-        DATA_PREFIX "/sounds/harp.wav",
-        DATA_PREFIX "/sounds/pop.wav",
-        DATA_PREFIX "/sounds/tock.wav",
-        DATA_PREFIX "/sounds/laser.wav",
-        DATA_PREFIX "/sounds/buzz.wav",
-        DATA_PREFIX "/sounds/alarm.wav",
-        DATA_PREFIX "/sounds/shieldsdown.wav",
-        DATA_PREFIX "/sounds/explosion.wav",
-        DATA_PREFIX "/sounds/sizzling.wav",
-        DATA_PREFIX "/sounds/towerclock.wav",
-        DATA_PREFIX "/sounds/cheer.wav",
-        DATA_PREFIX "/sounds/engine.wav"
-    };
+    switch (img)
+    {
+        /* Used by the title screen, menus, campaign and LAN screens: */
+        case IMG_TITLE:
+        case IMG_LEFT:
+        case IMG_LEFT_GRAY:
+        case IMG_RIGHT:
+        case IMG_RIGHT_GRAY:
+        case IMG_TUX4KIDS:
+        case IMG_NBS:
+        case IMG_PAUSED:
+        case IMG_WAVE:
+        case IMG_SCORE:
+        case IMG_STOP:
+        case IMG_NUMBERS:
+        case IMG_ARROWS:
+            return BUNDLE_BIT(BUNDLE_COMMON);
 
+        /* Used by both games: */
+        case IMG_TUX_CONSOLE1:
+        case IMG_TUX_CONSOLE2:
+        case IMG_TUX_CONSOLE3:
+        case IMG_TUX_CONSOLE4:
+        case IMG_STEAM1:
+        case IMG_STEAM2:
+        case IMG_STEAM3:
+        case IMG_STEAM4:
+        case IMG_STEAM5:
+        case IMG_EXTRA_LIFE:
+        case IMG_BONUS_POWERBOMB:
+        case IMG_GAMEOVER:
+        case IMG_GAMEOVER_WON:
+            return BUNDLE_BIT(BUNDLE_COMETS) | BUNDLE_BIT(BUNDLE_FACTOROIDS);
 
-    /* skip loading sound files if sound system not available: */
-    if (Opts_UsingSound())
+        /* The rest come in two runs, comets' and then factoroids': */
+        default:
+            if (img < BG_STARS)
+                return BUNDLE_BIT(BUNDLE_COMETS);
+            return BUNDLE_BIT(BUNDLE_FACTOROIDS);
+    }
+}
+
+
+/* The key covers each of the bundle's image files, and the directory */
+/* of each sprite (whose frames we don't know the names of in advance): */
+static Uint32 bundle_key(int bundle)
+{
+    Uint32 key = asset_key_start();
+    char dir[PATH_MAX];
+    int i;
+
+    key = asset_key_data(key, &bundle, sizeof(bundle));
+    for (i = 0; i < NUM_IMAGES; i++)
+        if (image_bundles(i) & BUNDLE_BIT(bundle))
+            key = asset_key_file(key, image_filenames[i]);
+    if (SPRITE_BUNDLES & BUNDLE_BIT(bundle))
+    {
+        for (i = 0; i < NUM_SPRITES; i++)
+        {
+            strncpy(dir, sprite_filenames[i], PATH_MAX - 1);
+            dir[PATH_MAX - 1] = '\0';
+            if (strrchr(dir, '/'))
+                *strrchr(dir, '/') = '\0';
+            key = asset_key_file(key, dir);
+        }
+    }
+    return key;
+}
+
+
+/* Mark the bundle's images and sprites that are neither loaded nor */
+/* decoded as wanted, returning how many there are.  Ready images    */
+/* decoded for a different display format have to be converted now:  */
+static int mark_wanted(int bundle)
+{
+    Uint32 format = asset_key_start();
+    int i, n = 0;
+
+    if (format != decoded_format)
+    {
+        for (i = 0; i < NUM_IMAGES; i++)
+            decoded_image_ready[i] = 0;
+        for (i = 0; i < NUM_SPRITES; i++)
+            decoded_sprite_ready[i] = 0;
+        decoded_format = format;
+    }
+
+    for (i = 0; i < NUM_IMAGES; i++)
+    {
+        want_image[i] = (image_bundles(i) & BUNDLE_BIT(bundle))
+            && !images[i] && !decoded_images[i];
+        n += want_image[i];
+    }
+    for (i = 0; i < NUM_SPRITES; i++)
+    {
+        want_sprite[i] = (SPRITE_BUNDLES & BUNDLE_BIT(bundle))
+            && !sprites[i] && !decoded_sprites[i];
+        n += want_sprite[i];
+    }
+    return n;
+}
+
+
+/* Decode each wanted image in turn - returns 1 if they all could be: */
+static int decode_wanted(void)
+{
+    int i, ok = 1;
+
+    for (i = 0; i < NUM_IMAGES; i++)
+        if (want_image[i])
+            ok = decode_image_task(i) && decoded_images[i] && ok;
+    for (i = 0; i < NUM_SPRITES; i++)
+        if (want_sprite[i])
+            ok = decode_sprite_task(i) && decoded_sprites[i] && ok;
+    return ok;
+}
+
+
+static int bundle_cache_path(int bundle, char* path)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), "images-%s", bundle_names[bundle]);
+    return cache_file_path(path, name);
+}
+
+
+/* Read the bundle's cache file (at "path") into the decoded images, */
+/* ready for the screen.  Only the wanted ones are kept:             */
+static int bundle_cache_load(int bundle, const char* path)
+{
+    SDL_Surface* cached[NUM_CACHED_IMAGES];
+    int i, j, n;
+
+    if (!cache_load_path(path, bundle_keys[bundle], cached, NUM_CACHED_IMAGES))
+        return 0;
+
+    for (i = 0; i < NUM_IMAGES; i++)
+    {
+        if (!cached[i])
+            continue;
+        if (!want_image[i])
+            SDL_FreeSurface(cached[i]);
+        else
+        {
+            decoded_images[i] = cached[i];
+            decoded_image_ready[i] = 1;
+        }
+    }
+    for (i = 0; i < NUM_SPRITES; i++)
+    {
+        n = NUM_IMAGES + i * (CACHED_SPRITE_FRAMES + 1);
+        if (!cached[n])
+            continue;
+        if (want_sprite[i])
+            decoded_sprites[i] = (sprite*)calloc(1, sizeof(sprite));
+        if (!decoded_sprites[i] || !want_sprite[i])
+        {
+            /* (finish_image_data() will load it instead) */
+            free_surfaces(cached + n, CACHED_SPRITE_FRAMES + 1);
+            continue;
+        }
+        decoded_sprites[i]->default_img = cached[n];
+        for (j = 0; j < CACHED_SPRITE_FRAMES && cached[n + 1 + j]; j++)
+            decoded_sprites[i]->frame[j] = cached[n + 1 + j];
+        decoded_sprites[i]->num_frames = j;
+        decoded_sprites[i]->cur = 0;
+        decoded_sprite_ready[i] = 1;
+    }
+    return 1;
+}
+
+
+/* Save the bundle's images, if its sprites fit: */
+static void bundle_cache_save(int bundle)
+{
+    SDL_Surface* cached[NUM_CACHED_IMAGES];
+    char name[64];
+    int i, j, n;
+
+    for (i = 0; i < NUM_CACHED_IMAGES; i++)
+        cached[i] = NULL;
+    for (i = 0; i < NUM_IMAGES; i++)
+        if (image_bundles(i) & BUNDLE_BIT(bundle))
+            cached[i] = images[i];
+    if (SPRITE_BUNDLES & BUNDLE_BIT(bundle))
     {
-        for (i = 0; i < NUM_SOUNDS; i++)
+        for (i = 0; i < NUM_SPRITES; i++)
         {
-            sounds[i] = Mix_LoadWAV(sound_filenames[i]);
+            if (sprites[i]->num_frames > CACHED_SPRITE_FRAMES)
+                return;
+            n = NUM_IMAGES + i * (CACHED_SPRITE_FRAMES + 1);
+            cached[n] = sprites[i]->default_img;
+            for (j = 0; j < sprites[i]->num_frames; j++)
+                cached[n + 1 + j] = sprites[i]->frame[j];
+        }
+    }
+
+    snprintf(name, sizeof(name), "images-%s", bundle_names[bundle]);
+    asset_cache_save(name, bundle_keys[bundle], cached, NUM_CACHED_IMAGES);
+}
+
+
+/* Tasks, which may run on any thread, so only decode the files - */
+/* anything they can't do is loaded by finish_image_data():        */
+static int decode_image_task(int i)
+{
+    decoded_images[i] = archive_decode_image(image_filenames[i]);
+    decoded_image_ready[i] = 0;
+    return 1;
+}
+
+
+static int decode_sprite_task(int i)
+{
+    decoded_sprites[i] = archive_decode_sprite(sprite_filenames[i]);
+    decoded_sprite_ready[i] = 0;
+    return 1;
+}
+
+
+/* Loading on the main thread, with t4k_common if need be: */
+static int load_image(int i)
+{
+    images[i] = archive_load_image(image_filenames[i], IMG_ALPHA);
+
+    if (images[i] == NULL)
+    {
+        fprintf(stderr,
+                "\nError: I couldn't load a graphics file:\n"
+                "%s\n"
+                "The Simple DirectMedia error that occured was:\n"
+                "%s\n\n", image_filenames[i], SDL_GetError());
+        return 0;
+    }
+    return 1;
+}
+
+
+static int load_sprite(int i)
+{
+    sprites[i] = archive_load_sprite(sprite_filenames[i], IMG_ALPHA);
+
+    if (sprites[i] == NULL)
+    {
+        fprintf(stderr,
+                "\nError: I couldn't load a graphics file:\n"
+                "%s\n"
+                "The Simple DirectMedia error that occured was:\n"
+                "%s\n\n", sprite_filenames[i], SDL_GetError());
+        return 0;
+    }
+    return 1;
+}
+
+
 
-            if (sounds[i] == NULL)
+/* Load a background in both its fullscreen and windowed sizes, as     */
+/* T4K_LoadBothBkgds() does, but from the cache if it has been scaled   */
+/* for this resolution before:                                          */
+void load_both_bkgds(const char* name, SDL_Surface** fs_bkgd, SDL_Surface** win_bkgd)
+{
+    SDL_Surface* surfs[2];
+    char cache_name[PATH_MAX];
+    int res[4];
+    Uint32 key;
+
+    T4K_GetResolutions(&res[0], &res[1], &res[2], &res[3]);
+    key = asset_key_start();
+    key = asset_key_data(key, res, sizeof(res));
+    key = asset_key_file(key, name);
+    snprintf(cache_name, sizeof(cache_name), "bkgd-%s", name);
+
+    if (asset_cache_load(cache_name, key, surfs, 2))
+    {
+        *fs_bkgd = surfs[0];
+        *win_bkgd = surfs[1];
+        return;
+    }
+
+    T4K_LoadBothBkgds(name, fs_bkgd, win_bkgd);
+    if (*fs_bkgd && *win_bkgd)
+    {
+        surfs[0] = *fs_bkgd;
+        surfs[1] = *win_bkgd;
+        asset_cache_save(cache_name, key, surfs, 2);
+    }
+}
+
+
+/* Keys are FNV-1a hashes.  Every key starts from the program version */
+/* and the display's pixel format:                                    */
+Uint32 asset_key_start(void)
+{
+    SDL_PixelFormat* fmt = T4K_GetScreen()->format;
+    Uint32 vals[6];
+    Uint32 key = 2166136261u;
+
+    vals[0] = ASSET_CACHE_VERSION;
+    vals[1] = fmt->BitsPerPixel;
+    vals[2] = fmt->Rmask;
+    vals[3] = fmt->Gmask;
+    vals[4] = fmt->Bmask;
+    vals[5] = fmt->Amask;
+
+    key = asset_key_data(key, VERSION, strlen(VERSION));
+    key = asset_key_data(key, DATA_PREFIX, strlen(DATA_PREFIX));
+    return asset_key_data(key, vals, sizeof(vals));
+}
+
+
+Uint32 asset_key_data(Uint32 key, const void* data, int len)
+{
+    const Uint8* p = (const Uint8*)data;
+
+    while (len-- > 0)
+    {
+        key ^= *p++;
+        key *= 16777619u;
+    }
+    return key;
+}
+
+
+/* Mix in the name, size and date of an image file (or directory),    */
+/* named relative to the images directory as for T4K_LoadImage(), so  */
+/* the cache is rebuilt when it changes.  As t4k_common will use an   */
+/* SVG in place of a PNG of the same name, we look at both:           */
+Uint32 asset_key_file(Uint32 key, const char* name)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    Uint32 vals[4] = {0, 0, 0, 0};
+    char* ext;
+
+    /* From the archive's index if it's there, saving a stat() each: */
+    snprintf(path, sizeof(path), "images/%s", name);
+    if (archive_stat(path, &vals[0], &vals[1]))
+    {
+        ext = strrchr(path, '.');
+        if (ext && strcmp(ext, ".png") == 0)
+        {
+            strcpy(ext, ".svg");
+            archive_stat(path, &vals[2], &vals[3]);
+        }
+        key = asset_key_data(key, name, strlen(name));
+        return asset_key_data(key, vals, sizeof(vals));
+    }
+
+    snprintf(path, sizeof(path), "%s/images/%s", DATA_PREFIX, name);
+    if (stat(path, &st) == 0)
+    {
+        vals[0] = st.st_size;
+        vals[1] = st.st_mtime;
+    }
+    ext = strrchr(path, '.');
+    if (ext && strcmp(ext, ".png") == 0)
+    {
+        strcpy(ext, ".svg");
+        if (stat(path, &st) == 0)
+        {
+            vals[2] = st.st_size;
+            vals[3] = st.st_mtime;
+        }
+    }
+
+    key = asset_key_data(key, name, strlen(name));
+    return asset_key_data(key, vals, sizeof(vals));
+}
+
+
+/* Mix in the pixels of a surface, for things made from images that */
+/* are already loaded:                                               */
+Uint32 asset_key_surface(Uint32 key, SDL_Surface* s)
+{
+    int y;
+
+    if (!s)
+        return key;
+    key = asset_key_data(key, &s->w, sizeof(s->w));
+    key = asset_key_data(key, &s->h, sizeof(s->h));
+    if (SDL_MUSTLOCK(s) && SDL_LockSurface(s) < 0)
+        return key;
+    for (y = 0; y < s->h; y++)
+        key = asset_key_data(key, (Uint8*)s->pixels + y * s->pitch,
+                s->w * s->format->BytesPerPixel);
+    if (SDL_MUSTLOCK(s))
+        SDL_UnlockSurface(s);
+    return key;
+}
+
+
+/* Read n surfaces saved by asset_cache_save() with the same key into */
+/* surfs.  Returns 1 if successful, or 0 (with surfs all NULL) if the */
+/* cache file is missing, stale or damaged:                           */
+int asset_cache_load(const char* name, Uint32 key, SDL_Surface** surfs, int n)
+{
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < n; i++)
+        surfs[i] = NULL;
+    if (!cache_file_path(path, name))
+        return 0;
+    return cache_load_path(path, key, surfs, n);
+}
+
+
+/* As asset_cache_load(), given the file's path - which, as it depends */
+/* on the user logged in, has to be found on the main thread:          */
+static int cache_load_path(const char* path, Uint32 key, SDL_Surface** surfs, int n)
+{
+    Uint32 header[4];
+    cache_surface_header sh;
+    SDL_Surface* s;
+    FILE* fp;
+    int i, y;
+    int ok = 1;
+
+    for (i = 0; i < n; i++)
+        surfs[i] = NULL;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    if (fread(header, sizeof(Uint32), 4, fp) != 4
+            || header[0] != ASSET_CACHE_MAGIC
+            || header[1] != ASSET_CACHE_VERSION
+            || header[2] != key
+            || header[3] != n)
+    {
+        DEBUGMSG(debug_fileops, "asset_cache_load(): %s is out of date\n", path);
+        fclose(fp);
+        return 0;
+    }
+
+    for (i = 0; i < n && ok; i++)
+    {
+        if (fread(&sh, sizeof(sh), 1, fp) != 1)
+        {
+            ok = 0;
+            break;
+        }
+        if (sh.w == 0)
+            continue;     /* saved from a NULL surface */
+        if (sh.bpp < 2 || sh.bpp > 4 || sh.w > 16384 || sh.h > 16384)
+        {
+            ok = 0;
+            break;
+        }
+
+        s = SDL_CreateRGBSurface(SDL_SWSURFACE, sh.w, sh.h, sh.bpp * 8,
+                sh.Rmask, sh.Gmask, sh.Bmask, sh.Amask);
+        if (!s)
+        {
+            ok = 0;
+            break;
+        }
+        surfs[i] = s;
+
+        for (y = 0; y < sh.h; y++)
+        {
+            if (fread((Uint8*)s->pixels + y * s->pitch, sh.bpp, sh.w, fp) != sh.w)
             {
-                fprintf(stderr,
-                        "\nError: I couldn't load a sound file:\n"
-                        "%s\n"
-                        "The Simple DirectMedia error that occured was:\n"
-                        "%s\n\n", sound_filenames[i], SDL_GetError());
-                return 0;
+                ok = 0;
+                break;
             }
         }
+
+        if (sh.flags & SDL_SRCCOLORKEY)
+            SDL_SetColorKey(s, SDL_SRCCOLORKEY, sh.colorkey);
+        SDL_SetAlpha(s, sh.flags & SDL_SRCALPHA, sh.alpha);
+    }
+    fclose(fp);
+
+    if (!ok)
+    {
+        fprintf(stderr, "Warning - image cache %s is damaged, rebuilding it\n", path);
+        free_surfaces(surfs, n);
+        remove(path);
+        return 0;
+    }
+
+    DEBUGMSG(debug_fileops, "asset_cache_load(): loaded %d surfaces from %s\n", n, path);
+    return 1;
+}
+
+
+/* Save n surfaces (NULLs allowed) under the given name and key.  The */
+/* file is written under a temporary name and then renamed, so a      */
+/* half-written cache is never read back.  Returns 1 if successful:   */
+int asset_cache_save(const char* name, Uint32 key, SDL_Surface** surfs, int n)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    Uint32 header[4];
+    cache_surface_header sh;
+    SDL_Surface* s;
+    FILE* fp;
+    int i, y;
+    int ok = 1;
+
+    /* We don't bother with palettized surfaces: */
+    for (i = 0; i < n; i++)
+        if (surfs[i] && surfs[i]->format->BytesPerPixel < 2)
+            return 0;
+
+    if (!cache_file_path(path, name))
+        return 0;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    fp = fopen(tmp_path, "wb");
+    if (!fp)
+        return 0;
+
+    header[0] = ASSET_CACHE_MAGIC;
+    header[1] = ASSET_CACHE_VERSION;
+    header[2] = key;
+    header[3] = n;
+    if (fwrite(header, sizeof(Uint32), 4, fp) != 4)
+        ok = 0;
+
+    for (i = 0; i < n && ok; i++)
+    {
+        s = surfs[i];
+        memset(&sh, 0, sizeof(sh));
+        if (s)
+        {
+            sh.w = s->w;
+            sh.h = s->h;
+            sh.bpp = s->format->BytesPerPixel;
+            sh.Rmask = s->format->Rmask;
+            sh.Gmask = s->format->Gmask;
+            sh.Bmask = s->format->Bmask;
+            sh.Amask = s->format->Amask;
+            sh.flags = s->flags & (SDL_SRCALPHA | SDL_SRCCOLORKEY);
+            sh.colorkey = s->format->colorkey;
+            sh.alpha = s->format->alpha;
+        }
+        if (fwrite(&sh, sizeof(sh), 1, fp) != 1)
+        {
+            ok = 0;
+            break;
+        }
+        if (!s)
+            continue;
+
+        /* Locking also undoes any RLE encoding: */
+        if (SDL_MUSTLOCK(s) && SDL_LockSurface(s) < 0)
+        {
+            ok = 0;
+            break;
+        }
+        for (y = 0; y < s->h && ok; y++)
+            if (fwrite((Uint8*)s->pixels + y * s->pitch, sh.bpp, s->w, fp) != s->w)
+                ok = 0;
+        if (SDL_MUSTLOCK(s))
+            SDL_UnlockSurface(s);
+    }
+
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (ok)
+    {
+        remove(path);   /* rename() won't replace a file on Windows */
+        ok = (rename(tmp_path, path) == 0);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Warning - could not write image cache %s\n", path);
+        remove(tmp_path);
+        return 0;
+    }
+
+    DEBUGMSG(debug_fileops, "asset_cache_save(): saved %d surfaces to %s\n", n, path);
+    return 1;
+}
+
+
+/* Cache files go in the cache dir, named after what they hold: */
+static int cache_file_path(char* path, const char* name)
+{
+    char* p;
+
+    if (!find_cache_dir(path))
+        return 0;
+    p = path + strlen(path);
+    snprintf(p, PATH_MAX - strlen(path), "%s.cache", name);
+    /* e.g. "backgrounds/1.jpg" -> "backgrounds_1.jpg": */
+    for (; *p; p++)
+        if (*p == '/' || *p == '\\')
+            *p = '_';
+    return 1;
+}
+
+
+static void free_surfaces(SDL_Surface** surfs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (surfs[i])
+        {
+            SDL_FreeSurface(surfs[i]);
+            surfs[i] = NULL;
+        }
+    }
+}
+
+
+
+
+
+#ifndef NOSOUND
+static char* sound_filenames[NUM_SOUNDS] = {
+    DATA_PREFIX "/sounds/harp.wav",
+    DATA_PREFIX "/sounds/pop.wav",
+    DATA_PREFIX "/sounds/tock.wav",
+    DATA_PREFIX "/sounds/laser.wav",
+    DATA_PREFIX "/sounds/buzz.wav",
+    DATA_PREFIX "/sounds/alarm.wav",
+    DATA_PREFIX "/sounds/shieldsdown.wav",
+    DATA_PREFIX "/sounds/explosion.wav",
+    DATA_PREFIX "/sounds/sizzling.wav",
+    DATA_PREFIX "/sounds/towerclock.wav",
+    DATA_PREFIX "/sounds/cheer.wav",
+    DATA_PREFIX "/sounds/engine.wav"
+};
+
+/* Sound files read by the tasks, for finish_sound_data() to decode: */
+static Uint8* sound_data[NUM_SOUNDS];
+static Uint32 sound_size[NUM_SOUNDS];
+
+static int read_sound_task(int i);
+
+
+/* Queue a task to read each sound file that isn't in the archive for */
+/* tasks_run().  SDL_mixer only decodes them afterwards, on the main  */
+/* thread:                                                             */
+void queue_sound_data(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_SOUNDS; i++)
+    {
+        sounds[i] = NULL;
+        sound_data[i] = NULL;
+    }
+
+    /* skip loading sound files if sound system not available: */
+    if (!Opts_UsingSound())
+        return;
+
+    for (i = 0; i < NUM_SOUNDS; i++)
+        if (!archive_find_path(sound_filenames[i], NULL))
+            task_add("sounds", read_sound_task, i);
+}
+
+
+/* After tasks_run() - returns 1 if all sounds were loaded: */
+int finish_sound_data(void)
+{
+    int i, ok = 1;
+
+    if (!Opts_UsingSound())
+        return 1;
+
+    for (i = 0; i < NUM_SOUNDS; i++)
+    {
+        if (sound_data[i])
+            sounds[i] = Mix_LoadWAV_RW(SDL_RWFromConstMem(sound_data[i], sound_size[i]), 1);
+        else
+            sounds[i] = archive_load_wav(sound_filenames[i]);
+        free(sound_data[i]);
+        sound_data[i] = NULL;
+
+        if (sounds[i] == NULL)
+        {
+            fprintf(stderr,
+                    "\nError: I couldn't load a sound file:\n"
+                    "%s\n"
+                    "The Simple DirectMedia error that occured was:\n"
+                    "%s\n\n", sound_filenames[i], SDL_GetError());
+            ok = 0;
+        }
     }
 
     //NOTE - no longer load musics here - they are loaded as needed
+    return ok;
+}
+
+
+/* Read a sound file into memory - if it can't be, finish_sound_data() */
+/* just loads it from the file instead:                                 */
+static int read_sound_task(int i)
+{
+    FILE* fp;
+    long size;
+
+    fp = fopen(sound_filenames[i], "rb");
+    if (!fp)
+        return 1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0
+            && fseek(fp, 0, SEEK_SET) == 0)
+    {
+        sound_data[i] = malloc(size);
+        if (sound_data[i] && fread(sound_data[i], 1, size, fp) == (size_t)size)
+            sound_size[i] = size;
+        else
+        {
+            free(sound_data[i]);
+            sound_data[i] = NULL;
+        }
+    }
+    fclose(fp);
     return 1;
 }
 
@@ -0,0 +1,76 @@
+/*
+   fixed.c:
+
+   Fixed point helpers for the factoroids physics: sine and cosine
+   from a table of whole degrees, and moving something that goes so
+   many pixels (or degrees) a second by whole units each frame while
+   keeping the remainder for the next.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+fixed.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "fixed.h"
+
+/* cos() of each whole degree, made once by fixed_init(): */
+static fixed cos_table[360];
+static int tables_made = 0;
+
+
+void fixed_init(void)
+{
+    int i;
+
+    if (tables_made)
+        return;
+    for (i = 0; i < 360; i++)
+        cos_table[i] = (fixed)floor(cos(i * M_PI / 180.0) * FIXED_ONE + 0.5);
+    tables_made = 1;
+}
+
+
+/* Angles are in degrees, anticlockwise, and needn't be within 0-359: */
+fixed fixed_cos(int degrees)
+{
+    degrees %= 360;
+    if (degrees < 0)
+        degrees += 360;
+    return cos_table[degrees];
+}
+
+
+fixed fixed_sin(int degrees)
+{
+    return fixed_cos(degrees - 90);
+}
+
+
+/* How many whole units something moving "speed" units a second goes */
+/* in dt seconds, with the fraction left over from last time in       */
+/* *frac, which is left with the new fraction (always 0 to 1):        */
+int fixed_step(fixed* frac, int speed, fixed dt)
+{
+    Sint64 moved = *frac + (Sint64)speed * dt;
+    int whole = (int)(moved >> FIXED_SHIFT);
+
+    *frac = (fixed)(moved - ((Sint64)whole << FIXED_SHIFT));
+    return whole;
+}
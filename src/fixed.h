@@ -0,0 +1,28 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <SDL_types.h>
+
+/* 16.16 fixed point, for the factoroids physics.  Things that move are */
+/* kept at whole pixels (or degrees) as before, plus a fraction that is */
+/* carried from frame to frame, so slow motion at a high frame rate     */
+/* isn't rounded away - see fixed.c:                                    */
+typedef Sint32 fixed;
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+#define INT_TO_FIXED(i) ((fixed)(i) * FIXED_ONE)
+#define FLOAT_TO_FIXED(f) ((fixed)((f) * FIXED_ONE))
+#define FIXED_TO_FLOAT(x) ((float)(x) / FIXED_ONE)
+/* (these round towards minus infinity, and to nearest) */
+#define FIXED_FLOOR(x) ((x) >> FIXED_SHIFT)
+#define FIXED_ROUND(x) (((x) + FIXED_ONE / 2) >> FIXED_SHIFT)
+#define FIXED_MUL(a, b) ((fixed)(((Sint64)(a) * (b)) >> FIXED_SHIFT))
+
+void fixed_init(void);
+fixed fixed_cos(int degrees);
+fixed fixed_sin(int degrees);
+int fixed_step(fixed* frac, int speed, fixed dt);
+
+#endif
@@ -25,49 +25,130 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+#include <math.h>
+
 #include "SDL_timer.h"
 
 #include "options.h"
+#include "frame_counter.h"
+#include "profiler.h"
 
 #define SPRITE_DELAY 200
 
+//With frame pacing, the last SPIN_TIME microseconds or so before a
+//frame is due are waited out without sleeping, SDL_Delay() being
+//unable to wake up that precisely
+#define SPIN_TIME 500
+
+//How far past the time asked for SDL_Delay() is reckoned to sleep, to
+//begin with and at most - so that one bad hiccup can't stop us sleeping
+#define START_OVERSHOOT 1000.0f
+#define MAX_OVERSHOOT 2000.0f
+
 
 //global
 float FC_time_elapsed;
+float FC_busy_time;
 int FC_frame_rate;
 int FC_sprite_counter;
+float FC_step_alpha;
 
-//'local'
+//'local' - times are in microseconds
 static Uint32 last_time;
 static Uint32 counter_time;
 static Uint32 frame_begin_time;
 static Uint32 sprite_counter_time;
 static int frame_count;
+static float step_time;
+
+//for frame pacing: when the next frame is due, and how far past the
+//time asked for SDL_Delay() usually sleeps
+static Uint32 deadline;
+static int deadline_rem;
+static int deadline_set;
+static float overshoot;
+
+//frame time statistics, kept as in Welford's method
+static Uint32 num_frame_times;
+static double mean_frame_time;
+static double frame_time_m2;
+static Uint32 longest_frame_time;
+static int first_frame;
+
+static void pace_frame(int fps);
+
+
+//Microseconds from a clock that only ever goes forwards (the time of
+//day can be set back), wrapping around every 71 minutes or so - so
+//only the difference between two of them means anything
+Uint32 FC_ticks_us(void)
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER t;
+
+    if(!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (Uint32)(t.QuadPart / freq.QuadPart * 1000000
+                    + t.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (Uint32)((Uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+    return SDL_GetTicks() * 1000;
+#else
+    //(SDL's own clock is monotonic, if only to the millisecond)
+    return SDL_GetTicks() * 1000;
+#endif
+}
 
 
 void FC_init(void)
 {
-    last_time = SDL_GetTicks();
+    last_time = FC_ticks_us();
     counter_time = 0;
     sprite_counter_time = 0;
     frame_count = 0;
 
     FC_time_elapsed = 0.0f;
+    FC_busy_time = 0.0f;
     FC_frame_rate = 0;
     FC_sprite_counter = 0;
+    FC_step_alpha = 1.0f;
+    step_time = 0.0f;
+
+    deadline_set = 0;
+    overshoot = START_OVERSHOOT;
+
+    num_frame_times = 0;
+    mean_frame_time = 0.0;
+    frame_time_m2 = 0.0;
+    longest_frame_time = 0;
+    first_frame = 1;
 }
 
 
 void FC_frame_begin(void)
 {
-    frame_begin_time = SDL_GetTicks();
+    double diff;
+
+    PROF_frame();
+    frame_begin_time = FC_ticks_us();
 
     Uint32 delta_time = frame_begin_time - last_time;
     last_time = frame_begin_time;
 
     counter_time += delta_time;
     ++frame_count;
-    if(counter_time >= 1000)
+    if(counter_time >= 1000000)
     {
         FC_frame_rate = frame_count;
         frame_count = 0;
@@ -75,26 +156,160 @@ void FC_frame_begin(void)
     }
 
     sprite_counter_time += delta_time;
-    if(sprite_counter_time >= SPRITE_DELAY)
+    if(sprite_counter_time >= SPRITE_DELAY * 1000)
     {
         ++FC_sprite_counter;
         sprite_counter_time = 0;
     }
 
-    FC_time_elapsed = delta_time/1000.0f;
+    //(the first frame after FC_init() includes loading and so forth)
+    if(first_frame)
+        first_frame = 0;
+    else
+    {
+        num_frame_times++;
+        diff = delta_time - mean_frame_time;
+        mean_frame_time += diff / num_frame_times;
+        frame_time_m2 += diff * (delta_time - mean_frame_time);
+        if(delta_time > longest_frame_time)
+            longest_frame_time = delta_time;
+    }
+
+    FC_time_elapsed = delta_time/1000000.0f;
+    FC_step_alpha = 1.0f;
+}
+
+
+int FC_fixed_steps(void)
+{
+    int steps;
+
+    step_time += FC_time_elapsed;
+    steps = step_time / FC_STEP_TIME;
+    if(steps > FC_MAX_STEPS)
+    {
+        steps = FC_MAX_STEPS;
+        step_time = 0.0f;
+    }
+    else
+        step_time -= steps * FC_STEP_TIME;
+
+    FC_step_alpha = step_time / FC_STEP_TIME;
+    if(FC_step_alpha < 0.0f)
+        FC_step_alpha = 0.0f;
+    if(FC_step_alpha > 1.0f)
+        FC_step_alpha = 1.0f;
+    FC_time_elapsed = FC_STEP_TIME;
+    return steps;
 }
 
 
 void FC_frame_end(void)
 {
+    FC_busy_time = (FC_ticks_us()-frame_begin_time)/1000000.0f;
+
     if(Opts_FPSLimit() <= 0)
         return;
 
-    Uint32 this_frame_time = SDL_GetTicks()-frame_begin_time;
+    if(Opts_FramePacing())
+    {
+        pace_frame(Opts_FPSLimit());
+        return;
+    }
+
+    Uint32 this_frame_time = (FC_ticks_us()-frame_begin_time)/1000;
     Uint32 time_per_frame_limit = 1000/Opts_FPSLimit();
 
     if(this_frame_time < time_per_frame_limit)
     {
+        PROF_begin(PROF_IDLE);
         SDL_Delay(time_per_frame_limit-this_frame_time);
+        PROF_end(PROF_IDLE);
+    }
+}
+
+
+void FC_frame_time_stats(float* mean, float* stddev, float* longest, float* sleep_overshoot)
+{
+    if(mean)
+        *mean = mean_frame_time / 1000.0;
+    if(stddev)
+        *stddev = num_frame_times > 1 ?
+            sqrt(frame_time_m2 / (num_frame_times - 1)) / 1000.0 : 0.0;
+    if(longest)
+        *longest = longest_frame_time / 1000.0f;
+    if(sleep_overshoot)
+        *sleep_overshoot = overshoot / 1000.0f;
+}
+
+
+//Wait until the frame is due - frames being due exactly 1/fps seconds
+//apart, rather than a whole number of milliseconds after the last one
+//ended.  Most of the wait is slept, stopping short by however much
+//SDL_Delay() has lately been oversleeping, and the rest spun away.
+//A frame that is late by a whole frame or more starts the timing over,
+//so that a slow patch isn't followed by a rush to catch up.
+static void pace_frame(int fps)
+{
+    Uint32 now, before;
+    Sint32 remaining, slept;
+    Uint32 ms;
+
+    if(deadline_set)
+    {
+        deadline += 1000000 / fps;
+        deadline_rem += 1000000 % fps;
+        if(deadline_rem >= fps)
+        {
+            deadline++;
+            deadline_rem -= fps;
+        }
+    }
+
+    now = FC_ticks_us();
+    if(!deadline_set || (Sint32)(now - deadline) >= 1000000 / fps)
+    {
+        deadline = frame_begin_time + 1000000 / fps;
+        deadline_rem = 0;
+        deadline_set = 1;
+    }
+
+    PROF_begin(PROF_IDLE);
+    remaining = (Sint32)(deadline - now);
+    //(should the clock ever misbehave, never wait over a frame)
+    if(remaining > 1000000 / fps)
+    {
+        deadline = now + 1000000 / fps;
+        deadline_rem = 0;
+        remaining = 1000000 / fps;
+    }
+    if(remaining > overshoot + SPIN_TIME)
+    {
+        ms = (remaining - overshoot) / 1000;
+        if(ms > 0)
+        {
+            before = FC_ticks_us();
+            SDL_Delay(ms);
+            slept = (Sint32)(FC_ticks_us() - before) - (Sint32)(ms * 1000);
+            if(slept < 0)
+                slept = 0;
+            //catch up with a worse overshoot quickly, a better one slowly
+            if(slept > overshoot)
+                overshoot += (slept - overshoot) / 2;
+            else
+                overshoot += (slept - overshoot) / 16;
+            if(overshoot > MAX_OVERSHOOT)
+                overshoot = MAX_OVERSHOOT;
+        }
+    }
+    else
+    {
+        //Not sleeping at all, so we can't tell if SDL_Delay() has got
+        //better - assume it has, a little at a time, or a spell of
+        //short waits would have us spinning through every one after
+        overshoot -= overshoot / 16;
     }
+    while((Sint32)(deadline - FC_ticks_us()) > 0)
+        ;
+    PROF_end(PROF_IDLE);
 }
@@ -28,12 +28,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef FRAME_COUNTER_H
 #define FRAME_COUNTER_H
 
+#include "SDL_types.h"
+
 
 //FC_time_elapsed stores time elapsed since last frame in seconds
 //It's intended for use in calculating frame rate independent game logic
 extern float FC_time_elapsed;
 
 
+//FC_busy_time is how long the last frame took, in seconds, before
+//FC_frame_end() started waiting for the next
+extern float FC_busy_time;
+
+
 //FC_frame_rate stores number of frames rendered during last second
 extern int FC_frame_rate;
 
@@ -47,13 +54,44 @@ void FC_init(void);
 
 
 //FC_frame_begin() should be called on the beginning of every frame
-//This function updates FC_time_elapsed and FC_frame_rate
+//This function updates FC_time_elapsed and FC_frame_rate, and starts
+//a new frame in the profiler (see profiler.h)
 void FC_frame_begin(void);
 
 
 //FC_frame_end() should be called at the end of every frame
-//This function is responsible for limiting frame rate
+//This function is responsible for limiting frame rate.  With the
+//frame_pacing option it keeps to the limit to within a fraction of a
+//millisecond, sleeping for most of the wait and spinning for the rest
 void FC_frame_end(void);
 
 
+//FC_ticks_us() is a clock in microseconds, for timing within a frame
+Uint32 FC_ticks_us(void);
+
+
+//FC_frame_time_stats() gives the mean, standard deviation and longest
+//of the times between frames since FC_init(), and how far past the
+//time asked for SDL_Delay() has lately been sleeping, all in ms
+void FC_frame_time_stats(float* mean, float* stddev, float* longest, float* sleep_overshoot);
+
+
+//Game logic can instead run in fixed steps of FC_STEP_TIME seconds,
+//so it behaves the same whatever the frame rate.  FC_fixed_steps(),
+//called after FC_frame_begin(), returns how many steps are due this
+//frame - at most FC_MAX_STEPS, any more time than that is dropped, so a
+//slow machine slows the game down rather than running ever more steps -
+//and sets FC_time_elapsed to the length of one step
+#define FC_STEP_RATE 60
+#define FC_STEP_TIME (1.0f / FC_STEP_RATE)
+#define FC_MAX_STEPS 5
+int FC_fixed_steps(void);
+
+
+//FC_step_alpha is how far (0 to 1) the frame is between the last step
+//and the next, for drawing moving things part way between the two.
+//It's 1 unless FC_fixed_steps() is used
+extern float FC_step_alpha;
+
+
 #endif
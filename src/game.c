@@ -15,6 +15,8 @@ int pause_game(void)
     int pause_done, pause_quit;
     SDL_Event event;
     SDL_Rect dest;
+    /* The real screen, even if the game is drawing off-screen: */
+    SDL_Surface* scr = T4K_GetScreen();
 
     /* Only pause if pause allowed: */
     if (!Opts_AllowPause())
@@ -26,14 +28,14 @@ int pause_game(void)
     pause_done = 0;
     pause_quit = 0;
 
-    dest.x = (screen->w - images[IMG_PAUSED]->w) / 2;
-    dest.y = (screen->h - images[IMG_PAUSED]->h) / 2;
+    dest.x = (scr->w - images[IMG_PAUSED]->w) / 2;
+    dest.y = (scr->h - images[IMG_PAUSED]->h) / 2;
     dest.w = images[IMG_PAUSED]->w;
     dest.h = images[IMG_PAUSED]->h;
 
     T4K_DarkenScreen(1);  // cut all channels by half
-    SDL_BlitSurface(images[IMG_PAUSED], NULL, screen, &dest);
-    SDL_UpdateRect(screen, 0, 0, 0, 0);
+    SDL_BlitSurface(images[IMG_PAUSED], NULL, scr, &dest);
+    SDL_UpdateRect(scr, 0, 0, 0, 0);
 
 #ifndef NOSOUND
     if(Opts_GetGlobalOpt(USE_SOUND))
@@ -125,6 +125,14 @@ extern const int debug_multiplayer;
 #define DEFAULT_CITY_EXPL_HANDICAP 0
 #define DEFAULT_LAST_SCORE 0
 #define DEFAULT_FPS_LIMIT 60
+#define DEFAULT_FRAME_PACING 1
+#define DEFAULT_AUTO_QUALITY 1
+#define DEFAULT_RENDER_SCALE 1
+#define DEFAULT_RENDER_SMOOTH 0
+#define DEFAULT_ROTATION_STEP 2
+#define DEFAULT_ROTATION_CACHE_SIZE 24
+#define DEFAULT_ROTATION_PREWARM 1
+#define DEFAULT_PROFILER 0
 #define DEFAULT_WINDOW_WIDTH 640
 #define DEFAULT_WINDOW_HEIGHT 480
 #define DEFAULT_CUSTOM_RES 0
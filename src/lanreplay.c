@@ -0,0 +1,357 @@
+/*
+   lanreplay.c:
+
+   Command-line program that replays LAN game traffic recorded by
+   "tuxmathserver --record" against a running server, either
+   in real time or as fast as possible, for load testing and for
+   reproducing timing problems in the server.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+lanreplay.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBSDL_NET
+
+#include "SDL.h"
+#include "SDL_net.h"
+#include "transtruct.h"
+
+#define DEFAULT_PORT 4779
+
+/* One replayed connection per recorded index - players, then held */
+/* handshakes, then spectators (see transtruct.h):                    */
+TCPsocket replay_sock[LANLOG_MAX_CONNS];
+SDLNet_SocketSet replay_set = NULL;
+
+/* The server hands out a new session token each time, so the ones in */
+/* the recording have to be swapped for the live ones when resuming:  */
+char recorded_token[LANLOG_MAX_CONNS][NET_BUF_LEN];
+char live_token[LANLOG_MAX_CONNS][NET_BUF_LEN];
+
+/* Totals for the summary at the end: */
+int msgs_sent = 0;
+int msgs_expected = 0;
+int msgs_recvd = 0;
+int connects = 0;
+int connect_failures = 0;
+
+/* Local function prototypes: */
+int read_record(FILE* fp, Uint32* t, int* type, int* i, char* msg);
+void replay_connect(IPaddress* ip, int i);
+void replay_disconnect(int i);
+void replay_move(int from, int i);
+void replay_send(int i, char* msg);
+void map_token(char* msg);
+void drain_server(Uint32 wait);
+void usage(char* prog);
+
+
+int main(int argc, char** argv)
+{
+    FILE* fp = NULL;
+    IPaddress ip;
+    char* host = "localhost";
+    char* filename = NULL;
+    int fast = 0;
+    int i, type;
+    Uint32 t, start, now;
+    char header[LANLOG_HEADER_LEN];
+    char msg[NET_BUF_LEN];
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--fast") == 0 || strcmp(argv[i], "-f") == 0)
+            fast = 1;
+        else if((strcmp(argv[i], "--host") == 0 || strcmp(argv[i], "-s") == 0)
+                && (i + 1 < argc))
+            host = argv[++i];
+        else if(argv[i][0] != '-' && !filename)
+            filename = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(!filename)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fp = fopen(filename, "rb");
+    if(!fp)
+    {
+        fprintf(stderr, "Could not open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+    if(fread(header, 1, strlen(LANLOG_MAGIC) + 1, fp) != strlen(LANLOG_MAGIC) + 1
+            || strncmp(header, LANLOG_MAGIC, strlen(LANLOG_MAGIC)) != 0
+            || header[strlen(LANLOG_MAGIC)] != LANLOG_VERSION)
+    {
+        fprintf(stderr, "%s is not a tuxmathserver recording\n", filename);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    if(SDL_Init(SDL_INIT_TIMER) == -1)
+    {
+        fprintf(stderr, "SDL_Init: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+    if(SDLNet_Init() < 0)
+    {
+        fprintf(stderr, "SDLNet_Init: %s\n", SDLNet_GetError());
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+    if(SDLNet_ResolveHost(&ip, host, DEFAULT_PORT) < 0)
+    {
+        fprintf(stderr, "SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+        SDLNet_Quit();
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+    replay_set = SDLNet_AllocSocketSet(LANLOG_MAX_CONNS);
+    for(i = 0; i < LANLOG_MAX_CONNS; i++)
+    {
+        replay_sock[i] = NULL;
+        recorded_token[i][0] = live_token[i][0] = '\0';
+    }
+
+    start = SDL_GetTicks();
+
+    /* NOTE in fast mode the server may not have sent a question yet  */
+    /* when the recorded answer to it goes out, in which case the     */
+    /* server just ignores the answer - the point is to stress it:    */
+    while(read_record(fp, &t, &type, &i, msg))
+    {
+        if(!fast)
+        {
+            now = SDL_GetTicks();
+            while(now - start < t)
+            {
+                drain_server(t - (now - start));
+                now = SDL_GetTicks();
+            }
+        }
+
+        switch(type)
+        {
+            case LANLOG_CONNECT:
+                replay_connect(&ip, i);
+                break;
+            case LANLOG_RECV:
+                map_token(msg);
+                replay_send(i, msg);
+                break;
+            case LANLOG_SEND:
+                if(strncmp(msg, "SESSION_TOKEN", strlen("SESSION_TOKEN")) == 0)
+                    snprintf(recorded_token[i], NET_BUF_LEN, "%s", msg + strlen("SESSION_TOKEN"));
+                msgs_expected++;
+                break;
+            case LANLOG_DISCONNECT:
+                replay_disconnect(i);
+                break;
+            case LANLOG_MOVE:
+                replay_move(atoi(msg), i);
+                break;
+            default:
+                fprintf(stderr, "Unknown record type %d - skipping\n", type);
+        }
+        drain_server(0);
+    }
+
+    /* Give the server a moment to answer the last messages: */
+    drain_server(1000);
+
+    fprintf(stderr, "Replayed %s in %d msec (%s):\n"
+            "  connections:        %d (%d failed)\n"
+            "  messages sent:      %d\n"
+            "  messages received:  %d (%d in recording)\n",
+            filename, SDL_GetTicks() - start, fast ? "fast" : "real time",
+            connects, connect_failures, msgs_sent, msgs_recvd, msgs_expected);
+
+    for(i = 0; i < LANLOG_MAX_CONNS; i++)
+        replay_disconnect(i);
+    SDLNet_FreeSocketSet(replay_set);
+    fclose(fp);
+    SDLNet_Quit();
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
+
+
+/* Returns 1 if a complete record was read, 0 at end of file: */
+int read_record(FILE* fp, Uint32* t, int* type, int* i, char* msg)
+{
+    Uint8 header[LANLOG_HEADER_LEN];
+    Uint16 len;
+
+    if(fread(header, 1, LANLOG_HEADER_LEN, fp) != LANLOG_HEADER_LEN)
+        return 0;
+    *t = SDLNet_Read32(header);
+    *type = header[4];
+    *i = header[5];
+    len = SDLNet_Read16(header + 6);
+    if(len > NET_BUF_LEN - 1 || *i >= LANLOG_MAX_CONNS)
+    {
+        fprintf(stderr, "Corrupt record in recording - stopping\n");
+        return 0;
+    }
+    if(fread(msg, 1, len, fp) != len)
+        return 0;
+    msg[len] = '\0';
+    return 1;
+}
+
+
+void replay_connect(IPaddress* ip, int i)
+{
+    replay_disconnect(i);
+    replay_sock[i] = SDLNet_TCP_Open(ip);
+    if(!replay_sock[i])
+    {
+        fprintf(stderr, "SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+        connect_failures++;
+        return;
+    }
+    SDLNet_TCP_AddSocket(replay_set, replay_sock[i]);
+    connects++;
+}
+
+
+void replay_disconnect(int i)
+{
+    if(replay_sock[i])
+    {
+        SDLNet_TCP_DelSocket(replay_set, replay_sock[i]);
+        SDLNet_TCP_Close(replay_sock[i]);
+        replay_sock[i] = NULL;
+    }
+}
+
+
+/* A connection changing index, e.g. one that was held as a handshake */
+/* taking back a player's slot:                                        */
+void replay_move(int from, int i)
+{
+    if(from < 0 || from >= LANLOG_MAX_CONNS || from == i)
+        return;
+    replay_disconnect(i);
+    replay_sock[i] = replay_sock[from];
+    replay_sock[from] = NULL;
+}
+
+
+/* Swap a recorded session token in a RESUME_SESSION for the live one */
+/* the server gave the same player:                                    */
+void map_token(char* msg)
+{
+    char* tok;
+    int i;
+
+    if(strncmp(msg, "RESUME_SESSION", strlen("RESUME_SESSION")) != 0)
+        return;
+    tok = msg + strlen("RESUME_SESSION");
+    for(i = 0; i < LANLOG_MAX_CONNS; i++)
+    {
+        if(recorded_token[i][0] && live_token[i][0]
+                && strcmp(tok, recorded_token[i]) == 0)
+        {
+            snprintf(tok, NET_BUF_LEN - strlen("RESUME_SESSION"), "%s", live_token[i]);
+            return;
+        }
+    }
+}
+
+
+void replay_send(int i, char* msg)
+{
+    char buf[NET_BUF_LEN];
+
+    if(!replay_sock[i])
+        return;
+    memset(buf, 0, NET_BUF_LEN);
+    snprintf(buf, NET_BUF_LEN, "%s", msg);
+    if(SDLNet_TCP_Send(replay_sock[i], buf, NET_BUF_LEN) < NET_BUF_LEN)
+    {
+        fprintf(stderr, "Send to server failed for client %d\n", i);
+        replay_disconnect(i);
+        return;
+    }
+    msgs_sent++;
+}
+
+
+/* Read (and throw away, apart from session tokens) whatever the     */
+/* server has sent, waiting up to "wait" msec for it.  We have to keep */
+/* reading or the server would eventually block sending to us:        */
+void drain_server(Uint32 wait)
+{
+    char buf[NET_BUF_LEN];
+    int i;
+
+    if(SDLNet_CheckSockets(replay_set, wait) <= 0)
+        return;
+
+    for(i = 0; i < LANLOG_MAX_CONNS; i++)
+    {
+        if(replay_sock[i] && SDLNet_SocketReady(replay_sock[i]))
+        {
+            if(SDLNet_TCP_Recv(replay_sock[i], buf, NET_BUF_LEN) > 0)
+            {
+                buf[NET_BUF_LEN - 1] = '\0';
+                if(strncmp(buf, "SESSION_TOKEN", strlen("SESSION_TOKEN")) == 0)
+                    snprintf(live_token[i], NET_BUF_LEN, "%s", buf + strlen("SESSION_TOKEN"));
+                msgs_recvd++;
+            }
+            else
+                replay_disconnect(i);
+        }
+    }
+}
+
+
+void usage(char* prog)
+{
+    fprintf(stderr, "Usage: %s [--fast] [--host server] recording\n"
+            "Replays a recording made with \"tuxmathserver --record recording\"\n"
+            "against a running server.  --fast sends messages without the\n"
+            "recorded delays between them.\n", prog);
+}
+
+
+#else
+
+int main(int argc, char** argv)
+{
+    fprintf(stderr, "Sorry, this version built without network support.\n");
+    return EXIT_FAILURE;
+}
+
+#endif
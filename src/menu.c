@@ -439,10 +439,27 @@ int run_lan_host(void)
     char* serv_argv[3];
     int chosen_lesson = -1;
 
-    /* For now, only allow one server instance: */
+    /* For now, only allow one server instance - but if it is ours, */
+    /* we can give it a different lesson without restarting it:     */
     if(OurServerRunning())
     {
-        ShowMessageWrap(DEFAULT_MENU_FONT_SIZE, _("The server is already running")); 
+#ifdef HAVE_PTHREAD_H
+        ShowMessageWrap(DEFAULT_MENU_FONT_SIZE,_("The server is already running - click or press key to select new lesson file"));
+        chosen_lesson = run_menu(MENU_LESSONS, true);
+        if(chosen_lesson < 0)
+            return 0;
+        if (Opts_GetGlobalOpt(MENU_SOUND))
+            playsound(SND_POP);
+        if(!SrvrLoadLesson(lesson_list_filenames[chosen_lesson]))
+        {
+            ShowMessageWrap(DEFAULT_MENU_FONT_SIZE, _("Could not read lesson file"));
+            return 0;
+        }
+        sprintf(msg, _("Selected Lesson:\n%s\nwill be used for the next game"), lesson_list_titles[chosen_lesson]);
+        ShowMessageWrap(DEFAULT_MENU_FONT_SIZE, msg);
+#else
+        ShowMessageWrap(DEFAULT_MENU_FONT_SIZE, _("The server is already running"));
+#endif
         return 0;
     }
 
@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "game.h"
 #include "options.h"
 #include "fileops.h"
+#include "setup.h"
 #include "highscore.h"
 #include "credits.h"
 
@@ -83,6 +84,13 @@ void mp_run_multiplayer()
         return;
     }
 
+    /* Keep the comets images loaded between turns: */
+    if (!load_bundle(BUNDLE_COMETS))
+    {
+        cleanupMP();
+        return;
+    }
+
     //cycle through players until all but one has lost
     if (params[MODE] == ELIMINATION) 
     {
@@ -165,6 +173,7 @@ void mp_run_multiplayer()
 
     showWinners(winners, params[PLAYERS]);
     cleanupMP();
+    release_bundle(BUNDLE_COMETS);
 }
 
 int mp_get_currentplayer(void)
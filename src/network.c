@@ -52,6 +52,8 @@ IPaddress serv_ip;
 ServerEntry servers[MAX_SERVERS];
 static int connected_server = -1;
 static int my_index = -1;
+/* Given to us by the server so we can get our slot back if we drop: */
+static Uint32 session_token = 0;
 
 /* Keep track of other connected players: */
 lan_player_type lan_player_info[MAX_CLIENTS];
@@ -62,6 +64,7 @@ int evaluate(char *statement);
 int add_to_server_list(UDPpacket* pkt);
 void intercept(char* buf);
 int socket_index_recvd(char* buf);
+Uint32 session_token_recvd(char* buf);
 int connected_players_recvd(char* buf);
 int parse_player_info_msg(char* buf);
 int lan_player_left_recvd(char* buf);
@@ -266,11 +269,75 @@ void LAN_Cleanup(void)
         set = NULL;
     }
 
+    session_token = 0;
+
     DEBUGMSG(debug_lan|debug_game, "Leave LAN_cleanup():\n");
 }
 
 
 
+/* Find out if we have what we need to rejoin a game after a dropped */
+/* connection:                                                       */
+int LAN_CanResume(void)
+{
+    return (session_token != 0 && connected_server >= 0);
+}
+
+
+/* Try to get back into the game after our connection dropped.  On    */
+/* success the server replies with our SOCKET_INDEX and a              */
+/* GAME_SNAPSHOT, followed by the usual counter and player updates.   */
+/* Returns 1 if we reconnected and asked to resume, 0 otherwise.      */
+int LAN_Reconnect(void)
+{
+    char buf[NET_BUF_LEN];
+
+    if(!LAN_CanResume())
+        return 0;
+
+    DEBUGMSG(debug_lan, "Enter LAN_Reconnect():\n");
+
+    /* Get rid of the dead connection, if still around: */
+    if(sd)
+    {
+        if(set)
+            SDLNet_TCP_DelSocket(set, sd);
+        SDLNet_TCP_Close(sd);
+        sd = NULL;
+    }
+
+    if (!(sd = SDLNet_TCP_Open(&servers[connected_server].ip)))
+    {
+        DEBUGMSG(debug_lan, "SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+        return 0;
+    }
+
+    if(!set)
+    {
+        set = SDLNet_AllocSocketSet(1);
+        if(!set)
+        {
+            DEBUGMSG(debug_lan, "SDLNet_AllocSocketSet: %s\n", SDLNet_GetError());
+            SDLNet_TCP_Close(sd);
+            sd = NULL;
+            return 0;
+        }
+    }
+
+    if(SDLNet_TCP_AddSocket(set, sd) == -1)
+    {
+        DEBUGMSG(debug_lan, "SDLNet_AddSocket: %s\n", SDLNet_GetError());
+        SDLNet_TCP_Close(sd);
+        sd = NULL;
+        return 0;
+    }
+
+    snprintf(buf, NET_BUF_LEN, "%s\t%u", "RESUME_SESSION", session_token);
+    return say_to_server(buf);
+}
+
+
+
 int LAN_SetName(char* name)
 {
     char buf[NET_BUF_LEN];
@@ -484,6 +551,10 @@ int say_to_server(char* statement)
     if(!statement)
         return 0;
 
+    /* We may be between a dropped connection and LAN_Reconnect(): */
+    if(!sd)
+        return 0;
+
     snprintf(buffer, NET_BUF_LEN, "%s", statement);
     if (SDLNet_TCP_Send(sd, (void *)buffer, NET_BUF_LEN) < NET_BUF_LEN)
     {
@@ -570,6 +641,11 @@ void intercept(char* buf)
         my_index = socket_index_recvd(buf);
         snprintf(buf, NET_BUF_LEN, "%s", "LAN_INTERCEPTED");
     }
+    else if(strncmp(buf, "SESSION_TOKEN", strlen("SESSION_TOKEN")) == 0)
+    {
+        session_token = session_token_recvd(buf);
+        snprintf(buf, NET_BUF_LEN, "%s", "LAN_INTERCEPTED");
+    }
     else if(strncmp(buf, "CONNECTED_PLAYERS", strlen("CONNECTED_PLAYERS")) == 0)
     {
         connected_players_recvd(buf);
@@ -621,6 +697,23 @@ int socket_index_recvd(char* buf)
 }
 
 
+Uint32 session_token_recvd(char* buf)
+{
+    char* p = NULL;
+
+    if(!buf)
+        return 0;
+
+    p = strchr(buf, '\t');
+    if(!p)
+        return 0;
+    p++;
+
+    DEBUGMSG(debug_lan, "session_token_recvd(): token = %s\n", p);
+    return strtoul(p, NULL, 10);
+}
+
+
 int parse_player_info_msg(char* buf)
 {
     int i = 0;
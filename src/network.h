@@ -68,6 +68,9 @@ void LAN_Cleanup(void);
 int LAN_SetName(char* name);
 int LAN_SetReady(bool ready);
 int LAN_RequestIndex(void);
+/* Rejoining a game in progress after a dropped connection: */
+int LAN_CanResume(void);
+int LAN_Reconnect(void);
 /* Network replacement functions for mathcards "API": */
 /* These functions are how the client tells things to the server: */
 int LAN_AnsweredCorrectly(int id, float t);
@@ -173,6 +173,14 @@ int Opts_Initialize(void)
     game_options->max_city_colors = DEFAULT_MAX_CITY_COLORS;
 
     game_options->fps_limit = DEFAULT_FPS_LIMIT;
+    game_options->frame_pacing = DEFAULT_FRAME_PACING;
+    game_options->auto_quality = DEFAULT_AUTO_QUALITY;
+    game_options->render_scale = DEFAULT_RENDER_SCALE;
+    game_options->render_smooth = DEFAULT_RENDER_SMOOTH;
+    game_options->rotation_step = DEFAULT_ROTATION_STEP;
+    game_options->rotation_cache_size = DEFAULT_ROTATION_CACHE_SIZE;
+    game_options->rotation_prewarm = DEFAULT_ROTATION_PREWARM;
+    game_options->profiler = DEFAULT_PROFILER;
     game_options->w_width = DEFAULT_WINDOW_WIDTH;
     game_options->w_height = DEFAULT_WINDOW_HEIGHT;
     game_options->custom_res = DEFAULT_CUSTOM_RES;
@@ -635,6 +643,80 @@ void Opts_SetFPSLimit(int val)
     game_options->fps_limit = val;
 }
 
+void Opts_SetFramePacing(int val)
+{
+    game_options->frame_pacing = int_to_bool(val);
+}
+
+void Opts_SetAutoQuality(int val)
+{
+    game_options->auto_quality = int_to_bool(val);
+}
+
+void Opts_SetRenderScale(int val)
+{
+    if (val < 0 || val > 4)
+    {
+        fprintf(stderr,"Warning: render_scale must be from 0 to 4, setting to %d.\n",
+                DEFAULT_RENDER_SCALE);
+        val = DEFAULT_RENDER_SCALE;
+    }
+    game_options->render_scale = val;
+}
+
+void Opts_SetRenderSmooth(int val)
+{
+    game_options->render_smooth = int_to_bool(val);
+}
+
+void Opts_SetRotationStep(int val)
+{
+    if (val < 1 || val > 90)
+    {
+        fprintf(stderr,"Warning: rotation_step must be from 1 to 90, setting to %d.\n",
+                DEFAULT_ROTATION_STEP);
+        val = DEFAULT_ROTATION_STEP;
+    }
+    game_options->rotation_step = val;
+}
+
+void Opts_SetRotationCacheSize(int val)
+{
+    if (val < 1)
+    {
+        val = 1;
+        fprintf(stderr,"Warning: rotation_cache_size set below minimum, setting to 1.\n");
+    }
+    game_options->rotation_cache_size = val;
+}
+
+void Opts_SetRotationPrewarm(int val)
+{
+    game_options->rotation_prewarm = int_to_bool(val);
+}
+
+void Opts_SetProfiler(int val)
+{
+    if (val < 0 || val > 2)
+    {
+        fprintf(stderr,"Warning: profiler must be 0, 1 or 2, setting to 0.\n");
+        val = 0;
+    }
+    game_options->profiler = val;
+}
+
+void Opts_SetGameOptions(const game_option_type* opts)
+{
+    if (game_options && opts)
+        *game_options = *opts;
+}
+
+void Opts_CopyGameOptions(game_option_type* opts)
+{
+    if (game_options && opts)
+        *opts = *game_options;
+}
+
 
 void Opts_SetWindowWidth(int val)
 {
@@ -1089,6 +1171,54 @@ int Opts_FPSLimit(void)
 }
 
 
+int Opts_FramePacing(void)
+{
+    return game_options->frame_pacing;
+}
+
+
+int Opts_AutoQuality(void)
+{
+    return game_options->auto_quality;
+}
+
+
+int Opts_RenderScale(void)
+{
+    return game_options->render_scale;
+}
+
+
+int Opts_RenderSmooth(void)
+{
+    return game_options->render_smooth;
+}
+
+
+int Opts_RotationStep(void)
+{
+    return game_options->rotation_step;
+}
+
+
+int Opts_RotationCacheSize(void)
+{
+    return game_options->rotation_cache_size;
+}
+
+
+int Opts_RotationPrewarm(void)
+{
+    return game_options->rotation_prewarm;
+}
+
+
+int Opts_Profiler(void)
+{
+    return game_options->profiler;
+}
+
+
 int Opts_WindowWidth(void)
 {
     return game_options->w_width;
@@ -102,6 +102,14 @@ typedef struct game_option_type {
     int keep_score;
 
     int fps_limit;
+    int frame_pacing;
+    int auto_quality;           /* let comets draw less when it is slow */
+    int render_scale;           /* comets drawn at 1/n of the screen, 0 auto */
+    int render_smooth;          /* bilinear rather than blocky scaling up */
+    int rotation_step;          /* degrees between rotated factoroids images */
+    int rotation_cache_size;    /* in MB */
+    int rotation_prewarm;
+    int profiler;               /* 0 off, 1 timings to file, 2 also on screen */
     int w_width;
     int w_height;
     int custom_res;
@@ -166,6 +174,18 @@ void Opts_SetDangerLevelSpeedup(float val);
 void Opts_SetDangerLevelMax(float val);
 void Opts_SetCityExplHandicap(float val);
 void Opts_SetFPSLimit(int val);
+void Opts_SetFramePacing(int val);
+void Opts_SetAutoQuality(int val);
+void Opts_SetRenderScale(int val);
+void Opts_SetRenderSmooth(int val);
+void Opts_SetRotationStep(int val);
+void Opts_SetRotationCacheSize(int val);
+void Opts_SetRotationPrewarm(int val);
+void Opts_SetProfiler(int val);
+/* The whole set of game options at once, e.g. to read a lesson */
+/* without keeping what it sets:                               */
+void Opts_SetGameOptions(const game_option_type* opts);
+void Opts_CopyGameOptions(game_option_type* opts);
 void Opts_SetWindowWidth(int val);
 void Opts_SetWindowHeight(int val);
 
@@ -208,6 +228,14 @@ float Opts_DangerLevelMax(void);
 float Opts_CityExplHandicap(void);
 int Opts_KeepScore(void);
 int Opts_FPSLimit(void);
+int Opts_FramePacing(void);
+int Opts_AutoQuality(void);
+int Opts_RenderScale(void);
+int Opts_RenderSmooth(void);
+int Opts_RotationStep(void);
+int Opts_RotationCacheSize(void);
+int Opts_RotationPrewarm(void);
+int Opts_Profiler(void);
 int Opts_WindowWidth(void);
 int Opts_WindowHeight(void);
 int Opts_CustomRes(void);
@@ -0,0 +1,251 @@
+/* pack_assets.c
+
+   A simple standalone program, run at build time, that packs the
+   image and sound files into one indexed archive (assets.pak) for
+   tuxmath to map into memory and load from - see archive.c.
+
+   Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+
+pack_assets.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* (just the archive format, not the loading functions) */
+#define PACK_ASSETS
+#include "archive.h"
+
+/* Usage:
+
+   pack_assets assets.pak ../data images sounds
+
+   packs every image and sound file under ../data/images and
+   ../data/sounds, named relative to ../data (e.g. "images/status/title.png").
+*/
+
+typedef struct pack_entry {
+    char* name;
+    char* path;
+    unsigned long size;
+} pack_entry;
+
+static pack_entry* entries = NULL;
+static int num_entries = 0;
+static int max_entries = 0;
+
+/* Only what tuxmath loads through the archive - the SVGs are listed */
+/* (empty) just so it knows when t4k_common would use them instead   */
+/* of PNGs of the same name:                                         */
+static const char* packed_exts[] = {".png", ".svg", ".wav", NULL};
+
+static int add_dir(const char* root, const char* dir);
+static int add_file(const char* name, const char* path, unsigned long size);
+static int compare_entries(const void* a, const void* b);
+static int write_u32(FILE* fp, unsigned long val);
+static int write_archive(const char* out);
+
+
+int main(int argc, char* argv[])
+{
+    int i;
+
+    if (argc < 4)
+    {
+        fprintf(stderr, "Usage: %s <archive> <data dir> <subdir> [<subdir> ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (i = 3; i < argc; i++)
+        if (!add_dir(argv[2], argv[i]))
+            return 1;
+
+    /* The index is sorted, so tuxmath can search it: */
+    qsort(entries, num_entries, sizeof(pack_entry), compare_entries);
+
+    if (!write_archive(argv[1]))
+    {
+        remove(argv[1]);
+        return 1;
+    }
+    printf("%s: packed %d files\n", argv[1], num_entries);
+    return 0;
+}
+
+
+/* Add every packed file under root/dir (recursively): */
+static int add_dir(const char* root, const char* dir)
+{
+    char path[4096];
+    char name[2048];
+    struct stat st;
+    struct dirent* de;
+    DIR* d;
+    const char* ext;
+    int i, ok = 1;
+
+    snprintf(path, sizeof(path), "%s/%s", root, dir);
+    d = opendir(path);
+    if (!d)
+    {
+        fprintf(stderr, "pack_assets: can't open directory %s\n", path);
+        return 0;
+    }
+
+    while (ok && (de = readdir(d)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(name, sizeof(name), "%s/%s", dir, de->d_name);
+        snprintf(path, sizeof(path), "%s/%s", root, name);
+        if (stat(path, &st) != 0)
+            continue;
+
+        if (S_ISDIR(st.st_mode))
+        {
+            ok = add_dir(root, name);
+            continue;
+        }
+
+        ext = strrchr(de->d_name, '.');
+        if (!ext)
+            continue;
+        for (i = 0; packed_exts[i]; i++)
+            if (strcmp(ext, packed_exts[i]) == 0)
+                break;
+        if (packed_exts[i])
+            ok = add_file(name, path, strcmp(ext, ".svg") ? st.st_size : 0);
+    }
+    closedir(d);
+    return ok;
+}
+
+
+static int add_file(const char* name, const char* path, unsigned long size)
+{
+    pack_entry* e;
+
+    if (num_entries == max_entries)
+    {
+        max_entries = max_entries ? max_entries * 2 : 256;
+        entries = realloc(entries, max_entries * sizeof(pack_entry));
+        if (!entries)
+        {
+            fprintf(stderr, "pack_assets: out of memory\n");
+            return 0;
+        }
+    }
+
+    e = &entries[num_entries++];
+    e->name = strdup(name);
+    e->path = strdup(path);
+    e->size = size;
+    return e->name && e->path;
+}
+
+
+static int compare_entries(const void* a, const void* b)
+{
+    return strcmp(((const pack_entry*)a)->name, ((const pack_entry*)b)->name);
+}
+
+
+/* Everything in the archive is little-endian: */
+static int write_u32(FILE* fp, unsigned long val)
+{
+    unsigned char b[4];
+
+    b[0] = val & 0xFF;
+    b[1] = (val >> 8) & 0xFF;
+    b[2] = (val >> 16) & 0xFF;
+    b[3] = (val >> 24) & 0xFF;
+    return fwrite(b, 1, 4, fp) == 4;
+}
+
+
+/* See archive.h for the layout: */
+static int write_archive(const char* out)
+{
+    unsigned long names_size = 0, data_start, offset, data_offset;
+    char buf[65536];
+    size_t n;
+    FILE* fp;
+    FILE* in;
+    int i, ok = 1;
+
+    for (i = 0; i < num_entries; i++)
+        names_size += strlen(entries[i].name) + 1;
+    data_start = ARCHIVE_HEADER_SIZE + num_entries * ARCHIVE_ENTRY_SIZE + names_size;
+    data_start = (data_start + ARCHIVE_ALIGN - 1) & ~(ARCHIVE_ALIGN - 1);
+
+    fp = fopen(out, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "pack_assets: can't write %s\n", out);
+        return 0;
+    }
+
+    ok = write_u32(fp, ARCHIVE_MAGIC) && write_u32(fp, ARCHIVE_VERSION)
+        && write_u32(fp, num_entries) && write_u32(fp, data_start);
+
+    /* Index: */
+    offset = ARCHIVE_HEADER_SIZE + num_entries * ARCHIVE_ENTRY_SIZE;
+    data_offset = data_start;
+    for (i = 0; i < num_entries && ok; i++)
+    {
+        ok = write_u32(fp, offset) && write_u32(fp, strlen(entries[i].name))
+            && write_u32(fp, data_offset) && write_u32(fp, entries[i].size);
+        offset += strlen(entries[i].name) + 1;
+        data_offset += (entries[i].size + ARCHIVE_ALIGN - 1) & ~(ARCHIVE_ALIGN - 1);
+    }
+
+    /* Names, then the files themselves: */
+    for (i = 0; i < num_entries && ok; i++)
+        ok = fwrite(entries[i].name, 1, strlen(entries[i].name) + 1, fp) > 0;
+    while (ok && ftell(fp) < data_start)
+        ok = fputc(0, fp) != EOF;
+
+    for (i = 0; i < num_entries && ok; i++)
+    {
+        if (entries[i].size == 0)
+            continue;
+        in = fopen(entries[i].path, "rb");
+        if (!in)
+        {
+            fprintf(stderr, "pack_assets: can't read %s\n", entries[i].path);
+            ok = 0;
+            break;
+        }
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0 && ok)
+            ok = fwrite(buf, 1, n, fp) == n;
+        fclose(in);
+        while (ok && ftell(fp) % ARCHIVE_ALIGN)
+            ok = fputc(0, fp) != EOF;
+    }
+
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (!ok)
+        fprintf(stderr, "pack_assets: error writing %s\n", out);
+    return ok;
+}
@@ -0,0 +1,416 @@
+/*
+   profiler.c:
+
+   Times the parts of each frame of a game (input, game logic, each
+   kind of drawing, the flip, waiting for the next frame) to the
+   microsecond, so that when a game stutters we can see what took
+   the time.  The last few seconds of frames are kept, with totals
+   for the whole game, and can be shown as a graph over the game.
+   Everything is appended to a file in the user's data directory
+   when the game ends.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+profiler.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "SDL.h"
+
+#include "globals.h"
+#include "fileops.h"
+#include "options.h"
+#include "draw_utils.h"
+#include "frame_counter.h"
+#include "profiler.h"
+#include "render_target.h"
+
+#define PROFILE_FILENAME "frame_profile.txt"
+
+/* Time not in any zone - e.g. the pause screen - counts as "other": */
+#define PROF_OTHER PROF_NUM_ZONES
+
+/* Frames over half as long again as the frame rate allows are "slow": */
+#define SLOW_PERCENT 150
+
+/* The overlay: a graph of the recent frames, PROF_HISTORY pixels */
+/* wide and GRAPH_H high for each frame's worth of time, with the  */
+/* zones grouped by colour:                                        */
+#define GRAPH_H 60
+#define LEGEND_W 110
+#define LEGEND_FONT_SIZE 12
+
+enum {
+    GROUP_INPUT,
+    GROUP_LOGIC,
+    GROUP_DRAW,
+    GROUP_FLIP,
+    GROUP_IDLE,
+    GROUP_OTHER,
+    NUM_GROUPS
+};
+
+static const char* zone_names[PROF_NUM_ZONES + 1] = {
+    "input", "net", "logic", "bkgr", "misc", "cities", "smartbomb",
+    "comets", "powerup", "ship", "asteroids", "sprites", "lasers",
+    "console", "flip", "idle", "other"
+};
+
+static const int zone_group[PROF_NUM_ZONES + 1] = {
+    GROUP_INPUT, GROUP_INPUT, GROUP_LOGIC,
+    GROUP_DRAW, GROUP_DRAW, GROUP_DRAW, GROUP_DRAW, GROUP_DRAW, GROUP_DRAW,
+    GROUP_DRAW, GROUP_DRAW, GROUP_DRAW, GROUP_DRAW, GROUP_DRAW,
+    GROUP_FLIP, GROUP_IDLE, GROUP_OTHER
+};
+
+static const char* group_names[NUM_GROUPS] = {
+    "input", "logic", "draw", "flip", "idle", "other"
+};
+
+static const Uint8 group_rgb[NUM_GROUPS][3] = {
+    {80, 160, 255}, {80, 220, 80}, {255, 160, 40},
+    {230, 60, 60}, {90, 90, 90}, {200, 200, 200}
+};
+
+typedef struct prof_frame {
+    Uint32 total;                       /* start to start, in microseconds */
+    Uint32 zone[PROF_NUM_ZONES + 1];
+} prof_frame;
+
+static int active = 0;
+static char game[32];
+static Uint32 budget;                   /* microseconds per frame */
+
+/* history[newest] is the frame being timed, the ones before it done: */
+static prof_frame history[PROF_HISTORY];
+static int newest = -1;
+static Uint32 frame_start;
+static Uint32 zone_start;
+static int open_zone = -1;
+
+/* For the whole game: */
+static Uint32 num_frames;
+static double sum_total;
+static double sum_zone[PROF_NUM_ZONES + 1];
+static Uint32 max_total;
+static Uint32 max_zone[PROF_NUM_ZONES + 1];
+static Uint32 slow_frames;
+static Uint32 slow_by_zone[PROF_NUM_ZONES + 1];
+
+static SDL_Surface* labels[NUM_GROUPS];
+
+static void finish_frame(Uint32 total);
+static void write_profile(void);
+
+
+/* Start timing the frames of a game, if the "profiler" option is on: */
+void PROF_start(const char* game_name)
+{
+    int fps;
+
+    active = 0;
+    if (Opts_Profiler() <= 0)
+        return;
+
+    strncpy(game, game_name, sizeof(game) - 1);
+    game[sizeof(game) - 1] = '\0';
+    fps = Opts_FPSLimit() > 0 ? Opts_FPSLimit() : 30;
+    budget = 1000000 / fps;
+
+    newest = -1;
+    open_zone = -1;
+    num_frames = 0;
+    sum_total = 0;
+    max_total = 0;
+    slow_frames = 0;
+    memset(sum_zone, 0, sizeof(sum_zone));
+    memset(max_zone, 0, sizeof(max_zone));
+    memset(slow_by_zone, 0, sizeof(slow_by_zone));
+
+    active = 1;
+    DEBUGMSG(debug_game, "PROF_start(): profiling %s\n", game);
+}
+
+
+/* Write out what was timed.  The frame under way is left out: */
+void PROF_stop(void)
+{
+    int i;
+
+    if (!active)
+        return;
+
+    write_profile();
+    for (i = 0; i < NUM_GROUPS; i++)
+    {
+        if (labels[i])
+            SDL_FreeSurface(labels[i]);
+        labels[i] = NULL;
+    }
+    active = 0;
+}
+
+
+/* End one frame and begin the next - called by FC_frame_begin(): */
+void PROF_frame(void)
+{
+    Uint32 now;
+
+    if (!active)
+        return;
+
+    if (open_zone >= 0)
+        PROF_end(open_zone);
+    now = FC_ticks_us();
+    if (newest >= 0)
+        finish_frame(now - frame_start);
+
+    newest = (newest + 1) % PROF_HISTORY;
+    memset(&history[newest], 0, sizeof(prof_frame));
+    frame_start = now;
+}
+
+
+/* A zone may be timed several times in a frame, the times adding up: */
+void PROF_begin(int zone)
+{
+    if (!active || newest < 0)
+        return;
+    if (open_zone >= 0)
+        PROF_end(open_zone);
+    open_zone = zone;
+    zone_start = FC_ticks_us();
+}
+
+
+void PROF_end(int zone)
+{
+    if (!active || zone != open_zone)
+        return;
+    history[newest].zone[zone] += FC_ticks_us() - zone_start;
+    open_zone = -1;
+}
+
+
+/* The zone being timed, or -1 if none (or not profiling): */
+int PROF_zone(void)
+{
+    if (!active)
+        return -1;
+    return open_zone;
+}
+
+
+/* With the "profiler" option at 2, draw the recent frames on the */
+/* screen, which is added to the dirty rectangles:                 */
+void PROF_draw_overlay(void)
+{
+    static SDL_Color white = {0xff, 0xff, 0xff, 0};
+    SDL_Surface* scr = RT_surface();
+    SDL_Rect box, r;
+    Uint32 color[NUM_GROUPS];
+    Uint32 us[NUM_GROUPS];
+    double avg[NUM_GROUPS];
+    prof_frame* f;
+    char str[16];
+    int i, k, n, g, x, y, h, row_h, tenths;
+
+    if (!active || Opts_Profiler() < 2 || !scr || newest < 0)
+        return;
+
+    box.x = 8;
+    box.w = PROF_HISTORY + LEGEND_W;
+    box.h = 2 * GRAPH_H;
+    box.y = (scr->h - box.h) / 2;
+    r = box;
+    SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 0, 0, 0));
+    dirty_rects_add(&box);
+
+    for (g = 0; g < NUM_GROUPS; g++)
+    {
+        color[g] = SDL_MapRGB(scr->format, group_rgb[g][0], group_rgb[g][1], group_rgb[g][2]);
+        avg[g] = 0;
+    }
+
+    /* One column for each frame done, the newest on the right: */
+    n = num_frames < PROF_HISTORY - 1 ? num_frames : PROF_HISTORY - 1;
+    for (k = 0; k < n; k++)
+    {
+        f = &history[(newest - n + k + PROF_HISTORY) % PROF_HISTORY];
+        memset(us, 0, sizeof(us));
+        for (i = 0; i <= PROF_NUM_ZONES; i++)
+            us[zone_group[i]] += f->zone[i];
+
+        x = box.x + PROF_HISTORY - n + k;
+        y = box.y + box.h;
+        for (g = 0; g < NUM_GROUPS; g++)
+        {
+            avg[g] += us[g] / 1000.0 / n;
+            h = us[g] * GRAPH_H / budget;
+            if (h > y - box.y)
+                h = y - box.y;
+            if (h <= 0)
+                continue;
+            r.x = x;
+            r.y = y - h;
+            r.w = 1;
+            r.h = h;
+            SDL_FillRect(scr, &r, color[g]);
+            y -= h;
+        }
+    }
+
+    /* A line across at the time one frame should take: */
+    r.x = box.x;
+    r.y = box.y + box.h - GRAPH_H;
+    r.w = PROF_HISTORY;
+    r.h = 1;
+    SDL_FillRect(scr, &r, SDL_MapRGB(scr->format, 255, 255, 255));
+
+    /* What each colour is, and its average in ms: */
+    row_h = box.h / NUM_GROUPS;
+    for (g = 0; g < NUM_GROUPS; g++)
+    {
+        x = box.x + PROF_HISTORY + 6;
+        y = box.y + g * row_h;
+        r.x = x;
+        r.y = y + (row_h - 8) / 2;
+        r.w = r.h = 8;
+        SDL_FillRect(scr, &r, color[g]);
+        x += 12;
+
+        if (!labels[g])
+            labels[g] = T4K_BlackOutline(group_names[g], LEGEND_FONT_SIZE, &white);
+        if (labels[g])
+        {
+            r.x = x;
+            r.y = y;
+            SDL_BlitSurface(labels[g], NULL, scr, &r);
+            x += 48;
+        }
+
+        tenths = (int)(avg[g] * 10 + 0.5);
+        snprintf(str, sizeof(str), "%d.%d", tenths / 10, tenths % 10);
+        draw_glyph_text(scr, str, LEGEND_FONT_SIZE, &white, x, y);
+    }
+}
+
+
+/* Add the newest frame to the totals, putting any time not in a zone */
+/* down to "other":                                                   */
+static void finish_frame(Uint32 total)
+{
+    prof_frame* f = &history[newest];
+    Uint32 timed = 0;
+    int i, worst;
+
+    for (i = 0; i < PROF_NUM_ZONES; i++)
+        timed += f->zone[i];
+    f->zone[PROF_OTHER] = total > timed ? total - timed : 0;
+    f->total = total;
+
+    num_frames++;
+    sum_total += total;
+    if (total > max_total)
+        max_total = total;
+    for (i = 0; i <= PROF_NUM_ZONES; i++)
+    {
+        sum_zone[i] += f->zone[i];
+        if (f->zone[i] > max_zone[i])
+            max_zone[i] = f->zone[i];
+    }
+
+    /* A slow frame is blamed on whatever took longest in it: */
+    if (total > budget / 100 * SLOW_PERCENT)
+    {
+        slow_frames++;
+        worst = PROF_OTHER;
+        for (i = 0; i < PROF_NUM_ZONES; i++)
+            if (i != PROF_IDLE && f->zone[i] > f->zone[worst])
+                worst = i;
+        slow_by_zone[worst]++;
+    }
+}
+
+
+static void write_profile(void)
+{
+    FILE* fp;
+    char path[PATH_MAX];
+    time_t now;
+    prof_frame* f;
+    float mean, stddev, longest, overshoot;
+    int i, k, n;
+
+    get_user_data_dir_with_subdir(path);
+    strcat(path, PROFILE_FILENAME);
+    fp = fopen(path, "a");
+    if (!fp)
+    {
+        fprintf(stderr, "PROF_stop(): couldn't open %s\n", path);
+        return;
+    }
+
+    now = time(NULL);
+    fprintf(fp, "\n%s frame profile, %s", game, ctime(&now));
+    if (num_frames == 0)
+    {
+        fprintf(fp, "No frames\n");
+        fclose(fp);
+        return;
+    }
+
+    fprintf(fp, "%u frames, %.2f ms on average (%.1f fps), longest %.2f ms\n",
+            num_frames, sum_total / num_frames / 1000,
+            1000000 * num_frames / sum_total, max_total / 1000.0);
+    fprintf(fp, "%u slow frames (over %.1f ms)\n",
+            slow_frames, budget / 100 * SLOW_PERCENT / 1000.0);
+    FC_frame_time_stats(&mean, &stddev, &longest, &overshoot);
+    fprintf(fp, "Frames %.2f ms apart, standard deviation %.2f ms (frame pacing %s,"
+            " sleeps overshooting by %.2f ms)\n\n",
+            mean, stddev, Opts_FramePacing() ? "on" : "off", overshoot);
+
+    fprintf(fp, "(each drawing part includes the blits it queued - \"sprites\" is the rest\n"
+            " of drawing the queue)\n");
+    fprintf(fp, "part\t\tavg ms\tmax ms\t%% time\tslowest in\n");
+    for (i = 0; i <= PROF_NUM_ZONES; i++)
+        fprintf(fp, "%-10s\t%.3f\t%.3f\t%.1f\t%u\n", zone_names[i],
+                sum_zone[i] / num_frames / 1000, max_zone[i] / 1000.0,
+                100 * sum_zone[i] / sum_total, slow_by_zone[i]);
+
+    /* The recent frames one by one, oldest first: */
+    n = num_frames < PROF_HISTORY - 1 ? num_frames : PROF_HISTORY - 1;
+    fprintf(fp, "\nLast %d frames, in ms:\ntotal", n);
+    for (i = 0; i <= PROF_NUM_ZONES; i++)
+        fprintf(fp, "\t%s", zone_names[i]);
+    fprintf(fp, "\n");
+    for (k = 0; k < n; k++)
+    {
+        f = &history[(newest - n + k + PROF_HISTORY) % PROF_HISTORY];
+        fprintf(fp, "%.3f", f->total / 1000.0);
+        for (i = 0; i <= PROF_NUM_ZONES; i++)
+            fprintf(fp, "\t%.3f", f->zone[i] / 1000.0);
+        fprintf(fp, "\n");
+    }
+
+    fclose(fp);
+    DEBUGMSG(debug_game, "PROF_stop(): profile written to %s\n", path);
+}
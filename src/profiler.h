@@ -0,0 +1,40 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* The parts of a game frame that are timed.  They mustn't overlap - */
+/* each is begun and ended before the next is begun:                 */
+enum {
+    PROF_INPUT,
+    PROF_NET,
+    PROF_LOGIC,
+    PROF_DRAW_BKGR,
+    PROF_DRAW_MISC,
+    PROF_DRAW_CITIES,
+    PROF_DRAW_SMARTBOMB,
+    PROF_DRAW_COMETS,
+    PROF_DRAW_POWERUP,
+    PROF_DRAW_SHIP,
+    PROF_DRAW_ASTEROIDS,
+    PROF_DRAW_SPRITES,      /* draw_list_flush(), less the blits, which */
+                            /* count in the zones that queued them      */
+    PROF_DRAW_LASERS,
+    PROF_DRAW_CONSOLE,      /* and the rest of the interface */
+    PROF_FLIP,
+    PROF_IDLE,              /* waiting in FC_frame_end() */
+    PROF_NUM_ZONES
+};
+
+#define PROF_HISTORY 240
+
+/* Timings of each part of the recent frames of a game, kept while the */
+/* "profiler" option is on and written to a file when the game ends.  */
+/* FC_frame_begin() starts each frame - see profiler.c:                */
+void PROF_start(const char* game_name);
+void PROF_stop(void);
+void PROF_frame(void);
+void PROF_begin(int zone);
+void PROF_end(int zone);
+int PROF_zone(void);
+void PROF_draw_overlay(void);
+
+#endif
@@ -0,0 +1,224 @@
+/*
+   quality.c:
+
+   A governor for the comets game's drawing.  Once a second or so it
+   looks at how long the frames took - the slowest tenth of them, and
+   how long they were busy before waiting for the next frame - and if
+   they are missing the frame rate it steps down to drawing fewer
+   snowflakes and then to drawing at half the display's size (see
+   render_target.c).  When there has been plenty of time to spare for
+   a while it steps back up, waiting longer each time it has had to
+   step down again straight after, and less again once it settles.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+quality.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "options.h"
+#include "frame_counter.h"
+#include "render_target.h"
+#include "quality.h"
+
+/* The frames are judged a second at a time, or over WINDOW_MIN_FRAMES */
+/* if that takes longer, after leaving out the first few:             */
+#define WINDOW_TIME 1000000
+#define WINDOW_MIN_FRAMES 10
+#define WINDOW_MAX_FRAMES 240
+#define WARMUP_FRAMES 30
+
+/* Step down if one frame in ten takes over MISS_PERCENT of the time  */
+/* there is for it, or the frame rate is that much below the limit.   */
+/* Step up when nine in ten are busy for under SPARE_PERCENT, for     */
+/* SPARE_WINDOWS running, and at least hold_length after stepping     */
+/* down.  hold_length doubles when a step up is undone within         */
+/* HOLD_WINDOWS, and halves again after hold_length without stepping  */
+/* down:                                                              */
+#define MISS_PERCENT 120
+#define SPARE_PERCENT 50
+#define SPARE_WINDOWS 3
+#define HOLD_WINDOWS 5
+#define MAX_HOLD_WINDOWS 60
+
+/* Only levels drawing at no more than RT_auto_scale() are used, so */
+/* that there is always at least 640x480 to draw on:                */
+static const struct {
+    int snowflake_step;     /* draw every nth snowflake */
+    int render_scale;       /* draw at 1/nth of the display's size, or smaller */
+    const char* what;
+} levels[] = {
+    {1, 1, "full quality"},
+    {2, 1, "half the snowflakes"},
+    {2, 2, "half the snowflakes, drawn at half size"},
+    {4, 2, "a quarter of the snowflakes, drawn at half size"}
+};
+#define NUM_LEVELS ((int)(sizeof(levels) / sizeof(levels[0])))
+
+static int level = 0;
+static Uint32 frame_us[WINDOW_MAX_FRAMES];
+static Uint32 busy_us[WINDOW_MAX_FRAMES];
+static Uint32 sorted[WINDOW_MAX_FRAMES];
+static int num_frames;
+static Uint32 window_us;
+static int warmup;
+static int spare_windows;
+static int hold_windows;
+static int hold_length;
+static int since_up;            /* windows since stepping up, -1 if not yet */
+static int steady_windows;      /* windows since stepping down */
+
+static void judge_window(void);
+static Uint32 percentile(const Uint32* times, int n, int pct);
+static int compare_times(const void* a, const void* b);
+
+
+/* Start a game at full quality: */
+void QG_init(void)
+{
+    level = 0;
+    num_frames = 0;
+    window_us = 0;
+    warmup = WARMUP_FRAMES;
+    spare_windows = 0;
+    hold_windows = 0;
+    hold_length = HOLD_WINDOWS;
+    since_up = -1;
+    steady_windows = 0;
+}
+
+
+/* Note the last frame (FC_time_elapsed still being the real time since */
+/* it began) and judge the frames so far if it's time to:               */
+void QG_frame(void)
+{
+    if (!Opts_AutoQuality())
+    {
+        level = 0;
+        return;
+    }
+    if (warmup > 0)
+    {
+        warmup--;
+        return;
+    }
+
+    frame_us[num_frames] = FC_time_elapsed * 1000000;
+    busy_us[num_frames] = FC_busy_time * 1000000;
+    window_us += frame_us[num_frames];
+    num_frames++;
+
+    if ((window_us >= WINDOW_TIME && num_frames >= WINDOW_MIN_FRAMES)
+            || num_frames == WINDOW_MAX_FRAMES)
+    {
+        judge_window();
+        num_frames = 0;
+        window_us = 0;
+    }
+}
+
+
+int QG_level(void)
+{
+    return level;
+}
+
+
+int QG_snowflake_step(void)
+{
+    return levels[level].snowflake_step;
+}
+
+
+int QG_render_scale(void)
+{
+    return levels[level].render_scale;
+}
+
+
+static void judge_window(void)
+{
+    int fps = Opts_FPSLimit() > 0 ? Opts_FPSLimit() : DEFAULT_FPS_LIMIT;
+    Uint32 budget = 1000000 / fps;
+    Uint32 slow_frame = percentile(frame_us, num_frames, 90);
+    Uint32 slow_busy = percentile(busy_us, num_frames, 90);
+    int missed, spare;
+
+    missed = slow_frame > budget / 100 * MISS_PERCENT
+        || (FC_frame_rate > 0 && FC_frame_rate * MISS_PERCENT < fps * 100);
+    spare = slow_busy < budget / 100 * SPARE_PERCENT;
+
+    if (hold_windows > 0)
+        hold_windows--;
+    if (since_up >= 0)
+        since_up++;
+    steady_windows++;
+
+    if (missed && level < NUM_LEVELS - 1
+            && levels[level + 1].render_scale <= RT_auto_scale())
+    {
+        if (since_up >= 0 && since_up <= HOLD_WINDOWS && hold_length < MAX_HOLD_WINDOWS)
+            hold_length *= 2;
+        level++;
+        since_up = -1;
+        steady_windows = 0;
+        hold_windows = hold_length;
+        spare_windows = 0;
+        DEBUGMSG(debug_game, "QG: slowest frames %.1f ms, busy %.1f ms, %d fps (budget %.1f ms)"
+                 " - down to level %d, %s\n", slow_frame / 1000.0, slow_busy / 1000.0,
+                 FC_frame_rate, budget / 1000.0, level, levels[level].what);
+        return;
+    }
+
+    if (steady_windows >= hold_length && hold_length > HOLD_WINDOWS)
+    {
+        hold_length /= 2;
+        steady_windows = 0;
+    }
+
+    spare_windows = spare ? spare_windows + 1 : 0;
+    if (spare_windows >= SPARE_WINDOWS && hold_windows == 0 && level > 0)
+    {
+        level--;
+        since_up = 0;
+        spare_windows = 0;
+        DEBUGMSG(debug_game, "QG: slowest frames %.1f ms, busy %.1f ms, %d fps (budget %.1f ms)"
+                 " - up to level %d, %s\n", slow_frame / 1000.0, slow_busy / 1000.0,
+                 FC_frame_rate, budget / 1000.0, level, levels[level].what);
+    }
+}
+
+
+/* The time "pct" percent of the way from the fastest to the slowest: */
+static Uint32 percentile(const Uint32* times, int n, int pct)
+{
+    memcpy(sorted, times, n * sizeof(Uint32));
+    qsort(sorted, n, sizeof(Uint32), compare_times);
+    return sorted[(n - 1) * pct / 100];
+}
+
+
+static int compare_times(const void* a, const void* b)
+{
+    Uint32 x = *(const Uint32*)a, y = *(const Uint32*)b;
+
+    return x < y ? -1 : x > y;
+}
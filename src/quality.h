@@ -0,0 +1,14 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+/* Turns down the costlier parts of the comets game's drawing when the */
+/* frames aren't keeping up, and back up again once there is time to  */
+/* spare - see quality.c.  QG_frame() is called once a frame, before  */
+/* FC_fixed_steps(), and the rest say how to draw:                    */
+void QG_init(void);
+void QG_frame(void);
+int QG_level(void);
+int QG_snowflake_step(void);
+int QG_render_scale(void);
+
+#endif
@@ -0,0 +1,422 @@
+/*
+   render_target.c:
+
+   Lets a game draw on a surface a half, a third or a quarter of the
+   display's size, which is scaled up to fill the display whenever a
+   frame is shown.  Only the parts drawn that frame are scaled up, and
+   a whole number of display pixels per pixel drawn keeps the usual
+   case to copying each pixel a few times and then the row it makes.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+render_target.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <t4k_common.h>
+
+#include "render_target.h"
+#include "tuxmath.h"
+
+/* The art is made for a 640x480 screen, so a scale of 0 ("auto")  */
+/* picks the largest that still leaves at least that much to draw: */
+#define AUTO_MIN_W 640
+#define AUTO_MIN_H 480
+#define MAX_SCALE 4
+
+/* Display rects waiting for SDL_UpdateRects(): */
+#define MAX_UPDATE_RECTS 64
+
+static SDL_Surface* target = NULL;
+static int target_scale = 1;
+static int target_smooth = 0;
+
+/* For smooth scaling - the column drawn on that each display column */
+/* is taken from, how far (out of 256) it is towards the next one,   */
+/* and a row blended from the two rows above and below a display row: */
+static int* col_src = NULL;
+static int* col_frac = NULL;
+static Uint32* blend_row = NULL;
+
+static int auto_scale(SDL_Surface* scr);
+static void free_target(void);
+static void upscale_rect(SDL_Surface* scr, SDL_Rect* r, SDL_Rect* out);
+static void upscale_nearest(SDL_Surface* scr, SDL_Rect* r, SDL_Rect* d);
+static void upscale_smooth(SDL_Surface* scr, SDL_Rect* d);
+static void src_pos(int pos, int* src, int* frac, int size);
+static Uint32 lerp(Uint32 a, Uint32 b, int frac);
+
+
+/* Start drawing at 1/scale of the display's width and height, or at */
+/* the largest scale that leaves at least 640x480 if scale is 0.      */
+/* smooth asks for bilinear rather than nearest-pixel scaling up.    */
+/* Called again (e.g. after the display changes size) it starts over: */
+SDL_Surface* RT_begin(int scale, int smooth)
+{
+    SDL_Surface* scr = T4K_GetScreen();
+    SDL_PixelFormat* fmt;
+    int w, h, i;
+
+    free_target();
+    if (!scr)
+        return NULL;
+
+    if (scale <= 0)
+        scale = auto_scale(scr);
+    if (scale > MAX_SCALE)
+        scale = MAX_SCALE;
+    /* Paletted displays would need the palette kept in step: */
+    if (scale <= 1 || scr->format->BytesPerPixel < 2)
+        return scr;
+
+    /* Round up, so that scaled up it covers the whole display - */
+    /* the last row and column are cut short if need be:         */
+    w = (scr->w + scale - 1) / scale;
+    h = (scr->h + scale - 1) / scale;
+    fmt = scr->format;
+    target = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, fmt->BitsPerPixel,
+                                  fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+    if (!target)
+    {
+        fprintf(stderr, "RT_begin(): could not create %dx%d surface: %s\n",
+                w, h, SDL_GetError());
+        return scr;
+    }
+    target_scale = scale;
+
+    /* Our smooth scaling is only done for 32-bit pixels: */
+    target_smooth = smooth && fmt->BytesPerPixel == 4;
+    if (target_smooth)
+    {
+        col_src = malloc(scr->w * sizeof(int));
+        col_frac = malloc(scr->w * sizeof(int));
+        blend_row = malloc(w * sizeof(Uint32));
+        if (!col_src || !col_frac || !blend_row)
+        {
+            fprintf(stderr, "RT_begin(): out of memory, scaling without smoothing\n");
+            target_smooth = 0;
+        }
+        else
+            for (i = 0; i < scr->w; i++)
+                src_pos(i, &col_src[i], &col_frac[i], w);
+    }
+
+    DEBUGMSG(debug_game, "RT_begin(): drawing at %dx%d, scaled up %d times%s to %dx%d\n",
+             w, h, scale, target_smooth ? " (smoothly)" : "", scr->w, scr->h);
+    return target;
+}
+
+
+/* Go back to drawing on the display: */
+void RT_end(void)
+{
+    free_target();
+}
+
+
+int RT_active(void)
+{
+    return target != NULL;
+}
+
+
+/* How many display pixels across each of ours covers (1 if we are */
+/* drawing on the display) - for mapping the mouse onto our surface: */
+int RT_scale(void)
+{
+    return target ? target_scale : 1;
+}
+
+
+/* What to draw on - ours if we have one, otherwise the display: */
+SDL_Surface* RT_surface(void)
+{
+    return target ? target : T4K_GetScreen();
+}
+
+
+/* The scale that "auto" picks for the display as it is now: */
+int RT_auto_scale(void)
+{
+    SDL_Surface* scr = T4K_GetScreen();
+
+    return scr ? auto_scale(scr) : 1;
+}
+
+
+/* Show the whole frame: */
+void RT_flip(void)
+{
+    SDL_Surface* scr = T4K_GetScreen();
+    SDL_Rect all, out;
+
+    if (target)
+    {
+        all.x = all.y = 0;
+        all.w = target->w;
+        all.h = target->h;
+        upscale_rect(scr, &all, &out);
+    }
+    SDL_Flip(scr);
+}
+
+
+/* Show the given parts of the frame (in our surface's pixels): */
+void RT_update_rects(int n, SDL_Rect* rects)
+{
+    SDL_Surface* scr = T4K_GetScreen();
+    SDL_Rect out[MAX_UPDATE_RECTS];
+    int i, num_out = 0;
+
+    if (!target)
+    {
+        SDL_UpdateRects(scr, n, rects);
+        return;
+    }
+    /* A page flipping display needs all of every frame: */
+    if (scr->flags & SDL_DOUBLEBUF)
+    {
+        RT_flip();
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        upscale_rect(scr, &rects[i], &out[num_out]);
+        if (out[num_out].w > 0 && out[num_out].h > 0)
+            num_out++;
+        if (num_out == MAX_UPDATE_RECTS)
+        {
+            SDL_UpdateRects(scr, num_out, out);
+            num_out = 0;
+        }
+    }
+    if (num_out > 0)
+        SDL_UpdateRects(scr, num_out, out);
+}
+
+
+static int auto_scale(SDL_Surface* scr)
+{
+    int scale = 1;
+
+    while (scale < MAX_SCALE
+            && scr->w / (scale + 1) >= AUTO_MIN_W
+            && scr->h / (scale + 1) >= AUTO_MIN_H)
+        scale++;
+    return scale;
+}
+
+
+static void free_target(void)
+{
+    if (target)
+    {
+        SDL_FreeSurface(target);
+        target = NULL;
+    }
+    free(col_src);
+    free(col_frac);
+    free(blend_row);
+    col_src = col_frac = NULL;
+    blend_row = NULL;
+    target_scale = 1;
+    target_smooth = 0;
+}
+
+
+/* Scale up rect r of our surface onto the display, and set out to */
+/* the part of the display that has changed:                       */
+static void upscale_rect(SDL_Surface* scr, SDL_Rect* r, SDL_Rect* out)
+{
+    int s = target_scale;
+    int x1 = r->x, y1 = r->y, x2 = r->x + r->w, y2 = r->y + r->h;
+
+    /* Smoothed display pixels are blended from the pixels around them, */
+    /* so those just outside r have changed as well:                     */
+    if (target_smooth)
+    {
+        x1--;
+        y1--;
+        x2++;
+        y2++;
+    }
+    if (x1 < 0)
+        x1 = 0;
+    if (y1 < 0)
+        y1 = 0;
+    if (x2 > target->w)
+        x2 = target->w;
+    if (y2 > target->h)
+        y2 = target->h;
+
+    out->w = out->h = 0;
+    if (x2 <= x1 || y2 <= y1)
+        return;
+    out->x = x1 * s;
+    out->y = y1 * s;
+    out->w = (x2 * s > scr->w ? scr->w : x2 * s) - out->x;
+    out->h = (y2 * s > scr->h ? scr->h : y2 * s) - out->y;
+
+    if (SDL_MUSTLOCK(scr) && SDL_LockSurface(scr) < 0)
+        return;
+    if (target_smooth)
+        upscale_smooth(scr, out);
+    else
+    {
+        SDL_Rect src;
+        src.x = x1;
+        src.y = y1;
+        src.w = x2 - x1;
+        src.h = y2 - y1;
+        upscale_nearest(scr, &src, out);
+    }
+    if (SDL_MUSTLOCK(scr))
+        SDL_UnlockSurface(scr);
+}
+
+
+/* Each pixel of r becomes a square of scale x scale on the display    */
+/* (clipped to d): the first display row of each is built a pixel at a */
+/* time, and the others copied from it:                                */
+static void upscale_nearest(SDL_Surface* scr, SDL_Rect* r, SDL_Rect* d)
+{
+    int s = target_scale;
+    int bpp = scr->format->BytesPerPixel;
+    int x, y, k, n, row, last_row = d->y + d->h;
+    Uint8* first;
+
+    for (y = r->y; y < r->y + r->h; y++)
+    {
+        Uint8* sp = (Uint8*)target->pixels + y * target->pitch + r->x * bpp;
+        first = (Uint8*)scr->pixels + y * s * scr->pitch + d->x * bpp;
+
+        /* n is how many display pixels are left in the row: */
+        n = d->w;
+        switch (bpp)
+        {
+            case 4:
+            {
+                Uint32* s32 = (Uint32*)sp;
+                Uint32* d32 = (Uint32*)first;
+                if (s == 2)
+                    for (x = 0; n >= 2; x++, n -= 2, d32 += 2)
+                        d32[0] = d32[1] = s32[x];
+                else
+                    for (x = 0; n >= s; x++, n -= s)
+                        for (k = 0; k < s; k++)
+                            *d32++ = s32[x];
+                /* The last column may be cut short by the display's edge: */
+                for (; n > 0; n--)
+                    *d32++ = s32[x];
+                break;
+            }
+            case 2:
+            {
+                Uint16* s16 = (Uint16*)sp;
+                Uint16* d16 = (Uint16*)first;
+                for (x = 0; n > 0; x++)
+                    for (k = 0; k < s && n > 0; k++, n--)
+                        *d16++ = s16[x];
+                break;
+            }
+            default:
+            {
+                Uint8* dp = first;
+                for (; n > 0; sp += bpp)
+                    for (k = 0; k < s && n > 0; k++, n--, dp += bpp)
+                        memcpy(dp, sp, bpp);
+                break;
+            }
+        }
+
+        for (row = y * s + 1; row < y * s + s && row < last_row; row++)
+            memcpy((Uint8*)scr->pixels + row * scr->pitch + d->x * bpp, first, d->w * bpp);
+    }
+}
+
+
+/* Bilinear scaling of the display rect d, each display pixel blended */
+/* from the four pixels around where its centre falls on our surface: */
+static void upscale_smooth(SDL_Surface* scr, SDL_Rect* d)
+{
+    int x, y, src_y, frac_y, c, first_col, last_col;
+    Uint32* dp;
+    const Uint32* above;
+    const Uint32* below;
+    const Uint32* row;
+
+    first_col = col_src[d->x];
+    last_col = col_src[d->x + d->w - 1] + 1;
+    if (last_col >= target->w)
+        last_col = target->w - 1;
+
+    for (y = d->y; y < d->y + d->h; y++)
+    {
+        src_pos(y, &src_y, &frac_y, target->h);
+        above = (const Uint32*)((Uint8*)target->pixels + src_y * target->pitch);
+
+        /* Blend the rows above and below first (unless it falls right */
+        /* on a row), so each display pixel needs only one more blend: */
+        if (frac_y == 0)
+            row = above;
+        else
+        {
+            below = (const Uint32*)((Uint8*)above + target->pitch);
+            for (c = first_col; c <= last_col; c++)
+                blend_row[c] = lerp(above[c], below[c], frac_y);
+            row = blend_row;
+        }
+
+        dp = (Uint32*)((Uint8*)scr->pixels + y * scr->pitch) + d->x;
+        for (x = d->x; x < d->x + d->w; x++)
+        {
+            c = col_src[x];
+            *dp++ = col_frac[x] ? lerp(row[c], row[c + 1], col_frac[x]) : row[c];
+        }
+    }
+}
+
+
+/* Where the centre of display pixel pos falls on our surface (which is */
+/* size pixels across) - pixel src, and frac/256 of the way to the next: */
+static void src_pos(int pos, int* src, int* frac, int size)
+{
+    int p = (2 * pos + 1) * 128 / target_scale - 128;
+
+    if (p < 0)
+        p = 0;
+    *src = p >> 8;
+    *frac = p & 255;
+    if (*src >= size - 1)
+    {
+        *src = size - 1;
+        *frac = 0;
+    }
+}
+
+
+/* Blend two 32-bit pixels, two channels at a time: */
+static Uint32 lerp(Uint32 a, Uint32 b, int frac)
+{
+    Uint32 rb = (a & 0xFF00FF) * (256 - frac) + (b & 0xFF00FF) * frac;
+    Uint32 ag = ((a >> 8) & 0xFF00FF) * (256 - frac) + ((b >> 8) & 0xFF00FF) * frac;
+
+    return ((rb >> 8) & 0xFF00FF) | (ag & 0xFF00FF00);
+}
@@ -0,0 +1,21 @@
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <SDL_video.h>
+
+/* Drawing a game at a fraction of the display's size, on a surface of */
+/* its own that is scaled up to the display as each frame is shown.   */
+/* RT_begin() returns the surface to draw on - the display itself if  */
+/* scale is 1 (or anything goes wrong) - and RT_flip() and           */
+/* RT_update_rects() stand in for SDL_Flip() and SDL_UpdateRects()    */
+/* whether or not there is one.  See render_target.c:                 */
+SDL_Surface* RT_begin(int scale, int smooth);
+void RT_end(void);
+int RT_active(void);
+int RT_scale(void);
+SDL_Surface* RT_surface(void);
+int RT_auto_scale(void);
+void RT_flip(void);
+void RT_update_rects(int n, SDL_Rect* rects);
+
+#endif
@@ -0,0 +1,422 @@
+/*
+   roto_cache.c:
+
+   Keeps rotated copies of the factoroids ship and asteroid images.
+   Rather than making every angle of every image up front, each is
+   made the first time it is drawn and kept in a cache of limited
+   size, the least recently used being freed to make room.  A
+   background thread can fill the cache with the likeliest angles
+   before they are needed, leaving them to be converted to the display
+   format on the main thread when they are first drawn.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+roto_cache.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "SDL_rotozoom.h"
+
+#include "globals.h"
+#include "roto_cache.h"
+
+typedef struct roto_entry {
+    SDL_Surface* surf;
+    int converted;      /* to the display format (see convert_entry()) */
+    int bytes;
+    int prev, next;     /* in the LRU list, most recently used first */
+    Uint32 frame;       /* when it was last drawn */
+} roto_entry;
+
+/* One entry for each angle of each source, src * num_steps + step: */
+static roto_entry* entries = NULL;
+static SDL_Surface* sources[MAX_ROTO_SOURCES];
+static int num_sources = 0;
+static int num_steps = 0;
+static int step_deg = 1;
+static double cache_zoom = 1.0;
+
+static int lru_head = -1;
+static int lru_tail = -1;
+static int cache_bytes = 0;
+static int max_cache_bytes = 0;
+static int peak_bytes = 0;
+static Uint32 frame = 1;
+
+/* For roto_cache_report(): */
+static Uint32 hits = 0;
+static Uint32 misses = 0;
+static Uint32 evictions = 0;
+static Uint32 prewarmed = 0;
+
+/* Everything above is shared with the prewarming thread, under cache_lock: */
+static SDL_mutex* cache_lock = NULL;
+static SDL_Thread* prewarm_thread = NULL;
+static int prewarm_order[MAX_ROTO_SOURCES];
+static int prewarm_num = 0;
+static volatile int prewarm_stop = 0;
+
+static void lock(void);
+static void unlock(void);
+static SDL_Surface* rotate(int i);
+static void add_entry(int i, SDL_Surface* s, int converted);
+static void convert_entry(int i);
+static void unlink_entry(int i);
+static void push_entry(int i);
+static void evict(void);
+static int prewarm_worker(void* unused);
+
+
+/* Returns 1 if successful.  Nothing is rotated until it is asked for: */
+int roto_cache_init(SDL_Surface** srcs, int num_srcs, double zoom,
+                    int deg_step, int max_bytes)
+{
+    int i;
+
+    roto_cache_cleanup();
+
+    if (num_srcs < 1 || num_srcs > MAX_ROTO_SOURCES)
+    {
+        fprintf(stderr, "roto_cache_init(): can't cache %d images\n", num_srcs);
+        return 0;
+    }
+    if (deg_step < 1)
+        deg_step = 1;
+    if (deg_step > 90)
+        deg_step = 90;
+
+    num_sources = num_srcs;
+    step_deg = deg_step;
+    num_steps = (360 + step_deg - 1) / step_deg;
+    cache_zoom = zoom;
+    max_cache_bytes = max_bytes;
+
+    entries = (roto_entry*)calloc(num_sources * num_steps, sizeof(roto_entry));
+    if (!entries)
+    {
+        fprintf(stderr, "roto_cache_init(): out of memory\n");
+        return 0;
+    }
+    for (i = 0; i < num_sources * num_steps; i++)
+        entries[i].prev = entries[i].next = -1;
+    for (i = 0; i < num_sources; i++)
+        sources[i] = srcs[i];
+
+    /* Without a lock there can't be a prewarming thread, but the */
+    /* cache still works:                                         */
+    cache_lock = SDL_CreateMutex();
+
+    DEBUGMSG(debug_factoroids, "roto_cache_init(): %d images, %d angles each, up to %d KB\n",
+             num_sources, num_steps, max_cache_bytes / 1024);
+    return 1;
+}
+
+
+/* Start rotating the given sources, in that order, on another thread */
+/* until the cache is full:                                           */
+void roto_cache_prewarm(const int* order, int num)
+{
+    int i;
+
+    if (!entries || !cache_lock || prewarm_thread)
+        return;
+
+    prewarm_num = 0;
+    for (i = 0; i < num && i < MAX_ROTO_SOURCES; i++)
+        if (order[i] >= 0 && order[i] < num_sources)
+            prewarm_order[prewarm_num++] = order[i];
+
+    prewarm_stop = 0;
+    prewarm_thread = SDL_CreateThread(prewarm_worker, NULL);
+    if (!prewarm_thread)
+        DEBUGMSG(debug_factoroids, "roto_cache_prewarm(): couldn't start thread\n");
+}
+
+
+/* Source "src" rotated "angle" degrees (anticlockwise), to the nearest */
+/* step below.  It stays valid until roto_cache_next_frame():           */
+SDL_Surface* roto_cache_get(int src, int angle)
+{
+    SDL_Surface* s;
+    int i;
+
+    if (!entries || src < 0 || src >= num_sources)
+        return NULL;
+
+    angle %= 360;
+    if (angle < 0)
+        angle += 360;
+    i = src * num_steps + angle / step_deg;
+
+    lock();
+    if (entries[i].surf)
+    {
+        hits++;
+        if (!entries[i].converted)
+            convert_entry(i);
+        unlink_entry(i);
+        push_entry(i);
+        entries[i].frame = frame;
+        s = entries[i].surf;
+        unlock();
+        return s;
+    }
+    misses++;
+    unlock();
+
+    /* (rotating takes a while, so don't hold up the prewarming meanwhile) */
+    s = rotate(i);
+    if (!s)
+    {
+        fprintf(stderr, "roto_cache_get(): couldn't rotate image %d by %d: %s\n",
+                src, angle, SDL_GetError());
+        return NULL;
+    }
+
+    lock();
+    if (entries[i].surf)
+        SDL_FreeSurface(s);
+    else
+        add_entry(i, s, 0);
+    if (!entries[i].converted)
+        convert_entry(i);
+    entries[i].frame = frame;
+    evict();
+    s = entries[i].surf;
+    unlock();
+    return s;
+}
+
+
+/* Images drawn before this may now be freed - they aren't while the */
+/* frame is being drawn, even if the cache is over its limit:        */
+void roto_cache_next_frame(void)
+{
+    lock();
+    frame++;
+    unlock();
+}
+
+
+void roto_cache_report(void)
+{
+    int i, cached = 0;
+
+    if (!entries)
+        return;
+
+    DEBUGCODE(debug_factoroids)
+    {
+        lock();
+        for (i = 0; i < num_sources * num_steps; i++)
+            if (entries[i].surf)
+                cached++;
+        fprintf(stderr, "\nRotation cache (%d degree steps):\n", step_deg);
+        fprintf(stderr, "  %d of %d images, %d KB (peak %d KB, limit %d KB)\n",
+                cached, num_sources * num_steps, cache_bytes / 1024,
+                peak_bytes / 1024, max_cache_bytes / 1024);
+        fprintf(stderr, "  %u hits, %u misses (%.1f%% hit rate), %u evicted, %u prewarmed\n\n",
+                hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+                evictions, prewarmed);
+        unlock();
+    }
+}
+
+
+void roto_cache_cleanup(void)
+{
+    int i;
+
+    if (prewarm_thread)
+    {
+        prewarm_stop = 1;
+        SDL_WaitThread(prewarm_thread, NULL);
+        prewarm_thread = NULL;
+    }
+
+    if (entries)
+    {
+        roto_cache_report();
+        for (i = 0; i < num_sources * num_steps; i++)
+            if (entries[i].surf)
+                SDL_FreeSurface(entries[i].surf);
+        free(entries);
+        entries = NULL;
+    }
+
+    if (cache_lock)
+        SDL_DestroyMutex(cache_lock);
+    cache_lock = NULL;
+
+    num_sources = num_steps = 0;
+    lru_head = lru_tail = -1;
+    cache_bytes = peak_bytes = 0;
+    hits = misses = evictions = prewarmed = 0;
+}
+
+
+static void lock(void)
+{
+    if (cache_lock)
+        SDL_mutexP(cache_lock);
+}
+
+
+static void unlock(void)
+{
+    if (cache_lock)
+        SDL_mutexV(cache_lock);
+}
+
+
+/* Rotate and zoom the image for entry i - only pixel work, so the */
+/* prewarming thread can do it too:                                */
+static SDL_Surface* rotate(int i)
+{
+    return rotozoomSurface(sources[i / num_steps], (i % num_steps) * step_deg,
+                           cache_zoom, 1);
+}
+
+
+/* These are all called with cache_lock held: */
+static void add_entry(int i, SDL_Surface* s, int converted)
+{
+    entries[i].surf = s;
+    entries[i].converted = converted;
+    entries[i].bytes = s->pitch * s->h + sizeof(SDL_Surface);
+    cache_bytes += entries[i].bytes;
+    if (cache_bytes > peak_bytes)
+        peak_bytes = cache_bytes;
+    push_entry(i);
+}
+
+
+/* Convert entry i to the display format, so it needn't be converted  */
+/* every time it is drawn.  SDL's video code isn't thread safe, so   */
+/* this is only done on the main thread, from roto_cache_get():       */
+static void convert_entry(int i)
+{
+    SDL_Surface* converted = SDL_DisplayFormatAlpha(entries[i].surf);
+
+    /* (if that fails, the rotated image is drawn as it is) */
+    entries[i].converted = 1;
+    if (!converted)
+        return;
+    SDL_FreeSurface(entries[i].surf);
+    cache_bytes -= entries[i].bytes;
+    entries[i].surf = converted;
+    entries[i].bytes = converted->pitch * converted->h + sizeof(SDL_Surface);
+    cache_bytes += entries[i].bytes;
+    if (cache_bytes > peak_bytes)
+        peak_bytes = cache_bytes;
+}
+
+
+static void unlink_entry(int i)
+{
+    if (entries[i].prev >= 0)
+        entries[entries[i].prev].next = entries[i].next;
+    else
+        lru_head = entries[i].next;
+    if (entries[i].next >= 0)
+        entries[entries[i].next].prev = entries[i].prev;
+    else
+        lru_tail = entries[i].prev;
+    entries[i].prev = entries[i].next = -1;
+}
+
+
+static void push_entry(int i)
+{
+    entries[i].prev = -1;
+    entries[i].next = lru_head;
+    if (lru_head >= 0)
+        entries[lru_head].prev = i;
+    lru_head = i;
+    if (lru_tail < 0)
+        lru_tail = i;
+}
+
+
+/* Free the least recently used images until the cache is back within */
+/* its limit, stopping at any drawn this frame:                       */
+static void evict(void)
+{
+    int i;
+
+    while (cache_bytes > max_cache_bytes && lru_tail >= 0
+            && entries[lru_tail].frame != frame)
+    {
+        i = lru_tail;
+        unlink_entry(i);
+        SDL_FreeSurface(entries[i].surf);
+        entries[i].surf = NULL;
+        entries[i].converted = 0;
+        cache_bytes -= entries[i].bytes;
+        entries[i].bytes = 0;
+        evictions++;
+    }
+}
+
+
+/* Fill the cache, but never push anything out of it: */
+static int prewarm_worker(void* unused)
+{
+    SDL_Surface* s;
+    int n, step, i;
+
+    for (n = 0; n < prewarm_num; n++)
+    {
+        for (step = 0; step < num_steps; step++)
+        {
+            if (prewarm_stop)
+                return 0;
+
+            i = prewarm_order[n] * num_steps + step;
+            lock();
+            if (cache_bytes >= max_cache_bytes)
+            {
+                unlock();
+                DEBUGMSG(debug_factoroids, "prewarm_worker(): cache full\n");
+                return 0;
+            }
+            s = entries[i].surf;
+            unlock();
+            if (s)
+                continue;
+
+            s = rotate(i);
+            if (!s)
+                continue;
+
+            lock();
+            if (entries[i].surf)
+                SDL_FreeSurface(s);
+            else
+            {
+                add_entry(i, s, 0);
+                prewarmed++;
+            }
+            unlock();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef ROTO_CACHE_H
+#define ROTO_CACHE_H
+
+#include <SDL_video.h>
+
+#define MAX_ROTO_SOURCES 8
+
+/* A cache of rotated and zoomed copies of a few images, made when     */
+/* first drawn at each angle (rounded to "deg_step" degrees) and freed */
+/* least recently used first once they take more than "max_bytes" -   */
+/* see roto_cache.c.  The sources must outlive the cache:              */
+int roto_cache_init(SDL_Surface** srcs, int num_srcs, double zoom,
+                    int deg_step, int max_bytes);
+void roto_cache_prewarm(const int* order, int num);
+SDL_Surface* roto_cache_get(int src, int angle);
+void roto_cache_next_frame(void);
+void roto_cache_report(void);
+void roto_cache_cleanup(void);
+
+#endif
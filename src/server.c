@@ -44,6 +44,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "server.h" 
 #include "transtruct.h"
 #include "mathcards.h"
+#include "fileops.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +53,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <fcntl.h> 
 #include <sys/types.h>  
 #include <unistd.h>
+#ifdef WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#include <sys/time.h>
+#endif
 
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
@@ -59,6 +66,49 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define MAX_ARGS 16
 #define SRV_QUEST_INTERVAL 2000
+/* How many question intervals ahead of its spawn time a question is sent. */
+/* Clients hold prefetched questions and launch the comets themselves when */
+/* the scheduled time arrives, so no round trip is needed at spawn time:   */
+#define SRV_PREFETCH_WINDOW 3
+/* A player whose connection drops mid-game keeps their slot, name and  */
+/* score this long, so they can reconnect and carry on:                */
+#define SRV_RESUME_TIMEOUT 60000
+/* Connections made during a game get this long to ask to resume:      */
+#define SRV_HANDSHAKE_TIMEOUT 2000
+#define SRV_MAX_HANDSHAKES 4   //NOTE at most 7, see LANLOG_SPECTATOR_BASE
+
+/* Read-only spectators (e.g. a teacher's station watching the class).   */
+/* Their events are queued and sent only after all player traffic in    */
+/* each server loop, at most one message per SRV_SPECTATOR_INTERVAL     */
+/* msec per spectator, and only when the send can't block.  One that    */
+/* falls SRV_OUTQ_LEN messages behind is dropped.  NOTE the queue must  */
+/* hold the state of play sent when a spectator joins (see spectate()): */
+#define SRV_MAX_SPECTATORS 4   //NOTE at most 8, see LANLOG_MAX_CONNS
+#define SRV_OUTQ_LEN 160
+#define SRV_SPECTATOR_INTERVAL 20
+
+/* Lessons are parsed once and kept, so switching back to one is instant: */
+#define SRV_LESSON_CACHE_SIZE 16
+
+/* A question that has been sent out and not yet answered or missed: */
+typedef struct srv_quest_type {
+    int in_use;
+    Uint32 spawn_time;
+    MC_FlashCard fc;
+}srv_quest_type;
+
+/* Bounded queue of messages waiting to go out on a socket: */
+typedef struct srv_outq_type {
+    char msg[SRV_OUTQ_LEN][NET_BUF_LEN];
+    int head;                 //Index of oldest message
+    int count;
+}srv_outq_type;
+
+typedef struct srv_spectator_type {
+    TCPsocket sock;
+    Uint32 last_send;
+    srv_outq_type outq;
+}srv_spectator_type;
 
 typedef struct srv_game_type {
     char lesson_name[NAME_SIZE];
@@ -67,11 +117,23 @@ typedef struct srv_game_type {
     int max_quests_on_screen;
     int quests_in_wave;
     int rem_in_wave;          //Number still to be issued in wave
+    Uint32 next_spawn_time;   //Scheduled spawn time of next question
+    srv_quest_type active_list[MAX_MAX_COMETS]; //For game snapshots
 }srv_game_type;
 
 
 
 
+/* A lesson file already parsed into math and game options: */
+typedef struct srv_lesson_type {
+    char filename[PATH_MAX];
+    MC_Options opts;
+    game_option_type game_opts;
+    Uint32 last_used;
+}srv_lesson_type;
+
+
+
 /*  -----------  Local function prototypes:   ------------  */
 
 // setup and cleanup:
@@ -86,16 +148,40 @@ void update_clients(int thread_id_no);
 int server_check_messages(int thread_id_no);
 void server_update_game(int thread_id_no);
 void server_check_stdin(int thread_id_no);
+void server_check_lesson(int thread_id_no);
 // client management utilities:
 int find_vacant_client(int thread_id_no);
 void remove_client(int thread_id_no, int i);
+void drop_client(int thread_id_no, int i);
+void suspend_client(int thread_id_no, int i);
+void announce_suspended_clients(int thread_id_no);
+void expire_suspended_clients(int thread_id_no);
+void clear_suspended_clients(int thread_id_no);
 void check_game_clients(int thread_id_no);
+// mid-game reconnection:
+void add_handshake(int thread_id_no, TCPsocket sock);
+void check_handshakes(int thread_id_no);
+int resume_session(int thread_id_no, TCPsocket sock, char* buf, int log_index);
+Uint32 new_session_token(void);
+// spectators:
+int spectate(int thread_id_no, TCPsocket sock, char* buf, int log_index);
+void msg_spectate(int thread_id_no, int i, char* buf);
+void remove_spectator(int thread_id_no, int j);
+void spectator_event(int thread_id_no, char* msg);
+void spectator_player_event(int thread_id_no, int i);
+void spectator_wave_event(int thread_id_no);
+void flush_spectators(int thread_id_no);
+void outq_reset(srv_outq_type* q);
+int outq_push(srv_outq_type* q, const char* msg);
+int outq_send(TCPsocket sock, srv_outq_type* q);
+int socket_writable(TCPsocket sock);
 
 // message reception:
 int handle_client_game_msg(int thread_id_no, int i, char* buffer);
 void handle_client_nongame_msg(int thread_id_no, int i, char* buffer);
 int msg_set_name(int thread_id_no, int i, char* buf);
 void msg_socket_index(int thread_id_no, int i, char* buf);
+void msg_session_token(int thread_id_no, int i);
 void start_game(int thread_id_no);
 void end_game(int thread_id_no);
 void game_msg_correct_answer(int thread_id_no, int i, char* inbuf);
@@ -106,9 +192,14 @@ int calc_score(int difficulty, float t);
 
 //message sending:
 int add_question(int thread_id_no, MC_FlashCard* fc);
+int prefetch_question(int thread_id_no, MC_FlashCard* fc, Uint32 delay);
 int remove_question(int thread_id_no, int quest_id, int answered_by);
 int send_counter_updates(int thread_id_no);
 int send_player_updates(int thread_id_no);
+int send_game_snapshot(int thread_id_no, int i);
+void track_question(int thread_id_no, MC_FlashCard* fc, Uint32 spawn_time);
+void untrack_question(int thread_id_no, int quest_id);
+void reset_tracked_questions(int thread_id_no);
 //int SendQuestion(MC_FlashCard flash, TCPsocket client_sock);
 int SendMessage(int message, int ques_id, char* name, TCPsocket client_sock);
 int player_msg(int thread_id_no, int i, char* msg);
@@ -119,10 +210,22 @@ int transmit_all(int thread_id_no, char* msg);
 // For non-blocking input:
 int read_stdin_nonblock(char* buf, size_t max_length);
 
+// recording of LAN traffic:
+int record_open(const char* filename);
+void record_msg(int type, int i, const char* msg);
+void record_move(int from, int to);
+void record_close(void);
+
+// lesson cache:
+int find_cached_lesson(const char* lesson_name);
+int cache_lesson(const char* lesson_name);
+void lock_lessons(void);
+void unlock_lessons(void);
+
 
 // not really deprecated but not done in response to 
 // client message --needs better name:
-void game_msg_next_question(int thread_id_no);
+void game_msg_next_question(int thread_id_no, Uint32 delay);
 
 /* global mathgame struct for lan game: */
 extern MC_MathGame* lan_game_settings;  //TODO Deepak:- see its effect and change it accordingly
@@ -135,6 +238,22 @@ static int server_running = 0;
 static int quit = 0;
 static int ignore_stdin = 0;    //TODO not needed as all work is done in threads
 
+/* Log of all client traffic for tuxmathreplay, if --record given: */
+static FILE* record_fp = NULL;
+static Uint32 record_start = 0;
+
+/* Lessons loaded with SrvrLoadLesson(), and the one to use next game: */
+static srv_lesson_type lesson_cache[SRV_LESSON_CACHE_SIZE];
+static int num_cached_lessons = 0;
+static int pending_lesson = -1;
+/* The game options the server plays by - its own copy, so the global */
+/* ones can change (e.g. while a lesson is read) without affecting it: */
+static game_option_type srv_opts;
+#ifdef HAVE_PTHREAD_H
+/* SrvrLoadLesson() may be called from the tuxmath GUI thread: */
+static pthread_mutex_t lesson_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /* used for keeping record of every instance of a thread running within a server */
 struct threadID   
 {
@@ -145,6 +264,13 @@ struct threadID
     struct client_type client[MAX_CLIENTS];  //TODO Deepak removed static from it as they can't be declared inside it. might result problem in future 
     int num_clients;
     struct srv_game_type srv_game;
+    /* Connections made during a game, waiting to see if they resume: */
+    SDLNet_SocketSet handshake_set;
+    TCPsocket handshake_sock[SRV_MAX_HANDSHAKES];
+    Uint32 handshake_time[SRV_MAX_HANDSHAKES];
+    /* Read-only connections that get a stream of game events: */
+    SDLNet_SocketSet spectator_set;
+    srv_spectator_type spectator[SRV_MAX_SPECTATORS];
 };
 struct threadID slave_thread[2]; //TODO it might have to be replaced with a pointer pointing to head of the stack when integrating thread in it.
 
@@ -173,6 +299,8 @@ int RunServer(int argc, char* argv[])
 
     fprintf(stderr, "Started tuxmathserver, waiting for client to connect:\n>\n");
 
+    /* Until a lesson is loaded we go by the options already read: */
+    Opts_CopyGameOptions(&srv_opts);
     server_handle_command_args(argc, argv);
 
     /*     ---------------- Setup: ---------------------------   */
@@ -209,8 +337,14 @@ int RunServer(int argc, char* argv[])
         server_check_messages(0);  //FIXME Deepak its hard coded.
         /* Handle any game updates not driven by received messages:  */
         server_update_game(0);     //FIXME Deepak its hard coded
+        /* Tell the others about any players who lost their connection: */
+        announce_suspended_clients(0);
         /* Check for command line input, if appropriate: */
         server_check_stdin(0);   // FIXME Deepak its hard coded
+        /* Switch to a newly loaded lesson if not in a game: */
+        server_check_lesson(0);
+        /* Lowest priority - feed any spectators once players are served: */
+        flush_spectators(0);
         /* Limit frame rate to keep from eating all CPU: */
         /* NOTE almost certainly could make this longer wtihout noticably */
         /* affecting performance, but even throttling to 1 msec/loop cuts */
@@ -370,6 +504,41 @@ int SrvrGameInProgress(void)
     return game_in_progress;
 }
 
+
+/* Load a lesson for the server to use, without restarting it.  The   */
+/* lesson is parsed once and cached, so loading it again costs nothing */
+/* more than a copy.  If a game is in progress, the new lesson takes   */
+/* effect when the next game starts.  Returns 1 on success, 0 if the   */
+/* lesson file could not be read.                                      */
+int SrvrLoadLesson(const char* lesson_name)
+{
+    int i;
+
+    if(!lesson_name || lesson_name[0] == '\0')
+        return 0;
+
+    lock_lessons();
+    i = find_cached_lesson(lesson_name);
+    if(i < 0)
+        i = cache_lesson(lesson_name);
+    if(i >= 0)
+    {
+        lesson_cache[i].last_used = SDL_GetTicks();
+        pending_lesson = i;
+    }
+    unlock_lessons();
+
+    if(i < 0)
+    {
+        fprintf(stderr, "SrvrLoadLesson() - could not read lesson: %s\n", lesson_name);
+        return 0;
+    }
+
+    DEBUGMSG(debug_lan, "SrvrLoadLesson() - lesson %s (%s) will be used for next game\n",
+            lesson_name, lesson_cache[i].game_opts.lesson_title);
+    return 1;
+}
+
 /* FIXME make these more civilized - notify players, clean up game
  * properly, and so forth.
  */
@@ -434,6 +603,33 @@ int setup_server(int thread_id_no)
         return 0;
     }
 
+    slave_thread[thread_id_no].handshake_set = SDLNet_AllocSocketSet(SRV_MAX_HANDSHAKES);
+    if(!(slave_thread[thread_id_no].handshake_set) )
+    { 
+        fprintf(stderr, "SDLNet_AllocSocketSet: %s\n", SDLNet_GetError());
+        return 0;
+    }
+    {
+        int i;
+        for(i = 0; i < SRV_MAX_HANDSHAKES; i++)
+            slave_thread[thread_id_no].handshake_sock[i] = NULL;
+    }
+
+    slave_thread[thread_id_no].spectator_set = SDLNet_AllocSocketSet(SRV_MAX_SPECTATORS);
+    if(!(slave_thread[thread_id_no].spectator_set) )
+    { 
+        fprintf(stderr, "SDLNet_AllocSocketSet: %s\n", SDLNet_GetError());
+        return 0;
+    }
+    {
+        int i;
+        for(i = 0; i < SRV_MAX_SPECTATORS; i++)
+        {
+            slave_thread[thread_id_no].spectator[i].sock = NULL;
+            outq_reset(&slave_thread[thread_id_no].spectator[i].outq);
+        }
+    }
+
     //this sets up our mathcards "library" with hard-coded defaults - no
     //settings read from config file here as of yet:
     if (!MC_Initialize(lan_game_settings))
@@ -494,6 +690,8 @@ int setup_server(int thread_id_no)
             strncpy(slave_thread[thread_id_no].client[i].name, _("Await player name"), NAME_SIZE);   /* no nicknames yet                  */
             slave_thread[thread_id_no].client[i].sock = NULL;      /* sockets start out unconnected     */
             slave_thread[thread_id_no].client[i].score = 0;
+            slave_thread[thread_id_no].client[i].session_token = 0;
+            slave_thread[thread_id_no].client[i].suspended = 0;
         }
     }
 
@@ -533,6 +731,36 @@ void cleanup_server(int thread_id_no)
         slave_thread[thread_id_no].client_set = NULL;                   //this helps us remember that this set is not allocated
     } 
 
+    for(i = 0; i < SRV_MAX_HANDSHAKES; i++)
+    {
+        if(slave_thread[thread_id_no].handshake_sock[i] != NULL)
+        {
+            SDLNet_TCP_Close(slave_thread[thread_id_no].handshake_sock[i]);
+            slave_thread[thread_id_no].handshake_sock[i] = NULL;
+        }
+    }
+
+    if (slave_thread[thread_id_no].handshake_set != NULL)
+    {
+        SDLNet_FreeSocketSet(slave_thread[thread_id_no].handshake_set);
+        slave_thread[thread_id_no].handshake_set = NULL;
+    } 
+
+    for(i = 0; i < SRV_MAX_SPECTATORS; i++)
+    {
+        if(slave_thread[thread_id_no].spectator[i].sock != NULL)
+        {
+            SDLNet_TCP_Close(slave_thread[thread_id_no].spectator[i].sock);
+            slave_thread[thread_id_no].spectator[i].sock = NULL;
+        }
+    }
+
+    if (slave_thread[thread_id_no].spectator_set != NULL)
+    {
+        SDLNet_FreeSocketSet(slave_thread[thread_id_no].spectator_set);
+        slave_thread[thread_id_no].spectator_set = NULL;
+    } 
+
     if(slave_thread[thread_id_no].server_sock != NULL)
     {
         SDLNet_TCP_Close(slave_thread[thread_id_no].server_sock);
@@ -544,6 +772,8 @@ void cleanup_server(int thread_id_no)
         SDLNet_UDP_Close(slave_thread[thread_id_no].udpsock);
         slave_thread[thread_id_no].udpsock = NULL;
     }
+
+    record_close();
 }
 
 
@@ -601,6 +831,16 @@ void server_handle_command_args(int argc, char* argv[])
             strncpy(server_name, argv[i + 1], NAME_SIZE);
             need_server_name = 0;
         }
+        else if ((strcmp(argv[i], "--lesson") == 0 || strcmp(argv[i], "-l") == 0)
+                && (i + 1 < argc))
+        {
+            SrvrLoadLesson(argv[i + 1]);
+        }
+        else if ((strcmp(argv[i], "--record") == 0 || strcmp(argv[i], "-r") == 0)
+                && (i + 1 < argc))
+        {
+            record_open(argv[i + 1]);
+        }
     }
 }
 
@@ -640,7 +880,7 @@ void check_UDP(int thread_id_no)
             // between multiple servers on same network (e.g. "Mrs. Adams' Class");
             out = SDLNet_AllocPacket(NET_BUF_LEN); 
             snprintf(buf, NET_BUF_LEN, "%s\t%s\t%s",
-                    "TUXMATH_SERVER", server_name, Opts_LessonTitle());
+                    "TUXMATH_SERVER", server_name, srv_opts.lesson_title);
             snprintf(out->data, NET_BUF_LEN, "%s", buf);
             out->len = strlen(buf) + 1;
             out->address.host = in->address.host;
@@ -666,6 +906,9 @@ void update_clients(int thread_id_no)
     int sockets_used = 0;
     char buffer[NET_BUF_LEN];
 
+    /* Deal with anyone who connected during a game and may be resuming: */
+    check_handshakes(thread_id_no);
+
     /* See if we have a pending connection: */
     temp_sock = SDLNet_TCP_Accept(slave_thread[thread_id_no].server_sock);
     if (!temp_sock)  /* No one waiting to join - do nothing */
@@ -673,6 +916,19 @@ void update_clients(int thread_id_no)
         return;   // Leave num_clients unchanged
     }
 
+    //If everyone is disconnected, game no longer in progress:
+    check_game_clients(thread_id_no); 
+
+    // If game already started, the connection may be a dropped player
+    // coming back, so give it a chance to say so before sending regrets.
+    // NOTE this comes before the vacancy check since a resuming player
+    // reclaims their own (held) slot:
+    if(game_in_progress)
+    {
+        add_handshake(thread_id_no, temp_sock);
+        return;   // Leave num_clients unchanged
+    }
+
     // See if any slots are available:
     slot = find_vacant_client(thread_id_no);
     if (slot == -1) /* No vacancies: */
@@ -691,25 +947,6 @@ void update_clients(int thread_id_no)
         return;   // Leave num_clients unchanged
     }
 
-    //If everyone is disconnected, game no longer in progress:
-    check_game_clients(thread_id_no); 
-
-    // If game already started, send our regrets:
-    if(game_in_progress)
-    {
-        snprintf(buffer, NET_BUF_LEN, 
-                "%s",
-                "GAME_IN_PROGRESS");
-        SDLNet_TCP_Send(temp_sock, buffer, NET_BUF_LEN);
-        //hang up:
-        SDLNet_TCP_Close(temp_sock);
-        temp_sock = NULL;
-
-        DEBUGMSG(debug_lan, "update_clients() - game already started\n");
-
-        return;   // Leave num_clients unchanged
-    }
-
     // If we get to here, we have room for the new connection and the
     // game is not in progress, so we connect:
     DEBUGMSG(debug_lan, "creating connection for client[%d].sock:\n", slot);
@@ -727,12 +964,17 @@ void update_clients(int thread_id_no)
 
     /* At this point num_clients can be updated: */
     slave_thread[thread_id_no].num_clients = sockets_used;
+    record_msg(LANLOG_CONNECT, slot, "");
 
     /* Now we can communicate with the client using slave_thread[thread_id_no].client[i].sock socket */
     /* serv_sock will remain opened waiting other connections.            */
 
     /* Send message informing client of successful connection:            */
     msg_socket_index(thread_id_no, slot, buffer);
+    /* and the token it can use to get its slot back if it drops: */
+    slave_thread[thread_id_no].client[slot].session_token = new_session_token();
+    slave_thread[thread_id_no].client[slot].suspended = 0;
+    msg_session_token(thread_id_no, slot);
     /* Now tell rest of clients that another has joined: */
     send_player_updates(thread_id_no);
     /* Get the remote address */
@@ -801,6 +1043,7 @@ int server_check_messages(int thread_id_no)
                 if (SDLNet_TCP_Recv(slave_thread[thread_id_no].client[i].sock, buffer, NET_BUF_LEN) > 0)
                 {
                     DEBUGMSG(debug_lan, "buffer received from client %d is: %s\n", i, buffer);
+                    record_msg(LANLOG_RECV, i, buffer);
 
                     /* Here we pass the client number and the message buffer */
                     /* to a suitable function for further action:                */
@@ -818,7 +1061,7 @@ int server_check_messages(int thread_id_no)
                 else  // Socket activity but cannot receive - client invalid
                 {
                     fprintf(stderr, "Client %d active but receive failed - apparently disconnected\n>\n", i);
-                    remove_client(thread_id_no,i);
+                    drop_client(thread_id_no,i);
                 }
             }
         }  // end of for() loop - all client sockets checked
@@ -858,6 +1101,11 @@ void server_check_stdin(int thread_id_no)
         {
             end_game(thread_id_no);
         }
+        else if (strncmp(buffer, "lesson ", 7) == 0) // load lesson for next game
+        {
+            if(SrvrLoadLesson(buffer + 7))
+                fprintf(stderr, "Lesson loaded: %s\n", buffer + 7);
+        }
         else
         {
             fprintf(stderr, "Command not recognized.\n");
@@ -866,13 +1114,610 @@ void server_check_stdin(int thread_id_no)
 }
 
 
+// Between games, switch to the lesson most recently given to
+// SrvrLoadLesson().  This is done here in the server's own loop so
+// lan_game_settings and srv_opts are never changed underneath a
+// running game, nor by another thread:
+void server_check_lesson(int thread_id_no)
+{
+    if(game_in_progress || pending_lesson < 0)
+        return;
+
+    lock_lessons();
+    if(pending_lesson >= 0)
+    {
+        srv_lesson_type* l = &lesson_cache[pending_lesson];
+
+        if(MC_Initialize(lan_game_settings))
+        {
+            *(lan_game_settings->math_opts) = l->opts;
+            srv_opts = l->game_opts;
+            strncpy(slave_thread[thread_id_no].srv_game.lesson_name, srv_opts.lesson_title, NAME_SIZE);
+            slave_thread[thread_id_no].srv_game.lesson_name[NAME_SIZE - 1] = '\0';
+            fprintf(stderr, "Now using lesson: %s\n", srv_opts.lesson_title);
+        }
+        pending_lesson = -1;
+    }
+    unlock_lessons();
+}
+
+
+// lesson cache:
+
+// Returns index in lesson_cache[], or -1 if not cached:
+int find_cached_lesson(const char* lesson_name)
+{
+    int i;
+    for(i = 0; i < num_cached_lessons; i++)
+        if(strcmp(lesson_cache[i].filename, lesson_name) == 0)
+            return i;
+    return -1;
+}
+
+
+// Parse a lesson file into the cache, replacing the least recently
+// used entry if the cache is full.  Like run_lan_host(), we start from
+// the global config file so lessons only change what they mention.
+// Returns index in lesson_cache[], or -1 if the file could not be read.
+// NOTE reading the files sets the global options, so they are put back
+// as they were afterwards.  The server thread never reads the global
+// ones (see srv_opts), and the thread calling SrvrLoadLesson() is busy
+// in here meanwhile:
+int cache_lesson(const char* lesson_name)
+{
+    MC_MathGame scratch;
+    static game_option_type saved_opts;
+    int i, slot;
+
+    memset(&scratch, 0, sizeof(MC_MathGame));
+    if(!MC_Initialize(&scratch))
+        return -1;
+
+    Opts_CopyGameOptions(&saved_opts);
+
+    read_global_config_file(&scratch);
+    if(!read_named_config_file(&scratch, lesson_name))
+    {
+        Opts_SetGameOptions(&saved_opts);
+        MC_EndGame(&scratch);
+        return -1;
+    }
+
+    if(num_cached_lessons < SRV_LESSON_CACHE_SIZE)
+        slot = num_cached_lessons++;
+    else
+    {
+        slot = (pending_lesson == 0) ? 1 : 0;
+        for(i = 0; i < SRV_LESSON_CACHE_SIZE; i++)
+            if(i != pending_lesson
+                    && lesson_cache[i].last_used < lesson_cache[slot].last_used)
+                slot = i;
+    }
+
+    strncpy(lesson_cache[slot].filename, lesson_name, PATH_MAX);
+    lesson_cache[slot].filename[PATH_MAX - 1] = '\0';
+    lesson_cache[slot].opts = *(scratch.math_opts);
+    Opts_CopyGameOptions(&lesson_cache[slot].game_opts);
+
+    Opts_SetGameOptions(&saved_opts);
+    MC_EndGame(&scratch);
+
+    DEBUGMSG(debug_lan, "cache_lesson() - %s cached in slot %d\n", lesson_name, slot);
+    return slot;
+}
+
+
+void lock_lessons(void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&lesson_mutex);
+#endif
+}
+
+
+void unlock_lessons(void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&lesson_mutex);
+#endif
+}
+
+
+// mid-game reconnection:
+
+// A connection made while a game is running is held here briefly.  If
+// its first message is RESUME_SESSION with a valid token, it takes back
+// the player's old slot, and if it is SPECTATE it may watch the game;
+// otherwise it gets the usual GAME_IN_PROGRESS.
+void add_handshake(int thread_id_no, TCPsocket sock)
+{
+    char buffer[NET_BUF_LEN];
+    int j;
+
+    for(j = 0; j < SRV_MAX_HANDSHAKES; j++)
+    {
+        if(slave_thread[thread_id_no].handshake_sock[j] == NULL)
+        {
+            if(SDLNet_TCP_AddSocket(slave_thread[thread_id_no].handshake_set, sock) == -1)
+                break;
+            slave_thread[thread_id_no].handshake_sock[j] = sock;
+            slave_thread[thread_id_no].handshake_time[j] = SDL_GetTicks();
+            record_msg(LANLOG_CONNECT, LANLOG_HANDSHAKE_BASE + j, "");
+            DEBUGMSG(debug_lan, "add_handshake() - connection during game held in slot %d\n", j);
+            return;
+        }
+    }
+
+    // No room to wait on it - send our regrets:
+    j = LANLOG_HANDSHAKE_BASE + SRV_MAX_HANDSHAKES;
+    record_msg(LANLOG_CONNECT, j, "");
+    snprintf(buffer, NET_BUF_LEN, "%s", "GAME_IN_PROGRESS");
+    SDLNet_TCP_Send(sock, buffer, NET_BUF_LEN);
+    record_msg(LANLOG_SEND, j, buffer);
+    SDLNet_TCP_Close(sock);
+    record_msg(LANLOG_DISCONNECT, j, "");
+    DEBUGMSG(debug_lan, "add_handshake() - game already started\n");
+}
+
+
+void check_handshakes(int thread_id_no)
+{
+    char buffer[NET_BUF_LEN];
+    int j;
+    int actives;
+    Uint32 now = SDL_GetTicks();
+
+    actives = SDLNet_CheckSockets(slave_thread[thread_id_no].handshake_set, 0);
+    if(actives == -1)
+        fprintf(stderr, "In check_handshakes(), SDLNet_CheckSockets: %s\n", SDLNet_GetError());
+
+    for(j = 0; j < SRV_MAX_HANDSHAKES; j++)
+    {
+        TCPsocket sock = slave_thread[thread_id_no].handshake_sock[j];
+        int resumed = 0;
+
+        if(sock == NULL)
+            continue;
+
+        if(actives > 0 && SDLNet_SocketReady(sock))
+        {
+            if(SDLNet_TCP_Recv(sock, buffer, NET_BUF_LEN) > 0)
+            {
+                record_msg(LANLOG_RECV, LANLOG_HANDSHAKE_BASE + j, buffer);
+                resumed = resume_session(thread_id_no, sock, buffer, LANLOG_HANDSHAKE_BASE + j)
+                    || spectate(thread_id_no, sock, buffer, LANLOG_HANDSHAKE_BASE + j);
+            }
+            else
+            {
+                // Hung up on us:
+                SDLNet_TCP_DelSocket(slave_thread[thread_id_no].handshake_set, sock);
+                SDLNet_TCP_Close(sock);
+                record_msg(LANLOG_DISCONNECT, LANLOG_HANDSHAKE_BASE + j, "");
+                slave_thread[thread_id_no].handshake_sock[j] = NULL;
+                continue;
+            }
+        }
+        else if(game_in_progress
+                && (now - slave_thread[thread_id_no].handshake_time[j] < SRV_HANDSHAKE_TIMEOUT))
+            continue;  // keep waiting
+
+        // Either resumed (socket now belongs to a client or spectator
+        // slot) or rejected - either way it leaves the handshake list:
+        SDLNet_TCP_DelSocket(slave_thread[thread_id_no].handshake_set, sock);
+        slave_thread[thread_id_no].handshake_sock[j] = NULL;
+        if(!resumed)
+        {
+            // NOTE if the game ended meanwhile, we just hang up and
+            // the client can connect again normally:
+            if(game_in_progress)
+            {
+                snprintf(buffer, NET_BUF_LEN, "%s", "GAME_IN_PROGRESS");
+                SDLNet_TCP_Send(sock, buffer, NET_BUF_LEN);
+                record_msg(LANLOG_SEND, LANLOG_HANDSHAKE_BASE + j, buffer);
+                DEBUGMSG(debug_lan, "check_handshakes() - game already started\n");
+            }
+            SDLNet_TCP_Close(sock);
+            record_msg(LANLOG_DISCONNECT, LANLOG_HANDSHAKE_BASE + j, "");
+        }
+    }
+}
+
+
+// Returns 1 if buf is a valid RESUME_SESSION request, in which case sock
+// is put into the player's old slot and the player gets a snapshot of
+// the game.  NOTE the old socket may not have been noticed as dead yet,
+// in which case it is simply replaced.  log_index is the connection's
+// index in the LAN recording until now:
+int resume_session(int thread_id_no, TCPsocket sock, char* buf, int log_index)
+{
+    char outbuf[NET_BUF_LEN];
+    Uint32 token = 0;
+    char* p;
+    int i;
+
+    if(!game_in_progress
+            || strncmp(buf, "RESUME_SESSION", strlen("RESUME_SESSION")) != 0)
+        return 0;
+
+    p = strchr(buf, '\t');
+    if(!p)
+        return 0;
+    p++;
+    token = strtoul(p, NULL, 10);
+    if(!token)
+        return 0;
+
+    for(i = 0; i < MAX_CLIENTS; i++)
+        if(slave_thread[thread_id_no].client[i].session_token == token)
+            break;
+    if(i == MAX_CLIENTS)
+    {
+        DEBUGMSG(debug_lan, "resume_session() - unknown token %u\n", token);
+        return 0;
+    }
+
+    if(slave_thread[thread_id_no].client[i].sock != NULL)
+    {
+        SDLNet_TCP_DelSocket(slave_thread[thread_id_no].client_set, slave_thread[thread_id_no].client[i].sock);
+        SDLNet_TCP_Close(slave_thread[thread_id_no].client[i].sock);
+        record_msg(LANLOG_DISCONNECT, i, "");
+    }
+    slave_thread[thread_id_no].client[i].sock = sock;
+    slave_thread[thread_id_no].client[i].suspended = 0;
+    slave_thread[thread_id_no].client[i].game_ready = 1;
+    if(SDLNet_TCP_AddSocket(slave_thread[thread_id_no].client_set, sock) == -1)
+    {
+        fprintf(stderr, "SDLNet_AddSocket: %s\n", SDLNet_GetError());
+        slave_thread[thread_id_no].client[i].sock = NULL;
+        slave_thread[thread_id_no].client[i].suspended = 1;
+        return 0;
+    }
+
+    fprintf(stderr, "client[%d] - name: %s has resumed the game\n>\n", i, slave_thread[thread_id_no].client[i].name);
+    record_move(log_index, i);
+
+    msg_socket_index(thread_id_no, i, outbuf);
+    send_game_snapshot(thread_id_no, i);
+    return 1;
+}
+
+
+// Tokens only need to be hard to guess by accident, not secure:
+Uint32 new_session_token(void)
+{
+    Uint32 token = 0;
+    while(token == 0)
+        token = ((Uint32)rand() << 16) ^ (Uint32)rand() ^ SDL_GetTicks();
+    return token;
+}
+
+
+// spectators:
+
+// Spectators get a compact stream of game events, one per message:
+//   SPECTATING       <server name>
+//   SPEC_START       <lesson title>
+//   SPEC_WAVE        <wave> <questions left>
+//   SPEC_PLAYER      <index> <name> <score>
+//   SPEC_PLAYER_LEFT <index>
+//   SPEC_QUESTION    <question id> <formula>
+//   SPEC_ANSWER      <question id> <player index> <seconds> <points>
+//   SPEC_MISSED      <question id> <player index>
+//   SPEC_END
+// Anything a spectator sends us is ignored, and one that stops reading
+// is disconnected once its queue is full.
+
+// Returns 1 if buf is a SPECTATE request and sock has been taken on as
+// a spectator.  The spectator is then sent the current state of play.
+// log_index is the connection's index in the LAN recording until now:
+int spectate(int thread_id_no, TCPsocket sock, char* buf, int log_index)
+{
+    char outbuf[NET_BUF_LEN];
+    srv_spectator_type* spec = NULL;
+    srv_quest_type* q = slave_thread[thread_id_no].srv_game.active_list;
+    int i, j, queued = 1;
+
+    if(strncmp(buf, "SPECTATE", strlen("SPECTATE")) != 0)
+        return 0;
+
+    for(j = 0; j < SRV_MAX_SPECTATORS; j++)
+    {
+        if(slave_thread[thread_id_no].spectator[j].sock == NULL)
+        {
+            spec = &slave_thread[thread_id_no].spectator[j];
+            break;
+        }
+    }
+    if(!spec)
+    {
+        DEBUGMSG(debug_lan, "spectate() - no vacant spectator slot\n");
+        return 0;
+    }
+    if(SDLNet_TCP_AddSocket(slave_thread[thread_id_no].spectator_set, sock) == -1)
+    {
+        fprintf(stderr, "SDLNet_AddSocket: %s\n", SDLNet_GetError());
+        return 0;
+    }
+
+    spec->sock = sock;
+    spec->last_send = 0;
+    outq_reset(&spec->outq);
+
+    fprintf(stderr, "Spectator %d connected\n>\n", j);
+    record_move(log_index, LANLOG_SPECTATOR_BASE + j);
+
+    snprintf(outbuf, NET_BUF_LEN, "%s\t%s", "SPECTATING", server_name);
+    queued &= outq_push(&spec->outq, outbuf);
+    for(i = 0; i < MAX_CLIENTS; i++)
+    {
+        if(slave_thread[thread_id_no].client[i].sock == NULL
+                && !slave_thread[thread_id_no].client[i].suspended)
+            continue;
+        snprintf(outbuf, NET_BUF_LEN, "%s\t%d\t%s\t%d", "SPEC_PLAYER", i,
+                slave_thread[thread_id_no].client[i].name,
+                slave_thread[thread_id_no].client[i].score);
+        queued &= outq_push(&spec->outq, outbuf);
+    }
+    if(game_in_progress)
+    {
+        snprintf(outbuf, NET_BUF_LEN, "%s\t%s", "SPEC_START", srv_opts.lesson_title);
+        queued &= outq_push(&spec->outq, outbuf);
+        snprintf(outbuf, NET_BUF_LEN, "%s\t%d\t%d", "SPEC_WAVE",
+                slave_thread[thread_id_no].srv_game.wave,
+                MC_TotalQuestionsLeft(lan_game_settings));
+        queued &= outq_push(&spec->outq, outbuf);
+        for(i = 0; i < MAX_MAX_COMETS; i++)
+        {
+            if(!q[i].in_use)
+                continue;
+            snprintf(outbuf, NET_BUF_LEN, "%s\t%d\t%s", "SPEC_QUESTION",
+                    q[i].fc.question_id, q[i].fc.formula_string);
+            queued &= outq_push(&spec->outq, outbuf);
+        }
+    }
+    //Shouldn't happen with SRV_OUTQ_LEN big enough, but the socket is
+    //ours now either way:
+    if(!queued)
+    {
+        fprintf(stderr, "spectate() - state of play too big for SRV_OUTQ_LEN\n");
+        remove_spectator(thread_id_no, j);
+    }
+    return 1;
+}
+
+
+// A connection that came in as a player before the game, and then asked
+// to spectate instead, gives up its player slot:
+void msg_spectate(int thread_id_no, int i, char* buf)
+{
+    TCPsocket sock = slave_thread[thread_id_no].client[i].sock;
+
+    SDLNet_TCP_DelSocket(slave_thread[thread_id_no].client_set, sock);
+    if(!spectate(thread_id_no, sock, buf, i))
+    {
+        SDLNet_TCP_AddSocket(slave_thread[thread_id_no].client_set, sock);
+        player_msg(thread_id_no, i, "Sorry, already have maximum number of spectators connected");
+        return;
+    }
+
+    slave_thread[thread_id_no].client[i].sock = NULL;
+    slave_thread[thread_id_no].client[i].game_ready = 0;
+    strncpy(slave_thread[thread_id_no].client[i].name, _("Await player name"), NAME_SIZE);
+    slave_thread[thread_id_no].client[i].session_token = 0;
+    slave_thread[thread_id_no].client[i].suspended = 0;
+    send_player_updates(thread_id_no);
+}
+
+
+void remove_spectator(int thread_id_no, int j)
+{
+    srv_spectator_type* spec = &slave_thread[thread_id_no].spectator[j];
+
+    fprintf(stderr, "Removing spectator %d\n>\n", j);
+
+    if(spec->sock != NULL)
+    {
+        SDLNet_TCP_DelSocket(slave_thread[thread_id_no].spectator_set, spec->sock);
+        SDLNet_TCP_Close(spec->sock);
+        record_msg(LANLOG_DISCONNECT, LANLOG_SPECTATOR_BASE + j, "");
+    }
+    spec->sock = NULL;
+    outq_reset(&spec->outq);
+}
+
+
+/* Queue an event for all spectators.  Nothing is sent here, and any */
+/* spectator too far behind to take it is dropped:                   */
+void spectator_event(int thread_id_no, char* msg)
+{
+    int j;
+    if(!msg)
+        return;
+    for(j = 0; j < SRV_MAX_SPECTATORS; j++)
+        if(slave_thread[thread_id_no].spectator[j].sock != NULL
+                && !outq_push(&slave_thread[thread_id_no].spectator[j].outq, msg))
+        {
+            fprintf(stderr, "Spectator %d is not keeping up\n", j);
+            remove_spectator(thread_id_no, j);
+        }
+}
+
+
+void spectator_player_event(int thread_id_no, int i)
+{
+    char buf[NET_BUF_LEN];
+
+    if(slave_thread[thread_id_no].client[i].sock == NULL
+            && !slave_thread[thread_id_no].client[i].suspended)
+        return;
+    snprintf(buf, NET_BUF_LEN, "%s\t%d\t%s\t%d", "SPEC_PLAYER", i,
+            slave_thread[thread_id_no].client[i].name,
+            slave_thread[thread_id_no].client[i].score);
+    spectator_event(thread_id_no, buf);
+}
+
+
+void spectator_wave_event(int thread_id_no)
+{
+    char buf[NET_BUF_LEN];
+    snprintf(buf, NET_BUF_LEN, "%s\t%d\t%d", "SPEC_WAVE",
+            slave_thread[thread_id_no].srv_game.wave,
+            MC_TotalQuestionsLeft(lan_game_settings));
+    spectator_event(thread_id_no, buf);
+}
+
+
+// Called once per server loop after all the player work is done.  Each
+// spectator gets at most one queued message per SRV_SPECTATOR_INTERVAL.
+// A spectator that has stopped reading fills up its TCP send buffer, and
+// a blocked send here would stall the whole server loop, so nothing is
+// sent unless the socket has room - it is dropped when its queue fills.
+void flush_spectators(int thread_id_no)
+{
+    char buf[NET_BUF_LEN];
+    int j;
+    int actives;
+    Uint32 now = SDL_GetTicks();
+
+    // Spectators are read-only, so activity means either junk to be
+    // discarded or a hang-up:
+    actives = SDLNet_CheckSockets(slave_thread[thread_id_no].spectator_set, 0);
+    if(actives == -1)
+        fprintf(stderr, "In flush_spectators(), SDLNet_CheckSockets: %s\n", SDLNet_GetError());
+
+    for(j = 0; j < SRV_MAX_SPECTATORS; j++)
+    {
+        srv_spectator_type* spec = &slave_thread[thread_id_no].spectator[j];
+
+        if(spec->sock == NULL)
+            continue;
+
+        if(actives > 0 && SDLNet_SocketReady(spec->sock))
+        {
+            if(SDLNet_TCP_Recv(spec->sock, buf, NET_BUF_LEN) <= 0)
+            {
+                remove_spectator(thread_id_no, j);
+                continue;
+            }
+        }
+
+        if(now - spec->last_send < SRV_SPECTATOR_INTERVAL
+                || !socket_writable(spec->sock))
+            continue;
+        switch(outq_send(spec->sock, &spec->outq))
+        {
+            case 1:
+                spec->last_send = now;
+                //NOTE outq_send() leaves the message where it was:
+                record_msg(LANLOG_SEND, LANLOG_SPECTATOR_BASE + j,
+                        spec->outq.msg[(spec->outq.head + SRV_OUTQ_LEN - 1) % SRV_OUTQ_LEN]);
+                break;
+            case -1:
+                remove_spectator(thread_id_no, j);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+
+// outbound message queues:
+
+void outq_reset(srv_outq_type* q)
+{
+    q->head = 0;
+    q->count = 0;
+}
+
+
+// Returns 1 if the message was queued, or 0 if the queue is full:
+int outq_push(srv_outq_type* q, const char* msg)
+{
+    if(q->count == SRV_OUTQ_LEN)
+        return 0;
+    snprintf(q->msg[(q->head + q->count) % SRV_OUTQ_LEN], NET_BUF_LEN, "%s", msg);
+    q->count++;
+    return 1;
+}
+
+
+// Sends the oldest queued message.  Returns 1 if a message was sent, 0 if
+// the queue was empty, or -1 if the send failed.
+int outq_send(TCPsocket sock, srv_outq_type* q)
+{
+    if(q->count == 0)
+        return 0;
+
+    if(SDLNet_TCP_Send(sock, q->msg[q->head], NET_BUF_LEN) < NET_BUF_LEN)
+        return -1;
+    q->head = (q->head + 1) % SRV_OUTQ_LEN;
+    q->count--;
+    return 1;
+}
+
+
+// SDL_net can't tell us whether a send would block, so we ask select()
+// about the system socket underneath.  SDL_net keeps its struct _TCPsocket
+// private, so this mirrors the start of it as of the 1.2 releases
+// (SDLnetTCP.c), and it is only trusted when we are built against, and
+// running with, one of those:
+#if defined(SDL_NET_MAJOR_VERSION) && SDL_NET_MAJOR_VERSION == 1 && SDL_NET_MINOR_VERSION == 2
+#define SRV_PEEK_SOCKETS 1
+struct srv_net_socket {
+    int ready;
+#ifdef WIN32
+    SOCKET channel;
+#else
+    int channel;
+#endif
+};
+#endif
+
+// Returns 1 if there is room to send on the socket without waiting.  If
+// we can't look, it always says there is - spectators are then only held
+// back by SRV_SPECTATOR_INTERVAL, and one that stops reading can stall the
+// server once its send buffer is full:
+int socket_writable(TCPsocket sock)
+{
+#ifdef SRV_PEEK_SOCKETS
+    static int peek = -1;
+    struct timeval tv = {0, 0};
+    fd_set fds;
+#endif
+
+    if(!sock)
+        return 0;
+#ifdef SRV_PEEK_SOCKETS
+    if(peek < 0)
+    {
+        const SDL_version* v = SDLNet_Linked_Version();
+        peek = (v->major == 1 && v->minor == 2);
+        if(!peek)
+            fprintf(stderr, "SDL_net %d.%d.%d - can't tell if spectators are keeping up\n",
+                    v->major, v->minor, v->patch);
+    }
+    if(!peek)
+        return 1;
+    FD_ZERO(&fds);
+    FD_SET(((struct srv_net_socket*)sock)->channel, &fds);
+    return select(((struct srv_net_socket*)sock)->channel + 1, NULL, &fds, NULL, &tv) > 0;
+#else
+    return 1;
+#endif
+}
+
+
 // client management utilities:
 
 //Returns the index of the first vacant client, or -1 if all clients full
 int find_vacant_client(int thread_id_no)
 {
     int i = 0;
-    while (slave_thread[thread_id_no].client[i].sock && i < MAX_CLIENTS)
+    //NOTE slots held for suspended players are not vacant:
+    while (i < MAX_CLIENTS
+            && (slave_thread[thread_id_no].client[i].sock
+                || slave_thread[thread_id_no].client[i].suspended))
         i++;
     if (i == MAX_CLIENTS)
     {
@@ -900,11 +1745,119 @@ void remove_client(int thread_id_no, int i)
     SDLNet_TCP_DelSocket(slave_thread[thread_id_no].client_set, slave_thread[thread_id_no].client[i].sock);
 
     if(slave_thread[thread_id_no].client[i].sock != NULL)
+    {
         SDLNet_TCP_Close(slave_thread[thread_id_no].client[i].sock);
+        record_msg(LANLOG_DISCONNECT, i, "");
+    }
 
     slave_thread[thread_id_no].client[i].sock = NULL;  
     slave_thread[thread_id_no].client[i].game_ready = 0;
     slave_thread[thread_id_no].client[i].name[0] = '\0';
+    slave_thread[thread_id_no].client[i].session_token = 0;
+    slave_thread[thread_id_no].client[i].suspended = 0;
+    slave_thread[thread_id_no].client[i].suspend_unannounced = 0;
+
+    snprintf(buf, 256, "SPEC_PLAYER_LEFT\t%d", i);
+    spectator_event(thread_id_no, buf);
+}
+
+
+// drop_client() is for connections that fail rather than clients that
+// leave on purpose.  During a game we hold on to the player's slot for a
+// while in case they reconnect; otherwise they are simply removed:
+void drop_client(int thread_id_no, int i)
+{
+    if(game_in_progress
+            && slave_thread[thread_id_no].client[i].game_ready
+            && slave_thread[thread_id_no].client[i].session_token)
+        suspend_client(thread_id_no, i);
+    else
+        remove_client(thread_id_no, i);
+}
+
+
+// NOTE this is called when a send to the client fails, so it mustn't
+// send anything itself - that could fail too and suspend another client
+// part way through.  The others are told by announce_suspended_clients():
+void suspend_client(int thread_id_no, int i)
+{
+    fprintf(stderr, "Suspending client[%d] - name: %s\n>\n", i, slave_thread[thread_id_no].client[i].name);
+
+    SDLNet_TCP_DelSocket(slave_thread[thread_id_no].client_set, slave_thread[thread_id_no].client[i].sock);
+    if(slave_thread[thread_id_no].client[i].sock != NULL)
+    {
+        SDLNet_TCP_Close(slave_thread[thread_id_no].client[i].sock);
+        record_msg(LANLOG_DISCONNECT, i, "");
+    }
+    slave_thread[thread_id_no].client[i].sock = NULL;
+    //NOTE we keep name, score, game_ready and session_token:
+    slave_thread[thread_id_no].client[i].suspended = 1;
+    slave_thread[thread_id_no].client[i].suspend_time = SDL_GetTicks();
+    slave_thread[thread_id_no].client[i].suspend_unannounced = 1;
+}
+
+
+// Tell the other players about anyone suspended since last time.  Sending
+// may suspend more clients, which are picked up on the next pass:
+void announce_suspended_clients(int thread_id_no)
+{
+    char buf[NET_BUF_LEN];
+    int i, found;
+
+    do
+    {
+        found = 0;
+        for(i = 0; i < MAX_CLIENTS; i++)
+        {
+            if(!slave_thread[thread_id_no].client[i].suspend_unannounced)
+                continue;
+            slave_thread[thread_id_no].client[i].suspend_unannounced = 0;
+            //Back already, or given up on:
+            if(!slave_thread[thread_id_no].client[i].suspended)
+                continue;
+            found = 1;
+            snprintf(buf, NET_BUF_LEN, "%s lost connection - waiting for them to return",
+                    slave_thread[thread_id_no].client[i].name);
+            broadcast_msg(thread_id_no, buf);
+        }
+    }
+    while(found);
+}
+
+
+// Give up on suspended players who have not come back in time:
+void expire_suspended_clients(int thread_id_no)
+{
+    int i;
+    Uint32 now = SDL_GetTicks();
+
+    for(i = 0; i < MAX_CLIENTS; i++)
+    {
+        if(slave_thread[thread_id_no].client[i].suspended
+                && (now - slave_thread[thread_id_no].client[i].suspend_time > SRV_RESUME_TIMEOUT))
+        {
+            DEBUGMSG(debug_lan, "Suspended client %d did not resume in time\n", i);
+            remove_client(thread_id_no, i);
+            send_player_updates(thread_id_no);
+        }
+    }
+}
+
+
+// Once a game is over there is nothing to resume:
+void clear_suspended_clients(int thread_id_no)
+{
+    int i;
+    for(i = 0; i < MAX_CLIENTS; i++)
+    {
+        if(slave_thread[thread_id_no].client[i].suspended)
+        {
+            slave_thread[thread_id_no].client[i].suspended = 0;
+            slave_thread[thread_id_no].client[i].game_ready = 0;
+            slave_thread[thread_id_no].client[i].session_token = 0;
+            slave_thread[thread_id_no].client[i].name[0] = '\0';
+        }
+    }
 }
 
 
@@ -930,7 +1883,9 @@ void check_game_clients(int thread_id_no)
         int someone_still_playing = 0;
         for(i = 0; i < MAX_CLIENTS; i++)
         {
-            if((slave_thread[thread_id_no].client[i].sock != NULL)
+            //NOTE a player who dropped and may yet resume counts as playing:
+            if(((slave_thread[thread_id_no].client[i].sock != NULL)
+                        || slave_thread[thread_id_no].client[i].suspended)
                     && slave_thread[thread_id_no].client[i].game_ready)
             {
                 someone_still_playing = 1;
@@ -1007,6 +1962,10 @@ void handle_client_nongame_msg(int thread_id_no, int i, char* buffer)
     {
         msg_socket_index(thread_id_no, i, buffer);
     }                            
+    else if(strncmp(buffer, "SPECTATE", strlen("SPECTATE")) == 0)
+    {
+        msg_spectate(thread_id_no, i, buffer);
+    }
 }
 
 
@@ -1065,6 +2024,7 @@ int msg_set_name(int thread_id_no,int i, char* buf)
         p++;
         strncpy(slave_thread[thread_id_no].client[i].name, p, NAME_SIZE);
         send_player_updates(thread_id_no);
+        spectator_player_event(thread_id_no, i);
         return 1;
     }
     else
@@ -1076,6 +2036,16 @@ void msg_socket_index(int thread_id_no, int i, char* buf)
 {  
     snprintf(buf, NET_BUF_LEN, "%s\t%d", "SOCKET_INDEX", i);
     SDLNet_TCP_Send(slave_thread[thread_id_no].client[i].sock, buf, NET_BUF_LEN);
+    record_msg(LANLOG_SEND, i, buf);
+}
+
+
+void msg_session_token(int thread_id_no, int i)
+{  
+    char buf[NET_BUF_LEN];
+    snprintf(buf, NET_BUF_LEN, "%s\t%u", "SESSION_TOKEN",
+            slave_thread[thread_id_no].client[i].session_token);
+    transmit(thread_id_no, i, buf);
 }
 
 
@@ -1114,6 +2084,7 @@ void game_msg_correct_answer(int thread_id_no,int i, char* inbuf)
     //and the corresponding question was found.
     slave_thread[thread_id_no].client[i].score += points;
     slave_thread[thread_id_no].srv_game.active_quests--;
+    untrack_question(thread_id_no, id);
 
     //Announcement for server and all clients:
     snprintf(outbuf, NET_BUF_LEN, 
@@ -1135,6 +2106,12 @@ void game_msg_correct_answer(int thread_id_no,int i, char* inbuf)
     send_counter_updates(thread_id_no);
     //and the scores:
     send_player_updates(thread_id_no);
+
+    //Spectators get who answered, how fast, and the new score:
+    snprintf(outbuf, NET_BUF_LEN, "%s\t%d\t%d\t%.2f\t%d", "SPEC_ANSWER",
+            id, i, t, points);
+    spectator_event(thread_id_no, outbuf);
+    spectator_player_event(thread_id_no, i);
 }
 
 
@@ -1162,6 +2139,7 @@ void game_msg_wrong_answer(int thread_id_no, int i, char* inbuf)
 
     //One less comet in play:
     slave_thread[thread_id_no].srv_game.active_quests--;
+    untrack_question(thread_id_no, id);
 
     DEBUGMSG(debug_lan, "\nAfter wrong answer: wave %d\n"
             "srv_game.max_quests_on_screen = %d\n"
@@ -1179,11 +2157,17 @@ void game_msg_wrong_answer(int thread_id_no, int i, char* inbuf)
     remove_question(thread_id_no, id, -1);
     //and update the game counters:
     send_counter_updates(thread_id_no);
+
+    snprintf(outbuf, NET_BUF_LEN, "%s\t%d\t%d", "SPEC_MISSED", id, i);
+    spectator_event(thread_id_no, outbuf);
 }
 
 
 
-void game_msg_next_question(int thread_id_no)
+/* Sends the next question to all clients, to be launched as a comet   */
+/* "delay" msec from now.  The question counts as active from the time  */
+/* it is sent, so it holds its comet slot while it waits to be launched: */
+void game_msg_next_question(int thread_id_no, Uint32 delay)
 {
     MC_FlashCard flash;
 
@@ -1195,11 +2179,14 @@ void game_msg_next_question(int thread_id_no)
         return;
     }
 
-    DEBUGMSG(debug_lan, "In game_msg_next_question(), about to send:\n");
+    DEBUGMSG(debug_lan, "In game_msg_next_question(), about to send "
+            "(spawn in %d msec):\n", delay);
     DEBUGCODE(debug_lan) print_card(flash); 
 
     /* Send it to all the clients: */ 
-    add_question(thread_id_no, &flash);
+    prefetch_question(thread_id_no, &flash, delay);
+    /* and remember it in case someone needs to resume: */
+    track_question(thread_id_no, &flash, SDL_GetTicks() + delay);
     /* Adjust counters accordingly: */
     slave_thread[thread_id_no].srv_game.active_quests++;
     slave_thread[thread_id_no].srv_game.rem_in_wave--;
@@ -1268,7 +2255,10 @@ void start_game(int thread_id_no)
                 && (slave_thread[thread_id_no].client[j].sock != NULL))
         {
             if(SDLNet_TCP_Send(slave_thread[thread_id_no].client[j].sock, buf, NET_BUF_LEN) == NET_BUF_LEN)
+            {
                 slave_thread[thread_id_no].num_clients++;
+                record_msg(LANLOG_SEND, j, buf);
+            }
             else
             {
                 fprintf(stderr, "in start_game() - failed to send to client %d, removing\n", j);
@@ -1302,8 +2292,10 @@ void start_game(int thread_id_no)
     /* Initialize game data that isn't handled by mathcards: */
     slave_thread[thread_id_no].srv_game.wave = 1;
     slave_thread[thread_id_no].srv_game.active_quests = 0;
-    slave_thread[thread_id_no].srv_game.max_quests_on_screen = Opts_StartingComets();
-    slave_thread[thread_id_no].srv_game.quests_in_wave = slave_thread[thread_id_no].srv_game.rem_in_wave = Opts_StartingComets() * 2;
+    slave_thread[thread_id_no].srv_game.next_spawn_time = SDL_GetTicks();
+    reset_tracked_questions(thread_id_no);
+    slave_thread[thread_id_no].srv_game.max_quests_on_screen = srv_opts.starting_comets;
+    slave_thread[thread_id_no].srv_game.quests_in_wave = slave_thread[thread_id_no].srv_game.rem_in_wave = srv_opts.starting_comets * 2;
 
     game_in_progress = 1;
 
@@ -1336,6 +2328,13 @@ void start_game(int thread_id_no)
     //Send all the clients the counter totals:
     send_counter_updates(thread_id_no);
     send_player_updates(thread_id_no);
+
+    //and let any spectators know who is playing:
+    snprintf(buf, NET_BUF_LEN, "%s\t%s", "SPEC_START", srv_opts.lesson_title);
+    spectator_event(thread_id_no, buf);
+    for(j = 0; j < MAX_CLIENTS; j++)
+        spectator_player_event(thread_id_no, j);
+    spectator_wave_event(thread_id_no);
 }
 
 /* Update anything that isn't a response to a client message, such
@@ -1343,7 +2342,8 @@ void start_game(int thread_id_no)
  */
 void server_update_game(int thread_id_no)
 {
-    static Uint32 last_time, now_time, wait_time;
+    Uint32 now_time, wait_time, lead_time, delay;
+    struct srv_game_type* g = &slave_thread[thread_id_no].srv_game;
 
     /* Do nothing unless game started: */
     if(!game_in_progress)
@@ -1351,29 +2351,38 @@ void server_update_game(int thread_id_no)
         return;
     }
 
+    /* Let go of any dropped players who have not come back: */
+    expire_suspended_clients(thread_id_no);
+
     now_time = SDL_GetTicks();
 
     /* Wait time is shorter in higher waves because the comets move faster: */
-    wait_time = SRV_QUEST_INTERVAL/pow(DEFAULT_SPEEDUP_FACTOR, slave_thread[thread_id_no].srv_game.wave);
+    wait_time = SRV_QUEST_INTERVAL/pow(DEFAULT_SPEEDUP_FACTOR, g->wave);
+    /* Questions go out this far ahead of their scheduled spawn time: */
+    lead_time = wait_time * SRV_PREFETCH_WINDOW;
+
+    /* Schedule more questions while there is room and the next spawn  */
+    /* time falls within the prefetch window.  If the schedule fell    */
+    /* behind because all the slots were full, restart it from now so  */
+    /* a freed slot is refilled right away (as before prefetching):    */
+    while((g->active_quests < g->max_quests_on_screen)
+            && (g->rem_in_wave > 0)
+            && ((Sint32)(g->next_spawn_time - now_time) <= (Sint32)lead_time))
+    {
+        if((Sint32)(g->next_spawn_time - now_time) < 0)
+            g->next_spawn_time = now_time;
+        delay = g->next_spawn_time - now_time;
 
-    /* Send another question if there is room and enough time has elapsed: */
-    if(now_time - last_time > wait_time)
-    {     
-        if((slave_thread[thread_id_no].srv_game.active_quests < slave_thread[thread_id_no].srv_game.max_quests_on_screen)
-                && (slave_thread[thread_id_no].srv_game.rem_in_wave > 0))
-        {
-            DEBUGMSG(debug_lan, "\nAbout to add next question:\n"
-                    "srv_game.max_quests_on_screen = %d\n"
-                    "srv_game.rem_in_wave = %d\n"
-                    "srv_game.active_quests = %d\n"
-                    "last_time = %d\n"
-                    "now_time = %d\n\n",
-                    slave_thread[thread_id_no].srv_game.max_quests_on_screen,
-                    slave_thread[thread_id_no].srv_game.rem_in_wave, slave_thread[thread_id_no].srv_game.active_quests,
-                    last_time, now_time);   
-            game_msg_next_question(thread_id_no);
-            last_time = now_time;
-        }
+        DEBUGMSG(debug_lan, "\nAbout to add next question:\n"
+                "srv_game.max_quests_on_screen = %d\n"
+                "srv_game.rem_in_wave = %d\n"
+                "srv_game.active_quests = %d\n"
+                "next_spawn_time = %d\n"
+                "now_time = %d\n\n",
+                g->max_quests_on_screen, g->rem_in_wave, g->active_quests,
+                g->next_spawn_time, now_time);
+        game_msg_next_question(thread_id_no, delay);
+        g->next_spawn_time += wait_time;
     }
 
     /* Go on to next wave when appropriate: */
@@ -1382,11 +2391,12 @@ void server_update_game(int thread_id_no)
     {
         slave_thread[thread_id_no].srv_game.wave++;
         slave_thread[thread_id_no].srv_game.active_quests = 0; 
-        slave_thread[thread_id_no].srv_game.max_quests_on_screen += Opts_ExtraCometsPerWave(); 
-        if(slave_thread[thread_id_no].srv_game.max_quests_on_screen > Opts_MaxComets()) 
-            slave_thread[thread_id_no].srv_game.max_quests_on_screen = Opts_MaxComets(); 
+        slave_thread[thread_id_no].srv_game.max_quests_on_screen += srv_opts.extra_comets_per_wave; 
+        if(slave_thread[thread_id_no].srv_game.max_quests_on_screen > srv_opts.max_comets) 
+            slave_thread[thread_id_no].srv_game.max_quests_on_screen = srv_opts.max_comets; 
         slave_thread[thread_id_no].srv_game.rem_in_wave = slave_thread[thread_id_no].srv_game.max_quests_on_screen * 2;
         send_counter_updates(thread_id_no); 
+        spectator_wave_event(thread_id_no);
         DEBUGMSG(debug_lan, "/nAdvance to wave %d\n"
                 "srv_game.max_quests_on_screen = %d\n"
                 "srv_game.rem_in_wave = %d\n"
@@ -1400,6 +2410,8 @@ void server_update_game(int thread_id_no)
     if(MC_TotalQuestionsLeft(lan_game_settings) == 0)
     {
         game_in_progress = 0;
+        clear_suspended_clients(thread_id_no);
+        spectator_event(thread_id_no, "SPEC_END");
         DEBUGMSG(debug_lan, "/nGame over:\nwave = %d\n"
                 "srv_game.max_quests_on_screen = %d\n"
                 "srv_game.rem_in_wave = %d\n"
@@ -1432,6 +2444,8 @@ void end_game(int thread_id_no)
     }
 
     game_in_progress = 0;
+    clear_suspended_clients(thread_id_no);
+    spectator_event(thread_id_no, "SPEC_END");
     //  NOTE: we only want to call MC_EndGame() when the program exits,
     //  not when an individual math game ends.
     //  MC_EndGame();
@@ -1508,6 +2522,99 @@ int send_player_updates(int thread_id_no)
 }
 
 
+/* Bring a player who has just resumed up to date in one go: the wave,  */
+/* the questions left, and every question still in play (with the time  */
+/* left until launch for those not yet launched).  The counters and the  */
+/* score table follow:                                                   */
+int send_game_snapshot(int thread_id_no, int i)
+{
+    char buf[NET_BUF_LEN];
+    int j, num_active = 0;
+    Uint32 now = SDL_GetTicks();
+    srv_quest_type* q = slave_thread[thread_id_no].srv_game.active_list;
+
+    for(j = 0; j < MAX_MAX_COMETS; j++)
+        if(q[j].in_use)
+            num_active++;
+
+    snprintf(buf, NET_BUF_LEN, "%s\t%d\t%d\t%d", "GAME_SNAPSHOT",
+            slave_thread[thread_id_no].srv_game.wave,
+            MC_TotalQuestionsLeft(lan_game_settings),
+            num_active);
+    if(!transmit(thread_id_no, i, buf))
+        return 0;
+
+    for(j = 0; j < MAX_MAX_COMETS; j++)
+    {
+        Uint32 delay = 0;
+        if(!q[j].in_use)
+            continue;
+        if((Sint32)(q[j].spawn_time - now) > 0)
+            delay = q[j].spawn_time - now;
+        snprintf(buf, NET_BUF_LEN,"%s\t%d\t%d\t%d\t%d\t%s\t%s\n",
+                "PREFETCH_QUESTION",
+                (int)delay,
+                q[j].fc.question_id,
+                q[j].fc.difficulty,
+                q[j].fc.answer,
+                q[j].fc.answer_string,
+                q[j].fc.formula_string);
+        if(!transmit(thread_id_no, i, buf))
+            return 0;
+    }
+
+    send_counter_updates(thread_id_no);
+    send_player_updates(thread_id_no);
+    return 1;
+}
+
+
+/* Keep a record of questions in play so we can tell resuming players: */
+void track_question(int thread_id_no, MC_FlashCard* fc, Uint32 spawn_time)
+{
+    int j;
+    srv_quest_type* q = slave_thread[thread_id_no].srv_game.active_list;
+
+    if(!fc)
+        return;
+    for(j = 0; j < MAX_MAX_COMETS; j++)
+    {
+        if(!q[j].in_use)
+        {
+            MC_CopyCard(fc, &(q[j].fc));
+            q[j].spawn_time = spawn_time;
+            q[j].in_use = 1;
+            return;
+        }
+    }
+    DEBUGMSG(debug_lan, "track_question() - no free slot for question %d\n", fc->question_id);
+}
+
+
+void untrack_question(int thread_id_no, int quest_id)
+{
+    int j;
+    srv_quest_type* q = slave_thread[thread_id_no].srv_game.active_list;
+
+    for(j = 0; j < MAX_MAX_COMETS; j++)
+    {
+        if(q[j].in_use && q[j].fc.question_id == quest_id)
+        {
+            q[j].in_use = 0;
+            return;
+        }
+    }
+}
+
+
+void reset_tracked_questions(int thread_id_no)
+{
+    int j;
+    for(j = 0; j < MAX_MAX_COMETS; j++)
+        slave_thread[thread_id_no].srv_game.active_list[j].in_use = 0;
+}
+
+
 /* Sends a new question to all clients: */
 int add_question(int thread_id_no, MC_FlashCard* fc)
 {
@@ -1527,6 +2634,32 @@ int add_question(int thread_id_no, MC_FlashCard* fc)
     return 1;
 }
 
+/* Sends a question to all clients ahead of time, with the number of */
+/* msec after which they should launch it as a comet.  The layout     */
+/* after the delay field is identical to ADD_QUESTION:               */
+int prefetch_question(int thread_id_no, MC_FlashCard* fc, Uint32 delay)
+{
+    char buf[NET_BUF_LEN];
+
+    if(!fc)
+        return 0;
+
+    snprintf(buf, NET_BUF_LEN,"%s\t%d\t%d\t%d\t%d\t%s\t%s\n",
+            "PREFETCH_QUESTION",
+            (int)delay,
+            fc->question_id,
+            fc->difficulty,
+            fc->answer,
+            fc->answer_string,
+            fc->formula_string);
+    transmit_all(thread_id_no, buf);
+
+    snprintf(buf, NET_BUF_LEN, "%s\t%d\t%s", "SPEC_QUESTION",
+            fc->question_id, fc->formula_string);
+    spectator_event(thread_id_no, buf);
+    return 1;
+}
+
 /* Tells all clients to remove a specific question: */
 int remove_question(int thread_id_no, int quest_id, int answered_by)
 {
@@ -1592,9 +2725,10 @@ int transmit(int thread_id_no, int i, char* msg)
     if(SDLNet_TCP_Send(slave_thread[thread_id_no].client[i].sock, buf, NET_BUF_LEN) < NET_BUF_LEN)
     {
         fprintf(stderr, "The client %s is disconnected\n", slave_thread[thread_id_no].client[i].name);
-        remove_client(thread_id_no, i);
+        drop_client(thread_id_no, i);
         return 0;
     }
+    record_msg(LANLOG_SEND, i, buf);
     //Success:
     return 1;
 }
@@ -1615,6 +2749,77 @@ int transmit_all(int thread_id_no, char* msg)
 
 
 
+// recording of LAN traffic:
+
+// Start recording to the named file for later replay - see transtruct.h
+// for the format.  Returns 1 on success:
+int record_open(const char* filename)
+{
+    Uint8 version = LANLOG_VERSION;
+
+    record_close();
+    record_fp = fopen(filename, "wb");
+    if(!record_fp)
+    {
+        fprintf(stderr, "Could not open %s for recording\n", filename);
+        return 0;
+    }
+    fwrite(LANLOG_MAGIC, 1, strlen(LANLOG_MAGIC), record_fp);
+    fwrite(&version, 1, 1, record_fp);
+    record_start = SDL_GetTicks();
+    fprintf(stderr, "Recording LAN traffic to %s\n", filename);
+    return 1;
+}
+
+
+// A connection changing index, e.g. a player resuming on a connection
+// that was held as a handshake:
+void record_move(int from, int to)
+{
+    char buf[NET_BUF_LEN];
+
+    snprintf(buf, NET_BUF_LEN, "%d", from);
+    record_msg(LANLOG_MOVE, to, buf);
+}
+
+
+// Messages go out in NET_BUF_LEN blocks but are rarely more than a few
+// dozen characters, so we only keep up to the terminating null:
+void record_msg(int type, int i, const char* msg)
+{
+    Uint8 header[LANLOG_HEADER_LEN];
+    size_t len;
+
+    if(!record_fp)
+        return;
+
+    len = msg ? strlen(msg) : 0;
+    if(len > NET_BUF_LEN - 1)
+        len = NET_BUF_LEN - 1;
+    SDLNet_Write32(SDL_GetTicks() - record_start, header);
+    header[4] = (Uint8)type;
+    header[5] = (Uint8)i;
+    SDLNet_Write16((Uint16)len, header + 6);
+    if(fwrite(header, 1, LANLOG_HEADER_LEN, record_fp) != LANLOG_HEADER_LEN
+            || fwrite(msg, 1, len, record_fp) != len)
+    {
+        fprintf(stderr, "Error writing LAN recording - recording stopped\n");
+        record_close();
+    }
+}
+
+
+void record_close(void)
+{
+    if(record_fp)
+    {
+        fclose(record_fp);
+        record_fp = NULL;
+    }
+}
+
+
+
 //Here we read up to max_length bytes from stdin into the buffer.
 //The first '\n' in the buffer, if present, is replaced with a
 //null terminator.
@@ -49,6 +49,10 @@ typedef struct client_type {
     char name[NAME_SIZE];
     int score;
     TCPsocket sock;
+    Uint32 session_token;  //lets a client that drops mid-game reclaim its slot
+    int suspended;         //connection lost mid-game, slot held for resume
+    Uint32 suspend_time;   //when the connection was lost
+    int suspend_unannounced;  //other players not yet told of the suspension
 }client_type;
 
 
@@ -85,6 +89,8 @@ int SrvrGameInProgress(void);
 void StopServer(void);
 /* Stop currently running game: */
 void StopSrvrGame(int thread_id_no);
+/* Load lesson file for the next game, without restarting the server: */
+int SrvrLoadLesson(const char* lesson_name);
 
 #endif
 
@@ -37,10 +37,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "titlescreen.h"
 #include "highscore.h"
 #include "mysetenv.h"
+#include "draw_utils.h"
+#include "tasks.h"
+#include "archive.h"
 
 
 /* SDL includes: -----------------*/
 #include "SDL.h"
+#include "SDL_thread.h"
 
 #ifndef NOSOUND
 #include "SDL_mixer.h"
@@ -90,6 +94,11 @@ const int flipped_img[] = {
 };
 
 
+/* How many activities are using each bundle of images, and the */
+/* thread prefetching one, if any:                               */
+static int bundle_users[NUM_BUNDLES];
+static SDL_Thread* prefetch_thread = NULL;
+
 #ifndef NOSOUND
 Mix_Chunk* sounds[NUM_SOUNDS];
 Mix_Music* musics[NUM_MUSICS];
@@ -114,6 +123,10 @@ void initialize_SDL(void);
 void load_data_files(void);
 void generate_flipped_images(void);
 void generate_blended_images(void);
+static int finish_generated_images(void);
+static void free_generated_images(void);
+static int prefetch_worker(void* data);
+static void prefetch_wait(void);
 
 //int initialize_game_options(void);
 void seticon(void);
@@ -129,6 +142,8 @@ void cleanup_memory(void);
 /* --- OK, now we have eight. --- */
 void setup(int argc, char * argv[])
 {
+    Uint32 start;
+
     /* Read debugging args from command line */
     handle_debug_args(argc, argv);
     /* initialize locale from system settings: */
@@ -141,13 +156,16 @@ void setup(int argc, char * argv[])
     /* initialize default user's options (for resolution)*/
     initialize_options_user();
     /* SDL setup in own function:*/
+    start = SDL_GetTicks();
     initialize_SDL();
-    /* Read image and sound files: */
+    tasks_note_time("SDL", start);
+    /* Read sound files and the images used everywhere - the rest */
+    /* are loaded by each activity as it starts:                  */
     load_data_files();
-    /* Generate flipped versions of walking images */
-    generate_flipped_images();
-    /* Generate blended images (e.g., igloos) */
-    generate_blended_images();
+    tasks_report();
+    /* Comets is usually played first, so start on its images while */
+    /* the title screen is up:                                      */
+    prefetch_bundle(BUNDLE_COMETS);
     /* Note that the per-user options will be set after the call to
        titlescreen, to allow for user-login to occur. 
 
@@ -156,7 +174,6 @@ void setup(int argc, char * argv[])
 }
 
 
-
 void initialize_locale(const char* desired_loc)
 {
     const char *s1, *s2, *s3, *s4;
@@ -789,21 +806,141 @@ void load_data_files(void)
 {
     /* Tell libt4k_common where TuxMath-specific data can be found */
     T4K_AddDataPrefix(DATA_PREFIX);
-    if (!load_sound_data())
-    {
-        fprintf(stderr, "\nCould not load sound file - attempting to proceed without sound.\n");
-        Opts_SetSoundHWAvailable(0);
-    }
+    /* and load from the packed archive of it, if it was installed: */
+    archive_open(DATA_PREFIX "/" ARCHIVE_NAME);
+
+    /* The sounds are decoded along with the common images: */
+#ifndef NOSOUND
+    queue_sound_data();
+#endif
 
     /* This now has to come after loading the font, because it replaces
        a couple of images with translatable versions. */
     /* NOTE now the text code will load the font if it isn't already loaded */
-    if (!load_image_data())
+    if (!load_bundle(BUNDLE_COMMON))
     {
         fprintf(stderr, "\nCould not load image file - exiting!\n");
         cleanup_on_error();
         exit(1);
     }
+
+#ifndef NOSOUND
+    if (!finish_sound_data())
+    {
+        fprintf(stderr, "\nCould not load sound file - attempting to proceed without sound.\n");
+        Opts_SetSoundHWAvailable(0);
+    }
+#endif
+}
+
+
+
+/* Load a bundle of images, if it isn't loaded already, decoding them on */
+/* as many threads as we have CPUs - along with anything queued before,  */
+/* e.g. the sounds at startup.  Each load_bundle() that succeeds needs a */
+/* release_bundle() once the activity using the images is over:          */
+int load_bundle(int bundle)
+{
+    Uint32 start;
+    int ok;
+
+    if (bundle < 0 || bundle >= NUM_BUNDLES)
+        return 0;
+    if (bundle_users[bundle]++ > 0)
+        return 1;
+
+    DEBUGMSG(debug_setup, "load_bundle(): loading bundle %d\n", bundle);
+
+    /* A bundle being prefetched has to finish first: */
+    prefetch_wait();
+
+    /* The files are decoded on the worker threads, then converted for */
+    /* the screen here - along with the images made from them, as      */
+    /* neither t4k_common nor SDL's video code is safe to use on more   */
+    /* than one thread:                                                */
+    start = SDL_GetTicks();
+    queue_image_data(bundle);
+    tasks_note_time("queue", start);
+
+    ok = tasks_run();
+    DEBUGMSG(debug_setup, "load_bundle(): tasks_run() returned %d\n", ok);
+
+    start = SDL_GetTicks();
+    ok = finish_image_data(bundle);
+    tasks_note_time("finish", start);
+    if (ok && bundle == BUNDLE_COMETS)
+    {
+        start = SDL_GetTicks();
+        generate_flipped_images();
+        generate_blended_images();
+        ok = finish_generated_images();
+        tasks_note_time("generate", start);
+    }
+
+    if (!ok)
+    {
+        release_bundle(bundle);
+        return 0;
+    }
+    return 1;
+}
+
+
+void release_bundle(int bundle)
+{
+    int i, keep = 0;
+
+    if (bundle < 0 || bundle >= NUM_BUNDLES || bundle_users[bundle] == 0)
+        return;
+    if (--bundle_users[bundle] > 0)
+        return;
+
+    DEBUGMSG(debug_setup, "release_bundle(): freeing bundle %d\n", bundle);
+    prefetch_wait();
+
+    if (bundle == BUNDLE_COMETS)
+        free_generated_images();
+    for (i = 0; i < NUM_BUNDLES; i++)
+        if (bundle_users[i] > 0)
+            keep |= 1 << i;
+    free_image_data(bundle, keep);
+}
+
+
+/* Start decoding a bundle in the background (e.g. while a menu is  */
+/* up), so that load_bundle() only has to convert it for the screen. */
+/* Only one bundle at a time:                                        */
+void prefetch_bundle(int bundle)
+{
+    if (bundle < 0 || bundle >= NUM_BUNDLES || bundle_users[bundle] > 0)
+        return;
+    prefetch_wait();
+    if (!begin_prefetch_image_data(bundle))
+        return;
+
+    prefetch_thread = SDL_CreateThread(prefetch_worker, (void*)(long)bundle);
+    if (!prefetch_thread)
+        DEBUGMSG(debug_setup, "prefetch_bundle(): couldn't start thread\n");
+}
+
+
+static int prefetch_worker(void* data)
+{
+    int bundle = (int)(long)data;
+    Uint32 start = SDL_GetTicks();
+    int ok = prefetch_image_data(bundle);
+
+    DEBUGMSG(debug_setup, "prefetch_worker(): bundle %d %s in %u ms\n", bundle,
+             ok ? "decoded" : "not all decoded", SDL_GetTicks() - start);
+    return ok;
+}
+
+
+static void prefetch_wait(void)
+{
+    if (prefetch_thread)
+        SDL_WaitThread(prefetch_thread, NULL);
+    prefetch_thread = NULL;
 }
 
 
@@ -819,30 +956,100 @@ void generate_flipped_images(void)
         flipped_img_lookup[i] = 0;
 
     for (i = 0; i < NUM_FLIPPED_IMAGES; i++) {
-        flipped_images[i] = T4K_Flip(images[flipped_img[i]],1,0);
+        flipped_images[i] = NULL;
+        if (images[flipped_img[i]])
+            flipped_images[i] = T4K_Flip(images[flipped_img[i]], 1, 0);
         flipped_img_lookup[flipped_img[i]] = i;
     }
 }
 
+
+/* Each blended igloo is "img1" blended with "img2" (or with nothing, */
+/* if img2 is -1) by "ratio" - or, if ratio is 1, just img1 itself:   */
+static const struct {
+    int img1;
+    int img2;
+    float ratio;
+} igloo_blends[NUM_BLENDED_IGLOOS] = {
+    {IMG_IGLOO_REBUILDING1, -1, 0.06},
+    {IMG_IGLOO_REBUILDING1, -1, 0.125},
+    {IMG_IGLOO_REBUILDING1, -1, 0.185},
+    {IMG_IGLOO_REBUILDING1, -1, 0.25},
+    {IMG_IGLOO_REBUILDING1, -1, 0.5},
+    {IMG_IGLOO_REBUILDING1, -1, 0.75},
+    {IMG_IGLOO_REBUILDING1, -1, 1},
+    {IMG_IGLOO_REBUILDING2, IMG_IGLOO_REBUILDING1, 0.25},
+    {IMG_IGLOO_REBUILDING2, IMG_IGLOO_REBUILDING1, 0.5},
+    {IMG_IGLOO_REBUILDING2, IMG_IGLOO_REBUILDING1, 0.75},
+    {IMG_IGLOO_REBUILDING2, -1, 1},
+    {IMG_IGLOO_INTACT, IMG_IGLOO_REBUILDING2, 0.25},
+    {IMG_IGLOO_INTACT, IMG_IGLOO_REBUILDING2, 0.5},
+    {IMG_IGLOO_INTACT, IMG_IGLOO_REBUILDING2, 0.75},
+    {IMG_IGLOO_INTACT, -1, 1}
+};
+
+
 /* Created images that are blends of two other images to smooth out
    the transitions. */
 void generate_blended_images(void)
 {
-    blended_igloos[0] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.06);
-    blended_igloos[1] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.125);
-    blended_igloos[2] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.185);
-    blended_igloos[3] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.25);
-    blended_igloos[4] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.5);
-    blended_igloos[5] = T4K_Blend(images[IMG_IGLOO_REBUILDING1],NULL,0.75);
-    blended_igloos[6] = images[IMG_IGLOO_REBUILDING1];
-    blended_igloos[7] = T4K_Blend(images[IMG_IGLOO_REBUILDING2],images[IMG_IGLOO_REBUILDING1],0.25);
-    blended_igloos[8] = T4K_Blend(images[IMG_IGLOO_REBUILDING2],images[IMG_IGLOO_REBUILDING1],0.5);
-    blended_igloos[9] = T4K_Blend(images[IMG_IGLOO_REBUILDING2],images[IMG_IGLOO_REBUILDING1],0.75);
-    blended_igloos[10] = images[IMG_IGLOO_REBUILDING2];
-    blended_igloos[11] = T4K_Blend(images[IMG_IGLOO_INTACT],images[IMG_IGLOO_REBUILDING2],0.25);
-    blended_igloos[12] = T4K_Blend(images[IMG_IGLOO_INTACT],images[IMG_IGLOO_REBUILDING2],0.5);
-    blended_igloos[13] = T4K_Blend(images[IMG_IGLOO_INTACT],images[IMG_IGLOO_REBUILDING2],0.75);
-    blended_igloos[14] = images[IMG_IGLOO_INTACT];
+    SDL_Surface* img2;
+    int i;
+
+    for (i = 0; i < NUM_BLENDED_IGLOOS; i++) {
+        /* (the unblended ones are filled in by finish_generated_images) */
+        blended_igloos[i] = NULL;
+        if (igloo_blends[i].ratio == 1 || !images[igloo_blends[i].img1])
+            continue;
+        img2 = NULL;
+        if (igloo_blends[i].img2 != -1)
+        {
+            img2 = images[igloo_blends[i].img2];
+            if (!img2)
+                continue;
+        }
+        blended_igloos[i] = T4K_Blend(images[igloo_blends[i].img1], img2, igloo_blends[i].ratio);
+    }
+}
+
+
+static void free_generated_images(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_FLIPPED_IMAGES; i++)
+    {
+        if (flipped_images[i])
+            SDL_FreeSurface(flipped_images[i]);
+        flipped_images[i] = NULL;
+    }
+    for (i = 0; i < NUM_BLENDED_IGLOOS; i++)
+    {
+        /* (the unblended ones belong to images[]) */
+        if (blended_igloos[i] && igloo_blends[i].ratio != 1)
+            SDL_FreeSurface(blended_igloos[i]);
+        blended_igloos[i] = NULL;
+    }
+}
+
+
+/* Fill in the blended igloos that are just the images themselves - */
+/* returns 1 if every generated image is there:                      */
+static int finish_generated_images(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_FLIPPED_IMAGES; i++)
+        if (!flipped_images[i])
+            return 0;
+    for (i = 0; i < NUM_BLENDED_IGLOOS; i++)
+    {
+        if (igloo_blends[i].ratio == 1)
+            blended_igloos[i] = images[igloo_blends[i].img1];
+        if (!blended_igloos[i])
+            return 0;
+    }
+    return 1;
 }
 
 
@@ -881,6 +1088,16 @@ void cleanup_memory(void)
     int i;
 
     /* Free all images and sounds used by SDL: */
+    prefetch_wait();
+    if (bundle_users[BUNDLE_COMETS] > 0)
+        free_generated_images();
+    for (i = 0; i < NUM_BUNDLES; i++)
+    {
+        bundle_users[i] = 0;
+        /* (including any prefetched but never used) */
+        free_image_data(i, 0);
+    }
+
     for (i = 0; i < NUM_IMAGES; i++)
     {
         if (images[i])
@@ -943,6 +1160,9 @@ void cleanup_memory(void)
         lesson_list_goldstars = NULL;
     }
 
+    /* Glyphs cached for drawing numbers: */
+    free_glyph_atlases();
+
     /* frees the game_options struct: */
     Opts_Cleanup();
 
@@ -962,6 +1182,8 @@ void cleanup_memory(void)
 
     /* Cleanup SDL+friends and anything else used by t4k_common: */
     CleanupT4KCommon();
+
+    archive_close();
 }
 
 
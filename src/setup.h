@@ -41,6 +41,10 @@ void setup(int argc, char * argv[]);
 void cleanup(void);
 void cleanup_on_error(void);
 extern void initialize_options_user(void);
+/* Images are loaded in bundles (see fileops.h) as they're needed: */
+int load_bundle(int bundle);
+void release_bundle(int bundle);
+void prefetch_bundle(int bundle);
 /* for debugging gettext behavior */
 void print_locale_info(FILE* fp);
 #endif
@@ -0,0 +1,250 @@
+/*
+   tasks.c:
+
+   Runs the independent parts of startup (reading and decoding image
+   and sound files) on a pool of worker threads, in the order they were
+   added, and times each phase of startup.  Tasks must not use
+   t4k_common or SDL's video functions, which are only safe on the main
+   thread - so the images made from others (flips and blends) are made
+   afterwards, on the main thread, and nothing here waits on anything.
+
+Copyright 2011.
+Project email: <tuxmath-devel@lists.sourceforge.net>
+Project website: http://tux4kids.alioth.debian.org
+
+tasks.c is part of "Tux, of Math Command", a.k.a. "tuxmath".
+
+Tuxmath is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+Tuxmath is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#include "globals.h"
+#include "tasks.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+typedef struct task_type {
+    const char* phase;
+    int (*func)(int);
+    int arg;
+    int ok;
+    Uint32 start;
+    Uint32 end;
+} task_type;
+
+/* Startup phases, for the timing report: */
+typedef struct phase_type {
+    const char* name;
+    int num_tasks;
+    Uint32 work;        /* total time in its tasks, on all threads */
+    Uint32 start;
+    Uint32 end;
+} phase_type;
+
+static task_type tasks[MAX_TASKS];
+static int num_tasks = 0;
+static phase_type phases[MAX_TASK_PHASES];
+static int num_phases = 0;
+static int num_workers = 1;
+
+/* The next task for a worker to take, under task_lock: */
+static int next_task = 0;
+static SDL_mutex* task_lock = NULL;
+
+static int worker(void* unused);
+static phase_type* get_phase(const char* name);
+
+
+/* Returns the new task's id, or -1 if there's no room (in which */
+/* case the caller should just do the work itself):              */
+int task_add(const char* phase, int (*func)(int), int arg)
+{
+    task_type* t;
+
+    if (num_tasks >= MAX_TASKS)
+        return -1;
+
+    t = &tasks[num_tasks];
+    t->phase = phase;
+    t->func = func;
+    t->arg = arg;
+    t->ok = 0;
+    t->start = t->end = 0;
+    return num_tasks++;
+}
+
+
+/* Run every task added so far, on this thread and as many more as   */
+/* there are other CPUs, and forget them.  Returns 1 if all of them  */
+/* succeeded.  If threads can't be started, everything just runs     */
+/* here:                                                             */
+int tasks_run(void)
+{
+    SDL_Thread* threads[MAX_TASK_WORKERS];
+    int num_threads = 0;
+    int i, failed = 0;
+
+    if (num_tasks == 0)
+        return 1;
+
+    next_task = 0;
+    num_workers = tasks_count_cpus();
+    if (num_workers > MAX_TASK_WORKERS)
+        num_workers = MAX_TASK_WORKERS;
+
+    task_lock = SDL_CreateMutex();
+    if (task_lock)
+    {
+        for (i = 1; i < num_workers; i++)
+        {
+            threads[num_threads] = SDL_CreateThread(worker, NULL);
+            if (!threads[num_threads])
+                break;
+            num_threads++;
+        }
+    }
+    num_workers = num_threads + 1;
+    DEBUGMSG(debug_setup, "tasks_run(): %d tasks on %d threads\n", num_tasks, num_workers);
+
+    worker(NULL);
+    for (i = 0; i < num_threads; i++)
+        SDL_WaitThread(threads[i], NULL);
+
+    if (task_lock)
+        SDL_DestroyMutex(task_lock);
+    task_lock = NULL;
+
+    /* Add up the time spent in each phase: */
+    for (i = 0; i < num_tasks; i++)
+    {
+        phase_type* p = get_phase(tasks[i].phase);
+
+        if (!tasks[i].ok)
+            failed = 1;
+        if (!p || !tasks[i].start)
+            continue;
+        if (p->num_tasks == 0 || tasks[i].start < p->start)
+            p->start = tasks[i].start;
+        if (p->num_tasks == 0 || tasks[i].end > p->end)
+            p->end = tasks[i].end;
+        p->work += tasks[i].end - tasks[i].start;
+        p->num_tasks++;
+    }
+
+    num_tasks = 0;
+    return !failed;
+}
+
+
+/* Record a phase done outside the pool, from "start" until now: */
+void tasks_note_time(const char* phase, Uint32 start)
+{
+    phase_type* p = get_phase(phase);
+
+    if (!p)
+        return;
+    p->start = start;
+    p->end = SDL_GetTicks();
+    p->work = p->end - start;
+}
+
+
+void tasks_report(void)
+{
+    int i;
+    Uint32 first = 0, last = 0;
+
+    DEBUGCODE(debug_setup)
+    {
+        fprintf(stderr, "\nStartup times (%d threads):\n", num_workers);
+        fprintf(stderr, "  %-12s %6s %10s %10s\n", "phase", "tasks", "work (ms)", "wall (ms)");
+        for (i = 0; i < num_phases; i++)
+        {
+            if (i == 0 || phases[i].start < first)
+                first = phases[i].start;
+            if (phases[i].end > last)
+                last = phases[i].end;
+            fprintf(stderr, "  %-12s %6d %10u %10u\n", phases[i].name,
+                    phases[i].num_tasks, phases[i].work,
+                    phases[i].end - phases[i].start);
+        }
+        fprintf(stderr, "  %-12s %6s %10s %10u\n\n", "total", "", "", last - first);
+    }
+}
+
+
+/* How many CPUs there are to share work between: */
+int tasks_count_cpus(void)
+{
+#if defined(WIN32)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return n > 0 ? n : 1;
+#else
+    return 1;
+#endif
+}
+
+
+/* Take tasks until there are none left: */
+static int worker(void* unused)
+{
+    int i;
+
+    for (;;)
+    {
+        if (task_lock)
+            SDL_mutexP(task_lock);
+        i = next_task < num_tasks ? next_task++ : -1;
+        if (task_lock)
+            SDL_mutexV(task_lock);
+        if (i < 0)
+            return 0;
+
+        tasks[i].start = SDL_GetTicks();
+        tasks[i].ok = tasks[i].func(tasks[i].arg);
+        tasks[i].end = SDL_GetTicks();
+        /* (so no phase is ever timed from 0) */
+        if (!tasks[i].start)
+            tasks[i].start = tasks[i].end = 1;
+    }
+}
+
+
+static phase_type* get_phase(const char* name)
+{
+    int i;
+
+    for (i = 0; i < num_phases; i++)
+        if (strcmp(phases[i].name, name) == 0)
+            return &phases[i];
+    if (num_phases >= MAX_TASK_PHASES)
+        return NULL;
+
+    memset(&phases[num_phases], 0, sizeof(phase_type));
+    phases[num_phases].name = name;
+    return &phases[num_phases++];
+}
@@ -0,0 +1,18 @@
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <SDL_types.h>
+
+#define MAX_TASKS 256
+#define MAX_TASK_PHASES 16
+#define MAX_TASK_WORKERS 8
+
+/* A small pool of worker threads for startup work - see tasks.c.  */
+/* Each task calls func(arg), which returns 1 if successful:        */
+int task_add(const char* phase, int (*func)(int), int arg);
+int tasks_run(void);
+void tasks_note_time(const char* phase, Uint32 start);
+void tasks_report(void);
+int tasks_count_cpus(void);
+
+#endif
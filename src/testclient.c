@@ -248,6 +248,16 @@ int game_check_msgs(void)
             else  
                 print_current_quests();
         }
+        else if(strncmp(buf, "PREFETCH_QUESTION", strlen("PREFETCH_QUESTION")) == 0)
+        {
+            //No falling comets here, so just show it right away - skipping
+            //the delay field leaves the same layout as ADD_QUESTION:
+            char* p = strchr(buf, '\t');
+            if(!p || !add_quest_recvd(p + 1))
+                fprintf(stderr, "PREFETCH_QUESTION received but could not add question\n");
+            else
+                print_current_quests();
+        }
         else if(strncmp(buf, "REMOVE_QUESTION", strlen("REMOVE_QUESTION")) == 0)
         {
             if(!remove_quest_recvd(buf)) //remove the question with id in buf
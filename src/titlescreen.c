@@ -34,6 +34,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "fileops.h"
 #include "setup.h"
 #include "menu.h"
+#include "blend.h"
 
 /* --- Data Structure for Dirty Blitting --- */
 SDL_Rect srcupdate[MAX_UPDATES];
@@ -160,7 +161,7 @@ void TitleScreen(void)
     start_time = SDL_GetTicks();
 
     /* display the Standby screen */
-    SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
+    blend_fill(screen, NULL, SDL_MapRGB(screen->format, 0, 0, 0));
 
     logo = T4K_LoadImage(standby_path, IMG_REGULAR);
     if(logo)
@@ -171,7 +172,7 @@ void TitleScreen(void)
         logo_rect.w = logo->w;
         logo_rect.h = logo->h;
 
-        SDL_BlitSurface(logo, NULL, screen, &logo_rect);
+        blend_blit(logo, NULL, screen, &logo_rect);
         SDL_FreeSurface(logo);
     }
 
@@ -184,7 +185,7 @@ void TitleScreen(void)
     LoadMenus();
 
     /* load backgrounds */
-    T4K_LoadBothBkgds(bkg_path, &fs_bkg, &win_bkg);
+    load_both_bkgds(bkg_path, &fs_bkg, &win_bkg);
     T4K_SetMenuSounds(NULL, sounds[SND_POP], sounds[SND_TOCK]);
     T4K_OnResolutionSwitch(&HandleTitleScreenResSwitch);
 
@@ -239,7 +240,7 @@ void TitleScreen(void)
         {
             /* Make sure background gets drawn (since trans_wipe() doesn't */
             /* seem to work reliably as of yet):                          */
-            SDL_BlitSurface(current_bkg(), NULL, screen, &bkg_rect);
+            blend_blit(current_bkg(), NULL, screen, &bkg_rect);
         }
     }
 
@@ -259,9 +260,9 @@ void TitleScreen(void)
         {
             /* Draw the entire background, over a black screen if necessary */
             if(current_bkg()->w != screen->w || current_bkg()->h != screen->h)
-                SDL_FillRect(screen, &screen->clip_rect, 0);
+                blend_fill(screen, &screen->clip_rect, 0);
 
-            SDL_BlitSurface(current_bkg(), NULL, screen, &bkg_rect);
+            blend_blit(current_bkg(), NULL, screen, &bkg_rect);
 
             /* calculate shifts */
             tux_pix_skip = (tux_anim.y - tux_rect.y) / (ANIM_FRAMES - i);
@@ -270,8 +271,8 @@ void TitleScreen(void)
             title_anim.x -= title_pix_skip;
 
             /* update screen */
-            SDL_BlitSurface(Tux->frame[0], NULL, screen, &tux_anim);
-            SDL_BlitSurface(title, NULL, screen, &title_anim);
+            blend_blit(Tux->frame[0], NULL, screen, &tux_anim);
+            blend_blit(title, NULL, screen, &title_anim);
 
             SDL_UpdateRect(screen, tux_anim.x, tux_anim.y, tux_anim.w,
                     min(tux_anim.h + tux_pix_skip, screen->h - tux_anim.y));
@@ -306,9 +307,9 @@ void TitleScreen(void)
 
 void DrawTitleScreen(void)
 {
-    SDL_BlitSurface(current_bkg(), NULL, screen, &bkg_rect);
-    SDL_BlitSurface(Tux->frame[0], NULL, screen, &tux_rect);
-    SDL_BlitSurface(title, NULL, screen, &title_rect);
+    blend_blit(current_bkg(), NULL, screen, &bkg_rect);
+    blend_blit(Tux->frame[0], NULL, screen, &tux_rect);
+    blend_blit(title, NULL, screen, &title_rect);
     //SDL_UpdateRect(screen, 0, 0, 0, 0);
 }
 
@@ -444,8 +445,8 @@ void HandleTitleScreenAnimations_Reset(bool reset)
     if (Tux && tux_frame)
     {
         /* Redraw background to keep edges anti-aliased properly: */
-        SDL_BlitSurface(current_bkg(),&tux_rect, screen, &tux_rect);
-        SDL_BlitSurface(Tux->frame[tux_frame - 1], NULL, screen, &tux_rect);
+        blend_blit(current_bkg(),&tux_rect, screen, &tux_rect);
+        blend_blit(Tux->frame[tux_frame - 1], NULL, screen, &tux_rect);
         T4K_UpdateRect(screen, &tux_rect);
     }
 
@@ -453,7 +454,7 @@ void HandleTitleScreenAnimations_Reset(bool reset)
         //who knows why GetMouseState() doesn't take Sint16's...
         SDL_GetMouseState((int*)(&cursor.x), (int*)(&cursor.y));
         cursor.x -= egg->w / 2; //center vertically
-        SDL_BlitSurface(egg, NULL, screen, &cursor);
+        blend_blit(egg, NULL, screen, &cursor);
         T4K_UpdateRect(screen, &cursor);
     }
 
@@ -564,7 +565,7 @@ void ShowMessageWrap( int font_size, const char* str )
 
         if (stop_button)
         {
-            SDL_BlitSurface(stop_button, NULL, screen, &stop_rect);
+            blend_blit(stop_button, NULL, screen, &stop_rect);
         }
         T4K_DrawButton( &loc, 50, SEL_RGBA );
 
@@ -610,8 +611,8 @@ void ShowMessageWrap( int font_size, const char* str )
             }
 
             /* page arrows */
-            SDL_BlitSurface(arrow, &srcleft, screen, &rleft);
-            SDL_BlitSurface(arrow, &srcright, screen, &rright);
+            blend_blit(arrow, &srcleft, screen, &rleft);
+            blend_blit(arrow, &srcright, screen, &rright);
         }
 
         //rtext.x = loc.x + 10;
@@ -625,7 +626,7 @@ void ShowMessageWrap( int font_size, const char* str )
                 /* Center text horizontally: */
                 rtext.x = loc.x + loc.w/2 - s1->w/2;
                 rtext.y += (s1->h+15);  
-                SDL_BlitSurface( s1, NULL, screen, &rtext );
+                blend_blit( s1, NULL, screen, &rtext );
 
                 SDL_FreeSurface( s1 );
                 s1 = NULL;
@@ -748,7 +749,7 @@ void ShowMessage(int font_size, const char* str1, const char* str2,
     DrawTitleScreen();
     /* Red "Stop" circle in upper right corner to go back to main menu: */
     if (stop_button)
-        SDL_BlitSurface(stop_button, NULL, screen, &stop_rect);
+        blend_blit(stop_button, NULL, screen, &stop_rect);
 
     /* Draw shaded background for better legibility: */ 
     loc.x = screen->w * 0.25;
@@ -762,24 +763,24 @@ void ShowMessage(int font_size, const char* str1, const char* str2,
     if (s1)
     {
         loc.x = (screen->w / 2) - (s1->w/2); loc.y = screen->h * 0.2;
-        SDL_BlitSurface( s1, NULL, screen, &loc);
+        blend_blit( s1, NULL, screen, &loc);
     }
     if (s2)
     {
         loc.x = (screen->w / 2) - (s2->w/2); loc.y = screen->h * 0.35;
-        SDL_BlitSurface( s2, NULL, screen, &loc);
+        blend_blit( s2, NULL, screen, &loc);
     }
     if (s3)
     {
         //loc.x = 320 - (s3->w/2); loc.y = 300;
         loc.x = (screen->w / 2) - (s3->w/2); loc.y = screen->h * 0.5;
-        SDL_BlitSurface( s3, NULL, screen, &loc);
+        blend_blit( s3, NULL, screen, &loc);
     }
     if (s4)
     {
         //loc.x = 320 - (s4->w/2); loc.y = 340;
         loc.x = (screen->w / 2) - (s4->w/2); loc.y = screen->h * 0.65;
-        SDL_BlitSurface( s4, NULL, screen, &loc);
+        blend_blit( s4, NULL, screen, &loc);
     }
 
     /* and update: */
@@ -1097,7 +1098,7 @@ int handle_easter_egg(const SDL_Event* evt)
         {
             SDL_ShowCursor(SDL_ENABLE);
             //SDL_FillRect(screen, &cursor, 0);
-            SDL_BlitSurface(current_bkg(), NULL, screen, &bkg_rect); //cover egg up once more
+            blend_blit(current_bkg(), NULL, screen, &bkg_rect); //cover egg up once more
             SDL_WarpMouse(cursor.x, cursor.y);
             SDL_UpdateRect(screen, cursor.x, cursor.y, cursor.w, cursor.h); //egg->x, egg->y, egg->w, egg->h);
             egg_active = 0;
@@ -1115,8 +1116,8 @@ int handle_easter_egg(const SDL_Event* evt)
             //animate
             while (tuxframe != 0)
             {
-                SDL_BlitSurface(current_bkg(), &tux_rect, screen, &tux_rect);
-                SDL_BlitSurface(Tux->frame[--tuxframe], NULL, screen, &tux_rect);
+                blend_blit(current_bkg(), &tux_rect, screen, &tux_rect);
+                blend_blit(Tux->frame[--tuxframe], NULL, screen, &tux_rect);
                 SDL_UpdateRect(screen, tux_rect.x, tux_rect.y, tux_rect.w, tux_rect.h);
                 SDL_Delay(GOBBLE_ANIM_MS / Tux->num_frames);
             }
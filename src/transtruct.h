@@ -44,6 +44,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define QUEST_QUEUE_SIZE 10
 
+/* Binary log of LAN traffic written by "tuxmathserver --record" and  */
+/* read back by tuxmathreplay.  The file starts with LANLOG_MAGIC and */
+/* LANLOG_VERSION (one byte), then one record per event:              */
+/*   Uint32 msec since recording started                              */
+/*   Uint8  event type (below)                                        */
+/*   Uint8  connection index (below)                                  */
+/*   Uint16 message length, followed by the message without its '\0'  */
+/* Multi-byte fields are big-endian, as written by SDLNet_Write32().  */
+#define LANLOG_MAGIC "TMLG"
+#define LANLOG_VERSION 2
+#define LANLOG_HEADER_LEN 8
+
+/* A connection's index is its player slot, or for connections made   */
+/* during a game, its place in the server's list of those waiting to  */
+/* resume or spectate (the last one being for those with no room to   */
+/* wait), and then for spectators their spectator slot:               */
+#define LANLOG_HANDSHAKE_BASE MAX_CLIENTS
+#define LANLOG_SPECTATOR_BASE (MAX_CLIENTS + 8)
+#define LANLOG_MAX_CONNS (MAX_CLIENTS + 16)
+
+enum {
+    LANLOG_CONNECT,      /* connection made and given this index        */
+    LANLOG_RECV,         /* message from client to server               */
+    LANLOG_SEND,         /* message from server to client               */
+    LANLOG_DISCONNECT,   /* connection closed or lost                   */
+    LANLOG_MOVE          /* connection whose index is the message (e.g. */
+                         /* a player resuming) now has this index       */
+};
+
 
 typedef struct _MC_FlashCard {
     char formula_string[MC_FORMULA_LEN];